@@ -0,0 +1,173 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef BIT_ACTIVITY_ANALYZER_H_
+#define BIT_ACTIVITY_ANALYZER_H_
+
+#include <cantaloupe/can_frame.h>
+#include <cantaloupe/can_frame_record_buffer.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cantaloupe
+{
+
+// Reverse-engineering aid: for every identifier, counts how often each payload bit is set, how often it toggles from
+// one frame to the next, and how often neighbouring bits toggle together, and from that guesses where the signals are.
+//
+// Bits are numbered as in `Predicate`'s `bits()`: the payload is a little-endian 64-bit word, so `data[i]` holds bits
+// `8 * i` to `8 * i + 7` (Intel signal layout).
+//
+// All 64 bits of a frame are counted at once with bit-sliced counters: each statistic is kept as eight 64-bit planes,
+// plane `j` holding bit `j` of every bit's count, and a frame adds to them with a few XORs and ANDs.  Every 255 frames
+// the planes are folded into ordinary per-bit totals.  Identifiers are looked up the same way as in
+// `PayloadChangeFilter`, and nothing is allocated after construction.
+class BitActivityAnalyzer
+{
+ public:
+  static constexpr size_t kDefaultMaxIds = 4096;
+  static constexpr size_t kNumBits = 64;
+
+  // Frames an identifier needs before `getReport()` guesses at fields.
+  static constexpr uint64_t kMinFramesForInference = 16;
+
+  enum class FieldKind
+  {
+    FLAG,  // A single bit.
+    SIGNAL,  // Neighbouring bits behaving like one number.
+    COUNTER,  // A nibble or byte counting up by one per frame (an alive / rolling counter).
+    CHECKSUM  // A byte whose bits all flip about half the time, as a checksum or CRC does.
+  };
+
+  struct Field
+  {
+    uint8_t start_bit;
+    uint8_t length;
+    FieldKind kind;
+  };
+
+  struct Report
+  {
+    uint32_t id = 0;
+    bool extended = false;
+    uint64_t frames = 0;
+    uint8_t max_dlc = 0;
+
+    // Per bit: frames with the bit set, changes from the previous frame, and changes together with the next bit up.
+    std::array<uint64_t, kNumBits> ones{};
+    std::array<uint64_t, kNumBits> toggles{};
+    std::array<uint64_t, kNumBits> co_toggles{};
+
+    // Bits that never changed.
+    uint64_t constant_mask = 0;
+
+    // Likely fields, in bit order.  Empty until there are `kMinFramesForInference` frames.
+    std::vector<Field> fields;
+
+    // Fraction of frame-to-frame transitions in which `bit` changed.
+    double toggleRate(size_t bit) const;
+  };
+
+  struct Statistics
+  {
+    uint64_t frames_in = 0;
+
+    // Error and remote frames, which carry no payload.
+    uint64_t skipped = 0;
+
+    // Frames of identifiers that did not fit in the table.
+    uint64_t table_full = 0;
+  };
+
+  // `max_ids` bounds the number of distinct identifiers tracked.
+  explicit BitActivityAnalyzer(size_t max_ids = kDefaultMaxIds);
+
+  void process(const CanFrame& frame);
+  void process(const CanFrame* frames, size_t num_frames);
+
+  // Analyze a capture.  CAN FD records are skipped, since only the first eight bytes would fit.
+  void process(const CanFrameRecordBuffer& records);
+
+  // Forget everything seen.
+  void reset();
+
+  // Identifiers seen so far, in the raw `CanFrame::id` convention (EFF flag set for extended ones).
+  std::vector<uint32_t> ids() const;
+
+  // Statistics and guessed fields for an identifier.  Returns false if it has not been seen.
+  bool getReport(uint32_t id, Report* report) const;
+
+  Statistics getStatistics() const { return statistics_; }
+
+ private:
+  // Planes per bit-sliced counter, and so the most frames it can take before being folded into the totals.
+  static constexpr size_t kNumPlanes = 8;
+  static constexpr uint32_t kPlaneCapacity = (1U << kNumPlanes) - 1;
+
+  static constexpr uint32_t kNoState = 0xFFFFFFFF;
+
+  // 64 counters, bit-sliced across `planes` with overflow folded into `totals`.
+  struct SlicedCounter
+  {
+    std::array<uint64_t, kNumPlanes> planes;
+    std::array<uint64_t, kNumBits> totals;
+
+    void add(uint64_t bits);
+    void fold();
+    uint64_t count(size_t bit) const;
+  };
+
+  struct IdState
+  {
+    uint32_t id;
+    bool extended;
+    uint8_t max_dlc;
+    uint64_t frames;
+    uint64_t last_payload;
+
+    // Frames added to the planes since they were last folded.
+    uint32_t pending;
+
+    SlicedCounter ones;
+    SlicedCounter toggles;
+    SlicedCounter co_toggles;
+
+    // Frames where a nibble (lane `4 * k`) or byte (lane `8 * k + 2`) was one more than in the previous frame.
+    SlicedCounter increments;
+  };
+
+  struct ExtendedSlot
+  {
+    uint32_t key;
+    uint32_t state;
+  };
+
+  IdState* lookup(uint32_t id, bool extended, bool insert);
+  const IdState* find(uint32_t id, bool extended) const;
+
+  static std::vector<Field> inferFields(const Report& report, const IdState& state);
+
+  size_t max_ids_;
+  std::vector<IdState> states_;
+  std::vector<uint32_t> standard_index_;
+  std::vector<ExtendedSlot> extended_index_;
+  size_t extended_mask_;
+
+  Statistics statistics_;
+};
+
+}  // namespace cantaloupe
+
+#endif  // ifndef BIT_ACTIVITY_ANALYZER_H_
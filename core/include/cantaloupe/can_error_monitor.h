@@ -0,0 +1,244 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef CAN_ERROR_MONITOR_H_
+#define CAN_ERROR_MONITOR_H_
+
+#include <cantaloupe/can_frame.h>
+#include <cantaloupe/clock.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace cantaloupe
+{
+
+// Fault confinement state of the controller, from its transmit and receive error counters (ISO 11898-1).
+enum class CanBusState : uint8_t
+{
+  ERROR_ACTIVE = 0,
+  ERROR_WARNING,  // A counter has reached 96.
+  ERROR_PASSIVE,  // A counter has reached 128; the controller may no longer signal errors actively.
+  BUS_OFF,  // The transmit counter passed 255 and the controller has left the bus.
+  NUM_STATES
+};
+
+static constexpr size_t kNumCanBusStates = static_cast<size_t>(CanBusState::NUM_STATES);
+
+// What an error frame reports.  The gs_usb firmware follows the SocketCAN layout: the error classes are bits in the
+// identifier, and the payload carries the details for the classes that have any.
+struct CanErrorFrame
+{
+  constexpr CanErrorFrame() :
+    classes{0},
+    lost_arbitration_bit{0},
+    controller{0},
+    protocol{0},
+    location{0},
+    transceiver{0},
+    tx_error_count{0},
+    rx_error_count{0}
+  {
+  }
+
+  // Error classes, in the identifier.
+  static constexpr uint32_t kClassTxTimeout = 0x00000001;
+  static constexpr uint32_t kClassLostArbitration = 0x00000002;
+  static constexpr uint32_t kClassController = 0x00000004;
+  static constexpr uint32_t kClassProtocol = 0x00000008;
+  static constexpr uint32_t kClassTransceiver = 0x00000010;
+  static constexpr uint32_t kClassNoAck = 0x00000020;
+  static constexpr uint32_t kClassBusOff = 0x00000040;
+  static constexpr uint32_t kClassBusError = 0x00000080;
+  static constexpr uint32_t kClassRestarted = 0x00000100;
+  static constexpr uint32_t kClassCounters = 0x00000200;
+
+  // Controller status, in `data[1]`.
+  static constexpr uint8_t kControllerRxOverflow = 0x01;
+  static constexpr uint8_t kControllerTxOverflow = 0x02;
+  static constexpr uint8_t kControllerRxWarning = 0x04;
+  static constexpr uint8_t kControllerTxWarning = 0x08;
+  static constexpr uint8_t kControllerRxPassive = 0x10;
+  static constexpr uint8_t kControllerTxPassive = 0x20;
+  static constexpr uint8_t kControllerActive = 0x40;
+
+  // Protocol violation type, in `data[2]`.
+  static constexpr uint8_t kProtocolBit = 0x01;
+  static constexpr uint8_t kProtocolForm = 0x02;
+  static constexpr uint8_t kProtocolStuff = 0x04;
+  static constexpr uint8_t kProtocolBit0 = 0x08;  // Could not drive the bus dominant.
+  static constexpr uint8_t kProtocolBit1 = 0x10;  // Could not drive the bus recessive.
+  static constexpr uint8_t kProtocolOverload = 0x20;
+  static constexpr uint8_t kProtocolActive = 0x40;
+  static constexpr uint8_t kProtocolTx = 0x80;  // Raised while transmitting.
+
+  // Protocol violation locations, in `data[3]`, that get singled out.
+  static constexpr uint8_t kLocationCrcSequence = 0x08;
+  static constexpr uint8_t kLocationCrcDelimiter = 0x18;
+  static constexpr uint8_t kLocationAckSlot = 0x19;
+  static constexpr uint8_t kLocationAckDelimiter = 0x1B;
+
+  // Unpack an error frame.  Returns false if `frame` is not one.
+  static bool decode(const CanFrame& frame, CanErrorFrame* error);
+
+  // Are the error counters in this frame meaningful?  They are always filled in alongside a controller status report,
+  // even by firmware that predates the counters class.
+  bool hasCounters() const { return (classes & (kClassCounters | kClassController)) != 0; }
+
+  // Bits of `kClass*`.
+  uint32_t classes;
+
+  // Bit position arbitration was lost at, or zero if unknown.
+  uint8_t lost_arbitration_bit;
+
+  // Bits of `kController*`, `kProtocol*`, and one of the `kLocation*` values.
+  uint8_t controller;
+  uint8_t protocol;
+  uint8_t location;
+
+  // Transceiver status, as reported by the device.
+  uint8_t transceiver;
+
+  uint8_t tx_error_count;
+  uint8_t rx_error_count;
+};
+
+// Kinds of error tallied by `CanErrorMonitor`.  A single error frame can count towards several.
+enum class CanErrorKind : size_t
+{
+  NO_ACK = 0,  // Nobody acknowledged a frame we sent, usually a lone node or an unterminated bus.
+  BIT,
+  STUFF,
+  FORM,
+  CRC,
+  OTHER_PROTOCOL,  // Protocol or bus errors without a more specific kind.
+  LOST_ARBITRATION,
+  TX_TIMEOUT,
+  OVERFLOW,  // The controller dropped frames because its buffers were full.
+  TRANSCEIVER,
+  BUS_OFF,
+  RESTARTED,
+  NUM_KINDS
+};
+
+static constexpr size_t kNumCanErrorKinds = static_cast<size_t>(CanErrorKind::NUM_KINDS);
+
+// Follows the controller's bus state from error frames and folds error traffic into one summary per interval, so a
+// storm of thousands of error frames a second reaches the application as a handful of reports.
+//
+// An interval opens with the first error frame (or state change) after a quiet spell and closes `interval_us` later
+// on the monitor's clock; its summary is handed over by the first `processFrame()` or `poll()` after that.  Quiet
+// intervals produce nothing.
+//
+// Frames are taken from a single thread, which must also be the one calling `poll()`; `getState()` may be called from
+// anywhere.  Nothing allocates after construction.
+class CanErrorMonitor
+{
+ public:
+  static constexpr uint64_t kDefaultIntervalUs = 1000 * 1000;
+
+  // Counter levels at which the controller goes to warning and error passive.
+  static constexpr uint8_t kWarningErrorCount = 96;
+  static constexpr uint8_t kPassiveErrorCount = 128;
+
+  // Everything that happened in one interval.  Times are on the monitor's clock.
+  struct Summary
+  {
+    uint64_t begin_us = 0;
+    uint64_t end_us = 0;
+
+    uint64_t error_frames = 0;
+    std::array<uint64_t, kNumCanErrorKinds> counts{};
+
+    CanBusState begin_state = CanBusState::ERROR_ACTIVE;
+    CanBusState end_state = CanBusState::ERROR_ACTIVE;
+    CanBusState worst_state = CanBusState::ERROR_ACTIVE;
+    uint32_t state_changes = 0;
+
+    // Error counters: the highest seen, and the last reported.  Zero if no frame carried them.
+    uint8_t peak_tx_error_count = 0;
+    uint8_t peak_rx_error_count = 0;
+    uint8_t tx_error_count = 0;
+    uint8_t rx_error_count = 0;
+
+    uint64_t count(CanErrorKind kind) const { return counts[static_cast<size_t>(kind)]; }
+  };
+
+  // Handed each summary as its interval closes, on the thread that closed it.
+  using SummaryHandler = std::function<void(const Summary&)>;
+
+  struct Statistics
+  {
+    uint64_t error_frames = 0;
+    uint64_t state_changes = 0;
+    uint64_t bus_off_events = 0;
+    uint64_t summaries = 0;
+  };
+
+  // The clock defaults to `SteadyClock`.
+  explicit CanErrorMonitor(SummaryHandler handler, uint64_t interval_us = kDefaultIntervalUs,
+    const Clock* clock = nullptr);
+
+  CanErrorMonitor(const CanErrorMonitor&) = delete;
+  CanErrorMonitor& operator=(const CanErrorMonitor&) = delete;
+
+  // Feed a frame from the bus.  Ordinary frames are only looked at for signs that the controller has come back from
+  // bus off.  Returns true if the frame was an error frame (and so has been accounted for).
+  bool processFrame(const CanFrame& frame);
+
+  // Close the current interval if it has run out, so the end of a storm is reported even though no more frames arrive.
+  // Call it every so often from the thread feeding frames.
+  void poll();
+
+  CanBusState getState() const { return state_.load(std::memory_order_relaxed); }
+
+  const Statistics& getStatistics() const { return statistics_; }
+
+  static const char* stateName(CanBusState state);
+  static const char* errorKindName(CanErrorKind kind);
+
+  // The state implied by a pair of error counters, short of bus off (which they cannot show).
+  static CanBusState stateFromCounters(uint8_t tx_error_count, uint8_t rx_error_count);
+
+ private:
+  // Start an interval at `now_us` if none is open.
+  void openInterval(uint64_t now_us);
+
+  // Report and close the interval if it has run out by `now_us`.
+  void closeIntervalIfDue(uint64_t now_us);
+
+  void changeState(CanBusState state, uint64_t now_us);
+
+  // Work out where the state machine goes next after `error`.
+  CanBusState nextState(const CanErrorFrame& error) const;
+
+  void count(CanErrorKind kind) { summary_.counts[static_cast<size_t>(kind)]++; }
+
+  SummaryHandler handler_;
+  uint64_t interval_us_;
+  const Clock* clock_;
+
+  std::atomic<CanBusState> state_;
+
+  // Summary being built, valid while `interval_open_` is set.
+  bool interval_open_;
+  Summary summary_;
+
+  Statistics statistics_;
+};
+
+}  // namespace cantaloupe
+
+#endif  // ifndef CAN_ERROR_MONITOR_H_
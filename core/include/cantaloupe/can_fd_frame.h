@@ -0,0 +1,89 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef CAN_FD_FRAME_H_
+#define CAN_FD_FRAME_H_
+
+#include <cantaloupe/can_frame.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace cantaloupe
+{
+
+// A frame that may be either classic CAN or CAN FD.  This is 64 bytes of payload wide, so it is meant for handing
+// single frames around; use `CanFrameRecordBuffer` to store many of them.
+struct CanFdFrame
+{
+  constexpr CanFdFrame() :
+    id{0},
+    length{0},
+    error_frame{false},
+    rtr_frame{false},
+    eff_frame{false},
+    from_tx{false},
+    fd_frame{false},
+    bit_rate_switch{false},
+    error_state_indicator{false},
+    data{},
+    timestamp_us{0}
+  {
+  }
+
+  // Maximum number of bytes able to be represented in a CAN FD frame.
+  static constexpr size_t kDataNumMaxBytes = 64;
+
+  // Message ID, including flag bits the same way `CanFrame::id` does.
+  uint32_t id;
+
+  // Payload length in bytes (not the DLC code).  For FD frames this is always one of the lengths a DLC can encode.
+  uint8_t length;
+
+  bool error_frame;
+  bool rtr_frame;
+  bool eff_frame;
+  bool from_tx;
+
+  // Indicates the frame uses the FD format.  False for classic frames, which are limited to eight bytes.
+  bool fd_frame;
+
+  // FD only: the data phase was sent at the data bitrate (BRS).
+  bool bit_rate_switch;
+
+  // FD only: the transmitter was error passive (ESI).
+  bool error_state_indicator;
+
+  std::array<uint8_t, kDataNumMaxBytes> data;
+
+  // Device timestamp on message receipt.
+  uint32_t timestamp_us;
+};
+
+// Map a 4-bit DLC code to a payload length.  Codes above 8 only mean more than 8 bytes on FD frames.
+uint8_t canDlcToLength(uint8_t dlc, bool fd_frame);
+
+// Smallest DLC code whose length holds `length` bytes.  Lengths past 64 saturate at code 15.
+uint8_t canLengthToDlc(size_t length);
+
+// Round a length up to the next one an FD DLC can express (eg 9 -> 12, 33 -> 48).
+uint8_t canFdPaddedLength(size_t length);
+
+// Conversions between the two representations.  Going to `CanFrame` fails for FD frames, since classic frames have no
+// way to carry the FD flags.
+CanFdFrame toCanFdFrame(const CanFrame& frame);
+bool toCanFrame(const CanFdFrame& frame, CanFrame* output);
+
+}  // namespace cantaloupe
+
+#endif  // ifndef CAN_FD_FRAME_H_
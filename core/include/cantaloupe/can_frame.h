@@ -14,6 +14,7 @@
 #define CAN_FRAME_H_
 
 #include <array>
+#include <cstddef>
 #include <cstdint>
 
 namespace cantaloupe
@@ -37,6 +38,20 @@ struct CanFrame
   // Maximum number of bytes able to be represented in a CAN frame.
   static constexpr size_t kDataNumMaxBytes = 8;
 
+  // Masks to strip the flag bits from `id` for standard (SFF) and extended (EFF) frame formats.
+  static constexpr uint32_t kIdMaskStandard = 0x000007FF;
+  static constexpr uint32_t kIdMaskExtended = 0x1FFFFFFF;
+
+  // Flag bit set in `id` for extended identifiers, in the same place the device puts it.
+  static constexpr uint32_t kIdFlagEff = 0x80000000;
+
+  // Does a raw `id` (flag bits and all) name an extended identifier?  It does if it carries the EFF flag, or if it
+  // does not fit in 11 bits.
+  static constexpr bool isExtendedId(uint32_t raw_id)
+  {
+    return ((raw_id & kIdFlagEff) != 0) || ((raw_id & kIdMaskExtended) > kIdMaskStandard);
+  }
+
   // Message ID.
   uint32_t id;
 
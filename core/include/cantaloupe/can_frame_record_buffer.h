@@ -0,0 +1,146 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef CAN_FRAME_RECORD_BUFFER_H_
+#define CAN_FRAME_RECORD_BUFFER_H_
+
+#include <cantaloupe/can_fd_frame.h>
+#include <cantaloupe/can_frame.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace cantaloupe
+{
+
+// Stores frames back to back in a fixed-size byte arena as variable-length records: a 12-byte header followed by the
+// payload rounded up to four bytes.  A classic 8-byte frame takes 20 bytes and only FD frames pay for their longer
+// payloads, so buffers of mostly classic traffic stay compact.  The arena is allocated once; appending never
+// allocates and simply fails once it is full.
+class CanFrameRecordBuffer
+{
+ public:
+  // Bits in `RecordHeader::flags`.
+  static constexpr uint8_t kFlagError = (1U << 0);
+  static constexpr uint8_t kFlagRtr = (1U << 1);
+  static constexpr uint8_t kFlagEff = (1U << 2);
+  static constexpr uint8_t kFlagFromTx = (1U << 3);
+  static constexpr uint8_t kFlagFd = (1U << 4);
+  static constexpr uint8_t kFlagBitRateSwitch = (1U << 5);
+  static constexpr uint8_t kFlagErrorStateIndicator = (1U << 6);
+
+  // Filler that pads a block of records out to a fixed size (eg for direct I/O).  Iterators skip it.
+  static constexpr uint8_t kFlagPadding = (1U << 7);
+
+  static constexpr size_t kRecordAlignment = 4;
+
+  struct RecordHeader
+  {
+    uint32_t id;
+    uint32_t timestamp_us;
+    uint8_t length;
+    uint8_t flags;
+
+    // Total size of the record including this header, so readers can skip it without decoding.
+    uint16_t record_size;
+  };
+
+  static_assert(sizeof(RecordHeader) == 12, "RecordHeader is not properly represented.");
+
+  // A record as seen through an iterator.  `data` points into the buffer.
+  struct RecordView
+  {
+    RecordHeader header;
+    const uint8_t* data;
+
+    bool isFd() const { return (header.flags & kFlagFd) != 0; }
+
+    // Expand back into a full frame.
+    CanFdFrame toCanFdFrame() const;
+  };
+
+  class ConstIterator
+  {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = RecordView;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const RecordView*;
+    using reference = const RecordView&;
+
+    ConstIterator(const uint8_t* position, const uint8_t* end);
+
+    reference operator*() const { return view_; }
+    pointer operator->() const { return &view_; }
+    ConstIterator& operator++();
+    bool operator==(const ConstIterator& other) const { return position_ == other.position_; }
+    bool operator!=(const ConstIterator& other) const { return position_ != other.position_; }
+
+   private:
+    void load();
+
+    const uint8_t* position_;
+    const uint8_t* end_;
+    RecordView view_;
+  };
+
+  explicit CanFrameRecordBuffer(size_t capacity_bytes);
+
+  // Append a frame.  Returns false if there is not enough room left.
+  bool append(const CanFrame& frame);
+  bool append(const CanFdFrame& frame);
+
+  // Forget every record, keeping the arena.
+  void clear();
+
+  // Number of records stored.
+  size_t size() const { return num_records_; }
+  bool empty() const { return num_records_ == 0; }
+
+  size_t bytesUsed() const { return bytes_used_; }
+  size_t capacityBytes() const { return storage_.size(); }
+
+  // Raw view of the records, eg for writing them out in one go.
+  const uint8_t* data() const { return storage_.data(); }
+
+  ConstIterator begin() const;
+  ConstIterator end() const;
+
+  // Bytes a record with `length` payload bytes occupies.
+  static size_t recordSize(size_t length);
+
+  // Encode a frame as a record at `destination`, for callers managing their own memory.  Returns the record size, or
+  // zero if it does not fit in `capacity` bytes.
+  static size_t encode(const CanFrame& frame, uint8_t* destination, size_t capacity);
+  static size_t encode(const CanFdFrame& frame, uint8_t* destination, size_t capacity);
+
+  // Fill `num_bytes` (a multiple of `kRecordAlignment`, at least one header) with a padding record.
+  static void encodePadding(uint8_t* destination, size_t num_bytes);
+
+ private:
+  bool appendRecord(const RecordHeader& header, const uint8_t* payload);
+
+  static RecordHeader makeHeader(const CanFrame& frame);
+  static RecordHeader makeHeader(const CanFdFrame& frame);
+  static size_t encodeRecord(const RecordHeader& header, const uint8_t* payload, uint8_t* destination,
+    size_t capacity);
+
+  std::vector<uint8_t> storage_;
+  size_t bytes_used_;
+  size_t num_records_;
+};
+
+}  // namespace cantaloupe
+
+#endif  // ifndef CAN_FRAME_RECORD_BUFFER_H_
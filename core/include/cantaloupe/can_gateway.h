@@ -0,0 +1,231 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef CAN_GATEWAY_H_
+#define CAN_GATEWAY_H_
+
+#include <cantaloupe/can_frame.h>
+#include <cantaloupe/can_transport.h>
+#include <cantaloupe/thread_config.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cantaloupe
+{
+
+// What happens to frames of each identifier crossing the gateway in one direction.  Rules are compiled as they are
+// added: standard identifiers index a flat table, extended identifiers are binary searched, and each lookup lands on a
+// small record saying whether to forward and how to rewrite.
+//
+// Identifiers follow the raw `CanFrame::id` convention: an identifier is extended if it carries the EFF flag bit
+// (`CanFrame::kIdFlagEff`) or does not fit in 11 bits.
+class RoutingTable
+{
+ public:
+  enum class Action
+  {
+    DROP,
+    FORWARD
+  };
+
+  // `new_id` value meaning "keep the identifier".
+  static constexpr uint32_t kKeepId = 0xFFFFFFFF;
+
+  struct Rule
+  {
+    uint32_t id = 0;
+    Action action = Action::FORWARD;
+
+    // Forwarded frames can have their identifier replaced (changing format if the new one is extended and the old one
+    // was not, or the other way round) ...
+    uint32_t new_id = kKeepId;
+
+    // ... and payload bits replaced, with `data[i]` in bits `8 * i` to `8 * i + 7`: bits under `patch_mask` are taken
+    // from `patch_bits`.  The length is never changed.
+    uint64_t patch_mask = 0;
+    uint64_t patch_bits = 0;
+
+    static Rule drop(uint32_t id);
+    static Rule forward(uint32_t id);
+    static Rule remap(uint32_t id, uint32_t new_id);
+    static Rule patch(uint32_t id, uint64_t patch_mask, uint64_t patch_bits);
+  };
+
+  // Unlisted identifiers get `default_action` (unchanged), which is forwarding unless given.
+  explicit RoutingTable(Action default_action);
+  RoutingTable();
+
+  // Add a rule, replacing any earlier one for the same identifier.  Returns false if an identifier has flag bits
+  // other than EFF set.
+  bool addRule(const Rule& rule);
+  void setDefaultAction(Action action);
+
+  // Forget every rule.
+  void clear();
+
+  size_t numRules() const { return routes_.size() - 1; }
+
+  // Route one frame.  Returns false if it should be dropped, otherwise writes the (possibly rewritten) frame to
+  // `output`, which may be `frame` itself.
+  bool route(const CanFrame& frame, CanFrame* output) const;
+
+  // Route a batch, copying the frames to forward into `output` (which may be `frames`).  Returns how many there are.
+  size_t route(const CanFrame* frames, size_t num_frames, CanFrame* output) const;
+
+ private:
+  // Bits in `Route::flags`.
+  static constexpr uint8_t kRouteForward = (1U << 0);
+  static constexpr uint8_t kRouteRemap = (1U << 1);
+  static constexpr uint8_t kRoutePatch = (1U << 2);
+  static constexpr uint8_t kRouteExtended = (1U << 3);
+
+  // Index of the default route in `routes_`.
+  static constexpr uint32_t kDefaultRoute = 0;
+
+  struct Route
+  {
+    uint64_t patch_mask;
+    uint64_t patch_bits;
+    uint32_t id;
+    uint8_t flags;
+  };
+
+  static Route compile(const Rule& rule);
+  uint32_t findRoute(uint32_t id, bool extended) const;
+
+  std::vector<Route> routes_;
+
+  // Route index for each standard identifier.
+  std::vector<uint32_t> standard_routes_;
+
+  // (identifier, route index), sorted by identifier.
+  std::vector<std::pair<uint32_t, uint32_t>> extended_routes_;
+};
+
+// Bridges two buses: frames read from one transport are routed and written to the other, in both directions at once.
+// Each direction has its own routing table and its own thread, which reads a batch (everything already waiting, up to
+// `batch_size`), routes it in place and writes what survives in one call.
+//
+// Loops are prevented by never forwarding frames flagged `from_tx`: those are the echoes of frames this gateway (or
+// anything else on this host) transmitted, which would otherwise be sent straight back across.  Error frames describe
+// the bus they were seen on and are never forwarded either.
+//
+// Both transports are read and written from different threads, so they must allow that.  `GsUsbWrapper` serializes
+// access to the device, so a write can wait for a read in progress; keep `poll_timeout_ms` short to bound that.
+class CanGateway
+{
+ public:
+  enum class Direction
+  {
+    A_TO_B,
+    B_TO_A
+  };
+
+  static constexpr size_t kDefaultBatchSize = 64;
+  static constexpr uint32_t kDefaultPollTimeoutMs = 1;
+  static constexpr uint32_t kDefaultWriteTimeoutMs = 100;
+
+  struct Config
+  {
+    // Most frames moved per read and write.
+    size_t batch_size = kDefaultBatchSize;
+
+    // How long a read waits for traffic, which also bounds how long `stop()` takes.
+    uint32_t poll_timeout_ms = kDefaultPollTimeoutMs;
+
+    uint32_t write_timeout_ms = kDefaultWriteTimeoutMs;
+
+    // Setup for the forwarding threads.
+    ThreadConfig a_to_b_thread_config;
+    ThreadConfig b_to_a_thread_config;
+  };
+
+  struct Statistics
+  {
+    uint64_t frames_in = 0;
+    uint64_t frames_forwarded = 0;
+
+    // Dropped by the routing table.
+    uint64_t frames_filtered = 0;
+
+    // Own transmissions and error frames, never forwarded.
+    uint64_t echoes_dropped = 0;
+    uint64_t error_frames_dropped = 0;
+
+    // Frames the output transport refused.
+    uint64_t write_failures = 0;
+
+    uint64_t batches = 0;
+    size_t max_batch = 0;
+  };
+
+  CanGateway(CanTransport* a, CanTransport* b, const Config& config);
+  CanGateway(CanTransport* a, CanTransport* b);
+  ~CanGateway();
+
+  CanGateway(const CanGateway&) = delete;
+  CanGateway& operator=(const CanGateway&) = delete;
+
+  // Routing for one direction.  Only change it while the gateway is stopped.
+  RoutingTable& routes(Direction direction) { return lanes_[index(direction)].routes; }
+  const RoutingTable& routes(Direction direction) const { return lanes_[index(direction)].routes; }
+
+  // Move one batch in one direction, waiting up to `timeout_ms` for it.  This is what the threads run; call it
+  // directly to drive the gateway without them.  Returns the number of frames forwarded.
+  size_t forwardBatch(Direction direction, uint32_t timeout_ms);
+
+  // Spawn / stop both forwarding threads.
+  bool start();
+  void stop();
+
+  bool isRunning() const { return lanes_[0].thread.joinable(); }
+
+  Statistics getStatistics(Direction direction) const;
+
+ private:
+  struct Lane
+  {
+    CanTransport* input = nullptr;
+    CanTransport* output = nullptr;
+    RoutingTable routes;
+    std::vector<CanFrame> batch;
+    std::thread thread;
+
+    // Only the lane's own thread updates these.
+    std::atomic<uint64_t> frames_in{0};
+    std::atomic<uint64_t> frames_forwarded{0};
+    std::atomic<uint64_t> frames_filtered{0};
+    std::atomic<uint64_t> echoes_dropped{0};
+    std::atomic<uint64_t> error_frames_dropped{0};
+    std::atomic<uint64_t> write_failures{0};
+    std::atomic<uint64_t> batches{0};
+    std::atomic<uint64_t> max_batch{0};
+  };
+
+  static size_t index(Direction direction) { return (direction == Direction::A_TO_B) ? 0 : 1; }
+
+  void forwardThread(Direction direction);
+
+  Config config_;
+  std::array<Lane, 2> lanes_;
+  std::atomic<bool> thread_shutdown_;
+};
+
+}  // namespace cantaloupe
+
+#endif  // ifndef CAN_GATEWAY_H_
@@ -0,0 +1,53 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef CAN_TRANSPORT_H_
+#define CAN_TRANSPORT_H_
+
+#include <cantaloupe/can_fd_frame.h>
+#include <cantaloupe/can_frame.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cantaloupe
+{
+
+// Anything that can put frames on, and take frames off, a bus.  `GsUsbWrapper` is the real one; higher level pieces
+// (schedulers, queues, gateways) only talk to this interface so they can be driven by a fake transport instead.
+class CanTransport
+{
+ public:
+  virtual ~CanTransport() = default;
+
+  // Write a single CAN frame to the bus.  Optionally specify a timeout in ms, or default to zero for blocking.
+  virtual bool writeCanFrame(const CanFrame& frame, uint32_t timeout_ms = 0) = 0;
+
+  // Read a single CAN frame from the bus.  Optionally specify a timeout in ms, or default to zero for blocking.
+  virtual bool readCanFrame(CanFrame* frame, uint32_t timeout_ms = 0) = 0;
+
+  // Read up to `max_frames`, waiting up to `timeout_ms` for the first and then taking only what is already waiting.
+  // Returns the number of frames read.  The default reads a single frame.
+  virtual size_t readCanFrames(CanFrame* frames, size_t max_frames, uint32_t timeout_ms = 0);
+
+  // Write several frames back to back, stopping at the first failure.  Returns the number of frames written.
+  virtual size_t writeCanFrames(const CanFrame* frames, size_t num_frames, uint32_t timeout_ms = 0);
+
+  // CAN FD counterparts, which also carry classic frames.  The defaults go through the classic calls above, so a
+  // transport without FD support still works for classic traffic and rejects FD frames.
+  virtual bool writeCanFdFrame(const CanFdFrame& frame, uint32_t timeout_ms = 0);
+  virtual bool readCanFdFrame(CanFdFrame* frame, uint32_t timeout_ms = 0);
+};
+
+}  // namespace cantaloupe
+
+#endif  // ifndef CAN_TRANSPORT_H_
@@ -0,0 +1,238 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef CAPTURE_WRITER_H_
+#define CAPTURE_WRITER_H_
+
+#include <cantaloupe/can_fd_frame.h>
+#include <cantaloupe/can_frame.h>
+#include <cantaloupe/clock.h>
+#include <cantaloupe/thread_config.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Only complete when built against liburing.
+struct io_uring;
+
+namespace cantaloupe
+{
+
+// Deleter for the io_uring instance, so liburing stays out of this header.
+struct ioUringDeleter
+{
+  void operator()(io_uring* ring) const;
+};
+
+// Deleter for the aligned capture buffers.
+struct alignedBufferDeleter
+{
+  void operator()(uint8_t* buffer) const;
+};
+
+// Capture sink that keeps disk I/O off the thread reading the bus.  Frames are encoded (in the `CanFrameRecordBuffer`
+// record format) into large, block-aligned buffers; a full buffer is handed to a dedicated I/O stage and the writer
+// carries on with the next free one.  Buffers come from a fixed pool passed back and forth through two lock-free
+// single-producer/single-consumer rings, so `write()` never blocks or allocates.  When the disk falls behind and the
+// pool runs dry, frames are dropped and counted rather than stalling the caller.
+//
+// The I/O stage uses io_uring when built with liburing and the kernel supports it, and otherwise a thread issuing
+// `pwrite()`.  Direct I/O (`O_DIRECT`, or `F_NOCACHE` on macOS) and a periodic `fdatasync()` are optional.
+//
+// A capture file is a `FileHeader` followed by records.  With direct I/O, flushed buffers are padded to the block size
+// with padding records, which `CanFrameRecordBuffer::ConstIterator` skips.
+class CaptureWriter
+{
+ public:
+  static constexpr size_t kDefaultBufferSize = 1U << 20;
+  static constexpr size_t kDefaultNumBuffers = 8;
+  static constexpr uint32_t kDefaultSyncIntervalMs = 1000;
+
+  // Alignment of buffers, file offsets and write sizes under direct I/O.
+  static constexpr size_t kBlockSize = 4096;
+
+  static constexpr char kFileMagic[9] = "CANCAP01";
+  static constexpr uint32_t kFileVersion = 1;
+
+  struct FileHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_header_size;
+  };
+
+  static_assert(sizeof(FileHeader) == 16, "FileHeader is not properly represented.");
+
+  struct Config
+  {
+    // Size of each buffer, rounded up to a multiple of `kBlockSize`, and how many there are.
+    size_t buffer_size = kDefaultBufferSize;
+    size_t num_buffers = kDefaultNumBuffers;
+
+    // Bypass the page cache.  Falls back to buffered I/O if the file system refuses.
+    bool direct_io = false;
+
+    // Call `fdatasync()` this often while data is being written, or never if zero.
+    uint32_t sync_interval_ms = kDefaultSyncIntervalMs;
+
+    // Try io_uring before falling back to `pwrite()`.
+    bool use_io_uring = true;
+
+    // Setup for the I/O thread.
+    ThreadConfig thread_config;
+  };
+
+  struct Statistics
+  {
+    uint64_t frames_written = 0;
+    uint64_t bytes_encoded = 0;
+
+    // Frames that arrived while no buffer was free.
+    uint64_t frames_dropped = 0;
+    uint64_t bytes_dropped = 0;
+
+    uint64_t buffers_written = 0;
+    uint64_t bytes_written = 0;
+    uint64_t write_errors = 0;
+    uint64_t syncs = 0;
+
+    // Time from handing a buffer to the I/O stage until it was written.
+    uint64_t max_write_latency_us = 0;
+  };
+
+  // The clock defaults to `SteadyClock` and is used for sync intervals and latency statistics.
+  explicit CaptureWriter(const Config& config, const Clock* clock = nullptr);
+  CaptureWriter();
+  ~CaptureWriter();
+
+  CaptureWriter(const CaptureWriter&) = delete;
+  CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+  // Create (or truncate) the capture file and start the I/O stage.
+  bool open(const std::string& path);
+
+  // Write out everything buffered, wait for the I/O stage to finish and close the file.
+  void close();
+
+  bool isOpen() const { return fd_ >= 0; }
+
+  // True if the I/O stage is running on io_uring.
+  bool usingIoUring() const { return ring_ != nullptr; }
+
+  // Queue a frame.  Never blocks; returns false if the frame was dropped.  Only one thread may write at a time.
+  bool write(const CanFrame& frame);
+  bool write(const CanFdFrame& frame);
+
+  // Hand the partly filled buffer to the I/O stage now, eg on a timer so a quiet bus still reaches the disk.  Call from
+  // the writing thread.
+  void flush();
+
+  Statistics getStatistics() const;
+
+ private:
+  static constexpr uint32_t kNoBuffer = 0xFFFFFFFF;
+
+  struct Buffer
+  {
+    uint8_t* data = nullptr;
+    size_t used = 0;
+
+    // Filled in when handed to the I/O stage.
+    uint64_t file_offset = 0;
+    size_t write_length = 0;
+    size_t written = 0;
+    uint64_t submit_us = 0;
+  };
+
+  // Lock-free ring of buffer indices with one producer and one consumer.
+  class IndexRing
+  {
+   public:
+    void reset(size_t capacity);
+    bool push(uint32_t index);
+    bool pop(uint32_t* index);
+
+   private:
+    std::vector<uint32_t> slots_;
+    std::atomic<uint64_t> head_{0};
+    std::atomic<uint64_t> tail_{0};
+  };
+
+  template<typename Frame>
+  bool writeFrame(const Frame& frame);
+
+  // Producer side: take a free buffer, and hand the current one to the I/O stage.
+  bool acquireBuffer();
+  void submitCurrent();
+
+  // I/O stage.
+  void ioThread();
+  void runPwrite();
+  void runIoUring();
+  bool writeBufferBlocking(Buffer* buffer);
+  void completeBuffer(uint32_t index, bool success);
+  bool syncDue(uint64_t now_us) const;
+  void syncFile();
+
+  // Add to a counter only the I/O thread (or only the writer) updates.
+  static void bump(std::atomic<uint64_t>* counter, uint64_t amount);
+
+  Config config_;
+  const Clock* clock_;
+  int fd_;
+
+  // Opened with `O_DIRECT`, so every write must be whole blocks.
+  bool aligned_writes_;
+
+  std::vector<std::unique_ptr<uint8_t, alignedBufferDeleter>> storage_;
+  std::vector<Buffer> buffers_;
+  IndexRing free_ring_;
+  IndexRing full_ring_;
+
+  // Writer side.
+  uint32_t current_;
+  uint64_t next_file_offset_;
+
+  // I/O side.
+  std::unique_ptr<io_uring, ioUringDeleter> ring_;
+  uint64_t last_sync_us_;
+  uint64_t bytes_since_sync_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool thread_shutdown_;
+  std::thread io_thread_;
+
+  // Writer-side counters.
+  std::atomic<uint64_t> frames_written_;
+  std::atomic<uint64_t> bytes_encoded_;
+  std::atomic<uint64_t> frames_dropped_;
+  std::atomic<uint64_t> bytes_dropped_;
+
+  // I/O-side counters.
+  std::atomic<uint64_t> buffers_written_;
+  std::atomic<uint64_t> bytes_written_;
+  std::atomic<uint64_t> write_errors_;
+  std::atomic<uint64_t> syncs_;
+  std::atomic<uint64_t> max_write_latency_us_;
+};
+
+}  // namespace cantaloupe
+
+#endif  // ifndef CAPTURE_WRITER_H_
@@ -0,0 +1,43 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include <cstdint>
+
+namespace cantaloupe
+{
+
+// Source of monotonic time in microseconds.  Components that schedule things take one of these so they can be run
+// against a virtual clock.
+class Clock
+{
+ public:
+  virtual ~Clock() = default;
+
+  virtual uint64_t nowUs() const = 0;
+};
+
+// Clock backed by std::chrono::steady_clock.
+class SteadyClock : public Clock
+{
+ public:
+  uint64_t nowUs() const override;
+
+  // Shared instance used when no clock is supplied.
+  static const SteadyClock& instance();
+};
+
+}  // namespace cantaloupe
+
+#endif  // ifndef CLOCK_H_
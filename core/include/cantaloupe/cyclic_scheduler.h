@@ -0,0 +1,212 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef CYCLIC_SCHEDULER_H_
+#define CYCLIC_SCHEDULER_H_
+
+#include <cantaloupe/can_frame.h>
+#include <cantaloupe/can_transport.h>
+#include <cantaloupe/clock.h>
+#include <cantaloupe/pool.h>
+#include <cantaloupe/thread_config.h>
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cantaloupe
+{
+
+// Transmits cyclic and one-shot frames from a single thread.  Pending transmissions live on a hierarchical timer wheel
+// (four levels of 256 slots), so adding, removing and expiring timers is O(1) no matter how many messages are
+// scheduled.  Cyclic messages are rescheduled from their nominal due time rather than from when they were actually
+// sent, so they do not drift.
+class CyclicScheduler
+{
+ public:
+  // Identifies a scheduled message.  Handles are never reused, so a stale handle is simply rejected.
+  using Handle = uint64_t;
+  static constexpr Handle kInvalidHandle = UINT64_MAX;
+
+  // Called with the outgoing copy of a frame just before it is sent, along with how many times this message has been
+  // sent before.  Use it to stamp rolling counters or checksums; the stored payload is left untouched.  Hooks run on
+  // the polling thread without the scheduler's lock held, so they may add, remove or update messages (which takes
+  // effect from the next transmission), but must not call `poll()`.
+  using TransmitHook = std::function<void(CanFrame* frame, uint64_t sequence)>;
+
+  static constexpr size_t kDefaultCapacity = 4096;
+  static constexpr uint32_t kDefaultTickUs = 100;
+
+  // Timeout handed to the transport for each batch.
+  static constexpr uint32_t kTransmitTimeoutMs = 10;
+
+  // Wheel geometry.
+  static constexpr size_t kWheelNumLevels = 4;
+  static constexpr size_t kWheelSlotBits = 8;
+  static constexpr size_t kWheelNumSlots = static_cast<size_t>(1) << kWheelSlotBits;
+
+  // Difference between the actual and nominal period of a cyclic message, accumulated over every transmission.
+  struct JitterStatistics
+  {
+    uint64_t num_transmissions = 0;
+    int64_t min_period_error_us = 0;
+    int64_t max_period_error_us = 0;
+    double mean_period_error_us = 0.0;
+    double stddev_period_error_us = 0.0;
+
+    // Worst delay between a frame falling due and it being handed to the transport.
+    uint64_t max_lateness_us = 0;
+  };
+
+  // `tick_us` is the wheel resolution; due times are rounded up to it.  The clock defaults to `SteadyClock`.  Supply a
+  // virtual clock and call `poll()` directly (instead of `start()`) to drive the scheduler deterministically.
+  explicit CyclicScheduler(CanTransport* transport, size_t capacity = kDefaultCapacity,
+    uint32_t tick_us = kDefaultTickUs, const Clock* clock = nullptr);
+  ~CyclicScheduler();
+
+  CyclicScheduler(const CyclicScheduler&) = delete;
+  CyclicScheduler& operator=(const CyclicScheduler&) = delete;
+
+  // Send `frame` every `period_us`, starting `initial_delay_us` from now.  Returns kInvalidHandle if the scheduler is
+  // full or the period is zero.
+  Handle addCyclic(const CanFrame& frame, uint32_t period_us, uint32_t initial_delay_us = 0,
+    TransmitHook hook = nullptr);
+
+  // Send `frame` once, `delay_us` from now.
+  Handle addOneShot(const CanFrame& frame, uint32_t delay_us = 0, TransmitHook hook = nullptr);
+
+  // Stop sending a message.  Returns false if the handle is unknown (one-shots remove themselves once sent).
+  bool remove(Handle handle);
+
+  // Replace the payload of a scheduled message.  The update is applied as a whole; a transmission never sees half of
+  // the old payload and half of the new one.
+  bool updatePayload(Handle handle, const uint8_t* data, uint8_t dlc);
+
+  bool getJitterStatistics(Handle handle, JitterStatistics* statistics) const;
+
+  // Number of messages currently scheduled.
+  size_t size() const;
+
+  // Send everything that has fallen due, as one batch.  Returns the number of frames handed to the transport.  Only
+  // one thread may poll at a time.
+  size_t poll();
+
+  // Spawn the transmit thread, set up as `thread_config` says, which polls whenever the next message falls due.
+  bool start(const ThreadConfig& thread_config = ThreadConfig());
+
+  // Stop and join the transmit thread.
+  void stop();
+
+ private:
+  static constexpr uint32_t kInvalidIndex = UINT32_MAX;
+
+  struct Entry
+  {
+    bool in_use = false;
+    uint32_t generation = 0;
+    CanFrame frame;
+
+    // Shared so `poll()` can keep hold of it, without allocating, while it runs the hook unlocked.
+    std::shared_ptr<const TransmitHook> hook;
+
+    // Zero for one-shot messages.
+    uint32_t period_us = 0;
+
+    // Nominal time of the next transmission, and when the previous one actually happened.
+    uint64_t due_us = 0;
+    uint64_t last_transmit_us = 0;
+    uint64_t sequence = 0;
+
+    // Position on the wheel.
+    uint32_t bucket = kInvalidIndex;
+    uint32_t prev = kInvalidIndex;
+    uint32_t next = kInvalidIndex;
+
+    // Running jitter accumulators.
+    int64_t min_error_us = 0;
+    int64_t max_error_us = 0;
+    double sum_error_us = 0.0;
+    double sum_squared_error_us = 0.0;
+    uint64_t num_intervals = 0;
+    uint64_t max_lateness_us = 0;
+  };
+
+  Handle addEntry(const CanFrame& frame, uint32_t period_us, uint32_t delay_us, TransmitHook hook);
+
+  // Resolve a handle to its entry, or nullptr.  Caller holds `mutex_`.
+  Entry* lookup(Handle handle);
+  const Entry* lookup(Handle handle) const;
+
+  // Wheel maintenance.  Caller holds `mutex_`.
+  uint64_t dueTick(uint64_t due_us) const;
+  void insertTimer(uint32_t index, uint64_t expiry_tick);
+  void unlinkTimer(uint32_t index);
+  void cascade(size_t level);
+  void expireSlot(uint64_t now_us);
+  void releaseEntry(uint32_t index);
+
+  // Tick at which the transmit thread next needs to wake up.
+  uint64_t nextWakeTick() const;
+
+  // Transmit thread body.
+  void transmitThread();
+
+  CanTransport* transport_;
+  const Clock* clock_;
+  uint32_t tick_us_;
+  uint64_t epoch_us_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_condition_;
+
+  Pool<Entry> entries_;
+
+  // Expiry tick of each timer, parallel to `entries_`.
+  std::vector<uint64_t> expiry_ticks_;
+
+  // Heads of the per-slot timer lists, level-major.
+  std::vector<uint32_t> slot_heads_;
+
+  // Occupancy of the first level, so the thread can find the next due slot without walking the lists.
+  std::array<uint64_t, kWheelNumSlots / 64> level0_occupancy_;
+
+  // The next tick to be processed.
+  uint64_t current_tick_;
+  size_t num_scheduled_;
+
+  // A hook to run on a frame in `batch_`, and the sequence number to give it.
+  struct PendingHook
+  {
+    std::shared_ptr<const TransmitHook> hook;
+    uint64_t sequence = 0;
+  };
+
+  // Frames gathered by `poll()`, and the hooks to run on them once the lock is dropped.  Sized to the capacity so a
+  // poll never allocates.
+  std::vector<CanFrame> batch_;
+  std::vector<PendingHook> batch_hooks_;
+  size_t num_batched_;
+
+  ThreadConfig thread_config_;
+  bool thread_shutdown_;
+  std::thread transmit_thread_;
+};
+
+}  // namespace cantaloupe
+
+#endif  // ifndef CYCLIC_SCHEDULER_H_
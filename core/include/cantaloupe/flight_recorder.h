@@ -0,0 +1,227 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef FLIGHT_RECORDER_H_
+#define FLIGHT_RECORDER_H_
+
+#include <cantaloupe/can_frame.h>
+#include <cantaloupe/clock.h>
+#include <cantaloupe/predicate.h>
+#include <cantaloupe/thread_config.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cantaloupe
+{
+
+// Always-on recorder for received traffic.  Every frame goes into a fixed-size ring that holds the last stretch of bus
+// traffic; when a frame matches one of the triggers, a background thread copies out the frames leading up to it,
+// follows the ring for a while longer, and writes the whole window to a candump-style log file.
+//
+// `record()` is meant to sit directly on the RX path.  It never blocks and never allocates: it copies the frame into
+// the next slot under a per-slot sequence number (a seqlock) and checks the triggers.  The background thread only ever
+// reads the ring, and detects and skips slots the writer has lapped.  Only one thread may call `record()` at a time.
+class FlightRecorder
+{
+ public:
+  static constexpr size_t kDefaultCapacityFrames = 1U << 16;
+  static constexpr uint32_t kDefaultPreTriggerUs = 5 * 1000 * 1000;
+  static constexpr uint32_t kDefaultPostTriggerUs = 2 * 1000 * 1000;
+
+  // How often the capture thread catches up with the ring while collecting the post-trigger window.
+  static constexpr uint32_t kFollowIntervalMs = 10;
+
+  // Extra host time allowed for the post-trigger window before giving up on frames arriving, eg on a bus gone quiet.
+  static constexpr uint64_t kPostTriggerSlackUs = 500 * 1000;
+
+  // Matches frames on identifier, payload, the error flag and/or a compiled predicate.  Each part only takes part when
+  // enabled.
+  struct Trigger
+  {
+    // Compare `(frame.id & id_mask) == (id & id_mask)`.  `id` is the raw identifier including the flag bits.
+    bool match_id = false;
+    uint32_t id = 0;
+    uint32_t id_mask = 0xFFFFFFFF;
+
+    // Compare `(frame.data[i] & data_mask[i]) == (data[i] & data_mask[i])` for every byte.  Frames shorter than
+    // `min_dlc` never match.
+    bool match_data = false;
+    std::array<uint8_t, CanFrame::kDataNumMaxBytes> data{};
+    std::array<uint8_t, CanFrame::kDataNumMaxBytes> data_mask{};
+    uint8_t min_dlc = 0;
+
+    // Match only error frames.
+    bool match_error_frame = false;
+
+    // Match only frames the predicate accepts, if set.
+    std::shared_ptr<const Predicate> predicate;
+
+    static Trigger onId(uint32_t id, uint32_t id_mask = 0xFFFFFFFF);
+    static Trigger onPayload(uint32_t id, const std::array<uint8_t, CanFrame::kDataNumMaxBytes>& data,
+      const std::array<uint8_t, CanFrame::kDataNumMaxBytes>& data_mask);
+    static Trigger onErrorFrame();
+    static Trigger onPredicate(std::shared_ptr<const Predicate> predicate);
+
+    bool matches(const CanFrame& frame) const;
+  };
+
+  struct Config
+  {
+    // Ring size in frames, rounded up to a power of two.  This bounds the pre-trigger window along with
+    // `pre_trigger_us`, and must be large enough to cover the post-trigger window at the expected bus load.
+    size_t capacity_frames = kDefaultCapacityFrames;
+
+    // Window around the triggering frame, in device time.
+    uint32_t pre_trigger_us = kDefaultPreTriggerUs;
+    uint32_t post_trigger_us = kDefaultPostTriggerUs;
+
+    // Captures are written as `<output_directory>/<file_prefix>-<n>.log`, `n` counting up from zero and skipping any
+    // file that already exists.
+    std::string output_directory = ".";
+    std::string file_prefix = "flight";
+
+    // Interface name put in the candump lines.
+    std::string interface_name = "can0";
+
+    // Setup for the capture thread.
+    ThreadConfig thread_config;
+  };
+
+  struct Statistics
+  {
+    uint64_t frames_recorded = 0;
+    uint64_t triggers = 0;
+
+    // Triggers that fired while a capture was already in progress.
+    uint64_t suppressed_triggers = 0;
+
+    uint64_t captures_written = 0;
+    uint64_t capture_failures = 0;
+    uint64_t frames_captured = 0;
+
+    // Frames in the post-trigger window that were overwritten before the capture thread got to them.
+    uint64_t frames_lost = 0;
+  };
+
+  // The clock (defaulting to `SteadyClock`) is only used by the capture thread to bound the post-trigger wait.
+  explicit FlightRecorder(const Config& config, const Clock* clock = nullptr);
+  FlightRecorder();
+  ~FlightRecorder();
+
+  FlightRecorder(const FlightRecorder&) = delete;
+  FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+  // Replace the triggers.  Safe while frames are being recorded, eg with the recorder attached to a `GsUsbWrapper`: a
+  // frame recorded during the swap itself is stored but not checked against any trigger.
+  void setTriggers(const std::vector<Trigger>& triggers);
+
+  // Hot path: store the frame and check the triggers.
+  void record(const CanFrame& frame);
+
+  // Fire a capture around the most recently recorded frame, eg from a UI button.  Returns false if a capture is already
+  // in progress.
+  bool triggerNow();
+
+  // Spawn / stop the capture thread.  A capture in progress when stopping is written with what it has so far.
+  bool start();
+  void stop();
+
+  // True while a capture is being collected or written.
+  bool isCapturing() const;
+
+  Statistics getStatistics() const;
+
+  // Path of the last capture written, or empty if there has been none.
+  std::string lastCapturePath() const;
+
+  // Format a frame as a candump log line (without the newline).
+  static std::string formatCandumpLine(const CanFrame& frame, const std::string& interface_name);
+
+ private:
+  enum State : uint32_t
+  {
+    ARMED,
+    CLAIMED,  // A trigger is filling in its position.
+    TRIGGERED,
+    CAPTURING
+  };
+
+  // Enough 64-bit words to hold a `CanFrame`.  The slot is stored word by word with relaxed atomics so the reader's
+  // copy is race free; the sequence number tells it whether the copy was torn.
+  static constexpr size_t kSlotWords = (sizeof(CanFrame) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  struct Slot
+  {
+    // Odd while the slot is being written, otherwise `2 * (position + 1)` for the frame at ring position `position`.
+    std::atomic<uint64_t> sequence{0};
+    std::array<std::atomic<uint64_t>, kSlotWords> words;
+  };
+
+  // Try to copy out the frame at ring position `position`.  Fails if it has been overwritten or not written yet.
+  bool readSlot(uint64_t position, CanFrame* frame) const;
+
+  // Move the state from ARMED to TRIGGERED around ring position `position`.
+  bool fire(uint64_t position, uint32_t timestamp_us);
+
+  // Capture thread body, and the pieces of one capture.
+  void captureThread();
+  void collectCapture(std::vector<CanFrame>* frames);
+  bool writeCapture(const std::vector<CanFrame>& frames);
+
+  Config config_;
+  const Clock* clock_;
+  std::vector<Trigger> triggers_;
+
+  // Held by `record()` while it checks `triggers_`, and by `setTriggers()` while it swaps them.  The RX path never
+  // waits for it; it skips the check instead.
+  std::atomic<bool> triggers_busy_;
+
+  std::vector<Slot> slots_;
+  uint64_t slot_mask_;
+
+  // Next ring position to write, which is also the number of frames recorded.  Only `record()` stores it.
+  std::atomic<uint64_t> head_;
+
+  // Trigger hand-off from the RX path to the capture thread.
+  std::atomic<uint32_t> state_;
+  std::atomic<uint64_t> trigger_position_;
+  std::atomic<uint32_t> trigger_timestamp_us_;
+
+  // Counters bumped when triggers fire.
+  std::atomic<uint64_t> num_triggers_;
+  std::atomic<uint64_t> suppressed_triggers_;
+
+  // Everything below belongs to the capture thread and is guarded by `mutex_`.
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  Statistics capture_statistics_;
+  std::string last_capture_path_;
+
+  // Number to try first for the next capture file.
+  uint64_t next_capture_number_;
+
+  bool thread_shutdown_;
+  std::thread capture_thread_;
+};
+
+}  // namespace cantaloupe
+
+#endif  // ifndef FLIGHT_RECORDER_H_
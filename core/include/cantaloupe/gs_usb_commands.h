@@ -43,6 +43,8 @@ struct __attribute__((packed)) GsDeviceMode
   static constexpr uint32_t kFlagOneShot = (1UL << 3);
   static constexpr uint32_t kFlagHwTimestamp = (1UL << 4);
   static constexpr uint32_t kFlagPadPacketsToMaxPacketSize = (1UL << 7);
+  static constexpr uint32_t kFlagFd = (1UL << 8);
+  static constexpr uint32_t kFlagBusErrorReporting = (1UL << 12);
 
   static constexpr uint32_t kModeReset = 0;
   static constexpr uint32_t kModeStart = 1;
@@ -70,6 +72,12 @@ struct __attribute__((packed)) GsHostCanFrame
   static constexpr uint32_t kCanIdRtrFlag = 0x40000000;
   static constexpr uint32_t kCanIdEffFlag = 0x80000000;
 
+  // Bits in `flags`.
+  static constexpr uint8_t kFlagOverflow = (1U << 0);
+  static constexpr uint8_t kFlagFd = (1U << 1);
+  static constexpr uint8_t kFlagBitRateSwitch = (1U << 2);
+  static constexpr uint8_t kFlagErrorStateIndicator = (1U << 3);
+
   constexpr GsHostCanFrame() :
     echo_id{0},
     can_id{0},
@@ -97,6 +105,37 @@ struct __attribute__((packed)) GsHostCanFrame
 
 static_assert(sizeof(GsHostCanFrame) == 24, "GsHostCanFrame is not properly represented.");
 
+// Frame representation used for CAN FD frames once the channel is started in FD mode.  Classic frames still arrive
+// in the shorter `GsHostCanFrame` layout; the two share the same header, so `flags` tells them apart.
+struct __attribute__((packed)) GsHostCanFdFrame
+{
+  constexpr GsHostCanFdFrame() :
+    echo_id{0},
+    can_id{0},
+    can_dlc{0},
+    channel{0},
+    flags{0},
+    reserved{0},
+    data{},
+    timestamp_us{0}
+  {
+  }
+
+  uint32_t echo_id;
+  uint32_t can_id;
+
+  uint8_t can_dlc;
+  uint8_t channel;
+  uint8_t flags;
+  uint8_t reserved;
+
+  uint8_t data[64];
+
+  uint32_t timestamp_us;
+};
+
+static_assert(sizeof(GsHostCanFdFrame) == 80, "GsHostCanFdFrame is not properly represented.");
+
 // Representation of the CAN bus bittiming on the device.
 struct __attribute__((packed)) GsDeviceBitTiming
 {
@@ -116,6 +155,71 @@ struct __attribute__((packed)) GsDeviceBitTiming
   uint32_t brp;
 };
 
+static_assert(sizeof(GsDeviceBitTiming) == 20, "GsDeviceBitTiming is not properly represented.");
+
+// Bit timing limits reported by the device (BT_CONST for the nominal phase, BT_CONST_EXT adds the data phase).
+struct __attribute__((packed)) GsDeviceBitTimingConst
+{
+  static constexpr uint32_t kFeatureFd = (1UL << 8);
+  static constexpr uint32_t kFeatureBusErrorReporting = (1UL << 12);
+
+  constexpr GsDeviceBitTimingConst() :
+    feature{0},
+    fclk_can{0},
+    tseg1_min{0},
+    tseg1_max{0},
+    tseg2_min{0},
+    tseg2_max{0},
+    sjw_max{0},
+    brp_min{0},
+    brp_max{0},
+    brp_inc{0}
+  {
+  }
+
+  uint32_t feature;
+  uint32_t fclk_can;
+  uint32_t tseg1_min;
+  uint32_t tseg1_max;
+  uint32_t tseg2_min;
+  uint32_t tseg2_max;
+  uint32_t sjw_max;
+  uint32_t brp_min;
+  uint32_t brp_max;
+  uint32_t brp_inc;
+};
+
+static_assert(sizeof(GsDeviceBitTimingConst) == 40, "GsDeviceBitTimingConst is not properly represented.");
+
+struct __attribute__((packed)) GsDeviceBitTimingConstExtended
+{
+  constexpr GsDeviceBitTimingConstExtended() :
+    nominal{},
+    dtseg1_min{0},
+    dtseg1_max{0},
+    dtseg2_min{0},
+    dtseg2_max{0},
+    dsjw_max{0},
+    dbrp_min{0},
+    dbrp_max{0},
+    dbrp_inc{0}
+  {
+  }
+
+  GsDeviceBitTimingConst nominal;
+  uint32_t dtseg1_min;
+  uint32_t dtseg1_max;
+  uint32_t dtseg2_min;
+  uint32_t dtseg2_max;
+  uint32_t dsjw_max;
+  uint32_t dbrp_min;
+  uint32_t dbrp_max;
+  uint32_t dbrp_inc;
+};
+
+static_assert(sizeof(GsDeviceBitTimingConstExtended) == 72,
+  "GsDeviceBitTimingConstExtended is not properly represented.");
+
 // Commands lifted from the Candelight firmware.
 enum GsUsbBreq : uint8_t
 {
@@ -129,6 +233,11 @@ enum GsUsbBreq : uint8_t
   IDENTIFY,
   GET_USER_ID,
   SET_USER_ID,
+  DATA_BITTIMING,
+  BT_CONST_EXT,
+  SET_TERMINATION,
+  GET_TERMINATION,
+  GET_STATE,
 };
 
 }  // namespace cantaloupe
@@ -13,9 +13,17 @@
 #ifndef GS_USB_WRAPPER_H_
 #define GS_USB_WRAPPER_H_
 
+#include <cantaloupe/can_error_monitor.h>
+#include <cantaloupe/can_fd_frame.h>
 #include <cantaloupe/can_frame.h>
+#include <cantaloupe/can_transport.h>
+#include <cantaloupe/flight_recorder.h>
+#include <cantaloupe/gs_usb_commands.h>
 #include <cantaloupe/libusb_forward_declare.h>
+#include <cantaloupe/thread_config.h>
 
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <mutex>
@@ -41,6 +49,12 @@ struct libUsbDeviceHandleDeleter
   }
 };
 
+// Deleter for the bulk transfers, which are allocated once up front.
+struct libUsbTransferDeleter
+{
+  void operator()(libusb_transfer* transfer) { libusb_free_transfer(transfer); }
+};
+
 // Types used for control messages.
 enum class ControlType
 {
@@ -48,7 +62,7 @@ enum class ControlType
   OUT
 };
 
-class GsUsbWrapper
+class GsUsbWrapper : public CanTransport
 {
  public:
   // USB Vendor and Product IDs we want to attach to.
@@ -66,8 +80,18 @@ class GsUsbWrapper
   // Default time (ms) to wait for a control transfer to succeed.
   static constexpr uint32_t kDefaultControlTransferTimeoutMs = 100;
 
+  // Bulk IN transfers kept queued on the device, so frames that arrive while we are busy elsewhere are already on the
+  // host by the time we ask for them.
+  static constexpr size_t kNumRxTransfers = 8;
+
+  // Default sample point for the CAN FD data phase, in tenths of a percent.
+  static constexpr uint16_t kDefaultDataSamplePointPermille = 750;
+
   GsUsbWrapper();
-  ~GsUsbWrapper();
+  ~GsUsbWrapper() override;
+
+  // Set up the hotplug thread (which also runs LibUSB's event handling) as `hotplug_thread_config` says.
+  explicit GsUsbWrapper(const ThreadConfig& hotplug_thread_config);
 
   // Get the version of LibUSB as a string.
   static const char* getLibUSBVersionString();
@@ -78,8 +102,9 @@ class GsUsbWrapper
   // Turn on/off the identify LEDs.
   bool setIdentifyLeds(bool enable_identify_leds);
 
-  // Enable the CAN channel.  Optionally enable loopback mode.
-  bool startChannel(bool loopback = false);
+  // Enable the CAN channel.  Optionally enable loopback mode, CAN FD if the device supports it, and an error frame for
+  // every bus error (rather than only for changes of bus state) if the device can report them.
+  bool startChannel(bool loopback = false, bool fd = false, bool bus_error_reporting = false);
 
   // Disable the CAN channel.
   bool stopChannel();
@@ -87,11 +112,52 @@ class GsUsbWrapper
   // Set the bitrate for the channel.
   bool setBitrate(uint32_t bitrate);
 
+  // Determine if the device can do CAN FD.
+  bool isFdCapable();
+
+  // Determine if the device can send an error frame for each bus error.
+  bool isBusErrorReportingCapable();
+
+  // Set the bitrate used for the data phase of CAN FD frames sent with bit rate switching.  The timing is worked out
+  // from the clock and limits the device reports.
+  bool setDataBitrate(uint32_t bitrate, uint16_t sample_point_permille = kDefaultDataSamplePointPermille);
+
   // Write a single CAN frame to the bus.  Optionally specify a timeout in ms, or default to zero for blocking.
-  bool writeCanFrame(const CanFrame& frame, uint32_t timeout_ms = 0);
+  bool writeCanFrame(const CanFrame& frame, uint32_t timeout_ms = 0) override;
 
   // Rear a single CAN frame to the bus.  Optionally specify a timeout in ms, or default to zero for blocking.
-  bool readCanFrame(CanFrame* frame, uint32_t timeout_ms = 0);
+  bool readCanFrame(CanFrame* frame, uint32_t timeout_ms = 0) override;
+
+  // Read up to `max_frames`, waiting up to `timeout_ms` for the first and then taking only frames whose transfers have
+  // already completed, so this never waits on a quiet bus once it has a frame.  An FD frame, or a frame the error
+  // monitor swallows, also ends the batch early.
+  size_t readCanFrames(CanFrame* frames, size_t max_frames, uint32_t timeout_ms = 0) override;
+
+  // Write several frames back to back while holding the device handle only once.  The gs_usb firmware expects one
+  // host frame per bulk transfer, so this is still one transfer per frame.
+  size_t writeCanFrames(const CanFrame* frames, size_t num_frames, uint32_t timeout_ms = 0) override;
+
+  // Write a classic or CAN FD frame.  FD frames need the channel to have been started in FD mode.
+  bool writeCanFdFrame(const CanFdFrame& frame, uint32_t timeout_ms = 0) override;
+
+  // Read a classic or CAN FD frame.  `readCanFrame` drops FD frames, since it has nowhere to put them.
+  bool readCanFdFrame(CanFdFrame* frame, uint32_t timeout_ms = 0) override;
+
+  // Translate between frames and the device's bulk transfer layout: the whole of `GsHostCanFdFrame` for FD frames, or
+  // only its first `sizeof(GsHostCanFrame)` bytes for classic ones.  `toHostCanFdFrame` returns the number of bytes to
+  // send, and `fromHostCanFdFrame` fails if `num_bytes` is not the size the frame's flags call for.
+  static size_t toHostCanFdFrame(const CanFdFrame& frame, GsHostCanFdFrame* output);
+  static bool fromHostCanFdFrame(const GsHostCanFdFrame& input, size_t num_bytes, CanFdFrame* frame);
+
+  // Feed every classic frame received into `recorder` (or nothing, if null).  The recorder takes frames from a single
+  // thread, so only read from one thread while it is attached.
+  void setFlightRecorder(FlightRecorder* recorder);
+
+  // Hand every error frame received to `monitor` (or nothing, if null) instead of returning it, so error storms are
+  // seen as the monitor's summaries.  Other classic frames are shown to it as well (they tell it the controller is
+  // back from bus off) and still returned.  The monitor takes frames from a single thread, so only read from one
+  // thread while it is attached.
+  void setErrorMonitor(CanErrorMonitor* monitor);
 
  private:
   // Determine if the device is already present at startup.
@@ -104,12 +170,44 @@ class GsUsbWrapper
   // Thread responsible for kicking LibUSB.
   void hotplugMonitorThread() const;
 
-  // Receive data from the bulk endpoint.
-  bool receiveBulkData(void* data, size_t num_bytes, size_t* actual_num_bytes, uint32_t timeout_ms);
+  // A bulk IN transfer kept queued on the device, and the frame it receives into.
+  struct RxTransfer
+  {
+    std::unique_ptr<libusb_transfer, libUsbTransferDeleter> transfer;
+    GsHostCanFdFrame frame;
+    int completed = 0;
+    bool in_flight = false;
+  };
+
+  // Receive the next frame from the bulk endpoint, waiting up to `timeout_ms` for it.  With `wait` false, only a
+  // transfer that has already completed is taken.
+  bool receiveBulkData(void* data, size_t num_bytes, size_t* actual_num_bytes, uint32_t timeout_ms, bool wait = true);
+
+  // What `readCanFdFrame` and `readCanFrame` do, with `wait` passed through to `receiveBulkData`.
+  bool receiveCanFdFrame(CanFdFrame* frame, uint32_t timeout_ms, bool wait);
+  bool receiveCanFrame(CanFrame* frame, uint32_t timeout_ms, bool wait);
+
+  // Queue every RX transfer not already on the device.  Expects `device_handle_mutex_` to already be held.
+  int submitRxTransfersLocked();
+
+  // Handle events until `rx` completes, for up to `timeout_ms` (zero waits forever), or only what is already
+  // pending if `wait` is false.  Returns a LibUSB error code.  Expects `device_handle_mutex_` to already be held.
+  int awaitRxTransferLocked(RxTransfer* rx, uint32_t timeout_ms, bool wait);
+
+  // Cancel the RX transfers and close the device handle.  Expects `device_handle_mutex_` to already be held.
+  void closeDeviceLocked();
 
   // Transmit data on the bulk endpoint.
   bool transmitBulkData(void* data, size_t num_bytes, uint32_t timeout_ms);
 
+  // Same as above, but expects `device_handle_mutex_` to already be held.
+  bool transmitBulkDataLocked(void* data, size_t num_bytes, uint32_t timeout_ms);
+
+  // Do what `libusb_bulk_transfer()` does, but on one of our preallocated transfers rather than one allocated (and
+  // freed) for every frame.  Returns a LibUSB error code.  Expects `device_handle_mutex_` to already be held.
+  int bulkTransferLocked(libusb_transfer* transfer, uint8_t endpoint, void* data, size_t num_bytes,
+    int* actual_num_bytes, uint32_t timeout_ms);
+
   // Transmit a control message on the interface.
   bool transmitControl(ControlType type, uint8_t request, uint16_t value, uint16_t index, void* data, size_t length);
 
@@ -122,15 +220,34 @@ class GsUsbWrapper
   // Handle to be used with LibUSB hotplug events.
   int hotplug_handle_;
 
+  // Setup applied by the hotplug thread when it starts.
+  ThreadConfig hotplug_thread_config_;
+
   // Flag indicating that the hotplug envent thread should terminate.
   bool hotplug_thread_shutdown_;
 
   // The thread responsible for kicking LibUSB.
   std::thread hotplug_thread_;
 
+  // Transfers kept queued for reading, taken in turn starting from `next_rx_transfer_`.  Declared ahead of the device
+  // handle so that closing it, which lets go of anything still queued, comes before they are freed.  Only used with
+  // `device_handle_mutex_` held.
+  std::array<RxTransfer, kNumRxTransfers> rx_transfers_;
+  size_t next_rx_transfer_;
+
   // The LibUSB device handle, and a mutex protecting it.
   std::mutex device_handle_mutex_;
   std::unique_ptr<libusb_device_handle, libUsbDeviceHandleDeleter<kExpectedConfigurationIndex>> device_handle_;
+
+  // Transfer reused for every bulk write, so the TX path stays off the heap.  Only used with `device_handle_mutex_`
+  // held.
+  std::unique_ptr<libusb_transfer, libUsbTransferDeleter> bulk_out_transfer_;
+
+  // Optional recorder fed from the RX path.
+  std::atomic<FlightRecorder*> flight_recorder_;
+
+  // Optional monitor fed from the RX path.
+  std::atomic<CanErrorMonitor*> error_monitor_;
 };
 
 }  // namespace cantaloupe
@@ -0,0 +1,206 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef J1939_H_
+#define J1939_H_
+
+#include <cantaloupe/can_frame.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace cantaloupe
+{
+
+// The fields packed into a 29-bit J1939 identifier.
+struct J1939Id
+{
+  constexpr J1939Id() :
+    priority{0},
+    pgn{0},
+    source_address{0},
+    destination_address{kGlobalAddress}
+  {
+  }
+
+  // Address used for broadcast (and for PDU2 messages, which carry no destination).
+  static constexpr uint8_t kGlobalAddress = 0xFF;
+
+  // PDU formats at or above this value are PDU2 (broadcast) and the PDU specific byte is a group extension.
+  static constexpr uint8_t kPdu2FormatMin = 240;
+
+  // Split a raw CAN identifier into its J1939 fields.  Any flag bits above the 29-bit identifier are ignored.
+  static J1939Id decode(uint32_t can_id);
+
+  // Pack the fields back into a 29-bit identifier (without the EFF flag).
+  uint32_t encode() const;
+
+  // Message priority, 0 (highest) through 7.
+  uint8_t priority;
+
+  // Parameter group number.  For PDU1 messages the destination address is not part of the PGN.
+  uint32_t pgn;
+
+  uint8_t source_address;
+  uint8_t destination_address;
+};
+
+// A complete J1939 message, either a single frame or a reassembled transport protocol transfer.  `data` is only valid
+// for the duration of the handler call.
+struct J1939Message
+{
+  J1939Id id;
+  const uint8_t* data;
+  size_t length;
+
+  // Device timestamp of the frame that completed the message.
+  uint32_t timestamp_us;
+};
+
+using J1939Handler = std::function<void(const J1939Message&)>;
+
+// Decodes J1939 traffic, reassembles BAM and RTS/CTS (CMDT) transport protocol transfers and dispatches complete
+// messages by PGN.  This is a passive listener: it follows both sides of a CMDT transfer but never transmits CTS or
+// acknowledgements itself.  All session storage is allocated up front, so `processFrame` never touches the heap.
+class J1939Receiver
+{
+ public:
+  // Transport protocol PGNs.
+  static constexpr uint32_t kPgnTpConnectionManagement = 0xEC00;
+  static constexpr uint32_t kPgnTpDataTransfer = 0xEB00;
+
+  // Control bytes found in the first byte of a TP.CM frame.
+  static constexpr uint8_t kTpCmRequestToSend = 16;
+  static constexpr uint8_t kTpCmClearToSend = 17;
+  static constexpr uint8_t kTpCmEndOfMessageAck = 19;
+  static constexpr uint8_t kTpCmBroadcastAnnounce = 32;
+  static constexpr uint8_t kTpCmAbort = 255;
+
+  // Each TP.DT frame carries a sequence number plus seven bytes, for at most 255 packets.
+  static constexpr size_t kTpBytesPerPacket = 7;
+  static constexpr size_t kTpMaxPackets = 255;
+  static constexpr size_t kTpMaxMessageBytes = kTpBytesPerPacket * kTpMaxPackets;
+
+  // Default number of transfers that may be in flight at once.
+  static constexpr size_t kDefaultMaxSessions = 64;
+
+  // Default time without traffic after which a transfer is abandoned (J1939-21 T1/T2/T3 are all <= 1250 ms).
+  static constexpr uint32_t kDefaultSessionTimeoutUs = 1250 * 1000;
+
+  struct Statistics
+  {
+    uint64_t frames_processed = 0;
+    uint64_t messages_dispatched = 0;
+    uint64_t sessions_started = 0;
+    uint64_t sessions_completed = 0;
+    uint64_t sessions_aborted = 0;
+    uint64_t sessions_timed_out = 0;
+
+    // Transfers that could not be tracked because every session slot was busy.
+    uint64_t sessions_dropped = 0;
+
+    // TP frames that were malformed or did not belong to any open transfer.
+    uint64_t protocol_errors = 0;
+  };
+
+  explicit J1939Receiver(size_t max_sessions = kDefaultMaxSessions,
+    uint32_t session_timeout_us = kDefaultSessionTimeoutUs);
+
+  // Register the handler for a PGN, replacing any previous one.  Do this before traffic starts flowing; registration
+  // may allocate, dispatch never does.
+  void setHandler(uint32_t pgn, J1939Handler handler);
+
+  // Handler for any PGN without a dedicated entry.
+  void setDefaultHandler(J1939Handler handler);
+
+  // Feed a single frame from the bus.  Returns false if the frame is not a J1939 (extended, non-error, non-RTR) frame.
+  bool processFrame(const CanFrame& frame);
+
+  // Abandon any transfer that has been quiet for longer than the session timeout, relative to `now_us` on the device
+  // clock.  Stale sessions are also reclaimed lazily when their slot is needed.
+  void expireSessions(uint32_t now_us);
+
+  // Number of transfers currently being reassembled.
+  size_t numActiveSessions() const;
+
+  const Statistics& getStatistics() const { return statistics_; }
+
+ private:
+  enum class SessionType : uint8_t
+  {
+    BAM,
+    CMDT
+  };
+
+  struct Session
+  {
+    bool in_use = false;
+    SessionType type = SessionType::BAM;
+    J1939Id id;
+    uint16_t total_bytes = 0;
+    uint8_t num_packets = 0;
+    uint8_t num_received = 0;
+    uint32_t last_timestamp_us = 0;
+
+    // One bit per sequence number so retransmitted packets are only counted once.
+    std::array<uint64_t, 4> received_mask{};
+    std::array<uint8_t, kTpMaxMessageBytes> data{};
+  };
+
+  struct HandlerEntry
+  {
+    uint32_t pgn;
+    J1939Handler handler;
+  };
+
+  // Handle the two transport protocol PGNs.
+  void processConnectionManagement(const J1939Id& id, const CanFrame& frame);
+  void processDataTransfer(const J1939Id& id, const CanFrame& frame);
+
+  // Start a new transfer from `source` to `destination`, replacing one already in progress between them.
+  void openSession(SessionType type, uint8_t source, uint8_t destination, const CanFrame& frame);
+
+  // Look up the transfer between a pair of addresses, or nullptr.
+  Session* findSession(uint8_t source, uint8_t destination);
+
+  // Release a session slot.
+  void closeSession(Session* session);
+
+  // Call the handler registered for the message's PGN.
+  void dispatch(const J1939Message& message);
+
+  static size_t addressPairIndex(uint8_t source, uint8_t destination)
+  {
+    return (static_cast<size_t>(source) << 8) | destination;
+  }
+
+  uint32_t session_timeout_us_;
+
+  // Preallocated session slots.
+  std::vector<Session> sessions_;
+
+  // Maps a (source, destination) address pair to its session slot plus one, or zero when there is no transfer.
+  std::vector<uint16_t> session_index_;
+
+  // Handlers sorted by PGN.
+  std::vector<HandlerEntry> handlers_;
+  J1939Handler default_handler_;
+
+  Statistics statistics_;
+};
+
+}  // namespace cantaloupe
+
+#endif  // ifndef J1939_H_
@@ -23,6 +23,7 @@ struct libusb_transfer;
 
 void libusb_close(libusb_device_handle*);
 void libusb_exit(libusb_context*);
+void libusb_free_transfer(libusb_transfer*);
 int libusb_release_interface(libusb_device_handle*, int);
 }
 
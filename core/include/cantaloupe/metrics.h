@@ -0,0 +1,138 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace cantaloupe
+{
+
+// Monotonic event counts.
+enum class MetricCounter : size_t
+{
+  BULK_IN_TRANSFERS = 0,
+  BULK_IN_BYTES,
+  BULK_OUT_TRANSFERS,
+  BULK_OUT_BYTES,
+  BULK_TIMEOUTS,
+  BULK_ERRORS,
+  CONTROL_TRANSFERS,
+  CONTROL_FAILURES,
+  HOTPLUG_ATTACH,
+  HOTPLUG_DETACH,
+  RX_FRAMES,
+  RX_ERROR_FRAMES,
+  TX_FRAMES,
+  TX_FAILURES,
+  NUM_COUNTERS
+};
+
+// Values that only ever ratchet upwards, such as queue high-water marks.
+enum class MetricGauge : size_t
+{
+  TX_QUEUE_HIGH_WATER_MARK = 0,
+  NUM_GAUGES
+};
+
+// Latency distributions, in microseconds.
+enum class MetricHistogram : size_t
+{
+  BULK_IN_LATENCY_US = 0,
+  BULK_OUT_LATENCY_US,
+  CONTROL_LATENCY_US,
+  NUM_HISTOGRAMS
+};
+
+static constexpr size_t kNumMetricCounters = static_cast<size_t>(MetricCounter::NUM_COUNTERS);
+static constexpr size_t kNumMetricGauges = static_cast<size_t>(MetricGauge::NUM_GAUGES);
+static constexpr size_t kNumMetricHistograms = static_cast<size_t>(MetricHistogram::NUM_HISTOGRAMS);
+
+// Log-linear bucketing: values below 2^kHistogramSubBucketBits get a bucket each, above that every power of two is
+// split into 2^kHistogramSubBucketBits equal buckets, so the relative error stays under 1/16 across the whole range.
+static constexpr size_t kHistogramSubBucketBits = 4;
+static constexpr size_t kHistogramSubBuckets = static_cast<size_t>(1) << kHistogramSubBucketBits;
+static constexpr size_t kHistogramNumBuckets = kHistogramSubBuckets * (64 - kHistogramSubBucketBits + 1);
+
+// LibUSB error codes run from -1 to -12, plus -99 for "other".  The last slot holds anything unrecognised.
+static constexpr size_t kNumLibUsbErrorSlots = 14;
+
+struct HistogramSnapshot
+{
+  std::array<uint64_t, kHistogramNumBuckets> buckets{};
+  uint64_t count = 0;
+  uint64_t sum = 0;
+
+  // Approximate value at quantile `q` (0.0 - 1.0), reported as the upper edge of the bucket it falls in.
+  uint64_t percentile(double q) const;
+
+  static size_t bucketIndex(uint64_t value);
+  static uint64_t bucketUpperBound(size_t index);
+};
+
+// Point-in-time totals across every thread.
+struct MetricsSnapshot
+{
+  uint64_t timestamp_us = 0;
+  std::array<uint64_t, kNumMetricCounters> counters{};
+  std::array<uint64_t, kNumLibUsbErrorSlots> libusb_errors{};
+  std::array<uint64_t, kNumMetricGauges> gauges{};
+  std::array<HistogramSnapshot, kNumMetricHistograms> histograms{};
+
+  uint64_t counter(MetricCounter which) const { return counters[static_cast<size_t>(which)]; }
+  uint64_t gauge(MetricGauge which) const { return gauges[static_cast<size_t>(which)]; }
+  const HistogramSnapshot& histogram(MetricHistogram which) const
+  {
+    return histograms[static_cast<size_t>(which)];
+  }
+
+  // What happened between `earlier` and this snapshot.  Gauges keep their current value.
+  MetricsSnapshot delta(const MetricsSnapshot& earlier) const;
+
+  // Human readable dump, one metric per line.
+  std::string toText() const;
+
+  // The same data as a single JSON object.
+  std::string toJson() const;
+};
+
+// Process-wide metrics for the USB/CAN stack.  Every thread records into its own shard of relaxed atomics, so the hot
+// path never contends or takes a lock; `snapshot()` sums the shards.  A shard outlives its thread (its totals are kept)
+// and is recycled by the next thread that starts recording.
+class Metrics
+{
+ public:
+  static void increment(MetricCounter counter, uint64_t amount = 1);
+
+  // Count a LibUSB return code.  Non-negative codes are ignored.
+  static void recordLibUsbError(int error_code);
+
+  static void recordLatency(MetricHistogram histogram, uint64_t value_us);
+
+  // Raise a gauge to `value` if it is below it.
+  static void updateHighWaterMark(MetricGauge gauge, uint64_t value);
+
+  static MetricsSnapshot snapshot();
+
+  static const char* counterName(MetricCounter counter);
+  static const char* gaugeName(MetricGauge gauge);
+  static const char* histogramName(MetricHistogram histogram);
+  static const char* libUsbErrorName(size_t slot);
+};
+
+}  // namespace cantaloupe
+
+#endif  // ifndef METRICS_H_
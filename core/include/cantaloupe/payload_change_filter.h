@@ -0,0 +1,116 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef PAYLOAD_CHANGE_FILTER_H_
+#define PAYLOAD_CHANGE_FILTER_H_
+
+#include <cantaloupe/can_frame.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cantaloupe
+{
+
+// RX stage for reverse engineering ("sniffer" mode): remembers the last payload seen for each identifier and only lets
+// a frame through when its payload differs from the previous frame with that identifier.  The payload is compared as
+// a single 64-bit word, and which bytes changed comes out as an 8-bit mask (bit `i` for `data[i]`).
+//
+// Standard identifiers index a flat table directly; extended identifiers go in a fixed-size open-addressed table, so
+// nothing is allocated after construction.  If that table fills up, frames with new extended identifiers are passed
+// through unfiltered.  Error and remote frames carry no payload to compare and are always passed through.
+class PayloadChangeFilter
+{
+ public:
+  static constexpr size_t kDefaultExtendedCapacity = 4096;
+
+  // Bits of the payload word that take part in the comparison, with `data[i]` in bits `8 * i` to `8 * i + 7`.
+  static constexpr uint64_t kAllBits = ~uint64_t{0};
+
+  struct Statistics
+  {
+    uint64_t frames_in = 0;
+    uint64_t frames_forwarded = 0;
+
+    // First frame seen for an identifier, forwarded as a change.
+    uint64_t first_seen = 0;
+
+    // Error and remote frames, forwarded without comparison.
+    uint64_t passed_through = 0;
+
+    // Frames with extended identifiers that did not fit in the table, forwarded without comparison.
+    uint64_t table_full = 0;
+  };
+
+  // `extended_capacity` is the number of distinct extended identifiers tracked, rounded up to a power of two.
+  explicit PayloadChangeFilter(size_t extended_capacity = kDefaultExtendedCapacity);
+
+  // Only changes in the bits under `bit_mask` count for frames with this identifier, eg to ignore a rolling counter.
+  // Applies to frames already tracked as well as future ones.  Returns false if the identifier does not fit in the
+  // table.
+  //
+  // `id` follows the raw `CanFrame::id` convention: frames are filed by their `eff_frame` flag, so an extended
+  // identifier that fits in 11 bits must carry `CanFrame::kIdFlagEff` here, or the mask lands on the standard one.
+  bool setBitMask(uint32_t id, uint64_t bit_mask);
+
+  // Mask for identifiers without one of their own.  This replaces every per-identifier mask, so set it before calling
+  // `setBitMask()`.
+  void setDefaultBitMask(uint64_t bit_mask);
+
+  // Compare `frame` with the previous frame of its identifier and remember it.  Returns true if it should be forwarded,
+  // and optionally reports which bytes changed.  A change of length counts as a change, and marks the bytes that
+  // appeared or disappeared.
+  bool process(const CanFrame& frame, uint8_t* changed_bytes = nullptr);
+
+  // Run a batch through `process()`, copying the frames to forward into `output` (which may be `frames` itself) and
+  // their changed-byte masks into `changed_bytes` if not null.  Returns how many frames were forwarded.
+  size_t filter(const CanFrame* frames, size_t num_frames, CanFrame* output, uint8_t* changed_bytes = nullptr);
+
+  // Forget every payload, so the next frame of each identifier is forwarded again.  Bit masks are kept.
+  void reset();
+
+  Statistics getStatistics() const { return statistics_; }
+
+  // Collapse a 64-bit word to one bit per byte: bit `i` is set if byte `i` is non-zero.
+  static uint8_t nonZeroBytes(uint64_t word);
+
+ private:
+  struct Entry
+  {
+    uint64_t payload = 0;
+    uint64_t bit_mask = kAllBits;
+    uint32_t key = 0;
+    uint8_t dlc = 0;
+
+    // Set once a payload has been stored.
+    bool seen = false;
+
+    // Set once the entry belongs to `key` (extended table only).
+    bool used = false;
+  };
+
+  // Find the entry for a frame's identifier, claiming one if needed.  Null if the extended table is full.
+  Entry* lookup(uint32_t id, bool extended);
+
+  std::vector<Entry> standard_entries_;
+  std::vector<Entry> extended_entries_;
+  size_t extended_mask_;
+  size_t extended_used_;
+  uint64_t default_bit_mask_;
+
+  Statistics statistics_;
+};
+
+}  // namespace cantaloupe
+
+#endif  // ifndef PAYLOAD_CHANGE_FILTER_H_
@@ -0,0 +1,109 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cantaloupe
+{
+
+// Fixed set of objects handed out by index, for storage that is sized once and then recycled (queue nodes, timer
+// entries and the like), so the hot paths never touch the heap.  Objects are constructed up front and keep whatever
+// state they were released with; a fresh pool hands out the lowest indices first.
+//
+// Not thread safe: owners guard it with their own lock.
+template<typename T>
+class Pool
+{
+ public:
+  static constexpr uint32_t kInvalidIndex = 0xFFFFFFFF;
+
+  explicit Pool(size_t capacity) :
+    objects_(capacity),
+    free_{},
+    low_water_mark_{capacity}
+  {
+    free_.reserve(capacity);
+    reset();
+  }
+
+  Pool(const Pool&) = delete;
+  Pool& operator=(const Pool&) = delete;
+
+  // Take an object, or return `kInvalidIndex` if they are all in use.
+  uint32_t acquire()
+  {
+    if (free_.empty() == true)
+    {
+      return kInvalidIndex;
+    }
+
+    const uint32_t index = free_.back();
+    free_.pop_back();
+
+    if (free_.size() < low_water_mark_)
+    {
+      low_water_mark_ = free_.size();
+    }
+
+    return index;
+  }
+
+  // Hand an object back.  Each index taken must be released exactly once.
+  void release(uint32_t index)
+  {
+    free_.push_back(index);
+  }
+
+  // Mark every object free again, without touching their contents.
+  void reset()
+  {
+    free_.clear();
+    for (size_t i = objects_.size(); i > 0; --i)
+    {
+      free_.push_back(static_cast<uint32_t>(i - 1));
+    }
+  }
+
+  T& operator[](uint32_t index) { return objects_[index]; }
+  const T& operator[](uint32_t index) const { return objects_[index]; }
+
+  // Index of an object from this pool.
+  uint32_t indexOf(const T* object) const { return static_cast<uint32_t>(object - objects_.data()); }
+
+  size_t capacity() const { return objects_.size(); }
+  size_t available() const { return free_.size(); }
+  size_t inUse() const { return objects_.size() - free_.size(); }
+  bool exhausted() const { return free_.empty(); }
+
+  // Fewest objects ever left free, ie how close the pool has come to running out.
+  size_t lowWaterMark() const { return low_water_mark_; }
+
+ private:
+  std::vector<T> objects_;
+
+  // Free indices, used as a stack so recently released (and still cached) objects are reused first.
+  std::vector<uint32_t> free_;
+  size_t low_water_mark_;
+};
+
+// Out-of-line definitions for constants that get bound to references (eg by std::min).
+template<typename T>
+constexpr uint32_t Pool<T>::kInvalidIndex;
+
+}  // namespace cantaloupe
+
+#endif  // ifndef POOL_H_
@@ -0,0 +1,186 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef PREDICATE_H_
+#define PREDICATE_H_
+
+#include <cantaloupe/can_frame.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cantaloupe
+{
+
+// A condition on a frame written as a C-like expression, eg
+//
+//   id == 0x1F0 && (data[2] & 0x0C) == 0x04 && dlc >= 6
+//
+// Fields:
+//   id                  Identifier without the flag bits.
+//   dlc                 Data length.
+//   eff, rtr, err, tx   Extended format / remote / error / own transmission flags, as 0 or 1.
+//   timestamp           Device timestamp in microseconds.
+//   data[i]             Payload byte `i` (0-7); zero past the end of the payload.
+//   bits(start, len)    `len` bits (1-64) of the payload starting at bit `start`, with the payload read as a
+//                       little-endian word (Intel signal layout).
+//
+// Operators, with C precedence: `|| && | ^ & == != < <= > >= << >> + - * / % ! ~` and unary minus.  Literals are
+// decimal or hex (`0x`), plus `true` and `false`.  All arithmetic is unsigned 64-bit; dividing by zero gives zero.
+//
+// Expressions are compiled once into a compact stack bytecode with constants folded, and evaluated without allocating.
+class Predicate
+{
+ public:
+  enum class Opcode : uint8_t
+  {
+    PUSH,
+    LOAD_ID,
+    LOAD_DLC,
+    LOAD_EFF,
+    LOAD_RTR,
+    LOAD_ERR,
+    LOAD_TX,
+    LOAD_TIMESTAMP,
+    LOAD_DATA,  // Operand is the byte index.
+    LOAD_BITS,  // Operand is `start | (length << 8)`.
+    NOT,
+    NEGATE,
+    BIT_NOT,
+    MULTIPLY,
+    DIVIDE,
+    MODULO,
+    ADD,
+    SUBTRACT,
+    SHIFT_LEFT,
+    SHIFT_RIGHT,
+    LESS,
+    LESS_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    EQUAL,
+    NOT_EQUAL,
+    BIT_AND,
+    BIT_XOR,
+    BIT_OR,
+    TO_BOOL,
+
+    // Short-circuit for `&&` and `||`: if the top of the stack decides the result, leave it (as 0 or 1) and jump to the
+    // operand; otherwise pop it and carry on.
+    JUMP_IF_FALSE,
+    JUMP_IF_TRUE
+  };
+
+  struct Instruction
+  {
+    Opcode opcode;
+
+    // For binary operators: take the right-hand side from `operand` instead of the stack.
+    bool immediate;
+
+    uint64_t operand;
+  };
+
+  // Deepest stack a predicate may need.
+  static constexpr size_t kMaxStackDepth = 32;
+
+  // Deepest an expression may nest, counting parentheses, unary operators and chained binary operators.  Keeps the
+  // recursion in the compiler well clear of the end of the stack.
+  static constexpr size_t kMaxNestingDepth = 256;
+
+  // Identifier value meaning "any identifier" in `requiredId()`.
+  static constexpr uint32_t kAnyId = 0xFFFFFFFF;
+
+  // An empty predicate, which matches nothing until `compile()` succeeds.
+  Predicate();
+
+  // Parse and compile `expression`.  On failure the predicate is left empty and `error` (if not null) says why.
+  bool compile(const std::string& expression, std::string* error = nullptr);
+
+  bool isValid() const { return code_.empty() == false; }
+
+  // Evaluate the expression; a non-zero result means the frame matches.
+  bool matches(const CanFrame& frame) const;
+  uint64_t evaluate(const CanFrame& frame) const;
+
+  // Evaluate over a batch, setting `results[i]` to 1 or 0.  Returns the number of matches.
+  size_t evaluate(const CanFrame* frames, size_t num_frames, uint8_t* results) const;
+
+  // If the expression can only match one identifier (it is a chain of `&&` with an `id == <constant>` in it), that
+  // identifier; otherwise `kAnyId`.
+  uint32_t requiredId() const { return required_id_; }
+
+  const std::string& expression() const { return expression_; }
+  const std::vector<Instruction>& code() const { return code_; }
+
+  // Human-readable listing of the bytecode, for debugging.
+  std::string disassemble() const;
+
+ private:
+  std::string expression_;
+  std::vector<Instruction> code_;
+  uint32_t required_id_;
+};
+
+// A collection of predicates evaluated together.  Predicates that can only match one identifier are grouped by it, so
+// each frame is only tested against the predicates for its identifier plus the ones that apply to every identifier.
+class PredicateSet
+{
+ public:
+  struct Match
+  {
+    uint32_t frame_index;
+    uint32_t predicate_index;
+  };
+
+  // Add a compiled predicate, returning its index.  Adding is not allowed while another thread is matching.
+  size_t add(const Predicate& predicate);
+
+  // Compile and add an expression.  Returns false (and adds nothing) if it does not compile.
+  bool add(const std::string& expression, size_t* index = nullptr, std::string* error = nullptr);
+
+  size_t size() const { return predicates_.size(); }
+  const Predicate& operator[](size_t index) const { return predicates_[index]; }
+
+  // Indices of the predicates matching `frame`, written to `indices`, stopping at `max_indices`.  Returns how many
+  // were written.  Indices come out grouped, not in order.
+  size_t match(const CanFrame& frame, uint32_t* indices, size_t max_indices) const;
+
+  // Every (frame, predicate) match across a batch, stopping once `max_matches` have been written.
+  size_t match(const CanFrame* frames, size_t num_frames, Match* matches, size_t max_matches) const;
+
+  // True if any predicate matches, stopping at the first one.
+  bool matchesAny(const CanFrame& frame) const;
+
+ private:
+  // Range of `by_id_` holding the predicates for this identifier.
+  std::pair<size_t, size_t> findId(uint32_t id) const;
+
+  // Call `sink(predicate_index)` for each predicate matching `frame` until it returns false.
+  template<typename Sink>
+  void forEachMatch(const CanFrame& frame, Sink sink) const;
+
+  std::vector<Predicate> predicates_;
+
+  // (identifier, predicate index), sorted by identifier.
+  std::vector<std::pair<uint32_t, uint32_t>> by_id_;
+
+  // Predicates that may match any identifier.
+  std::vector<uint32_t> any_id_;
+};
+
+}  // namespace cantaloupe
+
+#endif  // ifndef PREDICATE_H_
@@ -0,0 +1,65 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef THREAD_CONFIG_H_
+#define THREAD_CONFIG_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace cantaloupe
+{
+
+enum class SchedulingPolicy
+{
+  DEFAULT,  // Whatever the thread inherited, normally SCHED_OTHER.
+  FIFO,
+  ROUND_ROBIN
+};
+
+// How a thread should be set up.  Every thread the library creates takes one of these and applies it to itself when it
+// starts; the default leaves everything but the name alone.
+struct ThreadConfig
+{
+  // Name shown by debuggers and `top -H`, truncated to 15 characters.  Empty means the library's name for the thread.
+  std::string name;
+
+  // CPUs the thread may run on.  Empty means any.  Not supported on macOS.
+  std::vector<int> cpus;
+
+  // Real-time policies need a `priority` between 1 and 99, and usually root or CAP_SYS_NICE (or an RLIMIT_RTPRIO).
+  SchedulingPolicy policy = SchedulingPolicy::DEFAULT;
+  int priority = 0;
+
+  // Touch this much of the thread's stack up front, so it is resident (and locked, after `lockMemory()`) before the
+  // thread has to react to anything.  Keep it well below the thread's stack size.
+  size_t prefault_stack_bytes = 0;
+};
+
+// Apply `config` to the calling thread, using `default_name` if the config has no name.  Each setting is tried on its
+// own; any that fail (eg for lack of permission) are logged and skipped, and the thread carries on without them.
+// Returns true if everything was applied.  Call it at the top of an application thread that reads frames, too.
+bool applyThreadConfig(const ThreadConfig& config, const char* default_name = nullptr);
+
+// Lock every page of the process in memory, now and as it grows, so the real-time threads never wait on a page fault.
+// Under a finite RLIMIT_MEMLOCK (and not root) only the pages mapped so far are locked, so call it once the buffers are
+// allocated.  Returns false (and changes nothing) if not permitted.
+bool lockMemory();
+void unlockMemory();
+
+// Touch every page of `num_bytes` at `data` so it is resident.  The contents are left as they were.
+void prefault(void* data, size_t num_bytes);
+
+}  // namespace cantaloupe
+
+#endif  // ifndef THREAD_CONFIG_H_
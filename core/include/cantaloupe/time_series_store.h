@@ -0,0 +1,219 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef TIME_SERIES_STORE_H_
+#define TIME_SERIES_STORE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cantaloupe
+{
+
+// Storage for decoded signal values that can be drawn at any zoom level without touching every sample.
+//
+// Each series is split into chunks of `kChunkSamples` samples, held as separate timestamp and value columns.  Alongside
+// every chunk sits a min / max / sum pyramid: level `l` summarizes aligned runs of `2^l` samples, from runs of eight up
+// to the whole chunk, and levels above that summarize runs of chunks.  A summary is computed from the two below it as
+// soon as its run is complete, so appending costs a constant amount of work on average.
+//
+// `query()` picks the finest level with no more than the requested number of runs in the window and returns one point
+// per run, so the work depends on the number of points and not on the number of samples.
+//
+// Chunk memory comes from a fixed pool.  When it runs out, the oldest full chunk is written to an unlinked spill file
+// and read back through a shared mapping of that file, leaving the operating system to page it in and out.
+//
+// Not thread safe: appends and queries must be serialized by the caller.
+class TimeSeriesStore
+{
+ public:
+  // Level of the chunk summaries; a chunk holds `2^kChunkLevel` samples.
+  static constexpr size_t kChunkLevel = 13;
+  static constexpr size_t kChunkSamples = size_t{1} << kChunkLevel;
+
+  static constexpr size_t kDefaultMaxResidentChunks = 64;
+
+  struct Config
+  {
+    // Chunks kept in memory, including the one each series is appending to.
+    size_t max_resident_chunks = kDefaultMaxResidentChunks;
+
+    // Where the spill file is created.
+    std::string spill_directory = "/tmp";
+  };
+
+  // One plotted point: a summary of the samples it covers.
+  struct Point
+  {
+    // Timestamps of the first and last sample.
+    uint64_t begin_us;
+    uint64_t end_us;
+
+    double min;
+    double max;
+    double mean;
+    uint64_t num_samples;
+  };
+
+  struct Statistics
+  {
+    uint64_t samples = 0;
+
+    // Samples older than the last one in their series, which are dropped.
+    uint64_t out_of_order = 0;
+
+    // Samples dropped because no chunk could be freed for them.
+    uint64_t dropped = 0;
+
+    uint64_t chunks_spilled = 0;
+    uint64_t spill_bytes = 0;
+  };
+
+  // Throws `std::runtime_error` if the spill file cannot be created.
+  explicit TimeSeriesStore(const Config& config);
+  TimeSeriesStore();
+  ~TimeSeriesStore();
+
+  TimeSeriesStore(const TimeSeriesStore&) = delete;
+  TimeSeriesStore& operator=(const TimeSeriesStore&) = delete;
+
+  // Add a series and return its index, or -1 if every resident chunk is already taken by a series.
+  int addSeries(const std::string& name);
+
+  size_t numSeries() const { return series_.size(); }
+  const std::string& seriesName(size_t series) const { return series_[series].name; }
+
+  // Number of samples stored in a series.
+  uint64_t numSamples(size_t series) const { return series_[series].num_samples; }
+
+  // Append a sample.  Timestamps must not go backwards within a series.  Returns false if the sample was dropped.
+  bool append(size_t series, uint64_t timestamp_us, double value);
+
+  // Summarize the samples with timestamps in [`begin_us`, `end_us`) as at most `max_points` points in time order,
+  // replacing the contents of `points`.  Runs cut by the edges of the window only cover the samples inside it.
+  // Returns false for an unknown series.
+  bool query(size_t series, uint64_t begin_us, uint64_t end_us, size_t max_points, std::vector<Point>* points) const;
+
+  Statistics getStatistics() const { return statistics_; }
+
+ private:
+  // Lowest level stored; finer runs are summarized from the samples.
+  static constexpr size_t kMinLevel = 3;
+
+  // Summaries stored in a chunk, for levels `kMinLevel` to `kChunkLevel - 1`.
+  static constexpr size_t kChunkBuckets = (size_t{2} << (kChunkLevel - kMinLevel)) - 2;
+
+  static constexpr uint32_t kNoBlock = 0xFFFFFFFF;
+
+  struct Bucket
+  {
+    double min;
+    double max;
+    double sum;
+  };
+
+  // Summary of an arbitrary run of samples.
+  struct Aggregate
+  {
+    double min;
+    double max;
+    double sum;
+    uint64_t count;
+
+    void add(const Bucket& bucket, uint64_t bucket_count);
+    void add(double value);
+  };
+
+  // One chunk's columns and pyramid, as laid out both in memory and in the spill file.
+  struct Chunk
+  {
+    uint64_t timestamps_us[kChunkSamples];
+    double values[kChunkSamples];
+    Bucket buckets[kChunkBuckets];
+  };
+
+  struct ChunkInfo
+  {
+    uint64_t first_us;
+
+    // Whole-chunk summary, once the chunk is full.
+    Bucket summary;
+
+    // Pool block holding the chunk, or `kNoBlock` if it has been spilled to `spill_offset`.
+    uint32_t block;
+    uint64_t spill_offset;
+  };
+
+  struct Series
+  {
+    std::string name;
+    uint64_t num_samples = 0;
+    uint64_t last_us = 0;
+    std::vector<ChunkInfo> chunks;
+
+    // Levels above `kChunkLevel`, lowest first.
+    std::vector<std::vector<Bucket>> upper_levels;
+  };
+
+  struct ChunkRef
+  {
+    uint32_t series;
+    uint32_t chunk;
+  };
+
+  static size_t bucketOffset(size_t level);
+
+  static Bucket merge(const Bucket& a, const Bucket& b);
+
+  const Chunk& chunk(const Series& series, size_t index) const;
+  const Bucket& bucket(const Series& series, size_t level, uint64_t index) const;
+  size_t topLevel(const Series& series) const { return kChunkLevel + series.upper_levels.size(); }
+
+  uint64_t timestamp(const Series& series, uint64_t sample) const;
+
+  // Index of the first sample at or after `timestamp_us`.
+  uint64_t lowerBound(const Series& series, uint64_t timestamp_us) const;
+
+  Aggregate aggregate(const Series& series, uint64_t begin, uint64_t end) const;
+
+  // Fill in the summaries completed by the sample just appended.
+  void completeBuckets(Series* series);
+
+  // Get a free pool block, spilling the oldest full resident chunk if there is none.
+  bool acquireBlock(uint32_t* block);
+  bool spillOldest();
+  bool growSpillFile(uint64_t min_size);
+
+  Config config_;
+  std::vector<Chunk> pool_;
+  std::vector<uint32_t> free_blocks_;
+
+  // Full chunks still in memory, oldest first, as a ring over `max_resident_chunks` entries.
+  std::vector<ChunkRef> sealed_;
+  size_t sealed_head_;
+  size_t sealed_count_;
+
+  std::vector<Series> series_;
+
+  int spill_fd_;
+  uint8_t* spill_map_;
+  uint64_t spill_capacity_;
+  uint64_t spill_size_;
+
+  Statistics statistics_;
+};
+
+}  // namespace cantaloupe
+
+#endif  // ifndef TIME_SERIES_STORE_H_
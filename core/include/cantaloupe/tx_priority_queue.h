@@ -0,0 +1,170 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#ifndef TX_PRIORITY_QUEUE_H_
+#define TX_PRIORITY_QUEUE_H_
+
+#include <cantaloupe/can_frame.h>
+#include <cantaloupe/can_transport.h>
+#include <cantaloupe/clock.h>
+#include <cantaloupe/pool.h>
+#include <cantaloupe/thread_config.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cantaloupe
+{
+
+// Bounded transmit queue that hands frames to the transport in the order the bus would arbitrate them: lowest
+// identifier first, standard before extended for the same base identifier, data before remote.  Frames with the same
+// identifier keep their submission order.  A single drain thread feeds the transport one frame at a time, so a
+// high-priority frame never waits behind more than the one frame already on its way out.
+class TxPriorityQueue
+{
+ public:
+  // What ultimately happened to a frame.
+  enum class Result
+  {
+    TRANSMITTED,
+    FAILED,  // The transport refused it.
+    EXPIRED,  // Its deadline passed while it was queued.
+    EVICTED,  // Pushed out of a full queue by a higher-priority asynchronous submission.
+    ABORTED  // Still queued when the queue was cleared or destroyed.
+  };
+
+  // Reports the fate of an asynchronously submitted frame along with how long it sat in the queue.  Runs on the drain
+  // thread (or the submitting thread for eviction), so keep it short.
+  using CompletionCallback = std::function<void(const CanFrame& frame, Result result, uint64_t queueing_delay_us)>;
+
+  static constexpr size_t kDefaultCapacity = 256;
+
+  // Timeout handed to the transport for each frame.
+  static constexpr uint32_t kTransmitTimeoutMs = 100;
+
+  struct Statistics
+  {
+    uint64_t enqueued = 0;
+    uint64_t transmitted = 0;
+    uint64_t failed = 0;
+    uint64_t expired = 0;
+    uint64_t evicted = 0;
+    uint64_t aborted = 0;
+
+    // Submissions turned away because the queue was full or the deadline had already passed.
+    uint64_t rejected = 0;
+
+    size_t high_water_mark = 0;
+
+    // Time from submission until the frame was handed to the transport.
+    uint64_t max_queueing_delay_us = 0;
+    uint64_t total_queueing_delay_us = 0;
+  };
+
+  // The clock defaults to `SteadyClock`.  Deadlines are absolute times on this clock, and zero means "no deadline".
+  explicit TxPriorityQueue(CanTransport* transport, size_t capacity = kDefaultCapacity, const Clock* clock = nullptr);
+  ~TxPriorityQueue();
+
+  TxPriorityQueue(const TxPriorityQueue&) = delete;
+  TxPriorityQueue& operator=(const TxPriorityQueue&) = delete;
+
+  // Block until there is room (or `timeout_ms` passes, zero meaning forever) and queue the frame.
+  bool push(const CanFrame& frame, uint64_t deadline_us = 0, uint32_t timeout_ms = 0);
+
+  // Queue the frame if there is room right now, otherwise fail immediately.
+  bool tryPush(const CanFrame& frame, uint64_t deadline_us = 0);
+
+  // Never blocks.  If the queue is full and the frame outranks the lowest-priority frame queued, that frame is evicted
+  // to make room; otherwise the submission is rejected.  `callback` (which may be empty) is told the outcome once the
+  // frame leaves the queue.  Returns false if the frame was rejected, in which case the callback is not called.
+  bool pushAsync(const CanFrame& frame, CompletionCallback callback, uint64_t deadline_us = 0);
+
+  // Take the highest-priority frame that has not expired and hand it to the transport, waiting up to `timeout_ms` for
+  // one to arrive (zero meaning don't wait).  This is what the drain thread runs; call it directly to drive the queue
+  // without a thread.  Returns false if nothing was sent.
+  bool drainOne(uint32_t timeout_ms = 0);
+
+  // Drop everything still queued.
+  void clear();
+
+  // Spawn / stop the drain thread, set up as `thread_config` says.
+  bool start(const ThreadConfig& thread_config = ThreadConfig());
+  void stop();
+
+  size_t size() const;
+  Statistics getStatistics() const;
+
+  // Sort key reproducing CAN bus arbitration: the smaller key wins.
+  static uint32_t arbitrationKey(const CanFrame& frame);
+
+ private:
+  struct Node
+  {
+    CanFrame frame;
+    uint64_t deadline_us = 0;
+    uint64_t enqueue_us = 0;
+    CompletionCallback callback;
+  };
+
+  struct HeapItem
+  {
+    uint32_t key;
+    uint64_t sequence;
+    uint32_t node;
+  };
+
+  // Ordering of the heap: does `lhs` leave the queue before `rhs`?
+  static bool before(const HeapItem& lhs, const HeapItem& rhs)
+  {
+    return (lhs.key < rhs.key) || ((lhs.key == rhs.key) && (lhs.sequence < rhs.sequence));
+  }
+
+  // Caller holds `mutex_` and has checked there is room.
+  void insertLocked(const CanFrame& frame, uint64_t deadline_us, uint64_t now_us, CompletionCallback callback);
+
+  // Remove the heap item at `position` and return its node index.  Caller holds `mutex_`.
+  uint32_t removeAt(size_t position);
+
+  void siftUp(size_t position);
+  void siftDown(size_t position);
+
+  // Drain thread body.
+  void drainThread();
+
+  CanTransport* transport_;
+  const Clock* clock_;
+  size_t capacity_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+
+  // Preallocated frame storage and the binary min-heap that orders it.
+  Pool<Node> nodes_;
+  std::vector<HeapItem> heap_;
+  uint64_t next_sequence_;
+
+  Statistics statistics_;
+
+  ThreadConfig thread_config_;
+  bool thread_shutdown_;
+  std::thread drain_thread_;
+};
+
+}  // namespace cantaloupe
+
+#endif  // ifndef TX_PRIORITY_QUEUE_H_
@@ -0,0 +1,427 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#include <cantaloupe/bit_activity_analyzer.h>
+#include <cantaloupe/can_fd_frame.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace cantaloupe
+{
+
+// Per-nibble and per-byte masks for SWAR arithmetic on the payload word.
+static constexpr uint64_t kNibbleLowBits = 0x1111111111111111;
+static constexpr uint64_t kNibbleHighBits = 0x8888888888888888;
+static constexpr uint64_t kByteLowBits = 0x0101010101010101;
+static constexpr uint64_t kByteHighBits = 0x8080808080808080;
+
+// Lane of the byte-increment counters within `IdState::increments`, next to the nibble lanes at multiples of four.
+static constexpr size_t kByteIncrementLane = 2;
+
+// A nibble or byte counts as a counter if it went up by one in this fraction of transitions; the slack allows for
+// lost frames.
+static constexpr double kCounterMatchRatio = 0.9;
+
+// Bits flipping in this range of transitions look random.
+static constexpr double kRandomRateMin = 0.35;
+static constexpr double kRandomRateMax = 0.65;
+
+// A byte counts as a checksum if every bit changes and at least this many look random.  A CRC over inputs that barely
+// change is linear in them, so one or two of its bits can be noticeably biased.
+static constexpr size_t kChecksumMinRandomBits = 6;
+
+// Within a field that moves in small steps a bit only flips along with the bit below it (as a carry or borrow).  Below
+// this fraction the two bits are taken to belong to different fields.
+static constexpr double kCarryRatio = 0.75;
+
+// Out-of-line definitions for constants that get bound to references (eg by std::min).
+constexpr size_t BitActivityAnalyzer::kDefaultMaxIds;
+constexpr size_t BitActivityAnalyzer::kNumBits;
+constexpr uint64_t BitActivityAnalyzer::kMinFramesForInference;
+constexpr uint32_t BitActivityAnalyzer::kNoState;
+
+// Bits of the payload word covered by the first `dlc` bytes.
+static uint64_t lengthMask(uint8_t dlc)
+{
+  return (dlc >= CanFrame::kDataNumMaxBytes) ? ~uint64_t{0} : ((uint64_t{1} << (8 * dlc)) - 1);
+}
+
+// Load the payload as one word with `data[i]` in byte `i`, whatever the host byte order.
+static uint64_t loadPayload(const CanFrame& frame)
+{
+  uint64_t payload = 0;
+  std::memcpy(&payload, frame.data.data(), sizeof(payload));
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  payload = __builtin_bswap64(payload);
+#endif
+
+  return payload;
+}
+
+// Lowest bit of every nibble (`kNibbleLowBits`) or byte (`kByteLowBits`) in `next` that is one more than the same
+// nibble or byte in `previous`, wrapping around.
+static uint64_t incrementedNibbles(uint64_t previous, uint64_t next)
+{
+  // Add one to every nibble without letting carries cross into the next one.
+  const uint64_t incremented = ((previous & ~kNibbleHighBits) + kNibbleLowBits) ^ (previous & kNibbleHighBits);
+  const uint64_t same = ~(incremented ^ next);
+  return same & (same >> 1) & (same >> 2) & (same >> 3) & kNibbleLowBits;
+}
+
+static uint64_t incrementedBytes(uint64_t previous, uint64_t next)
+{
+  const uint64_t incremented = ((previous & ~kByteHighBits) + kByteLowBits) ^ (previous & kByteHighBits);
+  uint64_t same = ~(incremented ^ next);
+  same &= same >> 4;
+  same &= same >> 2;
+  same &= same >> 1;
+  return same & kByteLowBits;
+}
+
+void BitActivityAnalyzer::SlicedCounter::add(uint64_t bits)
+{
+  // Ripple-carry add of one to every counter under `bits`.  The planes are folded before they can overflow.
+  for (size_t plane = 0; (plane < kNumPlanes) && (bits != 0); ++plane)
+  {
+    const uint64_t carry = planes[plane] & bits;
+    planes[plane] ^= bits;
+    bits = carry;
+  }
+}
+
+void BitActivityAnalyzer::SlicedCounter::fold()
+{
+  for (size_t plane = 0; plane < kNumPlanes; ++plane)
+  {
+    uint64_t bits = planes[plane];
+    while (bits != 0)
+    {
+      totals[static_cast<size_t>(__builtin_ctzll(bits))] += uint64_t{1} << plane;
+      bits &= bits - 1;
+    }
+
+    planes[plane] = 0;
+  }
+}
+
+uint64_t BitActivityAnalyzer::SlicedCounter::count(size_t bit) const
+{
+  uint64_t total = totals[bit];
+  for (size_t plane = 0; plane < kNumPlanes; ++plane)
+  {
+    total += ((planes[plane] >> bit) & 1) << plane;
+  }
+
+  return total;
+}
+
+double BitActivityAnalyzer::Report::toggleRate(size_t bit) const
+{
+  return (frames > 1) ? (static_cast<double>(toggles[bit]) / static_cast<double>(frames - 1)) : 0.0;
+}
+
+BitActivityAnalyzer::BitActivityAnalyzer(size_t max_ids) :
+  max_ids_{std::max<size_t>(max_ids, 1)},
+  states_{},
+  standard_index_(CanFrame::kIdMaskStandard + 1, kNoState),
+  extended_index_{},
+  extended_mask_{0},
+  statistics_{}
+{
+  states_.reserve(max_ids_);
+
+  // Keep the table at most half full so probe sequences stay short.
+  size_t num_slots = 2;
+  while (num_slots < (2 * max_ids_))
+  {
+    num_slots <<= 1;
+  }
+
+  extended_index_.resize(num_slots, ExtendedSlot{0, kNoState});
+  extended_mask_ = num_slots - 1;
+}
+
+BitActivityAnalyzer::IdState* BitActivityAnalyzer::lookup(uint32_t id, bool extended, bool insert)
+{
+  const uint32_t key = id & (extended ? CanFrame::kIdMaskExtended : CanFrame::kIdMaskStandard);
+
+  // The extended index has twice as many slots as there are states, so the probe always ends.
+  ExtendedSlot* extended_slot = nullptr;
+  uint32_t* slot = &standard_index_[key & CanFrame::kIdMaskStandard];
+  if (extended == true)
+  {
+    size_t index = static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> 32) & extended_mask_;
+    while ((extended_index_[index].state != kNoState) && (extended_index_[index].key != key))
+    {
+      index = (index + 1) & extended_mask_;
+    }
+
+    extended_slot = &extended_index_[index];
+    slot = &extended_slot->state;
+  }
+
+  if (*slot != kNoState)
+  {
+    return &states_[*slot];
+  }
+
+  if ((insert == false) || (states_.size() >= max_ids_))
+  {
+    return nullptr;
+  }
+
+  if (extended_slot != nullptr)
+  {
+    extended_slot->key = key;
+  }
+
+  *slot = static_cast<uint32_t>(states_.size());
+  states_.push_back(IdState{});
+
+  IdState& state = states_.back();
+  state.id = key | (extended ? CanFrame::kIdFlagEff : 0);
+  state.extended = extended;
+  return &state;
+}
+
+const BitActivityAnalyzer::IdState* BitActivityAnalyzer::find(uint32_t id, bool extended) const
+{
+  return const_cast<BitActivityAnalyzer*>(this)->lookup(id, extended, false);
+}
+
+void BitActivityAnalyzer::process(const CanFrame& frame)
+{
+  statistics_.frames_in++;
+
+  if ((frame.error_frame == true) || (frame.rtr_frame == true))
+  {
+    statistics_.skipped++;
+    return;
+  }
+
+  IdState* state = lookup(frame.id, frame.eff_frame, true);
+  if (state == nullptr)
+  {
+    statistics_.table_full++;
+    return;
+  }
+
+  const uint8_t dlc = std::min<uint8_t>(frame.dlc, static_cast<uint8_t>(CanFrame::kDataNumMaxBytes));
+  const uint64_t payload = loadPayload(frame) & lengthMask(dlc);
+
+  state->ones.add(payload);
+  if (state->frames > 0)
+  {
+    const uint64_t previous = state->last_payload;
+    const uint64_t toggled = payload ^ previous;
+    state->toggles.add(toggled);
+    state->co_toggles.add(toggled & (toggled >> 1));
+    state->increments.add(incrementedNibbles(previous, payload) |
+      (incrementedBytes(previous, payload) << kByteIncrementLane));
+  }
+
+  state->last_payload = payload;
+  state->max_dlc = std::max(state->max_dlc, dlc);
+  state->frames++;
+
+  if (++state->pending == kPlaneCapacity)
+  {
+    state->ones.fold();
+    state->toggles.fold();
+    state->co_toggles.fold();
+    state->increments.fold();
+    state->pending = 0;
+  }
+}
+
+void BitActivityAnalyzer::process(const CanFrame* frames, size_t num_frames)
+{
+  for (size_t i = 0; i < num_frames; ++i)
+  {
+    process(frames[i]);
+  }
+}
+
+void BitActivityAnalyzer::process(const CanFrameRecordBuffer& records)
+{
+  for (const CanFrameRecordBuffer::RecordView& record : records)
+  {
+    CanFrame frame;
+    if ((record.isFd() == false) && (toCanFrame(record.toCanFdFrame(), &frame) == true))
+    {
+      process(frame);
+    }
+  }
+}
+
+void BitActivityAnalyzer::reset()
+{
+  states_.clear();
+  std::fill(standard_index_.begin(), standard_index_.end(), kNoState);
+  std::fill(extended_index_.begin(), extended_index_.end(), ExtendedSlot{0, kNoState});
+  statistics_ = Statistics{};
+}
+
+std::vector<uint32_t> BitActivityAnalyzer::ids() const
+{
+  std::vector<uint32_t> result;
+  result.reserve(states_.size());
+  for (const IdState& state : states_)
+  {
+    result.push_back(state.id);
+  }
+
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+bool BitActivityAnalyzer::getReport(uint32_t id, Report* report) const
+{
+  const IdState* state = find(id, CanFrame::isExtendedId(id));
+  if (state == nullptr)
+  {
+    return false;
+  }
+
+  report->id = state->id;
+  report->extended = state->extended;
+  report->frames = state->frames;
+  report->max_dlc = state->max_dlc;
+  report->constant_mask = 0;
+
+  for (size_t bit = 0; bit < kNumBits; ++bit)
+  {
+    report->ones[bit] = state->ones.count(bit);
+    report->toggles[bit] = state->toggles.count(bit);
+    report->co_toggles[bit] = state->co_toggles.count(bit);
+
+    if (report->toggles[bit] == 0)
+    {
+      report->constant_mask |= uint64_t{1} << bit;
+    }
+  }
+
+  report->fields.clear();
+  if (state->frames >= kMinFramesForInference)
+  {
+    report->fields = inferFields(*report, *state);
+  }
+
+  return true;
+}
+
+std::vector<BitActivityAnalyzer::Field> BitActivityAnalyzer::inferFields(const Report& report, const IdState& state)
+{
+  std::vector<Field> fields;
+  const double transitions = static_cast<double>(report.frames - 1);
+  const size_t num_bits = 8U * state.max_dlc;
+
+  auto is_random = [&](size_t bit) -> bool {
+    const double rate = report.toggleRate(bit);
+    return (rate >= kRandomRateMin) && (rate <= kRandomRateMax);
+  };
+
+  // Bits already explained by a counter or checksum.
+  uint64_t claimed = 0;
+
+  // Byte counters first, since the low nibble of a byte counter counts up too.  Requiring the high nibble to move
+  // keeps a nibble counter next to a constant nibble from passing as a byte counter.
+  for (size_t byte = 0; byte < state.max_dlc; ++byte)
+  {
+    const size_t lane = (8 * byte) + kByteIncrementLane;
+    if ((static_cast<double>(state.increments.count(lane)) >= (kCounterMatchRatio * transitions)) &&
+      (report.toggles[(8 * byte) + 4] > 0))
+    {
+      fields.push_back(Field{static_cast<uint8_t>(8 * byte), 8, FieldKind::COUNTER});
+      claimed |= uint64_t{0xFF} << (8 * byte);
+    }
+  }
+
+  for (size_t nibble = 0; nibble < (2U * state.max_dlc); ++nibble)
+  {
+    const size_t lane = 4 * nibble;
+    if (((claimed >> lane) & 1) == 0 &&
+      (static_cast<double>(state.increments.count(lane)) >= (kCounterMatchRatio * transitions)))
+    {
+      fields.push_back(Field{static_cast<uint8_t>(lane), 4, FieldKind::COUNTER});
+      claimed |= uint64_t{0xF} << lane;
+    }
+  }
+
+  for (size_t byte = 0; byte < state.max_dlc; ++byte)
+  {
+    if (((claimed >> (8 * byte)) & 0xFF) != 0)
+    {
+      continue;
+    }
+
+    size_t num_random = 0;
+    bool all_change = true;
+    for (size_t bit = 8 * byte; bit < (8 * byte) + 8; ++bit)
+    {
+      num_random += (is_random(bit) == true) ? 1 : 0;
+      all_change = all_change && (report.toggles[bit] > 0);
+    }
+
+    if ((all_change == true) && (num_random >= kChecksumMinRandomBits))
+    {
+      fields.push_back(Field{static_cast<uint8_t>(8 * byte), 8, FieldKind::CHECKSUM});
+      claimed |= uint64_t{0xFF} << (8 * byte);
+    }
+  }
+
+  // Split what is left into runs of changing bits, cutting a run wherever a bit flips without the bit below it.
+  size_t start = num_bits;
+  auto close_run = [&](size_t end) {
+    if (start < end)
+    {
+      const uint8_t length = static_cast<uint8_t>(end - start);
+      fields.push_back(Field{static_cast<uint8_t>(start), length, (length == 1) ? FieldKind::FLAG : FieldKind::SIGNAL});
+    }
+
+    start = num_bits;
+  };
+
+  for (size_t bit = 0; bit < num_bits; ++bit)
+  {
+    const bool active = (((claimed >> bit) & 1) == 0) && (report.toggles[bit] > 0);
+    if (active == false)
+    {
+      close_run(bit);
+      continue;
+    }
+
+    if (start < bit)
+    {
+      // Bits that both look random cannot be told apart this way, so keep them together.
+      const double carry = static_cast<double>(report.co_toggles[bit - 1]) / static_cast<double>(report.toggles[bit]);
+      if ((carry < kCarryRatio) && ((is_random(bit - 1) == false) || (is_random(bit) == false)))
+      {
+        close_run(bit);
+      }
+    }
+
+    if (start == num_bits)
+    {
+      start = bit;
+    }
+  }
+
+  close_run(num_bits);
+
+  std::sort(fields.begin(), fields.end(), [](const Field& a, const Field& b) { return a.start_bit < b.start_bit; });
+  return fields;
+}
+
+}  // namespace cantaloupe
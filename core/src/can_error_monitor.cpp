@@ -0,0 +1,323 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#include <cantaloupe/can_error_monitor.h>
+#include <cantaloupe/log.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace cantaloupe
+{
+
+static const char* const kStateNames[kNumCanBusStates] = {
+  "error_active",
+  "error_warning",
+  "error_passive",
+  "bus_off",
+};
+
+static const char* const kErrorKindNames[kNumCanErrorKinds] = {
+  "no_ack",
+  "bit",
+  "stuff",
+  "form",
+  "crc",
+  "other_protocol",
+  "lost_arbitration",
+  "tx_timeout",
+  "overflow",
+  "transceiver",
+  "bus_off",
+  "restarted",
+};
+
+bool CanErrorFrame::decode(const CanFrame& frame, CanErrorFrame* error)
+{
+  if (frame.error_frame == false)
+  {
+    return false;
+  }
+
+  // Drivers always send the full eight bytes, zeroing whatever a class does not use.
+  error->classes = frame.id & CanFrame::kIdMaskExtended;
+  error->lost_arbitration_bit = frame.data[0];
+  error->controller = frame.data[1];
+  error->protocol = frame.data[2];
+  error->location = frame.data[3];
+  error->transceiver = frame.data[4];
+  error->tx_error_count = frame.data[6];
+  error->rx_error_count = frame.data[7];
+
+  return true;
+}
+
+CanErrorMonitor::CanErrorMonitor(SummaryHandler handler, uint64_t interval_us, const Clock* clock) :
+  handler_{std::move(handler)},
+  interval_us_{interval_us},
+  clock_{(clock != nullptr) ? clock : &SteadyClock::instance()},
+  state_{CanBusState::ERROR_ACTIVE},
+  interval_open_{false},
+  summary_{},
+  statistics_{}
+{
+}
+
+bool CanErrorMonitor::processFrame(const CanFrame& frame)
+{
+  CanErrorFrame error;
+  if (CanErrorFrame::decode(frame, &error) == false)
+  {
+    // Only look at the clock for ordinary frames while there is something to report.
+    if ((interval_open_ == false) && (getState() != CanBusState::BUS_OFF))
+    {
+      return false;
+    }
+
+    const uint64_t now_us = clock_->nowUs();
+    closeIntervalIfDue(now_us);
+
+    // A controller that is off the bus can neither receive nor transmit, so any traffic at all means it has recovered,
+    // whether or not it said so.
+    if (getState() == CanBusState::BUS_OFF)
+    {
+      changeState(CanBusState::ERROR_ACTIVE, now_us);
+    }
+
+    return false;
+  }
+
+  const uint64_t now_us = clock_->nowUs();
+  closeIntervalIfDue(now_us);
+  openInterval(now_us);
+
+  statistics_.error_frames++;
+  summary_.error_frames++;
+
+  // Tally what went wrong.  Controllers disagree on how to report a missing acknowledgement, so take either form.
+  const bool protocol_error = (error.classes & (CanErrorFrame::kClassProtocol | CanErrorFrame::kClassBusError)) != 0;
+  bool specific_error = false;
+
+  if (((error.classes & CanErrorFrame::kClassNoAck) != 0) || ((protocol_error == true) &&
+    ((error.location == CanErrorFrame::kLocationAckSlot) || (error.location == CanErrorFrame::kLocationAckDelimiter))))
+  {
+    count(CanErrorKind::NO_ACK);
+    specific_error = true;
+  }
+
+  if (protocol_error == true)
+  {
+    if ((error.protocol & (CanErrorFrame::kProtocolBit | CanErrorFrame::kProtocolBit0 |
+      CanErrorFrame::kProtocolBit1)) != 0)
+    {
+      count(CanErrorKind::BIT);
+      specific_error = true;
+    }
+
+    if ((error.protocol & CanErrorFrame::kProtocolStuff) != 0)
+    {
+      count(CanErrorKind::STUFF);
+      specific_error = true;
+    }
+
+    if ((error.protocol & CanErrorFrame::kProtocolForm) != 0)
+    {
+      count(CanErrorKind::FORM);
+      specific_error = true;
+    }
+
+    if ((error.location == CanErrorFrame::kLocationCrcSequence) ||
+      (error.location == CanErrorFrame::kLocationCrcDelimiter))
+    {
+      count(CanErrorKind::CRC);
+      specific_error = true;
+    }
+
+    if (specific_error == false)
+    {
+      count(CanErrorKind::OTHER_PROTOCOL);
+    }
+  }
+
+  if ((error.classes & CanErrorFrame::kClassLostArbitration) != 0)
+  {
+    count(CanErrorKind::LOST_ARBITRATION);
+  }
+
+  if ((error.classes & CanErrorFrame::kClassTxTimeout) != 0)
+  {
+    count(CanErrorKind::TX_TIMEOUT);
+  }
+
+  if (((error.classes & CanErrorFrame::kClassController) != 0) && ((error.controller &
+    (CanErrorFrame::kControllerRxOverflow | CanErrorFrame::kControllerTxOverflow)) != 0))
+  {
+    count(CanErrorKind::OVERFLOW);
+  }
+
+  if ((error.classes & CanErrorFrame::kClassTransceiver) != 0)
+  {
+    count(CanErrorKind::TRANSCEIVER);
+  }
+
+  if ((error.classes & CanErrorFrame::kClassBusOff) != 0)
+  {
+    count(CanErrorKind::BUS_OFF);
+  }
+
+  if ((error.classes & CanErrorFrame::kClassRestarted) != 0)
+  {
+    count(CanErrorKind::RESTARTED);
+  }
+
+  if (error.hasCounters() == true)
+  {
+    summary_.tx_error_count = error.tx_error_count;
+    summary_.rx_error_count = error.rx_error_count;
+    summary_.peak_tx_error_count = std::max(summary_.peak_tx_error_count, error.tx_error_count);
+    summary_.peak_rx_error_count = std::max(summary_.peak_rx_error_count, error.rx_error_count);
+  }
+
+  const CanBusState next_state = nextState(error);
+  if (next_state != getState())
+  {
+    changeState(next_state, now_us);
+  }
+
+  return true;
+}
+
+void CanErrorMonitor::poll()
+{
+  if (interval_open_ == true)
+  {
+    closeIntervalIfDue(clock_->nowUs());
+  }
+}
+
+const char* CanErrorMonitor::stateName(CanBusState state)
+{
+  return kStateNames[static_cast<size_t>(state)];
+}
+
+const char* CanErrorMonitor::errorKindName(CanErrorKind kind)
+{
+  return kErrorKindNames[static_cast<size_t>(kind)];
+}
+
+CanBusState CanErrorMonitor::stateFromCounters(uint8_t tx_error_count, uint8_t rx_error_count)
+{
+  const uint8_t worst_count = std::max(tx_error_count, rx_error_count);
+
+  if (worst_count >= kPassiveErrorCount)
+  {
+    return CanBusState::ERROR_PASSIVE;
+  }
+
+  if (worst_count >= kWarningErrorCount)
+  {
+    return CanBusState::ERROR_WARNING;
+  }
+
+  return CanBusState::ERROR_ACTIVE;
+}
+
+void CanErrorMonitor::openInterval(uint64_t now_us)
+{
+  if (interval_open_ == true)
+  {
+    return;
+  }
+
+  summary_ = Summary();
+  summary_.begin_us = now_us;
+  summary_.begin_state = getState();
+  summary_.worst_state = summary_.begin_state;
+  interval_open_ = true;
+}
+
+void CanErrorMonitor::closeIntervalIfDue(uint64_t now_us)
+{
+  if ((interval_open_ == false) || ((now_us - summary_.begin_us) < interval_us_))
+  {
+    return;
+  }
+
+  summary_.end_us = summary_.begin_us + interval_us_;
+  summary_.end_state = getState();
+  interval_open_ = false;
+  statistics_.summaries++;
+
+  if (handler_)
+  {
+    handler_(summary_);
+  }
+}
+
+void CanErrorMonitor::changeState(CanBusState state, uint64_t now_us)
+{
+  openInterval(now_us);
+
+  CANTALOUPE_DEBUG("CAN bus state {} -> {}.", stateName(getState()), stateName(state));
+  state_.store(state, std::memory_order_relaxed);
+
+  summary_.state_changes++;
+  summary_.worst_state = std::max(summary_.worst_state, state);
+  statistics_.state_changes++;
+
+  if (state == CanBusState::BUS_OFF)
+  {
+    statistics_.bus_off_events++;
+  }
+}
+
+CanBusState CanErrorMonitor::nextState(const CanErrorFrame& error) const
+{
+  if ((error.classes & CanErrorFrame::kClassBusOff) != 0)
+  {
+    return CanBusState::BUS_OFF;
+  }
+
+  if ((error.classes & CanErrorFrame::kClassRestarted) != 0)
+  {
+    return CanBusState::ERROR_ACTIVE;
+  }
+
+  // The controller's own account of its state wins.  It reports a transition by the bits of the state it moved to.
+  if ((error.classes & CanErrorFrame::kClassController) != 0)
+  {
+    if ((error.controller & (CanErrorFrame::kControllerRxPassive | CanErrorFrame::kControllerTxPassive)) != 0)
+    {
+      return CanBusState::ERROR_PASSIVE;
+    }
+
+    if ((error.controller & (CanErrorFrame::kControllerRxWarning | CanErrorFrame::kControllerTxWarning)) != 0)
+    {
+      return CanBusState::ERROR_WARNING;
+    }
+
+    if ((error.controller & CanErrorFrame::kControllerActive) != 0)
+    {
+      return CanBusState::ERROR_ACTIVE;
+    }
+  }
+
+  // Otherwise go by the counters.  Controllers clear them on bus off, so they say nothing about leaving it.
+  if ((error.hasCounters() == true) && (getState() != CanBusState::BUS_OFF))
+  {
+    return stateFromCounters(error.tx_error_count, error.rx_error_count);
+  }
+
+  return getState();
+}
+
+}  // namespace cantaloupe
@@ -0,0 +1,86 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#include <cantaloupe/can_fd_frame.h>
+
+#include <algorithm>
+
+namespace cantaloupe
+{
+
+// Out-of-line definitions for constants that get bound to references (eg by std::min).
+constexpr size_t CanFdFrame::kDataNumMaxBytes;
+
+// Payload length for each DLC code on an FD frame.
+static constexpr uint8_t kFdDlcToLength[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+
+uint8_t canDlcToLength(uint8_t dlc, bool fd_frame)
+{
+  if (fd_frame == false)
+  {
+    return std::min<uint8_t>(dlc, static_cast<uint8_t>(CanFrame::kDataNumMaxBytes));
+  }
+
+  return kFdDlcToLength[dlc & 0x0F];
+}
+
+uint8_t canLengthToDlc(size_t length)
+{
+  for (uint8_t dlc = 0; dlc < 16; ++dlc)
+  {
+    if (kFdDlcToLength[dlc] >= length)
+    {
+      return dlc;
+    }
+  }
+
+  return 15;
+}
+
+uint8_t canFdPaddedLength(size_t length)
+{
+  return kFdDlcToLength[canLengthToDlc(length)];
+}
+
+CanFdFrame toCanFdFrame(const CanFrame& frame)
+{
+  CanFdFrame output;
+  output.id = frame.id;
+  output.length = std::min<uint8_t>(frame.dlc, static_cast<uint8_t>(CanFrame::kDataNumMaxBytes));
+  output.error_frame = frame.error_frame;
+  output.rtr_frame = frame.rtr_frame;
+  output.eff_frame = frame.eff_frame;
+  output.from_tx = frame.from_tx;
+  std::copy_n(frame.data.begin(), output.length, output.data.begin());
+  output.timestamp_us = frame.timestamp_us;
+  return output;
+}
+
+bool toCanFrame(const CanFdFrame& frame, CanFrame* output)
+{
+  if ((frame.fd_frame == true) || (frame.length > CanFrame::kDataNumMaxBytes))
+  {
+    return false;
+  }
+
+  output->id = frame.id;
+  output->dlc = frame.length;
+  output->error_frame = frame.error_frame;
+  output->rtr_frame = frame.rtr_frame;
+  output->eff_frame = frame.eff_frame;
+  output->from_tx = frame.from_tx;
+  std::copy_n(frame.data.begin(), frame.length, output->data.begin());
+  output->timestamp_us = frame.timestamp_us;
+  return true;
+}
+
+}  // namespace cantaloupe
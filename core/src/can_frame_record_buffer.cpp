@@ -0,0 +1,225 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#include <cantaloupe/can_frame_record_buffer.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace cantaloupe
+{
+
+CanFdFrame CanFrameRecordBuffer::RecordView::toCanFdFrame() const
+{
+  // Iterators never hand out a longer record, but a view may have been filled in by hand.
+  const uint8_t length = (header.length < CanFdFrame::kDataNumMaxBytes) ? header.length :
+    static_cast<uint8_t>(CanFdFrame::kDataNumMaxBytes);
+
+  CanFdFrame frame;
+  frame.id = header.id;
+  frame.length = length;
+  frame.error_frame = (header.flags & kFlagError) != 0;
+  frame.rtr_frame = (header.flags & kFlagRtr) != 0;
+  frame.eff_frame = (header.flags & kFlagEff) != 0;
+  frame.from_tx = (header.flags & kFlagFromTx) != 0;
+  frame.fd_frame = (header.flags & kFlagFd) != 0;
+  frame.bit_rate_switch = (header.flags & kFlagBitRateSwitch) != 0;
+  frame.error_state_indicator = (header.flags & kFlagErrorStateIndicator) != 0;
+  std::copy_n(data, length, frame.data.begin());
+  frame.timestamp_us = header.timestamp_us;
+  return frame;
+}
+
+CanFrameRecordBuffer::ConstIterator::ConstIterator(const uint8_t* position, const uint8_t* end) :
+  position_{position},
+  end_{end},
+  view_{}
+{
+  load();
+}
+
+CanFrameRecordBuffer::ConstIterator& CanFrameRecordBuffer::ConstIterator::operator++()
+{
+  position_ += view_.header.record_size;
+  load();
+  return *this;
+}
+
+void CanFrameRecordBuffer::ConstIterator::load()
+{
+  while (position_ < end_)
+  {
+    // Stop at anything that cannot be a whole record, eg the zeroed tail of a file that was not closed cleanly.
+    if (static_cast<size_t>(end_ - position_) < sizeof(RecordHeader))
+    {
+      break;
+    }
+
+    std::memcpy(&view_.header, position_, sizeof(view_.header));
+    if ((view_.header.record_size < sizeof(RecordHeader)) ||
+      (view_.header.record_size > static_cast<size_t>(end_ - position_)))
+    {
+      break;
+    }
+
+    if ((view_.header.flags & kFlagPadding) == 0)
+    {
+      // Nor can a payload longer than any frame's, or than the record claiming to hold it.
+      if ((view_.header.length > CanFdFrame::kDataNumMaxBytes) ||
+        (recordSize(view_.header.length) > view_.header.record_size))
+      {
+        break;
+      }
+
+      view_.data = position_ + sizeof(RecordHeader);
+      return;
+    }
+
+    position_ += view_.header.record_size;
+  }
+
+  position_ = end_;
+}
+
+CanFrameRecordBuffer::CanFrameRecordBuffer(size_t capacity_bytes) :
+  storage_(capacity_bytes),
+  bytes_used_{0},
+  num_records_{0}
+{
+}
+
+size_t CanFrameRecordBuffer::recordSize(size_t length)
+{
+  return sizeof(RecordHeader) + ((length + kRecordAlignment - 1) & ~(kRecordAlignment - 1));
+}
+
+CanFrameRecordBuffer::RecordHeader CanFrameRecordBuffer::makeHeader(const CanFrame& frame)
+{
+  RecordHeader header{};
+  header.id = frame.id;
+  header.timestamp_us = frame.timestamp_us;
+  header.length = std::min<uint8_t>(frame.dlc, static_cast<uint8_t>(CanFrame::kDataNumMaxBytes));
+  header.flags = static_cast<uint8_t>(((frame.error_frame == true) ? kFlagError : 0) |
+    ((frame.rtr_frame == true) ? kFlagRtr : 0) | ((frame.eff_frame == true) ? kFlagEff : 0) |
+    ((frame.from_tx == true) ? kFlagFromTx : 0));
+  return header;
+}
+
+CanFrameRecordBuffer::RecordHeader CanFrameRecordBuffer::makeHeader(const CanFdFrame& frame)
+{
+  RecordHeader header{};
+  header.id = frame.id;
+  header.timestamp_us = frame.timestamp_us;
+  header.length = std::min<uint8_t>(frame.length, static_cast<uint8_t>(CanFdFrame::kDataNumMaxBytes));
+  header.flags = static_cast<uint8_t>(((frame.error_frame == true) ? kFlagError : 0) |
+    ((frame.rtr_frame == true) ? kFlagRtr : 0) | ((frame.eff_frame == true) ? kFlagEff : 0) |
+    ((frame.from_tx == true) ? kFlagFromTx : 0) | ((frame.fd_frame == true) ? kFlagFd : 0) |
+    ((frame.bit_rate_switch == true) ? kFlagBitRateSwitch : 0) |
+    ((frame.error_state_indicator == true) ? kFlagErrorStateIndicator : 0));
+  return header;
+}
+
+size_t CanFrameRecordBuffer::encodeRecord(const RecordHeader& header, const uint8_t* payload, uint8_t* destination,
+  size_t capacity)
+{
+  const size_t record_size = recordSize(header.length);
+  if (record_size > capacity)
+  {
+    return 0;
+  }
+
+  RecordHeader stored = header;
+  stored.record_size = static_cast<uint16_t>(record_size);
+
+  std::memcpy(destination, &stored, sizeof(stored));
+  std::memcpy(destination + sizeof(stored), payload, header.length);
+
+  // Zero the padding so records can be written out verbatim.
+  std::memset(destination + sizeof(stored) + header.length, 0, record_size - sizeof(stored) - header.length);
+  return record_size;
+}
+
+size_t CanFrameRecordBuffer::encode(const CanFrame& frame, uint8_t* destination, size_t capacity)
+{
+  return encodeRecord(makeHeader(frame), frame.data.data(), destination, capacity);
+}
+
+size_t CanFrameRecordBuffer::encode(const CanFdFrame& frame, uint8_t* destination, size_t capacity)
+{
+  return encodeRecord(makeHeader(frame), frame.data.data(), destination, capacity);
+}
+
+void CanFrameRecordBuffer::encodePadding(uint8_t* destination, size_t num_bytes)
+{
+  std::memset(destination, 0, num_bytes);
+
+  // A single record can only describe 64k, so pad with as many as it takes.
+  while (num_bytes > 0)
+  {
+    size_t chunk = std::min<size_t>(num_bytes, 0x10000 - kRecordAlignment);
+    if ((num_bytes - chunk > 0) && (num_bytes - chunk < sizeof(RecordHeader)))
+    {
+      // Leave enough behind for the next header.
+      chunk -= 4 * kRecordAlignment;
+    }
+
+    RecordHeader header{};
+    header.flags = kFlagPadding;
+    header.record_size = static_cast<uint16_t>(chunk);
+    std::memcpy(destination, &header, sizeof(header));
+
+    destination += chunk;
+    num_bytes -= chunk;
+  }
+}
+
+bool CanFrameRecordBuffer::append(const CanFrame& frame)
+{
+  return appendRecord(makeHeader(frame), frame.data.data());
+}
+
+bool CanFrameRecordBuffer::append(const CanFdFrame& frame)
+{
+  return appendRecord(makeHeader(frame), frame.data.data());
+}
+
+bool CanFrameRecordBuffer::appendRecord(const RecordHeader& header, const uint8_t* payload)
+{
+  const size_t record_size = encodeRecord(header, payload, storage_.data() + bytes_used_,
+    storage_.size() - bytes_used_);
+  if (record_size == 0)
+  {
+    return false;
+  }
+
+  bytes_used_ += record_size;
+  num_records_++;
+  return true;
+}
+
+void CanFrameRecordBuffer::clear()
+{
+  bytes_used_ = 0;
+  num_records_ = 0;
+}
+
+CanFrameRecordBuffer::ConstIterator CanFrameRecordBuffer::begin() const
+{
+  return ConstIterator(storage_.data(), storage_.data() + bytes_used_);
+}
+
+CanFrameRecordBuffer::ConstIterator CanFrameRecordBuffer::end() const
+{
+  return ConstIterator(storage_.data() + bytes_used_, storage_.data() + bytes_used_);
+}
+
+}  // namespace cantaloupe
@@ -0,0 +1,383 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#include <cantaloupe/can_gateway.h>
+#include <cantaloupe/log.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+namespace cantaloupe
+{
+
+// Every flag bit above the identifier in the raw `CanFrame::id`.
+static constexpr uint32_t kCanIdFlagBits = ~CanFrame::kIdMaskExtended;
+
+// Out-of-line definitions for constants that get bound to references (eg by std::min).
+constexpr uint32_t RoutingTable::kKeepId;
+constexpr uint32_t RoutingTable::kDefaultRoute;
+constexpr size_t CanGateway::kDefaultBatchSize;
+constexpr uint32_t CanGateway::kDefaultPollTimeoutMs;
+constexpr uint32_t CanGateway::kDefaultWriteTimeoutMs;
+
+// True if `id` is an identifier, optionally with the EFF flag, and no other flag bits.
+static bool isValidId(uint32_t id)
+{
+  return (id & kCanIdFlagBits & ~CanFrame::kIdFlagEff) == 0;
+}
+
+// Add to a counter only one thread updates.
+static void bump(std::atomic<uint64_t>* counter, uint64_t amount)
+{
+  counter->store(counter->load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+RoutingTable::Rule RoutingTable::Rule::drop(uint32_t id)
+{
+  Rule rule;
+  rule.id = id;
+  rule.action = Action::DROP;
+  return rule;
+}
+
+RoutingTable::Rule RoutingTable::Rule::forward(uint32_t id)
+{
+  Rule rule;
+  rule.id = id;
+  return rule;
+}
+
+RoutingTable::Rule RoutingTable::Rule::remap(uint32_t id, uint32_t new_id)
+{
+  Rule rule;
+  rule.id = id;
+  rule.new_id = new_id;
+  return rule;
+}
+
+RoutingTable::Rule RoutingTable::Rule::patch(uint32_t id, uint64_t patch_mask, uint64_t patch_bits)
+{
+  Rule rule;
+  rule.id = id;
+  rule.patch_mask = patch_mask;
+  rule.patch_bits = patch_bits;
+  return rule;
+}
+
+RoutingTable::RoutingTable(Action default_action) :
+  routes_{},
+  standard_routes_(CanFrame::kIdMaskStandard + 1, kDefaultRoute),
+  extended_routes_{}
+{
+  routes_.push_back(Route{});
+  setDefaultAction(default_action);
+}
+
+RoutingTable::RoutingTable() :
+  RoutingTable(Action::FORWARD)
+{
+}
+
+RoutingTable::Route RoutingTable::compile(const Rule& rule)
+{
+  Route route{};
+  if (rule.action == Action::DROP)
+  {
+    return route;
+  }
+
+  route.flags = kRouteForward;
+  if (rule.new_id != kKeepId)
+  {
+    const bool extended = CanFrame::isExtendedId(rule.new_id);
+    route.flags |= kRouteRemap | (extended ? kRouteExtended : 0);
+    route.id = rule.new_id & (extended ? CanFrame::kIdMaskExtended : CanFrame::kIdMaskStandard);
+  }
+
+  if (rule.patch_mask != 0)
+  {
+    route.flags |= kRoutePatch;
+    route.patch_mask = rule.patch_mask;
+    route.patch_bits = rule.patch_bits & rule.patch_mask;
+  }
+
+  return route;
+}
+
+bool RoutingTable::addRule(const Rule& rule)
+{
+  if ((isValidId(rule.id) == false) || ((rule.new_id != kKeepId) && (isValidId(rule.new_id) == false)))
+  {
+    CANTALOUPE_ERROR("Invalid identifier in routing rule for 0x{:X}.", rule.id);
+    return false;
+  }
+
+  const bool extended = CanFrame::isExtendedId(rule.id);
+  const uint32_t key = rule.id & (extended ? CanFrame::kIdMaskExtended : CanFrame::kIdMaskStandard);
+  const Route route = compile(rule);
+
+  // Replace the identifier's existing route if it has one.
+  const uint32_t existing = findRoute(key, extended);
+  if (existing != kDefaultRoute)
+  {
+    routes_[existing] = route;
+    return true;
+  }
+
+  const uint32_t route_index = static_cast<uint32_t>(routes_.size());
+  routes_.push_back(route);
+
+  if (extended == false)
+  {
+    standard_routes_[key] = route_index;
+  }
+  else
+  {
+    const auto position = std::lower_bound(extended_routes_.begin(), extended_routes_.end(),
+      std::make_pair(key, uint32_t{0}));
+    extended_routes_.insert(position, std::make_pair(key, route_index));
+  }
+
+  return true;
+}
+
+void RoutingTable::setDefaultAction(Action action)
+{
+  Route route{};
+  route.flags = (action == Action::FORWARD) ? kRouteForward : 0;
+  routes_[kDefaultRoute] = route;
+}
+
+void RoutingTable::clear()
+{
+  routes_.resize(1);
+  std::fill(standard_routes_.begin(), standard_routes_.end(), kDefaultRoute);
+  extended_routes_.clear();
+}
+
+uint32_t RoutingTable::findRoute(uint32_t id, bool extended) const
+{
+  if (extended == false)
+  {
+    return standard_routes_[id & CanFrame::kIdMaskStandard];
+  }
+
+  const uint32_t key = id & CanFrame::kIdMaskExtended;
+  const auto position = std::lower_bound(extended_routes_.begin(), extended_routes_.end(),
+    std::make_pair(key, uint32_t{0}));
+  if ((position == extended_routes_.end()) || (position->first != key))
+  {
+    return kDefaultRoute;
+  }
+
+  return position->second;
+}
+
+bool RoutingTable::route(const CanFrame& frame, CanFrame* output) const
+{
+  const Route& route = routes_[findRoute(frame.id, frame.eff_frame)];
+  if ((route.flags & kRouteForward) == 0)
+  {
+    return false;
+  }
+
+  // Work on a copy, since `output` may be `frame`.
+  CanFrame result = frame;
+
+  if ((route.flags & kRouteRemap) != 0)
+  {
+    const bool extended = (route.flags & kRouteExtended) != 0;
+    result.id = (frame.id & kCanIdFlagBits & ~CanFrame::kIdFlagEff) | route.id |
+      (extended ? CanFrame::kIdFlagEff : 0);
+    result.eff_frame = extended;
+  }
+
+  if ((route.flags & kRoutePatch) != 0)
+  {
+    // Little-endian word with `data[i]` in byte `i`, whatever the host byte order.
+    uint64_t payload = 0;
+    std::memcpy(&payload, result.data.data(), sizeof(payload));
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    payload = __builtin_bswap64(payload);
+#endif
+
+    payload = (payload & ~route.patch_mask) | route.patch_bits;
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    payload = __builtin_bswap64(payload);
+#endif
+
+    std::memcpy(result.data.data(), &payload, sizeof(payload));
+  }
+
+  *output = result;
+  return true;
+}
+
+size_t RoutingTable::route(const CanFrame* frames, size_t num_frames, CanFrame* output) const
+{
+  size_t num_output = 0;
+  for (size_t i = 0; i < num_frames; ++i)
+  {
+    if (route(frames[i], &output[num_output]) == true)
+    {
+      num_output++;
+    }
+  }
+
+  return num_output;
+}
+
+CanGateway::CanGateway(CanTransport* a, CanTransport* b, const Config& config) :
+  config_{config},
+  lanes_{},
+  thread_shutdown_{false}
+{
+  config_.batch_size = std::max<size_t>(config_.batch_size, 1);
+
+  // A zero timeout would block forever, and the threads would never notice `stop()`.
+  config_.poll_timeout_ms = std::max<uint32_t>(config_.poll_timeout_ms, 1);
+
+  lanes_[index(Direction::A_TO_B)].input = a;
+  lanes_[index(Direction::A_TO_B)].output = b;
+  lanes_[index(Direction::B_TO_A)].input = b;
+  lanes_[index(Direction::B_TO_A)].output = a;
+
+  for (Lane& lane : lanes_)
+  {
+    lane.batch.resize(config_.batch_size);
+  }
+}
+
+CanGateway::CanGateway(CanTransport* a, CanTransport* b) :
+  CanGateway(a, b, Config{})
+{
+}
+
+CanGateway::~CanGateway()
+{
+  stop();
+}
+
+size_t CanGateway::forwardBatch(Direction direction, uint32_t timeout_ms)
+{
+  Lane& lane = lanes_[index(direction)];
+
+  const size_t num_read = lane.input->readCanFrames(lane.batch.data(), lane.batch.size(), timeout_ms);
+  if (num_read == 0)
+  {
+    return 0;
+  }
+
+  // Route in place; survivors are packed at the front of the batch.
+  size_t num_forward = 0;
+  uint64_t echoes = 0;
+  uint64_t error_frames = 0;
+  for (size_t i = 0; i < num_read; ++i)
+  {
+    const CanFrame& frame = lane.batch[i];
+    if (frame.from_tx == true)
+    {
+      echoes++;
+    }
+    else if (frame.error_frame == true)
+    {
+      error_frames++;
+    }
+    else if (lane.routes.route(frame, &lane.batch[num_forward]) == true)
+    {
+      num_forward++;
+    }
+  }
+
+  const size_t num_written = (num_forward > 0) ?
+    lane.output->writeCanFrames(lane.batch.data(), num_forward, config_.write_timeout_ms) : 0;
+
+  bump(&lane.frames_in, num_read);
+  bump(&lane.frames_forwarded, num_written);
+  bump(&lane.frames_filtered, num_read - num_forward - echoes - error_frames);
+  bump(&lane.echoes_dropped, echoes);
+  bump(&lane.error_frames_dropped, error_frames);
+  bump(&lane.write_failures, num_forward - num_written);
+  bump(&lane.batches, 1);
+
+  if (num_read > lane.max_batch.load(std::memory_order_relaxed))
+  {
+    lane.max_batch.store(num_read, std::memory_order_relaxed);
+  }
+
+  return num_written;
+}
+
+bool CanGateway::start()
+{
+  if (isRunning() == true)
+  {
+    return false;
+  }
+
+  thread_shutdown_ = false;
+  lanes_[index(Direction::A_TO_B)].thread = std::thread(std::bind(&CanGateway::forwardThread, this,
+    Direction::A_TO_B));
+  lanes_[index(Direction::B_TO_A)].thread = std::thread(std::bind(&CanGateway::forwardThread, this,
+    Direction::B_TO_A));
+  return true;
+}
+
+void CanGateway::stop()
+{
+  thread_shutdown_ = true;
+  for (Lane& lane : lanes_)
+  {
+    if (lane.thread.joinable() == true)
+    {
+      lane.thread.join();
+    }
+  }
+}
+
+void CanGateway::forwardThread(Direction direction)
+{
+  if (direction == Direction::A_TO_B)
+  {
+    applyThreadConfig(config_.a_to_b_thread_config, "cantaloupe-a2b");
+  }
+  else
+  {
+    applyThreadConfig(config_.b_to_a_thread_config, "cantaloupe-b2a");
+  }
+
+  while (thread_shutdown_ == false)
+  {
+    forwardBatch(direction, config_.poll_timeout_ms);
+  }
+}
+
+CanGateway::Statistics CanGateway::getStatistics(Direction direction) const
+{
+  const Lane& lane = lanes_[index(direction)];
+
+  Statistics statistics;
+  statistics.frames_in = lane.frames_in.load(std::memory_order_relaxed);
+  statistics.frames_forwarded = lane.frames_forwarded.load(std::memory_order_relaxed);
+  statistics.frames_filtered = lane.frames_filtered.load(std::memory_order_relaxed);
+  statistics.echoes_dropped = lane.echoes_dropped.load(std::memory_order_relaxed);
+  statistics.error_frames_dropped = lane.error_frames_dropped.load(std::memory_order_relaxed);
+  statistics.write_failures = lane.write_failures.load(std::memory_order_relaxed);
+  statistics.batches = lane.batches.load(std::memory_order_relaxed);
+  statistics.max_batch = static_cast<size_t>(lane.max_batch.load(std::memory_order_relaxed));
+  return statistics;
+}
+
+}  // namespace cantaloupe
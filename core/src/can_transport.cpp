@@ -0,0 +1,64 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#include <cantaloupe/can_transport.h>
+
+namespace cantaloupe
+{
+
+size_t CanTransport::readCanFrames(CanFrame* frames, size_t max_frames, uint32_t timeout_ms)
+{
+  if ((max_frames == 0) || (readCanFrame(&frames[0], timeout_ms) == false))
+  {
+    return 0;
+  }
+
+  return 1;
+}
+
+size_t CanTransport::writeCanFrames(const CanFrame* frames, size_t num_frames, uint32_t timeout_ms)
+{
+  for (size_t i = 0; i < num_frames; ++i)
+  {
+    if (writeCanFrame(frames[i], timeout_ms) == false)
+    {
+      return i;
+    }
+  }
+
+  return num_frames;
+}
+
+bool CanTransport::writeCanFdFrame(const CanFdFrame& frame, uint32_t timeout_ms)
+{
+  CanFrame classic_frame;
+  if (toCanFrame(frame, &classic_frame) == false)
+  {
+    return false;
+  }
+
+  return writeCanFrame(classic_frame, timeout_ms);
+}
+
+bool CanTransport::readCanFdFrame(CanFdFrame* frame, uint32_t timeout_ms)
+{
+  CanFrame classic_frame;
+  if (readCanFrame(&classic_frame, timeout_ms) == false)
+  {
+    return false;
+  }
+
+  *frame = toCanFdFrame(classic_frame);
+  return true;
+}
+
+}  // namespace cantaloupe
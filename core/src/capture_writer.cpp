@@ -0,0 +1,688 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#include <cantaloupe/can_frame_record_buffer.h>
+#include <cantaloupe/capture_writer.h>
+#include <cantaloupe/log.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef CANTALOUPE_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace cantaloupe
+{
+
+// How long the I/O stage waits for work before checking for shutdown and sync deadlines.
+static constexpr uint32_t kIdleWaitMs = 10;
+
+// Out-of-line definitions for constants that get bound to references (eg by std::min).
+constexpr size_t CaptureWriter::kDefaultBufferSize;
+constexpr size_t CaptureWriter::kDefaultNumBuffers;
+constexpr uint32_t CaptureWriter::kDefaultSyncIntervalMs;
+constexpr size_t CaptureWriter::kBlockSize;
+constexpr char CaptureWriter::kFileMagic[9];
+constexpr uint32_t CaptureWriter::kFileVersion;
+constexpr uint32_t CaptureWriter::kNoBuffer;
+
+static size_t roundUp(size_t value, size_t multiple)
+{
+  return ((value + multiple - 1) / multiple) * multiple;
+}
+
+// Payload bytes a frame's record carries.
+static size_t payloadLength(const CanFrame& frame)
+{
+  return (frame.dlc < CanFrame::kDataNumMaxBytes) ? frame.dlc : CanFrame::kDataNumMaxBytes;
+}
+
+static size_t payloadLength(const CanFdFrame& frame)
+{
+  return (frame.length < CanFdFrame::kDataNumMaxBytes) ? frame.length : CanFdFrame::kDataNumMaxBytes;
+}
+
+void ioUringDeleter::operator()(io_uring* ring) const
+{
+#ifdef CANTALOUPE_HAVE_LIBURING
+  io_uring_queue_exit(ring);
+  delete ring;
+#else
+  static_cast<void>(ring);
+#endif
+}
+
+void alignedBufferDeleter::operator()(uint8_t* buffer) const
+{
+  std::free(buffer);
+}
+
+void CaptureWriter::IndexRing::reset(size_t capacity)
+{
+  slots_.assign(capacity, kNoBuffer);
+  head_.store(0, std::memory_order_relaxed);
+  tail_.store(0, std::memory_order_relaxed);
+}
+
+bool CaptureWriter::IndexRing::push(uint32_t index)
+{
+  const uint64_t head = head_.load(std::memory_order_relaxed);
+  if (head - tail_.load(std::memory_order_acquire) >= slots_.size())
+  {
+    return false;
+  }
+
+  slots_[head % slots_.size()] = index;
+  head_.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+bool CaptureWriter::IndexRing::pop(uint32_t* index)
+{
+  const uint64_t tail = tail_.load(std::memory_order_relaxed);
+  if (tail == head_.load(std::memory_order_acquire))
+  {
+    return false;
+  }
+
+  *index = slots_[tail % slots_.size()];
+  tail_.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+CaptureWriter::CaptureWriter(const Config& config, const Clock* clock) :
+  config_{config},
+  clock_{(clock != nullptr) ? clock : &SteadyClock::instance()},
+  fd_{-1},
+  aligned_writes_{false},
+  storage_{},
+  buffers_{},
+  free_ring_{},
+  full_ring_{},
+  current_{kNoBuffer},
+  next_file_offset_{0},
+  ring_{},
+  last_sync_us_{0},
+  bytes_since_sync_{0},
+  mutex_{},
+  wake_{},
+  thread_shutdown_{false},
+  io_thread_{},
+  frames_written_{0},
+  bytes_encoded_{0},
+  frames_dropped_{0},
+  bytes_dropped_{0},
+  buffers_written_{0},
+  bytes_written_{0},
+  write_errors_{0},
+  syncs_{0},
+  max_write_latency_us_{0}
+{
+  config_.buffer_size = roundUp(std::max(config_.buffer_size, kBlockSize), kBlockSize);
+  config_.num_buffers = std::max<size_t>(config_.num_buffers, 2);
+
+  // Each buffer gets a spare block so padding a full buffer out to the block size always fits.
+  for (size_t i = 0; i < config_.num_buffers; ++i)
+  {
+    void* memory = nullptr;
+    if (posix_memalign(&memory, kBlockSize, config_.buffer_size + kBlockSize) != 0)
+    {
+      throw std::bad_alloc();
+    }
+
+    // Touch every page now, so the first pass through the pool does not take page faults on the writer's thread.
+    std::memset(memory, 0, config_.buffer_size + kBlockSize);
+    storage_.emplace_back(static_cast<uint8_t*>(memory));
+
+    Buffer buffer;
+    buffer.data = storage_.back().get();
+    buffers_.push_back(buffer);
+  }
+}
+
+CaptureWriter::CaptureWriter() :
+  CaptureWriter(Config{})
+{
+}
+
+CaptureWriter::~CaptureWriter()
+{
+  close();
+}
+
+bool CaptureWriter::open(const std::string& path)
+{
+  if (isOpen() == true)
+  {
+    CANTALOUPE_ERROR("Capture file is already open.");
+    return false;
+  }
+
+  const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  aligned_writes_ = false;
+
+#ifdef O_DIRECT
+  if (config_.direct_io == true)
+  {
+    fd_ = ::open(path.c_str(), flags | O_DIRECT, 0644);
+    if (fd_ >= 0)
+    {
+      aligned_writes_ = true;
+    }
+    else
+    {
+      CANTALOUPE_WARN("Direct I/O unavailable for {} ({}); using buffered I/O.", path, std::strerror(errno));
+    }
+  }
+#endif
+
+  if (fd_ < 0)
+  {
+    fd_ = ::open(path.c_str(), flags, 0644);
+  }
+
+  if (fd_ < 0)
+  {
+    CANTALOUPE_ERROR("Failed to open capture file {}: {}", path, std::strerror(errno));
+    return false;
+  }
+
+#if defined(__APPLE__)
+  // macOS has no O_DIRECT; F_NOCACHE keeps the data out of the page cache without any alignment requirements.
+  if ((config_.direct_io == true) && (fcntl(fd_, F_NOCACHE, 1) != 0))
+  {
+    CANTALOUPE_WARN("Failed to disable caching for {}: {}", path, std::strerror(errno));
+  }
+#endif
+
+  free_ring_.reset(buffers_.size());
+  full_ring_.reset(buffers_.size());
+  for (uint32_t i = 0; i < buffers_.size(); ++i)
+  {
+    buffers_[i].used = 0;
+    free_ring_.push(i);
+  }
+
+  current_ = kNoBuffer;
+  next_file_offset_ = 0;
+  last_sync_us_ = clock_->nowUs();
+  bytes_since_sync_ = 0;
+
+  for (std::atomic<uint64_t>* counter : {&frames_written_, &bytes_encoded_, &frames_dropped_, &bytes_dropped_,
+    &buffers_written_, &bytes_written_, &write_errors_, &syncs_, &max_write_latency_us_})
+  {
+    counter->store(0, std::memory_order_relaxed);
+  }
+
+#ifdef CANTALOUPE_HAVE_LIBURING
+  if (config_.use_io_uring == true)
+  {
+    // One entry per buffer plus one for a sync.
+    std::unique_ptr<io_uring> ring(new io_uring);
+    const int result = io_uring_queue_init(static_cast<unsigned>(buffers_.size() + 1), ring.get(), 0);
+    if (result == 0)
+    {
+      ring_.reset(ring.release());
+    }
+    else
+    {
+      CANTALOUPE_INFO("io_uring unavailable ({}); writing captures with pwrite().", std::strerror(-result));
+    }
+  }
+#endif
+
+  // Start the file with its header.
+  acquireBuffer();
+  FileHeader header{};
+  std::memcpy(header.magic, kFileMagic, sizeof(header.magic));
+  header.version = kFileVersion;
+  header.record_header_size = sizeof(CanFrameRecordBuffer::RecordHeader);
+  std::memcpy(buffers_[current_].data, &header, sizeof(header));
+  buffers_[current_].used = sizeof(header);
+
+  thread_shutdown_ = false;
+  io_thread_ = std::thread(std::bind(&CaptureWriter::ioThread, this));
+  return true;
+}
+
+void CaptureWriter::close()
+{
+  if (isOpen() == false)
+  {
+    return;
+  }
+
+  flush();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    thread_shutdown_ = true;
+  }
+
+  wake_.notify_all();
+  if (io_thread_.joinable() == true)
+  {
+    io_thread_.join();
+  }
+
+  ring_.reset();
+  ::close(fd_);
+  fd_ = -1;
+}
+
+bool CaptureWriter::write(const CanFrame& frame)
+{
+  return writeFrame(frame);
+}
+
+bool CaptureWriter::write(const CanFdFrame& frame)
+{
+  return writeFrame(frame);
+}
+
+template<typename Frame>
+bool CaptureWriter::writeFrame(const Frame& frame)
+{
+  if (fd_ < 0)
+  {
+    return false;
+  }
+
+  size_t record_size = 0;
+  if ((current_ != kNoBuffer) || (acquireBuffer() == true))
+  {
+    Buffer& buffer = buffers_[current_];
+    record_size = CanFrameRecordBuffer::encode(frame, buffer.data + buffer.used, config_.buffer_size - buffer.used);
+  }
+
+  // Out of room: pass the buffer on and try again in a fresh one.
+  if ((record_size == 0) && (current_ != kNoBuffer))
+  {
+    submitCurrent();
+    if (acquireBuffer() == true)
+    {
+      Buffer& buffer = buffers_[current_];
+      record_size = CanFrameRecordBuffer::encode(frame, buffer.data + buffer.used, config_.buffer_size - buffer.used);
+    }
+  }
+
+  if (record_size == 0)
+  {
+    bump(&frames_dropped_, 1);
+    bump(&bytes_dropped_, CanFrameRecordBuffer::recordSize(payloadLength(frame)));
+    return false;
+  }
+
+  buffers_[current_].used += record_size;
+  bump(&frames_written_, 1);
+  bump(&bytes_encoded_, record_size);
+  return true;
+}
+
+void CaptureWriter::flush()
+{
+  if ((current_ != kNoBuffer) && (buffers_[current_].used > 0))
+  {
+    submitCurrent();
+  }
+}
+
+bool CaptureWriter::acquireBuffer()
+{
+  if (free_ring_.pop(&current_) == false)
+  {
+    current_ = kNoBuffer;
+    return false;
+  }
+
+  buffers_[current_].used = 0;
+  return true;
+}
+
+void CaptureWriter::submitCurrent()
+{
+  Buffer& buffer = buffers_[current_];
+  size_t length = buffer.used;
+
+  if (aligned_writes_ == true)
+  {
+    // Direct I/O writes whole blocks.  Padding too small for a record header spills into the spare block.
+    size_t padding = roundUp(length, kBlockSize) - length;
+    if ((padding > 0) && (padding < sizeof(CanFrameRecordBuffer::RecordHeader)))
+    {
+      padding += kBlockSize;
+    }
+
+    if (padding > 0)
+    {
+      CanFrameRecordBuffer::encodePadding(buffer.data + length, padding);
+      length += padding;
+    }
+  }
+
+  buffer.file_offset = next_file_offset_;
+  buffer.write_length = length;
+  buffer.written = 0;
+  buffer.submit_us = clock_->nowUs();
+  next_file_offset_ += length;
+
+  // Every buffer is either free, current or full, so this always has room.
+  full_ring_.push(current_);
+  current_ = kNoBuffer;
+
+  // Notifying without the mutex never blocks; a missed wakeup costs at most one idle wait.
+  wake_.notify_one();
+}
+
+void CaptureWriter::ioThread()
+{
+  applyThreadConfig(config_.thread_config, "cantaloupe-io");
+
+  if (ring_ != nullptr)
+  {
+    runIoUring();
+  }
+  else
+  {
+    runPwrite();
+  }
+
+  // Whatever the sync interval, leave the data on disk when closing.
+  syncFile();
+}
+
+void CaptureWriter::runPwrite()
+{
+  while (true)
+  {
+    // Read the flag before draining, so every buffer handed over before shutdown gets written.
+    bool shutdown = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutdown = thread_shutdown_;
+    }
+
+    bool did_work = false;
+    uint32_t index = 0;
+    while (full_ring_.pop(&index) == true)
+    {
+      completeBuffer(index, writeBufferBlocking(&buffers_[index]));
+      did_work = true;
+
+      if (syncDue(clock_->nowUs()) == true)
+      {
+        syncFile();
+      }
+    }
+
+    if (syncDue(clock_->nowUs()) == true)
+    {
+      syncFile();
+    }
+
+    if (shutdown == true)
+    {
+      break;
+    }
+
+    if (did_work == false)
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait_for(lock, std::chrono::milliseconds(kIdleWaitMs));
+    }
+  }
+}
+
+void CaptureWriter::runIoUring()
+{
+#ifdef CANTALOUPE_HAVE_LIBURING
+  io_uring* ring = ring_.get();
+  size_t in_flight = 0;
+  bool sync_in_flight = false;
+
+  // Queue a write of whatever is left of a buffer.  The ring has an entry for every buffer, so this cannot run out.
+  auto queue_write = [&](uint32_t index)
+  {
+    Buffer& buffer = buffers_[index];
+    io_uring_sqe* sqe = io_uring_get_sqe(ring);
+    io_uring_prep_write(sqe, fd_, buffer.data + buffer.written, static_cast<unsigned>(buffer.write_length -
+      buffer.written), buffer.file_offset + buffer.written);
+    io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(static_cast<uintptr_t>(index)));
+    in_flight++;
+  };
+
+  while (true)
+  {
+    bool shutdown = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutdown = thread_shutdown_;
+    }
+
+    bool queued = false;
+    uint32_t index = 0;
+    while (full_ring_.pop(&index) == true)
+    {
+      queue_write(index);
+      queued = true;
+    }
+
+    // The drain flag holds the sync back until every write queued before it has completed.
+    const uint64_t now_us = clock_->nowUs();
+    if ((sync_in_flight == false) && (syncDue(now_us) == true))
+    {
+      io_uring_sqe* sqe = io_uring_get_sqe(ring);
+      io_uring_prep_fsync(sqe, fd_, IORING_FSYNC_DATASYNC);
+      io_uring_sqe_set_flags(sqe, IOSQE_IO_DRAIN);
+      io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(static_cast<uintptr_t>(kNoBuffer)));
+      sync_in_flight = true;
+      in_flight++;
+      queued = true;
+      last_sync_us_ = now_us;
+      bytes_since_sync_ = 0;
+    }
+
+    if (queued == true)
+    {
+      io_uring_submit(ring);
+    }
+
+    if (in_flight == 0)
+    {
+      if (shutdown == true)
+      {
+        break;
+      }
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait_for(lock, std::chrono::milliseconds(kIdleWaitMs));
+      continue;
+    }
+
+    io_uring_cqe* cqe = nullptr;
+    __kernel_timespec timeout{};
+    timeout.tv_nsec = static_cast<long long>(kIdleWaitMs) * 1000 * 1000;
+    if (io_uring_wait_cqe_timeout(ring, &cqe, &timeout) != 0)
+    {
+      continue;
+    }
+
+    bool resubmit = false;
+    while (io_uring_peek_cqe(ring, &cqe) == 0)
+    {
+      const uint32_t completed = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe)));
+      const int result = cqe->res;
+      io_uring_cqe_seen(ring, cqe);
+      in_flight--;
+
+      if (completed == kNoBuffer)
+      {
+        sync_in_flight = false;
+        if (result < 0)
+        {
+          CANTALOUPE_ERROR("Failed to sync capture file: {}", std::strerror(-result));
+        }
+        else
+        {
+          bump(&syncs_, 1);
+        }
+
+        continue;
+      }
+
+      Buffer& buffer = buffers_[completed];
+      if ((result == -EINTR) || (result == -EAGAIN))
+      {
+        queue_write(completed);
+        resubmit = true;
+      }
+      else if (result <= 0)
+      {
+        CANTALOUPE_ERROR("Failed to write capture buffer: {}", (result < 0) ? std::strerror(-result) : "no progress");
+        completeBuffer(completed, false);
+      }
+      else
+      {
+        buffer.written += static_cast<size_t>(result);
+        if (buffer.written < buffer.write_length)
+        {
+          queue_write(completed);
+          resubmit = true;
+        }
+        else
+        {
+          completeBuffer(completed, true);
+        }
+      }
+    }
+
+    if (resubmit == true)
+    {
+      io_uring_submit(ring);
+    }
+  }
+#endif
+}
+
+bool CaptureWriter::writeBufferBlocking(Buffer* buffer)
+{
+  while (buffer->written < buffer->write_length)
+  {
+    const ssize_t result = pwrite(fd_, buffer->data + buffer->written, buffer->write_length - buffer->written,
+      static_cast<off_t>(buffer->file_offset + buffer->written));
+    if (result < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      CANTALOUPE_ERROR("Failed to write capture buffer: {}", std::strerror(errno));
+      return false;
+    }
+
+    if (result == 0)
+    {
+      CANTALOUPE_ERROR("Failed to write capture buffer: no progress");
+      return false;
+    }
+
+    buffer->written += static_cast<size_t>(result);
+  }
+
+  return true;
+}
+
+void CaptureWriter::completeBuffer(uint32_t index, bool success)
+{
+  Buffer& buffer = buffers_[index];
+
+  const uint64_t latency_us = clock_->nowUs() - buffer.submit_us;
+  if (latency_us > max_write_latency_us_.load(std::memory_order_relaxed))
+  {
+    max_write_latency_us_.store(latency_us, std::memory_order_relaxed);
+  }
+
+  if (success == true)
+  {
+    bump(&buffers_written_, 1);
+    bump(&bytes_written_, buffer.write_length);
+    bytes_since_sync_ += buffer.write_length;
+  }
+  else
+  {
+    bump(&write_errors_, 1);
+  }
+
+  buffer.used = 0;
+  free_ring_.push(index);
+}
+
+bool CaptureWriter::syncDue(uint64_t now_us) const
+{
+  return (config_.sync_interval_ms > 0) && (bytes_since_sync_ > 0) &&
+    ((now_us - last_sync_us_) >= (static_cast<uint64_t>(config_.sync_interval_ms) * 1000));
+}
+
+void CaptureWriter::syncFile()
+{
+#if defined(__APPLE__)
+  // No fdatasync on macOS.
+  const int result = fsync(fd_);
+#else
+  const int result = fdatasync(fd_);
+#endif
+
+  if (result != 0)
+  {
+    CANTALOUPE_ERROR("Failed to sync capture file: {}", std::strerror(errno));
+  }
+  else
+  {
+    bump(&syncs_, 1);
+  }
+
+  last_sync_us_ = clock_->nowUs();
+  bytes_since_sync_ = 0;
+}
+
+void CaptureWriter::bump(std::atomic<uint64_t>* counter, uint64_t amount)
+{
+  // Single writer, so a plain load and store is enough and avoids a locked instruction.
+  counter->store(counter->load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+CaptureWriter::Statistics CaptureWriter::getStatistics() const
+{
+  Statistics statistics;
+  statistics.frames_written = frames_written_.load(std::memory_order_relaxed);
+  statistics.bytes_encoded = bytes_encoded_.load(std::memory_order_relaxed);
+  statistics.frames_dropped = frames_dropped_.load(std::memory_order_relaxed);
+  statistics.bytes_dropped = bytes_dropped_.load(std::memory_order_relaxed);
+  statistics.buffers_written = buffers_written_.load(std::memory_order_relaxed);
+  statistics.bytes_written = bytes_written_.load(std::memory_order_relaxed);
+  statistics.write_errors = write_errors_.load(std::memory_order_relaxed);
+  statistics.syncs = syncs_.load(std::memory_order_relaxed);
+  statistics.max_write_latency_us = max_write_latency_us_.load(std::memory_order_relaxed);
+  return statistics;
+}
+
+}  // namespace cantaloupe
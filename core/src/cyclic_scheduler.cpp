@@ -0,0 +1,521 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#include <cantaloupe/cyclic_scheduler.h>
+#include <cantaloupe/log.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <memory>
+
+namespace cantaloupe
+{
+
+// Out-of-line definitions for constants that get bound to references (eg by std::vector).
+constexpr uint32_t CyclicScheduler::kInvalidIndex;
+
+// How long the transmit thread sleeps when there is nothing scheduled at all.  Adding a message wakes it early.
+static constexpr uint32_t kIdleWaitMs = 100;
+
+CyclicScheduler::CyclicScheduler(CanTransport* transport, size_t capacity, uint32_t tick_us, const Clock* clock) :
+  transport_{transport},
+  clock_{(clock != nullptr) ? clock : &SteadyClock::instance()},
+  tick_us_{std::max<uint32_t>(tick_us, 1)},
+  epoch_us_{0},
+  mutex_{},
+  wake_condition_{},
+  entries_(capacity),
+  expiry_ticks_(capacity, 0),
+  slot_heads_(kWheelNumLevels * kWheelNumSlots, kInvalidIndex),
+  level0_occupancy_{},
+  current_tick_{0},
+  num_scheduled_{0},
+  batch_(capacity),
+  batch_hooks_(capacity),
+  num_batched_{0},
+  thread_config_{},
+  thread_shutdown_{false},
+  transmit_thread_{}
+{
+  epoch_us_ = clock_->nowUs();
+}
+
+CyclicScheduler::~CyclicScheduler()
+{
+  stop();
+}
+
+CyclicScheduler::Handle CyclicScheduler::addCyclic(const CanFrame& frame, uint32_t period_us,
+  uint32_t initial_delay_us, TransmitHook hook)
+{
+  if (period_us == 0)
+  {
+    return kInvalidHandle;
+  }
+
+  return addEntry(frame, period_us, initial_delay_us, std::move(hook));
+}
+
+CyclicScheduler::Handle CyclicScheduler::addOneShot(const CanFrame& frame, uint32_t delay_us, TransmitHook hook)
+{
+  return addEntry(frame, 0, delay_us, std::move(hook));
+}
+
+CyclicScheduler::Handle CyclicScheduler::addEntry(const CanFrame& frame, uint32_t period_us, uint32_t delay_us,
+  TransmitHook hook)
+{
+  const uint64_t now_us = clock_->nowUs();
+
+  Handle handle = kInvalidHandle;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const uint32_t index = entries_.acquire();
+    if (index == Pool<Entry>::kInvalidIndex)
+    {
+      CANTALOUPE_WARN("Cyclic scheduler is full ({} messages).", entries_.capacity());
+      return kInvalidHandle;
+    }
+
+    Entry& entry = entries_[index];
+    const uint32_t generation = entry.generation;
+    entry = Entry();
+    entry.in_use = true;
+    entry.generation = generation;
+    entry.frame = frame;
+    entry.hook = hook ? std::make_shared<const TransmitHook>(std::move(hook)) : nullptr;
+    entry.period_us = period_us;
+    entry.due_us = now_us + delay_us;
+
+    insertTimer(index, dueTick(entry.due_us));
+    num_scheduled_++;
+
+    handle = (static_cast<Handle>(generation) << 32) | index;
+  }
+
+  wake_condition_.notify_one();
+  return handle;
+}
+
+bool CyclicScheduler::remove(Handle handle)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  Entry* entry = lookup(handle);
+  if (entry == nullptr)
+  {
+    return false;
+  }
+
+  const uint32_t index = entries_.indexOf(entry);
+  unlinkTimer(index);
+  releaseEntry(index);
+  return true;
+}
+
+bool CyclicScheduler::updatePayload(Handle handle, const uint8_t* data, uint8_t dlc)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  Entry* entry = lookup(handle);
+  if ((entry == nullptr) || (dlc > CanFrame::kDataNumMaxBytes))
+  {
+    return false;
+  }
+
+  entry->frame.dlc = dlc;
+  std::copy_n(data, dlc, entry->frame.data.begin());
+  return true;
+}
+
+bool CyclicScheduler::getJitterStatistics(Handle handle, JitterStatistics* statistics) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  const Entry* entry = lookup(handle);
+  if ((entry == nullptr) || (statistics == nullptr))
+  {
+    return false;
+  }
+
+  *statistics = JitterStatistics();
+  statistics->num_transmissions = entry->sequence;
+  statistics->max_lateness_us = entry->max_lateness_us;
+
+  if (entry->num_intervals > 0)
+  {
+    const double count = static_cast<double>(entry->num_intervals);
+    const double mean = entry->sum_error_us / count;
+    const double variance = std::max(0.0, (entry->sum_squared_error_us / count) - (mean * mean));
+
+    statistics->min_period_error_us = entry->min_error_us;
+    statistics->max_period_error_us = entry->max_error_us;
+    statistics->mean_period_error_us = mean;
+    statistics->stddev_period_error_us = std::sqrt(variance);
+  }
+
+  return true;
+}
+
+size_t CyclicScheduler::size() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_scheduled_;
+}
+
+CyclicScheduler::Entry* CyclicScheduler::lookup(Handle handle)
+{
+  const uint32_t index = static_cast<uint32_t>(handle & 0xFFFFFFFF);
+  const uint32_t generation = static_cast<uint32_t>(handle >> 32);
+
+  if ((index >= entries_.capacity()) || (entries_[index].in_use == false) ||
+    (entries_[index].generation != generation))
+  {
+    return nullptr;
+  }
+
+  return &entries_[index];
+}
+
+const CyclicScheduler::Entry* CyclicScheduler::lookup(Handle handle) const
+{
+  return const_cast<CyclicScheduler*>(this)->lookup(handle);
+}
+
+uint64_t CyclicScheduler::dueTick(uint64_t due_us) const
+{
+  if (due_us <= epoch_us_)
+  {
+    return 0;
+  }
+
+  // Round up so a frame is never sent before it is due.
+  return (due_us - epoch_us_ + tick_us_ - 1) / tick_us_;
+}
+
+void CyclicScheduler::insertTimer(uint32_t index, uint64_t expiry_tick)
+{
+  // `current_tick_` is the next tick to be processed; anything already overdue goes there.
+  expiry_tick = std::max(expiry_tick, current_tick_);
+  expiry_ticks_[index] = expiry_tick;
+
+  // Pick the lowest level whose range covers the delay.  Timers beyond the top level park in its furthest slot and
+  // get re-filed when they cascade.
+  const uint64_t delta = expiry_tick - current_tick_;
+  size_t level = 0;
+  while ((level < kWheelNumLevels - 1) && (delta >= (static_cast<uint64_t>(1) << (kWheelSlotBits * (level + 1)))))
+  {
+    level++;
+  }
+
+  uint64_t slot_tick = expiry_tick;
+  const uint64_t level_range = static_cast<uint64_t>(1) << (kWheelSlotBits * kWheelNumLevels);
+  if (delta >= level_range)
+  {
+    slot_tick = current_tick_ + level_range - 1;
+  }
+
+  const size_t slot = static_cast<size_t>(slot_tick >> (kWheelSlotBits * level)) & (kWheelNumSlots - 1);
+  const uint32_t bucket = static_cast<uint32_t>(level * kWheelNumSlots + slot);
+
+  Entry& entry = entries_[index];
+  entry.bucket = bucket;
+  entry.prev = kInvalidIndex;
+  entry.next = slot_heads_[bucket];
+
+  if (entry.next != kInvalidIndex)
+  {
+    entries_[entry.next].prev = index;
+  }
+
+  slot_heads_[bucket] = index;
+
+  if (level == 0)
+  {
+    level0_occupancy_[slot / 64] |= static_cast<uint64_t>(1) << (slot % 64);
+  }
+}
+
+void CyclicScheduler::unlinkTimer(uint32_t index)
+{
+  Entry& entry = entries_[index];
+  if (entry.bucket == kInvalidIndex)
+  {
+    return;
+  }
+
+  if (entry.prev != kInvalidIndex)
+  {
+    entries_[entry.prev].next = entry.next;
+  }
+  else
+  {
+    slot_heads_[entry.bucket] = entry.next;
+  }
+
+  if (entry.next != kInvalidIndex)
+  {
+    entries_[entry.next].prev = entry.prev;
+  }
+
+  if ((entry.bucket < kWheelNumSlots) && (slot_heads_[entry.bucket] == kInvalidIndex))
+  {
+    level0_occupancy_[entry.bucket / 64] &= ~(static_cast<uint64_t>(1) << (entry.bucket % 64));
+  }
+
+  entry.bucket = kInvalidIndex;
+  entry.prev = kInvalidIndex;
+  entry.next = kInvalidIndex;
+}
+
+void CyclicScheduler::releaseEntry(uint32_t index)
+{
+  Entry& entry = entries_[index];
+  entry.in_use = false;
+  entry.generation++;
+  entry.hook = nullptr;
+
+  entries_.release(index);
+  num_scheduled_--;
+}
+
+void CyclicScheduler::cascade(size_t level)
+{
+  const size_t slot = static_cast<size_t>(current_tick_ >> (kWheelSlotBits * level)) & (kWheelNumSlots - 1);
+  const size_t bucket = level * kWheelNumSlots + slot;
+
+  // Detach the whole slot, then re-file each timer relative to the current tick.
+  uint32_t index = slot_heads_[bucket];
+  slot_heads_[bucket] = kInvalidIndex;
+
+  while (index != kInvalidIndex)
+  {
+    const uint32_t next = entries_[index].next;
+    entries_[index].bucket = kInvalidIndex;
+    insertTimer(index, expiry_ticks_[index]);
+    index = next;
+  }
+}
+
+void CyclicScheduler::expireSlot(uint64_t now_us)
+{
+  const size_t slot = static_cast<size_t>(current_tick_) & (kWheelNumSlots - 1);
+
+  uint32_t index = slot_heads_[slot];
+  slot_heads_[slot] = kInvalidIndex;
+  level0_occupancy_[slot / 64] &= ~(static_cast<uint64_t>(1) << (slot % 64));
+
+  // Rescheduled messages must land after the tick `now_us` falls in, so each message goes out at most once per poll
+  // and the batch can never overflow.
+  const uint64_t now_tick = (now_us - epoch_us_) / tick_us_;
+
+  while (index != kInvalidIndex)
+  {
+    Entry& entry = entries_[index];
+    const uint32_t next = entry.next;
+    entry.bucket = kInvalidIndex;
+    entry.prev = kInvalidIndex;
+    entry.next = kInvalidIndex;
+
+    batch_[num_batched_] = entry.frame;
+    batch_hooks_[num_batched_].hook = entry.hook;
+    batch_hooks_[num_batched_].sequence = entry.sequence;
+    num_batched_++;
+
+    entry.max_lateness_us = std::max(entry.max_lateness_us, (now_us > entry.due_us) ? now_us - entry.due_us : 0);
+
+    if ((entry.period_us != 0) && (entry.sequence > 0))
+    {
+      const int64_t error_us = static_cast<int64_t>(now_us - entry.last_transmit_us) -
+        static_cast<int64_t>(entry.period_us);
+
+      entry.min_error_us = (entry.num_intervals == 0) ? error_us : std::min(entry.min_error_us, error_us);
+      entry.max_error_us = (entry.num_intervals == 0) ? error_us : std::max(entry.max_error_us, error_us);
+      entry.sum_error_us += static_cast<double>(error_us);
+      entry.sum_squared_error_us += static_cast<double>(error_us) * static_cast<double>(error_us);
+      entry.num_intervals++;
+    }
+
+    entry.sequence++;
+    entry.last_transmit_us = now_us;
+
+    if (entry.period_us != 0)
+    {
+      // Stay on the nominal grid.  If we fell more than a whole period behind, skip the missed slots rather than
+      // bursting to catch up.
+      entry.due_us += entry.period_us;
+      if (entry.due_us <= now_us)
+      {
+        entry.due_us += ((now_us - entry.due_us) / entry.period_us + 1) * entry.period_us;
+      }
+
+      insertTimer(index, std::max(dueTick(entry.due_us), now_tick + 1));
+    }
+    else
+    {
+      releaseEntry(index);
+    }
+
+    index = next;
+  }
+}
+
+size_t CyclicScheduler::poll()
+{
+  const uint64_t now_us = std::max(clock_->nowUs(), epoch_us_);
+  const uint64_t now_tick = (now_us - epoch_us_) / tick_us_;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_batched_ = 0;
+
+    while (current_tick_ <= now_tick)
+    {
+      if (num_scheduled_ == 0)
+      {
+        // Nothing on the wheel, so there is nothing to walk past.
+        current_tick_ = now_tick + 1;
+        break;
+      }
+
+      // Each time a level wraps, pull the next slot of the level above down.
+      for (size_t level = 1; level < kWheelNumLevels; ++level)
+      {
+        if ((current_tick_ & ((static_cast<uint64_t>(1) << (kWheelSlotBits * level)) - 1)) != 0)
+        {
+          break;
+        }
+
+        cascade(level);
+      }
+
+      expireSlot(now_us);
+      current_tick_++;
+    }
+  }
+
+  if (num_batched_ == 0)
+  {
+    return 0;
+  }
+
+  // Hooks run unlocked, so one that calls back into the scheduler cannot deadlock on `mutex_`.
+  for (size_t i = 0; i < num_batched_; ++i)
+  {
+    PendingHook& pending = batch_hooks_[i];
+    if (pending.hook != nullptr)
+    {
+      (*pending.hook)(&batch_[i], pending.sequence);
+      pending.hook.reset();
+    }
+  }
+
+  const size_t num_written = transport_->writeCanFrames(batch_.data(), num_batched_, kTransmitTimeoutMs);
+  if (num_written != num_batched_)
+  {
+    CANTALOUPE_WARN("Cyclic scheduler sent {} of {} frames.", num_written, num_batched_);
+  }
+
+  return num_written;
+}
+
+uint64_t CyclicScheduler::nextWakeTick() const
+{
+  if (num_scheduled_ == 0)
+  {
+    return UINT64_MAX;
+  }
+
+  // The next cascade may bring timers down that are due before anything currently on the first level.
+  const uint64_t next_cascade_tick = (current_tick_ + kWheelNumSlots - 1) & ~static_cast<uint64_t>(kWheelNumSlots - 1);
+
+  const size_t first_slot = static_cast<size_t>(current_tick_) & (kWheelNumSlots - 1);
+  for (size_t offset = 0; offset < kWheelNumSlots; ++offset)
+  {
+    const size_t slot = (first_slot + offset) & (kWheelNumSlots - 1);
+    if ((level0_occupancy_[slot / 64] & (static_cast<uint64_t>(1) << (slot % 64))) != 0)
+    {
+      return std::min(current_tick_ + offset, next_cascade_tick);
+    }
+
+    // Skip empty words in one go.
+    if ((level0_occupancy_[slot / 64] >> (slot % 64)) == 0)
+    {
+      offset += 63 - (slot % 64);
+    }
+  }
+
+  return next_cascade_tick;
+}
+
+bool CyclicScheduler::start(const ThreadConfig& thread_config)
+{
+  if (transmit_thread_.joinable() == true)
+  {
+    return false;
+  }
+
+  thread_config_ = thread_config;
+  thread_shutdown_ = false;
+  transmit_thread_ = std::thread(std::bind(&CyclicScheduler::transmitThread, this));
+  return true;
+}
+
+void CyclicScheduler::stop()
+{
+  if (transmit_thread_.joinable() == false)
+  {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    thread_shutdown_ = true;
+  }
+
+  wake_condition_.notify_one();
+  transmit_thread_.join();
+}
+
+void CyclicScheduler::transmitThread()
+{
+  applyThreadConfig(thread_config_, "cantaloupe-cyc");
+
+  while (true)
+  {
+    poll();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (thread_shutdown_ == true)
+    {
+      break;
+    }
+
+    const uint64_t wake_tick = nextWakeTick();
+    if (wake_tick == UINT64_MAX)
+    {
+      wake_condition_.wait_for(lock, std::chrono::milliseconds(kIdleWaitMs));
+      continue;
+    }
+
+    const uint64_t wake_us = epoch_us_ + wake_tick * tick_us_;
+    const uint64_t now_us = clock_->nowUs();
+    if (wake_us > now_us)
+    {
+      wake_condition_.wait_for(lock, std::chrono::microseconds(wake_us - now_us));
+    }
+  }
+}
+
+}  // namespace cantaloupe
@@ -0,0 +1,554 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#include <cantaloupe/flight_recorder.h>
+#include <cantaloupe/gs_usb_commands.h>
+#include <cantaloupe/log.h>
+
+#include <spdlog/fmt/fmt.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace cantaloupe
+{
+
+// How long the capture thread sleeps between checks for shutdown while armed.
+static constexpr uint32_t kIdleWaitMs = 100;
+
+// Out-of-line definitions for constants that get bound to references (eg by std::min).
+constexpr size_t FlightRecorder::kDefaultCapacityFrames;
+constexpr uint32_t FlightRecorder::kDefaultPreTriggerUs;
+constexpr uint32_t FlightRecorder::kDefaultPostTriggerUs;
+constexpr uint32_t FlightRecorder::kFollowIntervalMs;
+
+FlightRecorder::Trigger FlightRecorder::Trigger::onId(uint32_t id, uint32_t id_mask)
+{
+  Trigger trigger;
+  trigger.match_id = true;
+  trigger.id = id;
+  trigger.id_mask = id_mask;
+  return trigger;
+}
+
+FlightRecorder::Trigger FlightRecorder::Trigger::onPayload(uint32_t id,
+  const std::array<uint8_t, CanFrame::kDataNumMaxBytes>& data,
+  const std::array<uint8_t, CanFrame::kDataNumMaxBytes>& data_mask)
+{
+  Trigger trigger = onId(id);
+  trigger.match_data = true;
+  trigger.data = data;
+  trigger.data_mask = data_mask;
+
+  // Only frames long enough to carry every masked byte can match.
+  for (size_t i = 0; i < data_mask.size(); ++i)
+  {
+    if (data_mask[i] != 0)
+    {
+      trigger.min_dlc = static_cast<uint8_t>(i + 1);
+    }
+  }
+
+  return trigger;
+}
+
+FlightRecorder::Trigger FlightRecorder::Trigger::onErrorFrame()
+{
+  Trigger trigger;
+  trigger.match_error_frame = true;
+  return trigger;
+}
+
+FlightRecorder::Trigger FlightRecorder::Trigger::onPredicate(std::shared_ptr<const Predicate> predicate)
+{
+  Trigger trigger;
+  trigger.predicate = std::move(predicate);
+  return trigger;
+}
+
+bool FlightRecorder::Trigger::matches(const CanFrame& frame) const
+{
+  if ((match_error_frame == true) && (frame.error_frame == false))
+  {
+    return false;
+  }
+
+  if ((match_id == true) && (((frame.id ^ id) & id_mask) != 0))
+  {
+    return false;
+  }
+
+  if (match_data == true)
+  {
+    if (frame.dlc < min_dlc)
+    {
+      return false;
+    }
+
+    uint8_t difference = 0;
+    for (size_t i = 0; i < CanFrame::kDataNumMaxBytes; ++i)
+    {
+      difference |= static_cast<uint8_t>((frame.data[i] ^ data[i]) & data_mask[i]);
+    }
+
+    if (difference != 0)
+    {
+      return false;
+    }
+  }
+
+  if ((predicate != nullptr) && (predicate->matches(frame) == false))
+  {
+    return false;
+  }
+
+  return true;
+}
+
+FlightRecorder::FlightRecorder(const Config& config, const Clock* clock) :
+  config_{config},
+  clock_{(clock != nullptr) ? clock : &SteadyClock::instance()},
+  triggers_{},
+  triggers_busy_{false},
+  slots_{},
+  slot_mask_{0},
+  head_{0},
+  state_{ARMED},
+  trigger_position_{0},
+  trigger_timestamp_us_{0},
+  num_triggers_{0},
+  suppressed_triggers_{0},
+  mutex_{},
+  wake_{},
+  capture_statistics_{},
+  last_capture_path_{},
+  next_capture_number_{0},
+  thread_shutdown_{false},
+  capture_thread_{}
+{
+  size_t capacity = 1;
+  while (capacity < std::max<size_t>(config_.capacity_frames, 2))
+  {
+    capacity <<= 1;
+  }
+
+  config_.capacity_frames = capacity;
+  slots_ = std::vector<Slot>(capacity);
+  slot_mask_ = capacity - 1;
+}
+
+FlightRecorder::FlightRecorder() :
+  FlightRecorder(Config{})
+{
+}
+
+FlightRecorder::~FlightRecorder()
+{
+  stop();
+}
+
+void FlightRecorder::setTriggers(const std::vector<Trigger>& triggers)
+{
+  // Copy (and later free) outside the hand-off, so the RX path is only ever held off for the swap itself.
+  std::vector<Trigger> replacement = triggers;
+
+  bool expected = false;
+  while (triggers_busy_.compare_exchange_weak(expected, true, std::memory_order_acquire) == false)
+  {
+    expected = false;
+    std::this_thread::yield();
+  }
+
+  triggers_.swap(replacement);
+  triggers_busy_.store(false, std::memory_order_release);
+}
+
+void FlightRecorder::record(const CanFrame& frame)
+{
+  const uint64_t position = head_.load(std::memory_order_relaxed);
+  Slot& slot = slots_[position & slot_mask_];
+
+  uint64_t words[kSlotWords] = {};
+  std::memcpy(static_cast<void*>(words), static_cast<const void*>(&frame), sizeof(frame));
+
+  // Seqlock write: mark the slot odd, fill it, then publish the even sequence for this position.
+  slot.sequence.store((2 * position) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < kSlotWords; ++i)
+  {
+    slot.words[i].store(words[i], std::memory_order_relaxed);
+  }
+
+  slot.sequence.store(2 * (position + 1), std::memory_order_release);
+  head_.store(position + 1, std::memory_order_release);
+
+  // `setTriggers()` is swapping the set: this frame is kept, but not checked.
+  if (triggers_busy_.exchange(true, std::memory_order_acquire) == true)
+  {
+    return;
+  }
+
+  for (const Trigger& trigger : triggers_)
+  {
+    if (trigger.matches(frame) == true)
+    {
+      if (fire(position, frame.timestamp_us) == false)
+      {
+        suppressed_triggers_.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      break;
+    }
+  }
+
+  triggers_busy_.store(false, std::memory_order_release);
+}
+
+bool FlightRecorder::triggerNow()
+{
+  const uint64_t head = head_.load(std::memory_order_acquire);
+  CanFrame frame;
+  if ((head == 0) || (readSlot(head - 1, &frame) == false))
+  {
+    return false;
+  }
+
+  return fire(head - 1, frame.timestamp_us);
+}
+
+bool FlightRecorder::fire(uint64_t position, uint32_t timestamp_us)
+{
+  // Claim the recorder first so a racing `triggerNow()` cannot mix its position with ours, then publish the position
+  // and timestamp along with the TRIGGERED state.
+  uint32_t expected = ARMED;
+  if ((state_.load(std::memory_order_relaxed) != ARMED) ||
+    (state_.compare_exchange_strong(expected, CLAIMED, std::memory_order_relaxed) == false))
+  {
+    return false;
+  }
+
+  trigger_position_.store(position, std::memory_order_relaxed);
+  trigger_timestamp_us_.store(timestamp_us, std::memory_order_relaxed);
+  state_.store(TRIGGERED, std::memory_order_release);
+  num_triggers_.fetch_add(1, std::memory_order_relaxed);
+
+  // Notifying without the mutex cannot block.  If the capture thread misses it, it picks the trigger up on its next
+  // idle timeout.
+  wake_.notify_one();
+  return true;
+}
+
+bool FlightRecorder::readSlot(uint64_t position, CanFrame* frame) const
+{
+  const Slot& slot = slots_[position & slot_mask_];
+  const uint64_t expected = 2 * (position + 1);
+
+  if (slot.sequence.load(std::memory_order_acquire) != expected)
+  {
+    return false;
+  }
+
+  uint64_t words[kSlotWords];
+  for (size_t i = 0; i < kSlotWords; ++i)
+  {
+    words[i] = slot.words[i].load(std::memory_order_relaxed);
+  }
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot.sequence.load(std::memory_order_relaxed) != expected)
+  {
+    return false;
+  }
+
+  std::memcpy(static_cast<void*>(frame), static_cast<const void*>(words), sizeof(*frame));
+  return true;
+}
+
+bool FlightRecorder::start()
+{
+  if (capture_thread_.joinable() == true)
+  {
+    return false;
+  }
+
+  thread_shutdown_ = false;
+  capture_thread_ = std::thread(std::bind(&FlightRecorder::captureThread, this));
+  return true;
+}
+
+void FlightRecorder::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    thread_shutdown_ = true;
+  }
+
+  wake_.notify_all();
+
+  if (capture_thread_.joinable() == true)
+  {
+    capture_thread_.join();
+  }
+}
+
+bool FlightRecorder::isCapturing() const
+{
+  return state_.load(std::memory_order_acquire) != ARMED;
+}
+
+void FlightRecorder::captureThread()
+{
+  applyThreadConfig(config_.thread_config, "cantaloupe-rec");
+
+  std::vector<CanFrame> frames;
+  frames.reserve(config_.capacity_frames);
+
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait_for(lock, std::chrono::milliseconds(kIdleWaitMs),
+        [this]() { return (thread_shutdown_ == true) || (state_.load(std::memory_order_acquire) == TRIGGERED); });
+
+      if (thread_shutdown_ == true)
+      {
+        break;
+      }
+    }
+
+    uint32_t expected = TRIGGERED;
+    if (state_.compare_exchange_strong(expected, CAPTURING, std::memory_order_acquire) == false)
+    {
+      continue;
+    }
+
+    frames.clear();
+    collectCapture(&frames);
+
+    const bool written = writeCapture(frames);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (written == true)
+      {
+        capture_statistics_.captures_written++;
+        capture_statistics_.frames_captured += frames.size();
+      }
+      else
+      {
+        capture_statistics_.capture_failures++;
+      }
+    }
+
+    state_.store(ARMED, std::memory_order_release);
+  }
+}
+
+void FlightRecorder::collectCapture(std::vector<CanFrame>* frames)
+{
+  const uint64_t trigger_position = trigger_position_.load(std::memory_order_relaxed);
+  const uint32_t trigger_timestamp_us = trigger_timestamp_us_.load(std::memory_order_relaxed);
+  const uint64_t capacity = config_.capacity_frames;
+  uint64_t lost = 0;
+
+  // Pre-trigger window: walk back from the trigger until the window ends or the ring runs out of history.  Device
+  // timestamps wrap, so compare differences.
+  const uint64_t head = head_.load(std::memory_order_acquire);
+  const uint64_t oldest = (head > capacity) ? (head - capacity) : 0;
+  for (uint64_t position = trigger_position; position > oldest; --position)
+  {
+    CanFrame frame;
+    if (readSlot(position - 1, &frame) == false)
+    {
+      break;
+    }
+
+    if (static_cast<uint32_t>(trigger_timestamp_us - frame.timestamp_us) > config_.pre_trigger_us)
+    {
+      break;
+    }
+
+    frames->push_back(frame);
+  }
+
+  std::reverse(frames->begin(), frames->end());
+
+  // Post-trigger window, starting with the triggering frame itself.  Follow the writer until the window has passed in
+  // device time, or in host time if the bus has gone quiet.
+  const uint64_t deadline_us = clock_->nowUs() + config_.post_trigger_us + kPostTriggerSlackUs;
+  uint64_t next = trigger_position;
+  bool done = false;
+
+  while (done == false)
+  {
+    const uint64_t current_head = head_.load(std::memory_order_acquire);
+    if (current_head - next > capacity)
+    {
+      lost += current_head - capacity - next;
+      next = current_head - capacity;
+    }
+
+    for (; (next < current_head) && (done == false); ++next)
+    {
+      CanFrame frame;
+      if (readSlot(next, &frame) == false)
+      {
+        lost++;
+        continue;
+      }
+
+      if (static_cast<uint32_t>(frame.timestamp_us - trigger_timestamp_us) > config_.post_trigger_us)
+      {
+        done = true;
+        break;
+      }
+
+      frames->push_back(frame);
+    }
+
+    if ((done == true) || (clock_->nowUs() >= deadline_us))
+    {
+      break;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (wake_.wait_for(lock, std::chrono::milliseconds(kFollowIntervalMs),
+      [this]() { return thread_shutdown_ == true; }) == true)
+    {
+      break;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  capture_statistics_.frames_lost += lost;
+}
+
+bool FlightRecorder::writeCapture(const std::vector<CanFrame>& frames)
+{
+  // Numbering starts again with every run, so step over any capture already there (eg from before a crash) rather
+  // than overwrite it.
+  std::string path;
+  int fd = -1;
+  do
+  {
+    path = fmt::format("{}/{}-{}.log", config_.output_directory, config_.file_prefix, next_capture_number_++);
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  } while ((fd < 0) && (errno == EEXIST));
+
+  if (fd < 0)
+  {
+    CANTALOUPE_ERROR("Failed to open flight recorder capture {}: {}", path, std::strerror(errno));
+    return false;
+  }
+
+  std::FILE* file = ::fdopen(fd, "w");
+  if (file == nullptr)
+  {
+    CANTALOUPE_ERROR("Failed to open flight recorder capture {}: {}", path, std::strerror(errno));
+    ::close(fd);
+    return false;
+  }
+
+  // Format in chunks to keep the number of writes down without building the whole file in memory.
+  static constexpr size_t kFlushThresholdBytes = 64 * 1024;
+  fmt::memory_buffer out;
+  bool success = true;
+
+  for (const CanFrame& frame : frames)
+  {
+    fmt::format_to(out, "{}\n", formatCandumpLine(frame, config_.interface_name));
+    if (out.size() >= kFlushThresholdBytes)
+    {
+      success = success && (std::fwrite(out.data(), 1, out.size(), file) == out.size());
+      out.resize(0);
+    }
+  }
+
+  success = success && (std::fwrite(out.data(), 1, out.size(), file) == out.size());
+  success = (std::fclose(file) == 0) && success;
+
+  if (success == false)
+  {
+    CANTALOUPE_ERROR("Failed to write flight recorder capture {}.", path);
+    return false;
+  }
+
+  CANTALOUPE_INFO("Flight recorder wrote {} frames to {}.", frames.size(), path);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  last_capture_path_ = path;
+  return true;
+}
+
+std::string FlightRecorder::formatCandumpLine(const CanFrame& frame, const std::string& interface_name)
+{
+  fmt::memory_buffer out;
+  fmt::format_to(out, "({}.{:06}) {} ", frame.timestamp_us / 1000000, frame.timestamp_us % 1000000, interface_name);
+
+  if (frame.error_frame == true)
+  {
+    fmt::format_to(out, "{:08X}#", (frame.id & CanFrame::kIdMaskExtended) | GsHostCanFrame::kCanIdErrorFlag);
+  }
+  else if (frame.eff_frame == true)
+  {
+    fmt::format_to(out, "{:08X}#", frame.id & CanFrame::kIdMaskExtended);
+  }
+  else
+  {
+    fmt::format_to(out, "{:03X}#", frame.id & CanFrame::kIdMaskStandard);
+  }
+
+  if (frame.rtr_frame == true)
+  {
+    fmt::format_to(out, "R");
+  }
+  else
+  {
+    const size_t length = (frame.dlc < CanFrame::kDataNumMaxBytes) ? frame.dlc : CanFrame::kDataNumMaxBytes;
+    for (size_t i = 0; i < length; ++i)
+    {
+      fmt::format_to(out, "{:02X}", frame.data[i]);
+    }
+  }
+
+  return fmt::to_string(out);
+}
+
+FlightRecorder::Statistics FlightRecorder::getStatistics() const
+{
+  Statistics statistics;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    statistics = capture_statistics_;
+  }
+
+  statistics.frames_recorded = head_.load(std::memory_order_relaxed);
+  statistics.triggers = num_triggers_.load(std::memory_order_relaxed);
+  statistics.suppressed_triggers = suppressed_triggers_.load(std::memory_order_relaxed);
+  return statistics;
+}
+
+std::string FlightRecorder::lastCapturePath() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return last_capture_path_;
+}
+
+}  // namespace cantaloupe
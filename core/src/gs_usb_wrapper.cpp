@@ -10,11 +10,15 @@
 //
 // You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
 // <https://www.gnu.org/licenses/>.
+#include <cantaloupe/clock.h>
 #include <cantaloupe/gs_usb_commands.h>
 #include <cantaloupe/gs_usb_wrapper.h>
 #include <cantaloupe/log.h>
+#include <cantaloupe/metrics.h>
 
 #include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <functional>
 #include <stdexcept>
 
@@ -30,12 +34,23 @@ namespace cantaloupe
 {
 
 GsUsbWrapper::GsUsbWrapper() :
+  GsUsbWrapper(ThreadConfig())
+{
+}
+
+GsUsbWrapper::GsUsbWrapper(const ThreadConfig& hotplug_thread_config) :
   context_{nullptr},
   hotplug_handle_{0},
+  hotplug_thread_config_{hotplug_thread_config},
   hotplug_thread_shutdown_{false},
   hotplug_thread_{},
+  rx_transfers_{},
+  next_rx_transfer_{0},
   device_handle_mutex_{},
-  device_handle_{nullptr}
+  device_handle_{nullptr},
+  bulk_out_transfer_{nullptr},
+  flight_recorder_{nullptr},
+  error_monitor_{nullptr}
 {
   // Create the necessary LibUSB context.
   libusb_context* temp_context;
@@ -47,6 +62,21 @@ GsUsbWrapper::GsUsbWrapper() :
   // Stuff it into smart pointer.
   context_.reset(temp_context);
 
+  for (RxTransfer& rx : rx_transfers_)
+  {
+    rx.transfer.reset(libusb_alloc_transfer(0));
+    if (rx.transfer == nullptr)
+    {
+      throw std::runtime_error("Failed to allocate LibUSB transfers.");
+    }
+  }
+
+  bulk_out_transfer_.reset(libusb_alloc_transfer(0));
+  if (bulk_out_transfer_ == nullptr)
+  {
+    throw std::runtime_error("Failed to allocate LibUSB transfers.");
+  }
+
   // Create a lambda to be used when a hotplug event occurs.  This is to prevent the LibUSB API from "poisoning" our
   // public header, yet we stil have access to private methods.
   auto hotplug_callback = [](libusb_context*, libusb_device* dev, libusb_hotplug_event event, void* this_ptr) -> int {
@@ -95,6 +125,12 @@ GsUsbWrapper::~GsUsbWrapper()
   // If we have an open channel, close it.
   stopChannel();
 
+  // Take back the queued RX transfers while LibUSB can still complete them.
+  {
+    std::lock_guard<std::mutex> lock(device_handle_mutex_);
+    closeDeviceLocked();
+  }
+
   // If the hotplug monitor thread is still running, signal it to die and then wait for it.
   if (hotplug_thread_.joinable() == true)
   {
@@ -119,6 +155,8 @@ bool GsUsbWrapper::isConnected()
 
 void GsUsbWrapper::hotplugMonitorThread() const
 {
+  applyThreadConfig(hotplug_thread_config_, "cantaloupe-usb");
+
   while (hotplug_thread_shutdown_ == false)
   {
     // Use a timeout so that way there is a opportunity for this thread to be signaled to be closed.
@@ -188,6 +226,7 @@ void GsUsbWrapper::hotplugAttachEvent(libusb_device* dev)
       return;
     }
 
+    closeDeviceLocked();
     device_handle_.reset(handle);
 
     // We already checked that there was one configuration previously. Now claim it.
@@ -198,6 +237,7 @@ void GsUsbWrapper::hotplugAttachEvent(libusb_device* dev)
   }
 
   setHostFormat();
+  Metrics::increment(MetricCounter::HOTPLUG_ATTACH);
   CANTALOUPE_INFO("Connected!");
 }
 
@@ -210,13 +250,44 @@ void GsUsbWrapper::hotplugDetachEvent(libusb_device* dev)
 
   {
     std::lock_guard<std::mutex> lock(device_handle_mutex_);
-    device_handle_.reset();
+    closeDeviceLocked();
   }
 
+  Metrics::increment(MetricCounter::HOTPLUG_DETACH);
   CANTALOUPE_INFO("Disconnected.");
 }
 
-bool GsUsbWrapper::receiveBulkData(void* data, size_t num_bytes, size_t* actual_num_bytes, uint32_t timeout_ms)
+// Completion callback for the bulk transfers: flags the transfer as done for whoever is waiting on it.
+static void LIBUSB_CALL bulkTransferCallback(libusb_transfer* transfer)
+{
+  *static_cast<int*>(transfer->user_data) = 1;
+}
+
+// The LibUSB error code matching how a transfer finished.
+static int transferStatusToError(libusb_transfer_status status)
+{
+  switch (status)
+  {
+    case LIBUSB_TRANSFER_COMPLETED:
+      return LIBUSB_SUCCESS;
+    case LIBUSB_TRANSFER_TIMED_OUT:
+      return LIBUSB_ERROR_TIMEOUT;
+    case LIBUSB_TRANSFER_STALL:
+      return LIBUSB_ERROR_PIPE;
+    case LIBUSB_TRANSFER_OVERFLOW:
+      return LIBUSB_ERROR_OVERFLOW;
+    case LIBUSB_TRANSFER_NO_DEVICE:
+      return LIBUSB_ERROR_NO_DEVICE;
+    case LIBUSB_TRANSFER_ERROR:
+    case LIBUSB_TRANSFER_CANCELLED:
+      return LIBUSB_ERROR_IO;
+  }
+
+  return LIBUSB_ERROR_OTHER;
+}
+
+bool GsUsbWrapper::receiveBulkData(void* data, size_t num_bytes, size_t* actual_num_bytes, uint32_t timeout_ms,
+  bool wait)
 {
   int signed_actual_length = 0;
 
@@ -229,20 +300,54 @@ bool GsUsbWrapper::receiveBulkData(void* data, size_t num_bytes, size_t* actual_
       return false;
     }
 
-    int retcode = libusb_bulk_transfer(device_handle_.get(), kExpectedEndpointInIdx | LIBUSB_ENDPOINT_IN,
-      static_cast<uint8_t*>(data), static_cast<int>(num_bytes), &signed_actual_length, timeout_ms);
+    // Normally only needed the first time through; after that each transfer is requeued as soon as it is read.
+    const uint64_t start_us = SteadyClock::instance().nowUs();
+    RxTransfer& rx = rx_transfers_[next_rx_transfer_];
+    int retcode = submitRxTransfersLocked();
+    if ((retcode == LIBUSB_SUCCESS) || (rx.in_flight == true))
+    {
+      retcode = awaitRxTransferLocked(&rx, timeout_ms, wait);
+    }
+
+    if ((retcode == LIBUSB_SUCCESS) && (rx.completed != 0))
+    {
+      rx.in_flight = false;
+      next_rx_transfer_ = (next_rx_transfer_ + 1) % rx_transfers_.size();
+      retcode = transferStatusToError(rx.transfer->status);
+      signed_actual_length = std::min(rx.transfer->actual_length, static_cast<int>(num_bytes));
+      std::memcpy(data, &rx.frame, static_cast<size_t>(signed_actual_length));
+
+      // Straight back onto the device; if that fails it is tried again on the next call.
+      submitRxTransfersLocked();
+    }
+    else if (retcode == LIBUSB_SUCCESS)
+    {
+      // Not here yet; the transfer stays queued for the next call.
+      retcode = LIBUSB_ERROR_TIMEOUT;
+    }
 
     if (retcode != LIBUSB_SUCCESS)
     {
       // Only complain if the error was not a timeout.
       if (retcode != LIBUSB_ERROR_TIMEOUT)
       {
+        Metrics::increment(MetricCounter::BULK_ERRORS);
+        Metrics::recordLibUsbError(retcode);
         CANTALOUPE_ERROR("Failed to initiate transfer (ret = {}: {}).", retcode, libusb_error_name(retcode));
       }
+      else if (wait == true)
+      {
+        // Finding nothing without waiting is how a batch ends, not a timeout.
+        Metrics::increment(MetricCounter::BULK_TIMEOUTS);
+      }
 
       actual_num_bytes = 0;
       return false;
     }
+
+    Metrics::recordLatency(MetricHistogram::BULK_IN_LATENCY_US, SteadyClock::instance().nowUs() - start_us);
+    Metrics::increment(MetricCounter::BULK_IN_TRANSFERS);
+    Metrics::increment(MetricCounter::BULK_IN_BYTES, static_cast<uint64_t>(signed_actual_length));
   }
 
   *actual_num_bytes = static_cast<size_t>(signed_actual_length);
@@ -250,28 +355,181 @@ bool GsUsbWrapper::receiveBulkData(void* data, size_t num_bytes, size_t* actual_
 }
 
 bool GsUsbWrapper::transmitBulkData(void* data, size_t num_bytes, uint32_t timeout_ms)
+{
+  std::lock_guard<std::mutex> lock(device_handle_mutex_);
+  return transmitBulkDataLocked(data, num_bytes, timeout_ms);
+}
+
+bool GsUsbWrapper::transmitBulkDataLocked(void* data, size_t num_bytes, uint32_t timeout_ms)
 {
   int signed_actual_length = 0;
 
+  if (device_handle_ == nullptr)
   {
-    std::lock_guard<std::mutex> lock(device_handle_mutex_);
-    if (device_handle_ == nullptr)
+    CANTALOUPE_ERROR("Invalid device handle.");
+    return false;
+  }
+
+  const uint64_t start_us = SteadyClock::instance().nowUs();
+  int retcode = bulkTransferLocked(bulk_out_transfer_.get(), kExpectedEndpointOutIdx | LIBUSB_ENDPOINT_OUT, data,
+    num_bytes, &signed_actual_length, timeout_ms);
+
+  if (retcode != LIBUSB_SUCCESS)
+  {
+    Metrics::increment((retcode == LIBUSB_ERROR_TIMEOUT) ? MetricCounter::BULK_TIMEOUTS : MetricCounter::BULK_ERRORS);
+    Metrics::recordLibUsbError(retcode);
+    CANTALOUPE_ERROR("Failed to initiate transfer (ret = {}).", retcode);
+    return false;
+  }
+
+  Metrics::recordLatency(MetricHistogram::BULK_OUT_LATENCY_US, SteadyClock::instance().nowUs() - start_us);
+  Metrics::increment(MetricCounter::BULK_OUT_TRANSFERS);
+  Metrics::increment(MetricCounter::BULK_OUT_BYTES, static_cast<uint64_t>(signed_actual_length));
+
+  return static_cast<size_t>(signed_actual_length) == num_bytes;
+}
+
+int GsUsbWrapper::bulkTransferLocked(libusb_transfer* transfer, uint8_t endpoint, void* data, size_t num_bytes,
+  int* actual_num_bytes, uint32_t timeout_ms)
+{
+  int completed = 0;
+  libusb_fill_bulk_transfer(transfer, device_handle_.get(), endpoint, static_cast<uint8_t*>(data),
+    static_cast<int>(num_bytes), bulkTransferCallback, &completed, timeout_ms);
+
+  int retcode = libusb_submit_transfer(transfer);
+  if (retcode != LIBUSB_SUCCESS)
+  {
+    return retcode;
+  }
+
+  // Handle events (or wait for the thread that is) until our transfer completes, the same way LibUSB's synchronous
+  // API does.
+  while (completed == 0)
+  {
+    retcode = libusb_handle_events_completed(context_.get(), &completed);
+    if ((retcode < 0) && (retcode != LIBUSB_ERROR_INTERRUPTED))
     {
-      CANTALOUPE_ERROR("Invalid device handle.");
-      return false;
+      // Give up on the transfer, but keep handling events until LibUSB has finished with it.
+      libusb_cancel_transfer(transfer);
     }
+  }
 
-    int retcode = libusb_bulk_transfer(device_handle_.get(), kExpectedEndpointOutIdx | LIBUSB_ENDPOINT_OUT,
-      static_cast<uint8_t*>(data), static_cast<int>(num_bytes), &signed_actual_length, timeout_ms);
+  *actual_num_bytes = transfer->actual_length;
+  return transferStatusToError(transfer->status);
+}
+
+int GsUsbWrapper::submitRxTransfersLocked()
+{
+  // Resubmit in turn from the next to be read, so the order on the device matches the order we read them in.
+  for (size_t i = 0; i < rx_transfers_.size(); ++i)
+  {
+    RxTransfer& rx = rx_transfers_[(next_rx_transfer_ + i) % rx_transfers_.size()];
+    if (rx.in_flight == true)
+    {
+      continue;
+    }
 
+    // No timeout: the transfer waits on the device for as long as the bus stays quiet.
+    rx.completed = 0;
+    libusb_fill_bulk_transfer(rx.transfer.get(), device_handle_.get(), kExpectedEndpointInIdx | LIBUSB_ENDPOINT_IN,
+      reinterpret_cast<uint8_t*>(&rx.frame), static_cast<int>(sizeof(rx.frame)), bulkTransferCallback, &rx.completed,
+      0);
+
+    const int retcode = libusb_submit_transfer(rx.transfer.get());
     if (retcode != LIBUSB_SUCCESS)
     {
-      CANTALOUPE_ERROR("Failed to initiate transfer (ret = {}).", retcode);
-      return false;
+      return retcode;
     }
+
+    rx.in_flight = true;
   }
 
-  return static_cast<size_t>(signed_actual_length) == num_bytes;
+  return LIBUSB_SUCCESS;
+}
+
+int GsUsbWrapper::awaitRxTransferLocked(RxTransfer* rx, uint32_t timeout_ms, bool wait)
+{
+  const uint64_t deadline_us = SteadyClock::instance().nowUs() + (static_cast<uint64_t>(timeout_ms) * 1000);
+  while (rx->completed == 0)
+  {
+    int retcode = LIBUSB_SUCCESS;
+    if ((wait == true) && (timeout_ms == 0))
+    {
+      retcode = libusb_handle_events_completed(context_.get(), &rx->completed);
+    }
+    else
+    {
+      // A zero timeout only picks up completions LibUSB has already been told about.
+      timeval remaining;
+      remaining.tv_sec = 0;
+      remaining.tv_usec = 0;
+      if (wait == true)
+      {
+        const uint64_t now_us = SteadyClock::instance().nowUs();
+        if (now_us >= deadline_us)
+        {
+          return LIBUSB_SUCCESS;
+        }
+
+        remaining.tv_sec = static_cast<time_t>((deadline_us - now_us) / 1000000);
+        remaining.tv_usec = static_cast<suseconds_t>((deadline_us - now_us) % 1000000);
+      }
+
+      retcode = libusb_handle_events_timeout_completed(context_.get(), &remaining, &rx->completed);
+      if (wait == false)
+      {
+        return ((retcode < 0) && (retcode != LIBUSB_ERROR_INTERRUPTED)) ? retcode : LIBUSB_SUCCESS;
+      }
+    }
+
+    if ((retcode < 0) && (retcode != LIBUSB_ERROR_INTERRUPTED))
+    {
+      return retcode;
+    }
+  }
+
+  return LIBUSB_SUCCESS;
+}
+
+void GsUsbWrapper::closeDeviceLocked()
+{
+  if (device_handle_ == nullptr)
+  {
+    return;
+  }
+
+  for (RxTransfer& rx : rx_transfers_)
+  {
+    if (rx.in_flight == true)
+    {
+      libusb_cancel_transfer(rx.transfer.get());
+    }
+  }
+
+  // Give LibUSB a bounded time to hand them back.  From inside a hotplug callback it cannot, since we are then the
+  // thread handling events; closing the handle below lets go of anything still queued either way.
+  const uint64_t deadline_us = SteadyClock::instance().nowUs() + (kDefaultControlTransferTimeoutMs * 1000);
+  for (RxTransfer& rx : rx_transfers_)
+  {
+    while ((rx.in_flight == true) && (rx.completed == 0))
+    {
+      const uint64_t now_us = SteadyClock::instance().nowUs();
+      if (now_us >= deadline_us)
+      {
+        break;
+      }
+
+      timeval remaining;
+      remaining.tv_sec = static_cast<time_t>((deadline_us - now_us) / 1000000);
+      remaining.tv_usec = static_cast<suseconds_t>((deadline_us - now_us) % 1000000);
+      libusb_handle_events_timeout_completed(context_.get(), &remaining, &rx.completed);
+    }
+
+    rx.in_flight = false;
+  }
+
+  next_rx_transfer_ = 0;
+  device_handle_.reset();
 }
 
 bool GsUsbWrapper::transmitControl(ControlType type, uint8_t request, uint16_t value, uint16_t index, void* data,
@@ -288,11 +546,17 @@ bool GsUsbWrapper::transmitControl(ControlType type, uint8_t request, uint16_t v
       return false;
     }
 
+    const uint64_t start_us = SteadyClock::instance().nowUs();
     int num_bytes_tx = libusb_control_transfer(device_handle_.get(), request_type, request, value, index,
       static_cast<uint8_t*>(data), static_cast<uint16_t>(length), kDefaultControlTransferTimeoutMs);
 
+    Metrics::recordLatency(MetricHistogram::CONTROL_LATENCY_US, SteadyClock::instance().nowUs() - start_us);
+    Metrics::increment(MetricCounter::CONTROL_TRANSFERS);
+
     if (num_bytes_tx <= 0)
     {
+      Metrics::increment(MetricCounter::CONTROL_FAILURES);
+      Metrics::recordLibUsbError(num_bytes_tx);
       CANTALOUPE_ERROR("Failed to transfer control (ret = {}).", num_bytes_tx);
       return false;
     }
@@ -315,7 +579,7 @@ bool GsUsbWrapper::setHostFormat()
   return transmitControl(ControlType::OUT, GsUsbBreq::HOST_FORMAT, 0, 0, &config, sizeof(config));
 }
 
-bool GsUsbWrapper::startChannel(bool loopback)
+bool GsUsbWrapper::startChannel(bool loopback, bool fd, bool bus_error_reporting)
 {
   GsDeviceMode device_mode;
   device_mode.mode = GsDeviceMode::kModeStart;
@@ -326,6 +590,25 @@ bool GsUsbWrapper::startChannel(bool loopback)
     device_mode.flags |= GsDeviceMode::kFlagLoopBack;
   }
 
+  if (fd == true)
+  {
+    device_mode.flags |= GsDeviceMode::kFlagFd;
+  }
+
+  // Firmware refuses modes it does not know, so only ask for bus errors where they are on offer.  State changes are
+  // reported either way.
+  if (bus_error_reporting == true)
+  {
+    if (isBusErrorReportingCapable() == true)
+    {
+      device_mode.flags |= GsDeviceMode::kFlagBusErrorReporting;
+    }
+    else
+    {
+      CANTALOUPE_WARN("Device does not report bus errors; only bus state changes will be seen.");
+    }
+  }
+
   return transmitControl(ControlType::OUT, GsUsbBreq::MODE, 0, 0, &device_mode, sizeof(device_mode));
 }
 
@@ -400,40 +683,203 @@ bool GsUsbWrapper::setBitrate(uint32_t bitrate)
   return transmitControl(ControlType::OUT, GsUsbBreq::BITTIMING, 0, 0, &timing, sizeof(timing));
 }
 
-bool GsUsbWrapper::writeCanFrame(const CanFrame& frame, uint32_t timeout_ms )
+bool GsUsbWrapper::isFdCapable()
 {
-  GsHostCanFrame output;
-  output.can_id = frame.id;
-  output.echo_id = 0;
+  GsDeviceBitTimingConst bit_timing_const;
+  if (transmitControl(ControlType::IN, GsUsbBreq::BT_CONST, 0, 0, &bit_timing_const, sizeof(bit_timing_const)) == false)
+  {
+    return false;
+  }
+
+  return (bit_timing_const.feature & GsDeviceBitTimingConst::kFeatureFd) != 0;
+}
+
+bool GsUsbWrapper::isBusErrorReportingCapable()
+{
+  GsDeviceBitTimingConst bit_timing_const;
+  if (transmitControl(ControlType::IN, GsUsbBreq::BT_CONST, 0, 0, &bit_timing_const, sizeof(bit_timing_const)) == false)
+  {
+    return false;
+  }
+
+  return (bit_timing_const.feature & GsDeviceBitTimingConst::kFeatureBusErrorReporting) != 0;
+}
+
+// Work out a bit timing for `bitrate` within the given limits, preferring the smallest prescaler (and so the most time
+// quanta per bit) that divides the clock exactly.
+static bool computeBitTiming(uint32_t fclk_can, uint32_t bitrate, uint16_t sample_point_permille, uint32_t tseg1_min,
+  uint32_t tseg1_max, uint32_t tseg2_min, uint32_t tseg2_max, uint32_t sjw_max, uint32_t brp_min, uint32_t brp_max,
+  uint32_t brp_inc, GsDeviceBitTiming* timing)
+{
+  if ((fclk_can == 0) || (bitrate == 0))
+  {
+    return false;
+  }
+
+  for (uint32_t brp = std::max<uint32_t>(brp_min, 1); brp <= brp_max; brp += std::max<uint32_t>(brp_inc, 1))
+  {
+    const uint64_t divisor = static_cast<uint64_t>(brp) * bitrate;
+    if ((fclk_can % divisor) != 0)
+    {
+      continue;
+    }
+
+    // Time quanta per bit, including the one-quantum sync segment.
+    const uint32_t num_tq = static_cast<uint32_t>(fclk_can / divisor);
+    if ((num_tq < 1 + tseg1_min + tseg2_min) || (num_tq > 1 + tseg1_max + tseg2_max))
+    {
+      continue;
+    }
+
+    uint32_t tseg1 = (num_tq * sample_point_permille + 500) / 1000;
+    tseg1 = std::min(std::max(tseg1, static_cast<uint32_t>(1)) - 1, num_tq - 1 - tseg2_min);
+    tseg1 = std::min(std::max(tseg1, std::max<uint32_t>(tseg1_min, 2)), tseg1_max);
+
+    const uint32_t tseg2 = num_tq - 1 - tseg1;
+    if ((tseg2 < tseg2_min) || (tseg2 > tseg2_max))
+    {
+      continue;
+    }
+
+    // The device adds the propagation and first phase segments back together.
+    timing->prop_seg = 1;
+    timing->phase_seg1 = tseg1 - timing->prop_seg;
+    timing->phase_seg2 = tseg2;
+    timing->sjw = std::max<uint32_t>(std::min(tseg2, sjw_max), 1);
+    timing->brp = brp;
+    return true;
+  }
+
+  return false;
+}
+
+bool GsUsbWrapper::setDataBitrate(uint32_t bitrate, uint16_t sample_point_permille)
+{
+  GsDeviceBitTimingConstExtended limits;
+  if (transmitControl(ControlType::IN, GsUsbBreq::BT_CONST_EXT, 0, 0, &limits, sizeof(limits)) == false)
+  {
+    CANTALOUPE_ERROR("Failed to read the data phase bit timing limits.");
+    return false;
+  }
+
+  if ((limits.nominal.feature & GsDeviceBitTimingConst::kFeatureFd) == 0)
+  {
+    CANTALOUPE_ERROR("Device does not support CAN FD.");
+    return false;
+  }
+
+  GsDeviceBitTiming timing;
+  if (computeBitTiming(limits.nominal.fclk_can, bitrate, sample_point_permille, limits.dtseg1_min, limits.dtseg1_max,
+    limits.dtseg2_min, limits.dtseg2_max, limits.dsjw_max, limits.dbrp_min, limits.dbrp_max, limits.dbrp_inc,
+    &timing) == false)
+  {
+    CANTALOUPE_ERROR("No data phase bit timing for {} bit/s with a {} Hz clock.", bitrate, limits.nominal.fclk_can);
+    return false;
+  }
+
+  return transmitControl(ControlType::OUT, GsUsbBreq::DATA_BITTIMING, 0, 0, &timing, sizeof(timing));
+}
+
+// Translate our frame representation into the one the device expects.
+static void toHostCanFrame(const CanFrame& frame, GsHostCanFrame* output)
+{
+  output->can_id = frame.id;
+  output->echo_id = 0;
 
   // Make sure that the DLC never exceeds our max data size.
-  using dlc_type = decltype(output.can_dlc);
-  output.can_dlc = std::min(static_cast<dlc_type>(frame.dlc), static_cast<dlc_type>(CanFrame::kDataNumMaxBytes));
+  using dlc_type = decltype(output->can_dlc);
+  output->can_dlc = std::min(static_cast<dlc_type>(frame.dlc), static_cast<dlc_type>(CanFrame::kDataNumMaxBytes));
 
-  output.channel = 0;
-  output.flags = 0;
-  output.reserved = 0;
+  output->channel = 0;
+  output->flags = 0;
+  output->reserved = 0;
 
   // Check at compile time that our CAN frame data lengths match, and then copy all in one fell swoop.
-  static_assert(sizeof(output.data) / sizeof(output.data[0]) == CanFrame::kDataNumMaxBytes, "CAN data size mismatch");
-  std::copy_n(&frame.data[0], output.can_dlc, &output.data[0]);
+  static_assert(sizeof(output->data) / sizeof(output->data[0]) == CanFrame::kDataNumMaxBytes,
+    "CAN data size mismatch");
+  std::copy_n(&frame.data[0], output->can_dlc, &output->data[0]);
 
-  output.timestamp_us = 0;
+  output->timestamp_us = 0;
+}
 
-  return transmitBulkData(&output, sizeof(frame), timeout_ms);
+bool GsUsbWrapper::writeCanFrame(const CanFrame& frame, uint32_t timeout_ms)
+{
+  GsHostCanFrame output;
+  toHostCanFrame(frame, &output);
+
+  const bool transmitted = transmitBulkData(&output, sizeof(output), timeout_ms);
+  Metrics::increment((transmitted == true) ? MetricCounter::TX_FRAMES : MetricCounter::TX_FAILURES);
+  return transmitted;
 }
 
-bool GsUsbWrapper::readCanFrame(CanFrame* frame, uint32_t timeout_ms)
+size_t GsUsbWrapper::writeCanFrames(const CanFrame* frames, size_t num_frames, uint32_t timeout_ms)
 {
-  GsHostCanFrame input;
-  size_t actual_num_bytes = 0;
+  std::lock_guard<std::mutex> lock(device_handle_mutex_);
 
-  if (receiveBulkData(&input, sizeof(input), &actual_num_bytes, timeout_ms) == false)
+  for (size_t i = 0; i < num_frames; ++i)
   {
-    return false;
+    GsHostCanFrame output;
+    toHostCanFrame(frames[i], &output);
+
+    if (transmitBulkDataLocked(&output, sizeof(output), timeout_ms) == false)
+    {
+      Metrics::increment(MetricCounter::TX_FRAMES, i);
+      Metrics::increment(MetricCounter::TX_FAILURES);
+      return i;
+    }
   }
 
-  if (actual_num_bytes != sizeof(input))
+  Metrics::increment(MetricCounter::TX_FRAMES, num_frames);
+  return num_frames;
+}
+
+// Frames keep the device's flag bits in `id`, so the two must agree.
+static_assert(CanFrame::kIdFlagEff == GsHostCanFrame::kCanIdEffFlag, "EFF flag mismatch");
+
+size_t GsUsbWrapper::toHostCanFdFrame(const CanFdFrame& frame, GsHostCanFdFrame* output)
+{
+  *output = GsHostCanFdFrame();
+  output->can_id = frame.id;
+  output->echo_id = 0;
+  output->channel = 0;
+  output->reserved = 0;
+
+  if (frame.fd_frame == false)
+  {
+    // Classic frames go out in the shorter layout, which ends in the timestamp straight after eight data bytes.
+    output->can_dlc = (frame.length < CanFrame::kDataNumMaxBytes) ? frame.length :
+      static_cast<uint8_t>(CanFrame::kDataNumMaxBytes);
+    output->flags = 0;
+    std::copy_n(&frame.data[0], output->can_dlc, &output->data[0]);
+    return sizeof(GsHostCanFrame);
+  }
+
+  output->can_dlc = canLengthToDlc(frame.length);
+  output->flags = GsHostCanFrame::kFlagFd;
+
+  if (frame.bit_rate_switch == true)
+  {
+    output->flags |= GsHostCanFrame::kFlagBitRateSwitch;
+  }
+
+  if (frame.error_state_indicator == true)
+  {
+    output->flags |= GsHostCanFrame::kFlagErrorStateIndicator;
+  }
+
+  // Lengths between the DLC steps are padded with zeros (already there from the constructor).
+  static_assert(sizeof(output->data) / sizeof(output->data[0]) == CanFdFrame::kDataNumMaxBytes,
+    "CAN FD data size mismatch");
+  std::copy_n(&frame.data[0], std::min<size_t>(frame.length, CanFdFrame::kDataNumMaxBytes), &output->data[0]);
+
+  output->timestamp_us = 0;
+  return sizeof(GsHostCanFdFrame);
+}
+
+bool GsUsbWrapper::fromHostCanFdFrame(const GsHostCanFdFrame& input, size_t num_bytes, CanFdFrame* frame)
+{
+  const bool fd_frame = (input.flags & GsHostCanFrame::kFlagFd) != 0;
+  if (num_bytes != (fd_frame ? sizeof(GsHostCanFdFrame) : sizeof(GsHostCanFrame)))
   {
     return false;
   }
@@ -442,21 +888,143 @@ bool GsUsbWrapper::readCanFrame(CanFrame* frame, uint32_t timeout_ms)
   frame->error_frame = input.can_id & GsHostCanFrame::kCanIdErrorFlag;
   frame->rtr_frame = input.can_id & GsHostCanFrame::kCanIdRtrFlag;
   frame->eff_frame = input.can_id & GsHostCanFrame::kCanIdEffFlag;
+  frame->fd_frame = fd_frame;
+  frame->bit_rate_switch = (input.flags & GsHostCanFrame::kFlagBitRateSwitch) != 0;
+  frame->error_state_indicator = (input.flags & GsHostCanFrame::kFlagErrorStateIndicator) != 0;
 
   // We expect that the echo ID be set to uint32_t(-1) when its not loopback.
   frame->from_tx = input.echo_id != GsHostCanFrame::kEchoIdNormalRxFrame;
 
-  // Make sure that the DLC never exceeds our max data size.
-  using dlc_type = decltype(frame->dlc);
-  frame->dlc = std::min(static_cast<dlc_type>(input.can_dlc), static_cast<dlc_type>(CanFrame::kDataNumMaxBytes));
+  // Classic DLCs above 8 still only carry 8 bytes.
+  frame->length = canDlcToLength(input.can_dlc, fd_frame);
+  std::copy_n(&input.data[0], frame->length, &frame->data[0]);
 
-  // Check at compile time that our CAN frame data lengths match, and then copy all in one fell swoop.
-  static_assert(sizeof(input.data) / sizeof(input.data[0]) == CanFrame::kDataNumMaxBytes, "CAN data size mismatch");
-  std::copy_n(&input.data[0], frame->dlc, &frame->data[0]);
+  if (fd_frame == true)
+  {
+    frame->timestamp_us = input.timestamp_us;
+  }
+  else
+  {
+    // In the classic layout the timestamp directly follows the eight data bytes.
+    static_assert(offsetof(GsHostCanFrame, timestamp_us) == offsetof(GsHostCanFdFrame, data) +
+      CanFrame::kDataNumMaxBytes, "Unexpected classic frame layout");
+    std::memcpy(&frame->timestamp_us, &input.data[CanFrame::kDataNumMaxBytes], sizeof(frame->timestamp_us));
+  }
+
+  return true;
+}
+
+bool GsUsbWrapper::writeCanFdFrame(const CanFdFrame& frame, uint32_t timeout_ms)
+{
+  if (frame.fd_frame == false)
+  {
+    CanFrame classic_frame;
+    return (toCanFrame(frame, &classic_frame) == true) && (writeCanFrame(classic_frame, timeout_ms) == true);
+  }
+
+  GsHostCanFdFrame output;
+  const size_t num_bytes = toHostCanFdFrame(frame, &output);
 
-  frame->timestamp_us = input.timestamp_us;
+  const bool transmitted = transmitBulkData(&output, num_bytes, timeout_ms);
+  Metrics::increment((transmitted == true) ? MetricCounter::TX_FRAMES : MetricCounter::TX_FAILURES);
+  return transmitted;
+}
+
+bool GsUsbWrapper::readCanFdFrame(CanFdFrame* frame, uint32_t timeout_ms)
+{
+  return receiveCanFdFrame(frame, timeout_ms, true);
+}
+
+bool GsUsbWrapper::receiveCanFdFrame(CanFdFrame* frame, uint32_t timeout_ms, bool wait)
+{
+  // Receive into the larger layout; a classic frame simply comes up short.
+  GsHostCanFdFrame input;
+  size_t actual_num_bytes = 0;
+
+  if (receiveBulkData(&input, sizeof(input), &actual_num_bytes, timeout_ms, wait) == false)
+  {
+    return false;
+  }
+
+  if (fromHostCanFdFrame(input, actual_num_bytes, frame) == false)
+  {
+    return false;
+  }
+
+  Metrics::increment(MetricCounter::RX_FRAMES);
+  if (frame->error_frame == true)
+  {
+    Metrics::increment(MetricCounter::RX_ERROR_FRAMES);
+  }
+
+  FlightRecorder* recorder = flight_recorder_.load(std::memory_order_acquire);
+  CanErrorMonitor* monitor = error_monitor_.load(std::memory_order_acquire);
+  CanFrame classic_frame;
+  if (((recorder == nullptr) && (monitor == nullptr)) || (toCanFrame(*frame, &classic_frame) == false))
+  {
+    return true;
+  }
+
+  if (recorder != nullptr)
+  {
+    recorder->record(classic_frame);
+  }
+
+  // Error frames stop here; the monitor reports them in aggregate.
+  if ((monitor != nullptr) && (monitor->processFrame(classic_frame) == true))
+  {
+    return false;
+  }
+
+  return true;
+}
+
+bool GsUsbWrapper::readCanFrame(CanFrame* frame, uint32_t timeout_ms)
+{
+  return receiveCanFrame(frame, timeout_ms, true);
+}
+
+bool GsUsbWrapper::receiveCanFrame(CanFrame* frame, uint32_t timeout_ms, bool wait)
+{
+  CanFdFrame input;
+  if (receiveCanFdFrame(&input, timeout_ms, wait) == false)
+  {
+    return false;
+  }
+
+  if (toCanFrame(input, frame) == false)
+  {
+    CANTALOUPE_DEBUG("Dropping CAN FD frame 0x{:X}; use readCanFdFrame() to receive it.", input.id);
+    return false;
+  }
 
   return true;
 }
 
+size_t GsUsbWrapper::readCanFrames(CanFrame* frames, size_t max_frames, uint32_t timeout_ms)
+{
+  if ((max_frames == 0) || (readCanFrame(&frames[0], timeout_ms) == false))
+  {
+    return 0;
+  }
+
+  size_t num_read = 1;
+  while ((num_read < max_frames) && (receiveCanFrame(&frames[num_read], 0, false) == true))
+  {
+    num_read++;
+  }
+
+  return num_read;
+}
+
+void GsUsbWrapper::setFlightRecorder(FlightRecorder* recorder)
+{
+  flight_recorder_.store(recorder, std::memory_order_release);
+}
+
+void GsUsbWrapper::setErrorMonitor(CanErrorMonitor* monitor)
+{
+  error_monitor_.store(monitor, std::memory_order_release);
+}
+
 }  // namespace cantaloupe
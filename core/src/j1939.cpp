@@ -0,0 +1,348 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#include <cantaloupe/j1939.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace cantaloupe
+{
+
+J1939Id J1939Id::decode(uint32_t can_id)
+{
+  const uint32_t raw_id = can_id & CanFrame::kIdMaskExtended;
+
+  J1939Id id;
+  id.priority = static_cast<uint8_t>((raw_id >> 26) & 0x07);
+  id.source_address = static_cast<uint8_t>(raw_id & 0xFF);
+
+  // PGN covers the extended data page, data page, PDU format and PDU specific bits.
+  id.pgn = (raw_id >> 8) & 0x3FFFF;
+
+  const uint8_t pdu_format = static_cast<uint8_t>((id.pgn >> 8) & 0xFF);
+  if (pdu_format < kPdu2FormatMin)
+  {
+    // PDU1: the PDU specific byte is the destination address and is not part of the PGN.
+    id.destination_address = static_cast<uint8_t>(id.pgn & 0xFF);
+    id.pgn &= 0x3FF00;
+  }
+  else
+  {
+    id.destination_address = kGlobalAddress;
+  }
+
+  return id;
+}
+
+uint32_t J1939Id::encode() const
+{
+  uint32_t raw_id = (static_cast<uint32_t>(priority & 0x07) << 26) | ((pgn & 0x3FFFF) << 8) | source_address;
+
+  const uint8_t pdu_format = static_cast<uint8_t>((pgn >> 8) & 0xFF);
+  if (pdu_format < kPdu2FormatMin)
+  {
+    raw_id = (raw_id & ~static_cast<uint32_t>(0xFF00)) | (static_cast<uint32_t>(destination_address) << 8);
+  }
+
+  return raw_id;
+}
+
+// Out-of-line definitions for constants that get bound to references (eg by std::min).
+constexpr size_t J1939Receiver::kTpBytesPerPacket;
+
+J1939Receiver::J1939Receiver(size_t max_sessions, uint32_t session_timeout_us) :
+  session_timeout_us_{session_timeout_us},
+  sessions_(std::min<size_t>(std::max<size_t>(max_sessions, 1), std::numeric_limits<uint16_t>::max() - 1)),
+  session_index_(static_cast<size_t>(1) << 16, 0),
+  handlers_{},
+  default_handler_{},
+  statistics_{}
+{
+}
+
+void J1939Receiver::setHandler(uint32_t pgn, J1939Handler handler)
+{
+  auto it = std::lower_bound(handlers_.begin(), handlers_.end(), pgn,
+    [](const HandlerEntry& entry, uint32_t value) { return entry.pgn < value; });
+
+  if ((it != handlers_.end()) && (it->pgn == pgn))
+  {
+    it->handler = std::move(handler);
+    return;
+  }
+
+  handlers_.insert(it, HandlerEntry{pgn, std::move(handler)});
+}
+
+void J1939Receiver::setDefaultHandler(J1939Handler handler)
+{
+  default_handler_ = std::move(handler);
+}
+
+bool J1939Receiver::processFrame(const CanFrame& frame)
+{
+  if ((frame.eff_frame == false) || (frame.error_frame == true) || (frame.rtr_frame == true))
+  {
+    return false;
+  }
+
+  statistics_.frames_processed++;
+
+  const J1939Id id = J1939Id::decode(frame.id);
+
+  if (id.pgn == kPgnTpConnectionManagement)
+  {
+    processConnectionManagement(id, frame);
+  }
+  else if (id.pgn == kPgnTpDataTransfer)
+  {
+    processDataTransfer(id, frame);
+  }
+  else
+  {
+    J1939Message message;
+    message.id = id;
+    message.data = frame.data.data();
+    message.length = (frame.dlc < CanFrame::kDataNumMaxBytes) ? frame.dlc : CanFrame::kDataNumMaxBytes;
+    message.timestamp_us = frame.timestamp_us;
+    dispatch(message);
+  }
+
+  return true;
+}
+
+void J1939Receiver::processConnectionManagement(const J1939Id& id, const CanFrame& frame)
+{
+  if (frame.dlc < CanFrame::kDataNumMaxBytes)
+  {
+    statistics_.protocol_errors++;
+    return;
+  }
+
+  switch (frame.data[0])
+  {
+    case kTpCmBroadcastAnnounce:
+      openSession(SessionType::BAM, id.source_address, J1939Id::kGlobalAddress, frame);
+      break;
+
+    case kTpCmRequestToSend:
+      openSession(SessionType::CMDT, id.source_address, id.destination_address, frame);
+      break;
+
+    case kTpCmClearToSend:
+    {
+      // CTS travels from the receiver back to the originator, so the session is keyed the other way round.
+      Session* session = findSession(id.destination_address, id.source_address);
+      if (session != nullptr)
+      {
+        session->last_timestamp_us = frame.timestamp_us;
+      }
+      break;
+    }
+
+    case kTpCmEndOfMessageAck:
+      // Nothing to do; the message was dispatched as soon as the final packet arrived.
+      break;
+
+    case kTpCmAbort:
+    {
+      // Either side may abort.
+      Session* session = findSession(id.source_address, id.destination_address);
+      if (session == nullptr)
+      {
+        session = findSession(id.destination_address, id.source_address);
+      }
+
+      if (session != nullptr)
+      {
+        statistics_.sessions_aborted++;
+        closeSession(session);
+      }
+      break;
+    }
+
+    default:
+      statistics_.protocol_errors++;
+      break;
+  }
+}
+
+void J1939Receiver::processDataTransfer(const J1939Id& id, const CanFrame& frame)
+{
+  Session* session = findSession(id.source_address, id.destination_address);
+  if ((session == nullptr) || (frame.dlc < 1))
+  {
+    statistics_.protocol_errors++;
+    return;
+  }
+
+  if (static_cast<uint32_t>(frame.timestamp_us - session->last_timestamp_us) > session_timeout_us_)
+  {
+    statistics_.sessions_timed_out++;
+    closeSession(session);
+    return;
+  }
+
+  const uint8_t sequence = frame.data[0];
+  if ((sequence == 0) || (sequence > session->num_packets))
+  {
+    statistics_.protocol_errors++;
+    return;
+  }
+
+  session->last_timestamp_us = frame.timestamp_us;
+
+  const size_t packet_index = sequence - 1U;
+  const uint64_t packet_bit = static_cast<uint64_t>(1) << (packet_index % 64);
+  uint64_t& mask_word = session->received_mask[packet_index / 64];
+  if ((mask_word & packet_bit) != 0)
+  {
+    // Retransmission of a packet we already have.
+    return;
+  }
+
+  mask_word |= packet_bit;
+  session->num_received++;
+
+  // The last packet is padded out to eight bytes; only copy what fits the announced size.
+  const size_t offset = packet_index * kTpBytesPerPacket;
+  const size_t num_bytes = std::min<size_t>(std::min<size_t>(frame.dlc - 1U, kTpBytesPerPacket),
+    session->total_bytes - offset);
+  std::copy_n(&frame.data[1], num_bytes, &session->data[offset]);
+
+  if (session->num_received == session->num_packets)
+  {
+    J1939Message message;
+    message.id = session->id;
+    message.data = session->data.data();
+    message.length = session->total_bytes;
+    message.timestamp_us = frame.timestamp_us;
+
+    statistics_.sessions_completed++;
+    dispatch(message);
+    closeSession(session);
+  }
+}
+
+void J1939Receiver::openSession(SessionType type, uint8_t source, uint8_t destination, const CanFrame& frame)
+{
+  const uint16_t total_bytes = static_cast<uint16_t>(frame.data[1] | (frame.data[2] << 8));
+  const uint8_t num_packets = frame.data[3];
+
+  if ((total_bytes <= CanFrame::kDataNumMaxBytes) || (total_bytes > kTpMaxMessageBytes) ||
+    (num_packets != (total_bytes + kTpBytesPerPacket - 1) / kTpBytesPerPacket))
+  {
+    statistics_.protocol_errors++;
+    return;
+  }
+
+  // A new announcement between the same pair of nodes replaces the old transfer.
+  Session* session = findSession(source, destination);
+  if (session != nullptr)
+  {
+    statistics_.sessions_aborted++;
+    closeSession(session);
+  }
+
+  // Find a free slot, reclaiming a stale one if we have to.
+  for (Session& candidate : sessions_)
+  {
+    if ((candidate.in_use == true) &&
+      (static_cast<uint32_t>(frame.timestamp_us - candidate.last_timestamp_us) > session_timeout_us_))
+    {
+      statistics_.sessions_timed_out++;
+      closeSession(&candidate);
+    }
+
+    if (candidate.in_use == false)
+    {
+      session = &candidate;
+      break;
+    }
+  }
+
+  if (session == nullptr)
+  {
+    statistics_.sessions_dropped++;
+    return;
+  }
+
+  session->in_use = true;
+  session->type = type;
+  session->id.priority = J1939Id::decode(frame.id).priority;
+  session->id.pgn = static_cast<uint32_t>(frame.data[5] | (frame.data[6] << 8) | (frame.data[7] << 16));
+  session->id.source_address = source;
+  session->id.destination_address = destination;
+  session->total_bytes = total_bytes;
+  session->num_packets = num_packets;
+  session->num_received = 0;
+  session->last_timestamp_us = frame.timestamp_us;
+  session->received_mask.fill(0);
+
+  session_index_[addressPairIndex(source, destination)] = static_cast<uint16_t>(session - sessions_.data() + 1);
+  statistics_.sessions_started++;
+}
+
+J1939Receiver::Session* J1939Receiver::findSession(uint8_t source, uint8_t destination)
+{
+  const uint16_t slot = session_index_[addressPairIndex(source, destination)];
+  return (slot == 0) ? nullptr : &sessions_[slot - 1U];
+}
+
+void J1939Receiver::closeSession(Session* session)
+{
+  session_index_[addressPairIndex(session->id.source_address, session->id.destination_address)] = 0;
+  session->in_use = false;
+}
+
+void J1939Receiver::expireSessions(uint32_t now_us)
+{
+  for (Session& session : sessions_)
+  {
+    if ((session.in_use == true) &&
+      (static_cast<uint32_t>(now_us - session.last_timestamp_us) > session_timeout_us_))
+    {
+      statistics_.sessions_timed_out++;
+      closeSession(&session);
+    }
+  }
+}
+
+size_t J1939Receiver::numActiveSessions() const
+{
+  return static_cast<size_t>(std::count_if(sessions_.begin(), sessions_.end(),
+    [](const Session& session) { return session.in_use; }));
+}
+
+void J1939Receiver::dispatch(const J1939Message& message)
+{
+  auto it = std::lower_bound(handlers_.begin(), handlers_.end(), message.id.pgn,
+    [](const HandlerEntry& entry, uint32_t value) { return entry.pgn < value; });
+
+  if ((it != handlers_.end()) && (it->pgn == message.id.pgn))
+  {
+    it->handler(message);
+  }
+  else if (default_handler_)
+  {
+    default_handler_(message);
+  }
+  else
+  {
+    return;
+  }
+
+  statistics_.messages_dispatched++;
+}
+
+}  // namespace cantaloupe
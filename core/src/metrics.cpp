@@ -0,0 +1,435 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#include <cantaloupe/clock.h>
+#include <cantaloupe/metrics.h>
+
+#include <spdlog/fmt/fmt.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cantaloupe
+{
+
+// One thread's worth of metrics.  Only the owning thread writes, so updates are plain relaxed load/store pairs rather
+// than read-modify-write operations.
+struct MetricsShard
+{
+  std::array<std::atomic<uint64_t>, kNumMetricCounters> counters{};
+  std::array<std::atomic<uint64_t>, kNumLibUsbErrorSlots> libusb_errors{};
+
+  struct Histogram
+  {
+    std::array<std::atomic<uint64_t>, kHistogramNumBuckets> buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+  };
+
+  std::array<Histogram, kNumMetricHistograms> histograms{};
+};
+
+// Owns every shard ever handed out.  Shards are only created the first time a thread records something, and returned
+// to the free list when that thread exits.
+class MetricsRegistry
+{
+ public:
+  MetricsShard* acquire()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_shards_.empty() == false)
+    {
+      MetricsShard* shard = free_shards_.back();
+      free_shards_.pop_back();
+      return shard;
+    }
+
+    shards_.emplace_back(new MetricsShard());
+    return shards_.back().get();
+  }
+
+  void release(MetricsShard* shard)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_shards_.push_back(shard);
+  }
+
+  void accumulate(MetricsSnapshot* snapshot)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& shard : shards_)
+    {
+      for (size_t i = 0; i < kNumMetricCounters; ++i)
+      {
+        snapshot->counters[i] += shard->counters[i].load(std::memory_order_relaxed);
+      }
+
+      for (size_t i = 0; i < kNumLibUsbErrorSlots; ++i)
+      {
+        snapshot->libusb_errors[i] += shard->libusb_errors[i].load(std::memory_order_relaxed);
+      }
+
+      for (size_t h = 0; h < kNumMetricHistograms; ++h)
+      {
+        const MetricsShard::Histogram& source = shard->histograms[h];
+        HistogramSnapshot& destination = snapshot->histograms[h];
+
+        for (size_t i = 0; i < kHistogramNumBuckets; ++i)
+        {
+          destination.buckets[i] += source.buckets[i].load(std::memory_order_relaxed);
+        }
+
+        destination.count += source.count.load(std::memory_order_relaxed);
+        destination.sum += source.sum.load(std::memory_order_relaxed);
+      }
+    }
+
+    for (size_t i = 0; i < kNumMetricGauges; ++i)
+    {
+      snapshot->gauges[i] = gauges_[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  std::array<std::atomic<uint64_t>, kNumMetricGauges>& gauges() { return gauges_; }
+
+ private:
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<MetricsShard>> shards_;
+  std::vector<MetricsShard*> free_shards_;
+  std::array<std::atomic<uint64_t>, kNumMetricGauges> gauges_{};
+};
+
+// Intentionally leaked so that threads exiting during static destruction can still hand their shard back.
+static MetricsRegistry& registry()
+{
+  static MetricsRegistry* instance = new MetricsRegistry();
+  return *instance;
+}
+
+// Binds a shard to the current thread for the thread's lifetime.
+class ThreadShard
+{
+ public:
+  ThreadShard() : shard_{registry().acquire()} {}
+  ~ThreadShard() { registry().release(shard_); }
+
+  MetricsShard* get() const { return shard_; }
+
+ private:
+  MetricsShard* shard_;
+};
+
+static MetricsShard& localShard()
+{
+  static thread_local ThreadShard thread_shard;
+  return *thread_shard.get();
+}
+
+// Single-writer increment.
+static inline void bump(std::atomic<uint64_t>& value, uint64_t amount)
+{
+  value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+static const char* const kCounterNames[kNumMetricCounters] = {
+  "bulk_in_transfers",
+  "bulk_in_bytes",
+  "bulk_out_transfers",
+  "bulk_out_bytes",
+  "bulk_timeouts",
+  "bulk_errors",
+  "control_transfers",
+  "control_failures",
+  "hotplug_attach",
+  "hotplug_detach",
+  "rx_frames",
+  "rx_error_frames",
+  "tx_frames",
+  "tx_failures",
+};
+
+static const char* const kGaugeNames[kNumMetricGauges] = {
+  "tx_queue_high_water_mark",
+};
+
+static const char* const kHistogramNames[kNumMetricHistograms] = {
+  "bulk_in_latency_us",
+  "bulk_out_latency_us",
+  "control_latency_us",
+};
+
+// Indexed by -error_code - 1, with LIBUSB_ERROR_OTHER (-99) and anything unknown at the end.
+static const char* const kLibUsbErrorNames[] = {
+  "LIBUSB_ERROR_IO",
+  "LIBUSB_ERROR_INVALID_PARAM",
+  "LIBUSB_ERROR_ACCESS",
+  "LIBUSB_ERROR_NO_DEVICE",
+  "LIBUSB_ERROR_NOT_FOUND",
+  "LIBUSB_ERROR_BUSY",
+  "LIBUSB_ERROR_TIMEOUT",
+  "LIBUSB_ERROR_OVERFLOW",
+  "LIBUSB_ERROR_PIPE",
+  "LIBUSB_ERROR_INTERRUPTED",
+  "LIBUSB_ERROR_NO_MEM",
+  "LIBUSB_ERROR_NOT_SUPPORTED",
+  "LIBUSB_ERROR_OTHER",
+  "unknown",
+};
+
+static_assert(sizeof(kLibUsbErrorNames) / sizeof(kLibUsbErrorNames[0]) == kNumLibUsbErrorSlots,
+  "every LibUSB error slot needs a name");
+
+void Metrics::increment(MetricCounter counter, uint64_t amount)
+{
+  bump(localShard().counters[static_cast<size_t>(counter)], amount);
+}
+
+void Metrics::recordLibUsbError(int error_code)
+{
+  if (error_code >= 0)
+  {
+    return;
+  }
+
+  size_t slot = kNumLibUsbErrorSlots - 1;
+  if (error_code >= -12)
+  {
+    slot = static_cast<size_t>(-error_code - 1);
+  }
+  else if (error_code == -99)
+  {
+    slot = kNumLibUsbErrorSlots - 2;
+  }
+
+  bump(localShard().libusb_errors[slot], 1);
+}
+
+void Metrics::recordLatency(MetricHistogram histogram, uint64_t value_us)
+{
+  MetricsShard::Histogram& destination = localShard().histograms[static_cast<size_t>(histogram)];
+  bump(destination.buckets[HistogramSnapshot::bucketIndex(value_us)], 1);
+  bump(destination.count, 1);
+  bump(destination.sum, value_us);
+}
+
+void Metrics::updateHighWaterMark(MetricGauge gauge, uint64_t value)
+{
+  std::atomic<uint64_t>& destination = registry().gauges()[static_cast<size_t>(gauge)];
+
+  uint64_t current = destination.load(std::memory_order_relaxed);
+  while ((current < value) &&
+    (destination.compare_exchange_weak(current, value, std::memory_order_relaxed) == false))
+  {
+  }
+}
+
+MetricsSnapshot Metrics::snapshot()
+{
+  MetricsSnapshot snapshot;
+  snapshot.timestamp_us = SteadyClock::instance().nowUs();
+  registry().accumulate(&snapshot);
+  return snapshot;
+}
+
+const char* Metrics::counterName(MetricCounter counter)
+{
+  return kCounterNames[static_cast<size_t>(counter)];
+}
+
+const char* Metrics::gaugeName(MetricGauge gauge)
+{
+  return kGaugeNames[static_cast<size_t>(gauge)];
+}
+
+const char* Metrics::histogramName(MetricHistogram histogram)
+{
+  return kHistogramNames[static_cast<size_t>(histogram)];
+}
+
+const char* Metrics::libUsbErrorName(size_t slot)
+{
+  return (slot < kNumLibUsbErrorSlots) ? kLibUsbErrorNames[slot] : "unknown";
+}
+
+size_t HistogramSnapshot::bucketIndex(uint64_t value)
+{
+  if (value < kHistogramSubBuckets)
+  {
+    return static_cast<size_t>(value);
+  }
+
+  // Position of the most significant bit picks the power of two; the next few bits pick the sub-bucket.
+  const size_t exponent = static_cast<size_t>(63 - __builtin_clzll(value));
+  const size_t shift = exponent - kHistogramSubBucketBits;
+  const size_t sub_bucket = static_cast<size_t>(value >> shift) & (kHistogramSubBuckets - 1);
+
+  return kHistogramSubBuckets + shift * kHistogramSubBuckets + sub_bucket;
+}
+
+uint64_t HistogramSnapshot::bucketUpperBound(size_t index)
+{
+  if (index < kHistogramSubBuckets)
+  {
+    return index;
+  }
+
+  const size_t shift = (index - kHistogramSubBuckets) / kHistogramSubBuckets;
+  const uint64_t sub_bucket = (index - kHistogramSubBuckets) % kHistogramSubBuckets;
+  const uint64_t lower = (kHistogramSubBuckets + sub_bucket) << shift;
+
+  return lower + ((static_cast<uint64_t>(1) << shift) - 1);
+}
+
+uint64_t HistogramSnapshot::percentile(double q) const
+{
+  if (count == 0)
+  {
+    return 0;
+  }
+
+  const double clamped = std::min(std::max(q, 0.0), 1.0);
+  const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(clamped * static_cast<double>(count) + 0.5));
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kHistogramNumBuckets; ++i)
+  {
+    seen += buckets[i];
+    if (seen >= rank)
+    {
+      return bucketUpperBound(i);
+    }
+  }
+
+  return bucketUpperBound(kHistogramNumBuckets - 1);
+}
+
+MetricsSnapshot MetricsSnapshot::delta(const MetricsSnapshot& earlier) const
+{
+  MetricsSnapshot result = *this;
+  result.timestamp_us = timestamp_us - earlier.timestamp_us;
+
+  for (size_t i = 0; i < kNumMetricCounters; ++i)
+  {
+    result.counters[i] -= earlier.counters[i];
+  }
+
+  for (size_t i = 0; i < kNumLibUsbErrorSlots; ++i)
+  {
+    result.libusb_errors[i] -= earlier.libusb_errors[i];
+  }
+
+  for (size_t h = 0; h < kNumMetricHistograms; ++h)
+  {
+    for (size_t i = 0; i < kHistogramNumBuckets; ++i)
+    {
+      result.histograms[h].buckets[i] -= earlier.histograms[h].buckets[i];
+    }
+
+    result.histograms[h].count -= earlier.histograms[h].count;
+    result.histograms[h].sum -= earlier.histograms[h].sum;
+  }
+
+  return result;
+}
+
+std::string MetricsSnapshot::toText() const
+{
+  fmt::memory_buffer out;
+
+  for (size_t i = 0; i < kNumMetricCounters; ++i)
+  {
+    fmt::format_to(out, "{} {}\n", kCounterNames[i], counters[i]);
+  }
+
+  for (size_t i = 0; i < kNumLibUsbErrorSlots; ++i)
+  {
+    if (libusb_errors[i] != 0)
+    {
+      fmt::format_to(out, "libusb_errors{{code=\"{}\"}} {}\n", Metrics::libUsbErrorName(i), libusb_errors[i]);
+    }
+  }
+
+  for (size_t i = 0; i < kNumMetricGauges; ++i)
+  {
+    fmt::format_to(out, "{} {}\n", kGaugeNames[i], gauges[i]);
+  }
+
+  for (size_t h = 0; h < kNumMetricHistograms; ++h)
+  {
+    const HistogramSnapshot& histogram = histograms[h];
+    fmt::format_to(out, "{} count={} sum={} p50={} p90={} p99={} p999={} max={}\n", kHistogramNames[h],
+      histogram.count, histogram.sum, histogram.percentile(0.5), histogram.percentile(0.9),
+      histogram.percentile(0.99), histogram.percentile(0.999), histogram.percentile(1.0));
+  }
+
+  return fmt::to_string(out);
+}
+
+std::string MetricsSnapshot::toJson() const
+{
+  fmt::memory_buffer out;
+  fmt::format_to(out, "{{\"timestamp_us\":{},\"counters\":{{", timestamp_us);
+
+  for (size_t i = 0; i < kNumMetricCounters; ++i)
+  {
+    fmt::format_to(out, "{}\"{}\":{}", (i == 0) ? "" : ",", kCounterNames[i], counters[i]);
+  }
+
+  fmt::format_to(out, "}},\"libusb_errors\":{{");
+  bool first = true;
+  for (size_t i = 0; i < kNumLibUsbErrorSlots; ++i)
+  {
+    if (libusb_errors[i] != 0)
+    {
+      fmt::format_to(out, "{}\"{}\":{}", (first == true) ? "" : ",", Metrics::libUsbErrorName(i), libusb_errors[i]);
+      first = false;
+    }
+  }
+
+  fmt::format_to(out, "}},\"gauges\":{{");
+  for (size_t i = 0; i < kNumMetricGauges; ++i)
+  {
+    fmt::format_to(out, "{}\"{}\":{}", (i == 0) ? "" : ",", kGaugeNames[i], gauges[i]);
+  }
+
+  fmt::format_to(out, "}},\"histograms\":{{");
+  for (size_t h = 0; h < kNumMetricHistograms; ++h)
+  {
+    const HistogramSnapshot& histogram = histograms[h];
+    fmt::format_to(out, "{}\"{}\":{{\"count\":{},\"sum\":{},\"p50\":{},\"p90\":{},\"p99\":{},\"p999\":{},"
+      "\"max\":{},\"buckets\":[", (h == 0) ? "" : ",", kHistogramNames[h], histogram.count, histogram.sum,
+      histogram.percentile(0.5), histogram.percentile(0.9), histogram.percentile(0.99),
+      histogram.percentile(0.999), histogram.percentile(1.0));
+
+    // Sparse [upper_bound, count] pairs for the non-empty buckets.
+    first = true;
+    for (size_t i = 0; i < kHistogramNumBuckets; ++i)
+    {
+      if (histogram.buckets[i] != 0)
+      {
+        fmt::format_to(out, "{}[{},{}]", (first == true) ? "" : ",", HistogramSnapshot::bucketUpperBound(i),
+          histogram.buckets[i]);
+        first = false;
+      }
+    }
+
+    fmt::format_to(out, "]}}");
+  }
+
+  fmt::format_to(out, "}}}}");
+  return fmt::to_string(out);
+}
+
+}  // namespace cantaloupe
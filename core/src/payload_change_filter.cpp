@@ -0,0 +1,238 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#include <cantaloupe/payload_change_filter.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace cantaloupe
+{
+
+// Low bit of every byte in a 64-bit word.
+static constexpr uint64_t kByteLowBits = 0x0101010101010101;
+
+// Multiplier gathering the low bit of byte `i` into bit `56 + i`.
+static constexpr uint64_t kGatherBytes = 0x0102040810204080;
+
+// Out-of-line definitions for constants that get bound to references (eg by std::min).
+constexpr size_t PayloadChangeFilter::kDefaultExtendedCapacity;
+constexpr uint64_t PayloadChangeFilter::kAllBits;
+
+// Bits of the payload word covered by the first `dlc` bytes.
+static uint64_t lengthMask(uint8_t dlc)
+{
+  return (dlc >= CanFrame::kDataNumMaxBytes) ? PayloadChangeFilter::kAllBits : ((uint64_t{1} << (8 * dlc)) - 1);
+}
+
+// Load the payload as one word with `data[i]` in byte `i`, whatever the host byte order.
+static uint64_t loadPayload(const CanFrame& frame)
+{
+  uint64_t payload = 0;
+  std::memcpy(&payload, frame.data.data(), sizeof(payload));
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  payload = __builtin_bswap64(payload);
+#endif
+
+  return payload;
+}
+
+PayloadChangeFilter::PayloadChangeFilter(size_t extended_capacity) :
+  standard_entries_(CanFrame::kIdMaskStandard + 1),
+  extended_entries_{},
+  extended_mask_{0},
+  extended_used_{0},
+  default_bit_mask_{kAllBits},
+  statistics_{}
+{
+  // Keep the table at most half full so probe sequences stay short.
+  size_t num_slots = 2;
+  while (num_slots < (2 * std::max<size_t>(extended_capacity, 1)))
+  {
+    num_slots <<= 1;
+  }
+
+  extended_entries_.resize(num_slots);
+  extended_mask_ = num_slots - 1;
+}
+
+uint8_t PayloadChangeFilter::nonZeroBytes(uint64_t word)
+{
+  // Fold every byte onto its low bit, then gather the eight low bits into the top byte with one multiply.  Each
+  // partial product lands on a distinct bit, so there are no carries into the top byte.
+  word |= word >> 4;
+  word |= word >> 2;
+  word |= word >> 1;
+  return static_cast<uint8_t>(((word & kByteLowBits) * kGatherBytes) >> 56);
+}
+
+PayloadChangeFilter::Entry* PayloadChangeFilter::lookup(uint32_t id, bool extended)
+{
+  if (extended == false)
+  {
+    return &standard_entries_[id & CanFrame::kIdMaskStandard];
+  }
+
+  const uint32_t key = id & CanFrame::kIdMaskExtended;
+  size_t index = static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> 32) & extended_mask_;
+
+  while (true)
+  {
+    Entry& entry = extended_entries_[index];
+    if (entry.used == false)
+    {
+      // Leave room for the probe to always find an empty slot.
+      if (extended_used_ >= (extended_entries_.size() / 2))
+      {
+        return nullptr;
+      }
+
+      entry.used = true;
+      entry.key = key;
+      entry.bit_mask = default_bit_mask_;
+      extended_used_++;
+      return &entry;
+    }
+
+    if (entry.key == key)
+    {
+      return &entry;
+    }
+
+    index = (index + 1) & extended_mask_;
+  }
+}
+
+bool PayloadChangeFilter::setBitMask(uint32_t id, uint64_t bit_mask)
+{
+  Entry* entry = lookup(id, CanFrame::isExtendedId(id));
+  if (entry == nullptr)
+  {
+    return false;
+  }
+
+  entry->bit_mask = bit_mask;
+  return true;
+}
+
+void PayloadChangeFilter::setDefaultBitMask(uint64_t bit_mask)
+{
+  default_bit_mask_ = bit_mask;
+  for (Entry& entry : standard_entries_)
+  {
+    entry.bit_mask = bit_mask;
+  }
+
+  for (Entry& entry : extended_entries_)
+  {
+    entry.bit_mask = bit_mask;
+  }
+}
+
+bool PayloadChangeFilter::process(const CanFrame& frame, uint8_t* changed_bytes)
+{
+  statistics_.frames_in++;
+
+  uint8_t changed = 0;
+  bool forward = true;
+
+  Entry* entry = nullptr;
+  if ((frame.error_frame == true) || (frame.rtr_frame == true))
+  {
+    statistics_.passed_through++;
+  }
+  else if ((entry = lookup(frame.id, frame.eff_frame)) == nullptr)
+  {
+    statistics_.table_full++;
+  }
+  else
+  {
+    const uint8_t dlc = std::min<uint8_t>(frame.dlc, static_cast<uint8_t>(CanFrame::kDataNumMaxBytes));
+    const uint64_t payload = loadPayload(frame) & lengthMask(dlc);
+
+    if (entry->seen == false)
+    {
+      entry->seen = true;
+      changed = static_cast<uint8_t>((1U << dlc) - 1);
+      statistics_.first_seen++;
+    }
+    else
+    {
+      // Bytes that appeared or disappeared with a change of length count as changed too.
+      const uint64_t difference = (payload ^ entry->payload) | (lengthMask(dlc) ^ lengthMask(entry->dlc));
+      changed = nonZeroBytes(difference);
+      forward = ((difference & entry->bit_mask) != 0) || (dlc != entry->dlc);
+    }
+
+    entry->payload = payload;
+    entry->dlc = dlc;
+  }
+
+  if (changed_bytes != nullptr)
+  {
+    *changed_bytes = changed;
+  }
+
+  if (forward == true)
+  {
+    statistics_.frames_forwarded++;
+  }
+
+  return forward;
+}
+
+size_t PayloadChangeFilter::filter(const CanFrame* frames, size_t num_frames, CanFrame* output,
+  uint8_t* changed_bytes)
+{
+  size_t num_forwarded = 0;
+  for (size_t i = 0; i < num_frames; ++i)
+  {
+    uint8_t changed = 0;
+    if (process(frames[i], &changed) == false)
+    {
+      continue;
+    }
+
+    // `output` may alias `frames`, but never runs ahead of it.
+    if (&output[num_forwarded] != &frames[i])
+    {
+      output[num_forwarded] = frames[i];
+    }
+
+    if (changed_bytes != nullptr)
+    {
+      changed_bytes[num_forwarded] = changed;
+    }
+
+    num_forwarded++;
+  }
+
+  return num_forwarded;
+}
+
+void PayloadChangeFilter::reset()
+{
+  for (Entry& entry : standard_entries_)
+  {
+    entry.seen = false;
+  }
+
+  for (Entry& entry : extended_entries_)
+  {
+    entry.seen = false;
+  }
+
+  statistics_ = Statistics{};
+}
+
+}  // namespace cantaloupe
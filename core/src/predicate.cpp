@@ -0,0 +1,1242 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#include <cantaloupe/predicate.h>
+
+#include <spdlog/fmt/fmt.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <memory>
+
+namespace cantaloupe
+{
+
+// Out-of-line definitions for constants that get bound to references (eg by std::min).
+constexpr size_t Predicate::kMaxStackDepth;
+constexpr size_t Predicate::kMaxNestingDepth;
+constexpr uint32_t Predicate::kAnyId;
+
+namespace
+{
+
+// Bits of the payload word covered by the first `dlc` bytes.
+uint64_t lengthMask(uint8_t dlc)
+{
+  return (dlc >= CanFrame::kDataNumMaxBytes) ? ~uint64_t{0} : ((uint64_t{1} << (8 * dlc)) - 1);
+}
+
+// The payload as one little-endian word, with bytes past the end of the payload cleared.
+uint64_t loadPayload(const CanFrame& frame)
+{
+  uint64_t payload = 0;
+  std::memcpy(&payload, frame.data.data(), sizeof(payload));
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  payload = __builtin_bswap64(payload);
+#endif
+
+  return payload & lengthMask(frame.dlc);
+}
+
+uint64_t applyUnary(Predicate::Opcode opcode, uint64_t value)
+{
+  switch (opcode)
+  {
+    case Predicate::Opcode::NOT:
+      return (value == 0) ? 1 : 0;
+    case Predicate::Opcode::NEGATE:
+      return ~value + 1;
+    case Predicate::Opcode::BIT_NOT:
+      return ~value;
+    case Predicate::Opcode::TO_BOOL:
+      return (value != 0) ? 1 : 0;
+    case Predicate::Opcode::PUSH:
+    case Predicate::Opcode::LOAD_ID:
+    case Predicate::Opcode::LOAD_DLC:
+    case Predicate::Opcode::LOAD_EFF:
+    case Predicate::Opcode::LOAD_RTR:
+    case Predicate::Opcode::LOAD_ERR:
+    case Predicate::Opcode::LOAD_TX:
+    case Predicate::Opcode::LOAD_TIMESTAMP:
+    case Predicate::Opcode::LOAD_DATA:
+    case Predicate::Opcode::LOAD_BITS:
+    case Predicate::Opcode::MULTIPLY:
+    case Predicate::Opcode::DIVIDE:
+    case Predicate::Opcode::MODULO:
+    case Predicate::Opcode::ADD:
+    case Predicate::Opcode::SUBTRACT:
+    case Predicate::Opcode::SHIFT_LEFT:
+    case Predicate::Opcode::SHIFT_RIGHT:
+    case Predicate::Opcode::LESS:
+    case Predicate::Opcode::LESS_EQUAL:
+    case Predicate::Opcode::GREATER:
+    case Predicate::Opcode::GREATER_EQUAL:
+    case Predicate::Opcode::EQUAL:
+    case Predicate::Opcode::NOT_EQUAL:
+    case Predicate::Opcode::BIT_AND:
+    case Predicate::Opcode::BIT_XOR:
+    case Predicate::Opcode::BIT_OR:
+    case Predicate::Opcode::JUMP_IF_FALSE:
+    case Predicate::Opcode::JUMP_IF_TRUE:
+      return 0;
+  }
+
+  return 0;
+}
+
+inline uint64_t applyBinary(Predicate::Opcode opcode, uint64_t lhs, uint64_t rhs)
+{
+  switch (opcode)
+  {
+    case Predicate::Opcode::MULTIPLY:
+      return lhs * rhs;
+    case Predicate::Opcode::DIVIDE:
+      return (rhs == 0) ? 0 : (lhs / rhs);
+    case Predicate::Opcode::MODULO:
+      return (rhs == 0) ? 0 : (lhs % rhs);
+    case Predicate::Opcode::ADD:
+      return lhs + rhs;
+    case Predicate::Opcode::SUBTRACT:
+      return lhs - rhs;
+    case Predicate::Opcode::SHIFT_LEFT:
+      return (rhs >= 64) ? 0 : (lhs << rhs);
+    case Predicate::Opcode::SHIFT_RIGHT:
+      return (rhs >= 64) ? 0 : (lhs >> rhs);
+    case Predicate::Opcode::LESS:
+      return lhs < rhs;
+    case Predicate::Opcode::LESS_EQUAL:
+      return lhs <= rhs;
+    case Predicate::Opcode::GREATER:
+      return lhs > rhs;
+    case Predicate::Opcode::GREATER_EQUAL:
+      return lhs >= rhs;
+    case Predicate::Opcode::EQUAL:
+      return lhs == rhs;
+    case Predicate::Opcode::NOT_EQUAL:
+      return lhs != rhs;
+    case Predicate::Opcode::BIT_AND:
+      return lhs & rhs;
+    case Predicate::Opcode::BIT_XOR:
+      return lhs ^ rhs;
+    case Predicate::Opcode::BIT_OR:
+      return lhs | rhs;
+    case Predicate::Opcode::PUSH:
+    case Predicate::Opcode::LOAD_ID:
+    case Predicate::Opcode::LOAD_DLC:
+    case Predicate::Opcode::LOAD_EFF:
+    case Predicate::Opcode::LOAD_RTR:
+    case Predicate::Opcode::LOAD_ERR:
+    case Predicate::Opcode::LOAD_TX:
+    case Predicate::Opcode::LOAD_TIMESTAMP:
+    case Predicate::Opcode::LOAD_DATA:
+    case Predicate::Opcode::LOAD_BITS:
+    case Predicate::Opcode::NOT:
+    case Predicate::Opcode::NEGATE:
+    case Predicate::Opcode::BIT_NOT:
+    case Predicate::Opcode::TO_BOOL:
+    case Predicate::Opcode::JUMP_IF_FALSE:
+    case Predicate::Opcode::JUMP_IF_TRUE:
+      return 0;
+  }
+
+  return 0;
+}
+
+const char* opcodeName(Predicate::Opcode opcode)
+{
+  static const char* kNames[] = {"PUSH", "LOAD_ID", "LOAD_DLC", "LOAD_EFF", "LOAD_RTR", "LOAD_ERR", "LOAD_TX",
+    "LOAD_TIMESTAMP", "LOAD_DATA", "LOAD_BITS", "NOT", "NEGATE", "BIT_NOT", "MULTIPLY", "DIVIDE", "MODULO", "ADD",
+    "SUBTRACT", "SHIFT_LEFT", "SHIFT_RIGHT", "LESS", "LESS_EQUAL", "GREATER", "GREATER_EQUAL", "EQUAL", "NOT_EQUAL",
+    "BIT_AND", "BIT_XOR", "BIT_OR", "TO_BOOL", "JUMP_IF_FALSE", "JUMP_IF_TRUE"};
+  static_assert(sizeof(kNames) / sizeof(kNames[0]) == static_cast<size_t>(Predicate::Opcode::JUMP_IF_TRUE) + 1,
+    "Opcode names out of date");
+  return kNames[static_cast<size_t>(opcode)];
+}
+
+// Syntax tree built while compiling.
+struct Node
+{
+  enum class Kind
+  {
+    CONSTANT,
+    LOAD,
+    UNARY,
+    BINARY,
+    LOGICAL_AND,
+    LOGICAL_OR
+  };
+
+  Kind kind = Kind::CONSTANT;
+  Predicate::Opcode opcode = Predicate::Opcode::PUSH;
+  uint64_t value = 0;
+  std::unique_ptr<Node> lhs;
+  std::unique_ptr<Node> rhs;
+
+  // Nodes on the longest path down to a leaf, including this one.
+  size_t height = 1;
+
+  bool isConstant() const { return kind == Kind::CONSTANT; }
+
+  // Always evaluates to 0 or 1.
+  bool isBoolean() const
+  {
+    switch (kind)
+    {
+      case Kind::CONSTANT:
+        return value <= 1;
+      case Kind::LOAD:
+        return (opcode == Predicate::Opcode::LOAD_EFF) || (opcode == Predicate::Opcode::LOAD_RTR) ||
+          (opcode == Predicate::Opcode::LOAD_ERR) || (opcode == Predicate::Opcode::LOAD_TX);
+      case Kind::UNARY:
+        return (opcode == Predicate::Opcode::NOT) || (opcode == Predicate::Opcode::TO_BOOL);
+      case Kind::BINARY:
+        return (opcode >= Predicate::Opcode::LESS) && (opcode <= Predicate::Opcode::NOT_EQUAL);
+      case Kind::LOGICAL_AND:
+      case Kind::LOGICAL_OR:
+        return true;
+    }
+
+    return false;
+  }
+};
+
+std::unique_ptr<Node> makeConstant(uint64_t value)
+{
+  std::unique_ptr<Node> node(new Node);
+  node->value = value;
+  return node;
+}
+
+std::unique_ptr<Node> makeLoad(Predicate::Opcode opcode, uint64_t operand = 0)
+{
+  std::unique_ptr<Node> node(new Node);
+  node->kind = Node::Kind::LOAD;
+  node->opcode = opcode;
+  node->value = operand;
+  return node;
+}
+
+std::unique_ptr<Node> makeUnary(Predicate::Opcode opcode, std::unique_ptr<Node> operand)
+{
+  std::unique_ptr<Node> node(new Node);
+  node->kind = Node::Kind::UNARY;
+  node->opcode = opcode;
+  node->lhs = std::move(operand);
+  node->height = node->lhs->height + 1;
+  return node;
+}
+
+std::unique_ptr<Node> makeBinary(Node::Kind kind, Predicate::Opcode opcode, std::unique_ptr<Node> lhs,
+  std::unique_ptr<Node> rhs)
+{
+  std::unique_ptr<Node> node(new Node);
+  node->kind = kind;
+  node->opcode = opcode;
+  node->lhs = std::move(lhs);
+  node->rhs = std::move(rhs);
+  node->height = std::max(node->lhs->height, node->rhs->height) + 1;
+  return node;
+}
+
+// Normalize a value to 0 or 1, without a redundant conversion.
+std::unique_ptr<Node> makeBoolean(std::unique_ptr<Node> node)
+{
+  if (node->isConstant() == true)
+  {
+    return makeConstant(applyUnary(Predicate::Opcode::TO_BOOL, node->value));
+  }
+
+  return (node->isBoolean() == true) ? std::move(node) : makeUnary(Predicate::Opcode::TO_BOOL, std::move(node));
+}
+
+// Same comparison with the operands swapped.
+Predicate::Opcode mirror(Predicate::Opcode opcode)
+{
+  switch (opcode)
+  {
+    case Predicate::Opcode::LESS:
+      return Predicate::Opcode::GREATER;
+    case Predicate::Opcode::LESS_EQUAL:
+      return Predicate::Opcode::GREATER_EQUAL;
+    case Predicate::Opcode::GREATER:
+      return Predicate::Opcode::LESS;
+    case Predicate::Opcode::GREATER_EQUAL:
+      return Predicate::Opcode::LESS_EQUAL;
+    case Predicate::Opcode::PUSH:
+    case Predicate::Opcode::LOAD_ID:
+    case Predicate::Opcode::LOAD_DLC:
+    case Predicate::Opcode::LOAD_EFF:
+    case Predicate::Opcode::LOAD_RTR:
+    case Predicate::Opcode::LOAD_ERR:
+    case Predicate::Opcode::LOAD_TX:
+    case Predicate::Opcode::LOAD_TIMESTAMP:
+    case Predicate::Opcode::LOAD_DATA:
+    case Predicate::Opcode::LOAD_BITS:
+    case Predicate::Opcode::NOT:
+    case Predicate::Opcode::NEGATE:
+    case Predicate::Opcode::BIT_NOT:
+    case Predicate::Opcode::MULTIPLY:
+    case Predicate::Opcode::DIVIDE:
+    case Predicate::Opcode::MODULO:
+    case Predicate::Opcode::ADD:
+    case Predicate::Opcode::SUBTRACT:
+    case Predicate::Opcode::SHIFT_LEFT:
+    case Predicate::Opcode::SHIFT_RIGHT:
+    case Predicate::Opcode::EQUAL:
+    case Predicate::Opcode::NOT_EQUAL:
+    case Predicate::Opcode::BIT_AND:
+    case Predicate::Opcode::BIT_XOR:
+    case Predicate::Opcode::BIT_OR:
+    case Predicate::Opcode::TO_BOOL:
+    case Predicate::Opcode::JUMP_IF_FALSE:
+    case Predicate::Opcode::JUMP_IF_TRUE:
+      return opcode;
+  }
+
+  return opcode;
+}
+
+bool isSwappable(Predicate::Opcode opcode)
+{
+  switch (opcode)
+  {
+    case Predicate::Opcode::MULTIPLY:
+    case Predicate::Opcode::ADD:
+    case Predicate::Opcode::LESS:
+    case Predicate::Opcode::LESS_EQUAL:
+    case Predicate::Opcode::GREATER:
+    case Predicate::Opcode::GREATER_EQUAL:
+    case Predicate::Opcode::EQUAL:
+    case Predicate::Opcode::NOT_EQUAL:
+    case Predicate::Opcode::BIT_AND:
+    case Predicate::Opcode::BIT_XOR:
+    case Predicate::Opcode::BIT_OR:
+      return true;
+    case Predicate::Opcode::PUSH:
+    case Predicate::Opcode::LOAD_ID:
+    case Predicate::Opcode::LOAD_DLC:
+    case Predicate::Opcode::LOAD_EFF:
+    case Predicate::Opcode::LOAD_RTR:
+    case Predicate::Opcode::LOAD_ERR:
+    case Predicate::Opcode::LOAD_TX:
+    case Predicate::Opcode::LOAD_TIMESTAMP:
+    case Predicate::Opcode::LOAD_DATA:
+    case Predicate::Opcode::LOAD_BITS:
+    case Predicate::Opcode::NOT:
+    case Predicate::Opcode::NEGATE:
+    case Predicate::Opcode::BIT_NOT:
+    case Predicate::Opcode::DIVIDE:
+    case Predicate::Opcode::MODULO:
+    case Predicate::Opcode::SUBTRACT:
+    case Predicate::Opcode::SHIFT_LEFT:
+    case Predicate::Opcode::SHIFT_RIGHT:
+    case Predicate::Opcode::TO_BOOL:
+    case Predicate::Opcode::JUMP_IF_FALSE:
+    case Predicate::Opcode::JUMP_IF_TRUE:
+      return false;
+  }
+
+  return false;
+}
+
+// Fold constant subexpressions, simplify `&&` / `||` with a constant side, and move constants to the right-hand side
+// where the operator allows it so they can be encoded as immediates.
+std::unique_ptr<Node> fold(std::unique_ptr<Node> node)
+{
+  switch (node->kind)
+  {
+    case Node::Kind::CONSTANT:
+    case Node::Kind::LOAD:
+      return node;
+
+    case Node::Kind::UNARY:
+      node->lhs = fold(std::move(node->lhs));
+      if (node->lhs->isConstant() == true)
+      {
+        return makeConstant(applyUnary(node->opcode, node->lhs->value));
+      }
+
+      if ((node->opcode == Predicate::Opcode::TO_BOOL) && (node->lhs->isBoolean() == true))
+      {
+        return std::move(node->lhs);
+      }
+
+      return node;
+
+    case Node::Kind::BINARY:
+      node->lhs = fold(std::move(node->lhs));
+      node->rhs = fold(std::move(node->rhs));
+      if ((node->lhs->isConstant() == true) && (node->rhs->isConstant() == true))
+      {
+        return makeConstant(applyBinary(node->opcode, node->lhs->value, node->rhs->value));
+      }
+
+      if ((node->lhs->isConstant() == true) && (isSwappable(node->opcode) == true))
+      {
+        std::swap(node->lhs, node->rhs);
+        node->opcode = mirror(node->opcode);
+      }
+
+      return node;
+
+    case Node::Kind::LOGICAL_AND:
+    case Node::Kind::LOGICAL_OR:
+    {
+      node->lhs = fold(std::move(node->lhs));
+      node->rhs = fold(std::move(node->rhs));
+
+      // Operands have no side effects, so a constant on either side settles it or drops out.
+      const bool is_and = node->kind == Node::Kind::LOGICAL_AND;
+      for (std::unique_ptr<Node>* side : {&node->lhs, &node->rhs})
+      {
+        if ((*side)->isConstant() == true)
+        {
+          const bool truth = (*side)->value != 0;
+          if (truth != is_and)
+          {
+            return makeConstant(truth ? 1 : 0);
+          }
+
+          return makeBoolean(std::move((side == &node->lhs) ? node->rhs : node->lhs));
+        }
+      }
+
+      return node;
+    }
+  }
+
+  return node;
+}
+
+// Find an `id == <constant>` that every match must satisfy.
+uint32_t findRequiredId(const Node& node)
+{
+  if (node.kind == Node::Kind::LOGICAL_AND)
+  {
+    const uint32_t id = findRequiredId(*node.lhs);
+    return (id != Predicate::kAnyId) ? id : findRequiredId(*node.rhs);
+  }
+
+  if ((node.kind == Node::Kind::BINARY) && (node.opcode == Predicate::Opcode::EQUAL) &&
+    (node.lhs->kind == Node::Kind::LOAD) && (node.lhs->opcode == Predicate::Opcode::LOAD_ID) &&
+    (node.rhs->isConstant() == true) && (node.rhs->value <= CanFrame::kIdMaskExtended))
+  {
+    return static_cast<uint32_t>(node.rhs->value);
+  }
+
+  return Predicate::kAnyId;
+}
+
+class Parser
+{
+ public:
+  explicit Parser(const std::string& source) :
+    source_{source},
+    position_{0},
+    depth_{0},
+    error_{}
+  {
+  }
+
+  std::unique_ptr<Node> parse()
+  {
+    std::unique_ptr<Node> node = parseBinary(0);
+    skipSpace();
+    if ((node != nullptr) && (position_ < source_.size()))
+    {
+      return fail("unexpected '" + std::string(1, source_[position_]) + "'");
+    }
+
+    return node;
+  }
+
+  const std::string& error() const { return error_; }
+
+ private:
+  struct BinaryOperator
+  {
+    const char* text;
+    int precedence;
+    Node::Kind kind;
+    Predicate::Opcode opcode;
+  };
+
+  std::unique_ptr<Node> fail(const std::string& message)
+  {
+    if (error_.empty() == true)
+    {
+      error_ = fmt::format("{} at column {}", message, position_ + 1);
+    }
+
+    return nullptr;
+  }
+
+  std::unique_ptr<Node> failTooDeep()
+  {
+    return fail(fmt::format("expression nests more than {} levels deep", Predicate::kMaxNestingDepth));
+  }
+
+  void skipSpace()
+  {
+    while ((position_ < source_.size()) && (std::isspace(static_cast<unsigned char>(source_[position_])) != 0))
+    {
+      position_++;
+    }
+  }
+
+  // Consume `text` if it comes next.
+  bool accept(const char* text)
+  {
+    skipSpace();
+    const size_t length = std::strlen(text);
+    if (source_.compare(position_, length, text) != 0)
+    {
+      return false;
+    }
+
+    position_ += length;
+    return true;
+  }
+
+  // The binary operator coming next, if any, without consuming it.  Longer operators are listed first so `<=` is not
+  // taken for `<`, and `&&` not for `&`.
+  const BinaryOperator* peekOperator()
+  {
+    static const BinaryOperator kOperators[] = {
+      {"||", 1, Node::Kind::LOGICAL_OR, Predicate::Opcode::PUSH},
+      {"&&", 2, Node::Kind::LOGICAL_AND, Predicate::Opcode::PUSH},
+      {"==", 6, Node::Kind::BINARY, Predicate::Opcode::EQUAL},
+      {"!=", 6, Node::Kind::BINARY, Predicate::Opcode::NOT_EQUAL},
+      {"<=", 7, Node::Kind::BINARY, Predicate::Opcode::LESS_EQUAL},
+      {">=", 7, Node::Kind::BINARY, Predicate::Opcode::GREATER_EQUAL},
+      {"<<", 8, Node::Kind::BINARY, Predicate::Opcode::SHIFT_LEFT},
+      {">>", 8, Node::Kind::BINARY, Predicate::Opcode::SHIFT_RIGHT},
+      {"|", 3, Node::Kind::BINARY, Predicate::Opcode::BIT_OR},
+      {"^", 4, Node::Kind::BINARY, Predicate::Opcode::BIT_XOR},
+      {"&", 5, Node::Kind::BINARY, Predicate::Opcode::BIT_AND},
+      {"<", 7, Node::Kind::BINARY, Predicate::Opcode::LESS},
+      {">", 7, Node::Kind::BINARY, Predicate::Opcode::GREATER},
+      {"+", 9, Node::Kind::BINARY, Predicate::Opcode::ADD},
+      {"-", 9, Node::Kind::BINARY, Predicate::Opcode::SUBTRACT},
+      {"*", 10, Node::Kind::BINARY, Predicate::Opcode::MULTIPLY},
+      {"/", 10, Node::Kind::BINARY, Predicate::Opcode::DIVIDE},
+      {"%", 10, Node::Kind::BINARY, Predicate::Opcode::MODULO}};
+
+    skipSpace();
+    for (const BinaryOperator& op : kOperators)
+    {
+      if (source_.compare(position_, std::strlen(op.text), op.text) == 0)
+      {
+        return &op;
+      }
+    }
+
+    return nullptr;
+  }
+
+  // Precedence climbing: parse operators binding tighter than `min_precedence`.
+  std::unique_ptr<Node> parseBinary(int min_precedence)
+  {
+    std::unique_ptr<Node> lhs = parseUnary();
+    while (lhs != nullptr)
+    {
+      const BinaryOperator* op = peekOperator();
+      if ((op == nullptr) || (op->precedence <= min_precedence))
+      {
+        break;
+      }
+
+      position_ += std::strlen(op->text);
+      std::unique_ptr<Node> rhs = parseBinary(op->precedence);
+      if (rhs == nullptr)
+      {
+        return nullptr;
+      }
+
+      lhs = makeBinary(op->kind, op->opcode, std::move(lhs), std::move(rhs));
+      if (lhs->height > Predicate::kMaxNestingDepth)
+      {
+        return failTooDeep();
+      }
+    }
+
+    return lhs;
+  }
+
+  // Parentheses, unary operators and the arguments of data[] and bits() all recurse through here, so bounding the depth
+  // here bounds the parser's recursion.
+  std::unique_ptr<Node> parseUnary()
+  {
+    if (depth_ >= Predicate::kMaxNestingDepth)
+    {
+      return failTooDeep();
+    }
+
+    depth_++;
+    std::unique_ptr<Node> node = parseUnaryOperator();
+    depth_--;
+    if ((node != nullptr) && (node->height > Predicate::kMaxNestingDepth))
+    {
+      return failTooDeep();
+    }
+
+    return node;
+  }
+
+  std::unique_ptr<Node> parseUnaryOperator()
+  {
+    // Careful not to take the first character of `!=` for a logical not.
+    skipSpace();
+    if ((position_ < source_.size()) && (source_[position_] == '!') && (source_.compare(position_, 2, "!=") != 0))
+    {
+      position_++;
+      std::unique_ptr<Node> operand = parseUnary();
+      return (operand != nullptr) ? makeUnary(Predicate::Opcode::NOT, std::move(operand)) : nullptr;
+    }
+
+    const Predicate::Opcode opcode = accept("~") ? Predicate::Opcode::BIT_NOT :
+      (accept("-") ? Predicate::Opcode::NEGATE : Predicate::Opcode::PUSH);
+    if (opcode != Predicate::Opcode::PUSH)
+    {
+      std::unique_ptr<Node> operand = parseUnary();
+      return (operand != nullptr) ? makeUnary(opcode, std::move(operand)) : nullptr;
+    }
+
+    return parsePrimary();
+  }
+
+  // Parse an expression that must fold down to a constant in `[minimum, maximum]`.
+  bool parseConstant(const char* what, uint64_t minimum, uint64_t maximum, uint64_t* value)
+  {
+    std::unique_ptr<Node> node = parseBinary(0);
+    if (node == nullptr)
+    {
+      return false;
+    }
+
+    node = fold(std::move(node));
+    if (node->isConstant() == false)
+    {
+      fail(std::string(what) + " must be a constant");
+      return false;
+    }
+
+    if ((node->value < minimum) || (node->value > maximum))
+    {
+      fail(fmt::format("{} must be between {} and {}", what, minimum, maximum));
+      return false;
+    }
+
+    *value = node->value;
+    return true;
+  }
+
+  std::unique_ptr<Node> parsePrimary()
+  {
+    skipSpace();
+    if (position_ >= source_.size())
+    {
+      return fail("unexpected end of expression");
+    }
+
+    if (accept("("))
+    {
+      std::unique_ptr<Node> node = parseBinary(0);
+      if ((node != nullptr) && (accept(")") == false))
+      {
+        return fail("expected ')'");
+      }
+
+      return node;
+    }
+
+    const char c = source_[position_];
+    if (std::isdigit(static_cast<unsigned char>(c)) != 0)
+    {
+      return parseNumber();
+    }
+
+    if ((std::isalpha(static_cast<unsigned char>(c)) == 0) && (c != '_'))
+    {
+      return fail("unexpected '" + std::string(1, c) + "'");
+    }
+
+    const size_t start = position_;
+    while ((position_ < source_.size()) &&
+      ((std::isalnum(static_cast<unsigned char>(source_[position_])) != 0) || (source_[position_] == '_')))
+    {
+      position_++;
+    }
+
+    const std::string name = source_.substr(start, position_ - start);
+    if (name == "true")
+    {
+      return makeConstant(1);
+    }
+    else if (name == "false")
+    {
+      return makeConstant(0);
+    }
+    else if (name == "id")
+    {
+      return makeLoad(Predicate::Opcode::LOAD_ID);
+    }
+    else if (name == "dlc")
+    {
+      return makeLoad(Predicate::Opcode::LOAD_DLC);
+    }
+    else if (name == "eff")
+    {
+      return makeLoad(Predicate::Opcode::LOAD_EFF);
+    }
+    else if (name == "rtr")
+    {
+      return makeLoad(Predicate::Opcode::LOAD_RTR);
+    }
+    else if (name == "err")
+    {
+      return makeLoad(Predicate::Opcode::LOAD_ERR);
+    }
+    else if (name == "tx")
+    {
+      return makeLoad(Predicate::Opcode::LOAD_TX);
+    }
+    else if (name == "timestamp")
+    {
+      return makeLoad(Predicate::Opcode::LOAD_TIMESTAMP);
+    }
+    else if (name == "data")
+    {
+      uint64_t index = 0;
+      if (accept("[") == false)
+      {
+        return fail("expected '[' after data");
+      }
+
+      if (parseConstant("data index", 0, CanFrame::kDataNumMaxBytes - 1, &index) == false)
+      {
+        return nullptr;
+      }
+
+      if (accept("]") == false)
+      {
+        return fail("expected ']'");
+      }
+
+      return makeLoad(Predicate::Opcode::LOAD_DATA, index);
+    }
+    else if (name == "bits")
+    {
+      uint64_t start_bit = 0;
+      uint64_t length = 0;
+      if (accept("(") == false)
+      {
+        return fail("expected '(' after bits");
+      }
+
+      if ((parseConstant("bit start", 0, 63, &start_bit) == false) || (accept(",") == false) ||
+        (parseConstant("bit length", 1, 64 - start_bit, &length) == false) || (accept(")") == false))
+      {
+        return fail("expected bits(start, length)");
+      }
+
+      return makeLoad(Predicate::Opcode::LOAD_BITS, start_bit | (length << 8));
+    }
+
+    position_ = start;
+    return fail("unknown field '" + name + "'");
+  }
+
+  std::unique_ptr<Node> parseNumber()
+  {
+    const bool hex = (source_.compare(position_, 2, "0x") == 0) || (source_.compare(position_, 2, "0X") == 0);
+    const int base = hex ? 16 : 10;
+    if (hex == true)
+    {
+      position_ += 2;
+    }
+
+    const size_t start = position_;
+    uint64_t value = 0;
+    while (position_ < source_.size())
+    {
+      const char c = static_cast<char>(std::tolower(static_cast<unsigned char>(source_[position_])));
+      int digit = 0;
+      if ((c >= '0') && (c <= '9'))
+      {
+        digit = c - '0';
+      }
+      else if ((hex == true) && (c >= 'a') && (c <= 'f'))
+      {
+        digit = c - 'a' + 10;
+      }
+      else
+      {
+        break;
+      }
+
+      if (value > ((~uint64_t{0} - static_cast<uint64_t>(digit)) / static_cast<uint64_t>(base)))
+      {
+        return fail("number too large");
+      }
+
+      value = (value * static_cast<uint64_t>(base)) + static_cast<uint64_t>(digit);
+      position_++;
+    }
+
+    if (position_ == start)
+    {
+      return fail("expected hex digits");
+    }
+
+    if ((position_ < source_.size()) && (std::isalnum(static_cast<unsigned char>(source_[position_])) != 0))
+    {
+      return fail("invalid number");
+    }
+
+    return makeConstant(value);
+  }
+
+  const std::string& source_;
+  size_t position_;
+  size_t depth_;
+  std::string error_;
+};
+
+class Emitter
+{
+ public:
+  explicit Emitter(std::vector<Predicate::Instruction>* code) :
+    code_{code},
+    depth_{0},
+    max_depth_{0}
+  {
+  }
+
+  void emit(const Node& node)
+  {
+    switch (node.kind)
+    {
+      case Node::Kind::CONSTANT:
+        append(Predicate::Opcode::PUSH, false, node.value, 1);
+        break;
+
+      case Node::Kind::LOAD:
+        append(node.opcode, false, node.value, 1);
+        break;
+
+      case Node::Kind::UNARY:
+        emit(*node.lhs);
+        append(node.opcode, false, 0, 0);
+        break;
+
+      case Node::Kind::BINARY:
+        emit(*node.lhs);
+        if (node.rhs->isConstant() == true)
+        {
+          append(node.opcode, true, node.rhs->value, 0);
+        }
+        else
+        {
+          emit(*node.rhs);
+          append(node.opcode, false, 0, -1);
+        }
+
+        break;
+
+      case Node::Kind::LOGICAL_AND:
+      case Node::Kind::LOGICAL_OR:
+      {
+        emit(*node.lhs);
+
+        // The jump pops the left-hand side when it falls through, and the right-hand side takes its place.
+        const size_t jump = code_->size();
+        append((node.kind == Node::Kind::LOGICAL_AND) ? Predicate::Opcode::JUMP_IF_FALSE :
+          Predicate::Opcode::JUMP_IF_TRUE, false, 0, -1);
+        emit(*node.rhs);
+        if (node.rhs->isBoolean() == false)
+        {
+          append(Predicate::Opcode::TO_BOOL, false, 0, 0);
+        }
+
+        (*code_)[jump].operand = code_->size();
+        break;
+      }
+    }
+  }
+
+  size_t maxDepth() const { return max_depth_; }
+
+ private:
+  void append(Predicate::Opcode opcode, bool immediate, uint64_t operand, int depth_change)
+  {
+    code_->push_back(Predicate::Instruction{opcode, immediate, operand});
+    depth_ += depth_change;
+    max_depth_ = std::max<size_t>(max_depth_, static_cast<size_t>(depth_));
+  }
+
+  std::vector<Predicate::Instruction>* code_;
+  int depth_;
+  size_t max_depth_;
+};
+
+}  // namespace
+
+Predicate::Predicate() :
+  expression_{},
+  code_{},
+  required_id_{kAnyId}
+{
+}
+
+bool Predicate::compile(const std::string& expression, std::string* error)
+{
+  expression_.clear();
+  code_.clear();
+  required_id_ = kAnyId;
+
+  Parser parser(expression);
+  std::unique_ptr<Node> root = parser.parse();
+  if (root == nullptr)
+  {
+    if (error != nullptr)
+    {
+      *error = parser.error();
+    }
+
+    return false;
+  }
+
+  root = fold(std::move(root));
+
+  std::vector<Instruction> code;
+  Emitter emitter(&code);
+  emitter.emit(*root);
+  if (emitter.maxDepth() > kMaxStackDepth)
+  {
+    if (error != nullptr)
+    {
+      *error = fmt::format("expression nests too deeply (needs a stack of {}, limit is {})", emitter.maxDepth(),
+        kMaxStackDepth);
+    }
+
+    return false;
+  }
+
+  expression_ = expression;
+  code_ = std::move(code);
+  required_id_ = findRequiredId(*root);
+  return true;
+}
+
+uint64_t Predicate::evaluate(const CanFrame& frame) const
+{
+  if (code_.empty() == true)
+  {
+    return 0;
+  }
+
+  uint64_t stack[kMaxStackDepth];
+  size_t top = 0;
+
+  const Instruction* code = code_.data();
+  const size_t code_size = code_.size();
+
+  for (size_t pc = 0; pc < code_size; ++pc)
+  {
+    const Instruction& instruction = code[pc];
+    switch (instruction.opcode)
+    {
+      case Opcode::PUSH:
+        stack[top++] = instruction.operand;
+        break;
+      case Opcode::LOAD_ID:
+        stack[top++] = frame.id & CanFrame::kIdMaskExtended;
+        break;
+      case Opcode::LOAD_DLC:
+        stack[top++] = frame.dlc;
+        break;
+      case Opcode::LOAD_EFF:
+        stack[top++] = frame.eff_frame ? 1 : 0;
+        break;
+      case Opcode::LOAD_RTR:
+        stack[top++] = frame.rtr_frame ? 1 : 0;
+        break;
+      case Opcode::LOAD_ERR:
+        stack[top++] = frame.error_frame ? 1 : 0;
+        break;
+      case Opcode::LOAD_TX:
+        stack[top++] = frame.from_tx ? 1 : 0;
+        break;
+      case Opcode::LOAD_TIMESTAMP:
+        stack[top++] = frame.timestamp_us;
+        break;
+      case Opcode::LOAD_DATA:
+        stack[top++] = (instruction.operand < frame.dlc) ? frame.data[instruction.operand] : 0;
+        break;
+      case Opcode::LOAD_BITS:
+      {
+        const uint64_t start_bit = instruction.operand & 0xFF;
+        const uint64_t length = instruction.operand >> 8;
+        const uint64_t mask = (length >= 64) ? ~uint64_t{0} : ((uint64_t{1} << length) - 1);
+        stack[top++] = (loadPayload(frame) >> start_bit) & mask;
+        break;
+      }
+      case Opcode::NOT:
+      case Opcode::NEGATE:
+      case Opcode::BIT_NOT:
+      case Opcode::TO_BOOL:
+        stack[top - 1] = applyUnary(instruction.opcode, stack[top - 1]);
+        break;
+      case Opcode::JUMP_IF_FALSE:
+        if (stack[top - 1] == 0)
+        {
+          pc = instruction.operand - 1;
+        }
+        else
+        {
+          top--;
+        }
+
+        break;
+      case Opcode::JUMP_IF_TRUE:
+        if (stack[top - 1] != 0)
+        {
+          stack[top - 1] = 1;
+          pc = instruction.operand - 1;
+        }
+        else
+        {
+          top--;
+        }
+
+        break;
+      case Opcode::MULTIPLY:
+      case Opcode::DIVIDE:
+      case Opcode::MODULO:
+      case Opcode::ADD:
+      case Opcode::SUBTRACT:
+      case Opcode::SHIFT_LEFT:
+      case Opcode::SHIFT_RIGHT:
+      case Opcode::LESS:
+      case Opcode::LESS_EQUAL:
+      case Opcode::GREATER:
+      case Opcode::GREATER_EQUAL:
+      case Opcode::EQUAL:
+      case Opcode::NOT_EQUAL:
+      case Opcode::BIT_AND:
+      case Opcode::BIT_XOR:
+      case Opcode::BIT_OR:
+      {
+        const uint64_t rhs = (instruction.immediate == true) ? instruction.operand : stack[--top];
+        stack[top - 1] = applyBinary(instruction.opcode, stack[top - 1], rhs);
+        break;
+      }
+    }
+  }
+
+  return stack[0];
+}
+
+bool Predicate::matches(const CanFrame& frame) const
+{
+  return evaluate(frame) != 0;
+}
+
+size_t Predicate::evaluate(const CanFrame* frames, size_t num_frames, uint8_t* results) const
+{
+  size_t num_matches = 0;
+  for (size_t i = 0; i < num_frames; ++i)
+  {
+    results[i] = (evaluate(frames[i]) != 0) ? 1 : 0;
+    num_matches += results[i];
+  }
+
+  return num_matches;
+}
+
+std::string Predicate::disassemble() const
+{
+  fmt::memory_buffer out;
+  for (size_t pc = 0; pc < code_.size(); ++pc)
+  {
+    const Instruction& instruction = code_[pc];
+    fmt::format_to(out, "{:4} {}", pc, opcodeName(instruction.opcode));
+
+    switch (instruction.opcode)
+    {
+      case Opcode::PUSH:
+      case Opcode::LOAD_DATA:
+      case Opcode::JUMP_IF_FALSE:
+      case Opcode::JUMP_IF_TRUE:
+        fmt::format_to(out, " {}", instruction.operand);
+        break;
+      case Opcode::LOAD_BITS:
+        fmt::format_to(out, " {}, {}", instruction.operand & 0xFF, instruction.operand >> 8);
+        break;
+      case Opcode::LOAD_ID:
+      case Opcode::LOAD_DLC:
+      case Opcode::LOAD_EFF:
+      case Opcode::LOAD_RTR:
+      case Opcode::LOAD_ERR:
+      case Opcode::LOAD_TX:
+      case Opcode::LOAD_TIMESTAMP:
+      case Opcode::NOT:
+      case Opcode::NEGATE:
+      case Opcode::BIT_NOT:
+      case Opcode::MULTIPLY:
+      case Opcode::DIVIDE:
+      case Opcode::MODULO:
+      case Opcode::ADD:
+      case Opcode::SUBTRACT:
+      case Opcode::SHIFT_LEFT:
+      case Opcode::SHIFT_RIGHT:
+      case Opcode::LESS:
+      case Opcode::LESS_EQUAL:
+      case Opcode::GREATER:
+      case Opcode::GREATER_EQUAL:
+      case Opcode::EQUAL:
+      case Opcode::NOT_EQUAL:
+      case Opcode::BIT_AND:
+      case Opcode::BIT_XOR:
+      case Opcode::BIT_OR:
+      case Opcode::TO_BOOL:
+        if (instruction.immediate == true)
+        {
+          fmt::format_to(out, " #0x{:X}", instruction.operand);
+        }
+
+        break;
+    }
+
+    fmt::format_to(out, "\n");
+  }
+
+  return fmt::to_string(out);
+}
+
+size_t PredicateSet::add(const Predicate& predicate)
+{
+  const uint32_t index = static_cast<uint32_t>(predicates_.size());
+  predicates_.push_back(predicate);
+
+  const uint32_t id = predicate.requiredId();
+  if (id == Predicate::kAnyId)
+  {
+    any_id_.push_back(index);
+  }
+  else
+  {
+    const auto entry = std::make_pair(id, index);
+    by_id_.insert(std::upper_bound(by_id_.begin(), by_id_.end(), entry), entry);
+  }
+
+  return index;
+}
+
+bool PredicateSet::add(const std::string& expression, size_t* index, std::string* error)
+{
+  Predicate predicate;
+  if (predicate.compile(expression, error) == false)
+  {
+    return false;
+  }
+
+  const size_t added = add(predicate);
+  if (index != nullptr)
+  {
+    *index = added;
+  }
+
+  return true;
+}
+
+std::pair<size_t, size_t> PredicateSet::findId(uint32_t id) const
+{
+  const auto lower = std::lower_bound(by_id_.begin(), by_id_.end(), std::make_pair(id, uint32_t{0}));
+  auto upper = lower;
+  while ((upper != by_id_.end()) && (upper->first == id))
+  {
+    ++upper;
+  }
+
+  return std::make_pair(static_cast<size_t>(lower - by_id_.begin()), static_cast<size_t>(upper - by_id_.begin()));
+}
+
+template<typename Sink>
+void PredicateSet::forEachMatch(const CanFrame& frame, Sink sink) const
+{
+  const std::pair<size_t, size_t> range = findId(frame.id & CanFrame::kIdMaskExtended);
+  for (size_t i = range.first; i < range.second; ++i)
+  {
+    if ((predicates_[by_id_[i].second].matches(frame) == true) && (sink(by_id_[i].second) == false))
+    {
+      return;
+    }
+  }
+
+  for (const uint32_t index : any_id_)
+  {
+    if ((predicates_[index].matches(frame) == true) && (sink(index) == false))
+    {
+      return;
+    }
+  }
+}
+
+size_t PredicateSet::match(const CanFrame& frame, uint32_t* indices, size_t max_indices) const
+{
+  size_t num_matches = 0;
+  if (max_indices == 0)
+  {
+    return 0;
+  }
+
+  forEachMatch(frame, [&](uint32_t index)
+  {
+    indices[num_matches++] = index;
+    return num_matches < max_indices;
+  });
+
+  return num_matches;
+}
+
+size_t PredicateSet::match(const CanFrame* frames, size_t num_frames, Match* matches, size_t max_matches) const
+{
+  size_t num_matches = 0;
+  for (size_t f = 0; (f < num_frames) && (num_matches < max_matches); ++f)
+  {
+    forEachMatch(frames[f], [&](uint32_t index)
+    {
+      matches[num_matches++] = Match{static_cast<uint32_t>(f), index};
+      return num_matches < max_matches;
+    });
+  }
+
+  return num_matches;
+}
+
+bool PredicateSet::matchesAny(const CanFrame& frame) const
+{
+  bool matched = false;
+  forEachMatch(frame, [&](uint32_t /*index*/)
+  {
+    matched = true;
+    return false;
+  });
+
+  return matched;
+}
+
+}  // namespace cantaloupe
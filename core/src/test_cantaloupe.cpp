@@ -10,10 +10,76 @@
 //
 // You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
 // <https://www.gnu.org/licenses/>.
+#include <cantaloupe/bit_activity_analyzer.h>
+#include <cantaloupe/can_error_monitor.h>
+#include <cantaloupe/can_fd_frame.h>
+#include <cantaloupe/can_frame_record_buffer.h>
+#include <cantaloupe/can_gateway.h>
+#include <cantaloupe/capture_writer.h>
+#include <cantaloupe/clock.h>
+#include <cantaloupe/cyclic_scheduler.h>
+#include <cantaloupe/flight_recorder.h>
 #include <cantaloupe/log.h>
+#include <cantaloupe/gs_usb_commands.h>
 #include <cantaloupe/gs_usb_wrapper.h>
+#include <cantaloupe/j1939.h>
+#include <cantaloupe/metrics.h>
+#include <cantaloupe/payload_change_filter.h>
+#include <cantaloupe/predicate.h>
+#include <cantaloupe/thread_config.h>
+#include <cantaloupe/time_series_store.h>
+#include <cantaloupe/tx_priority_queue.h>
 
+#include <spdlog/fmt/fmt.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
 #include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Every allocation made through the global operator new (the array and nothrow forms come through here too) is
+// counted, so `--audit-allocations` can check the hot paths stay off the heap once running.
+static std::atomic<uint64_t> g_num_allocations{0};
+
+void* operator new(std::size_t num_bytes)
+{
+  g_num_allocations.fetch_add(1, std::memory_order_relaxed);
+
+  void* memory = std::malloc((num_bytes > 0) ? num_bytes : 1);
+  if (memory == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+
+  return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+  std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t /*num_bytes*/) noexcept
+{
+  std::free(memory);
+}
 
 // Hacky way stop our loop with a sigint.
 bool g_should_continue = true;
@@ -25,11 +91,2676 @@ void sigint_handler(int /*signal*/)
   signal(SIGINT, SIG_DFL);
 }
 
+// `--capture-writer` slows the capture writer's disk down by standing in for pwrite() itself: while
+// `g_pwrite_delay_us` is non-zero, every call sleeps that long before writing, like a disk that cannot keep up.
+static std::atomic<uint32_t> g_pwrite_delay_us{0};
 
-int main(int argc, char** /*argv*/)
+#if defined(__linux__) && defined(__LP64__)
+static constexpr bool kCanSlowPwrite = true;
+
+extern "C" ssize_t pwrite(int fd, const void* data, size_t num_bytes, off_t offset)
 {
-  // Attach to SIGINT in order to close.
-  signal(SIGINT, sigint_handler);
+  const uint32_t delay_us = g_pwrite_delay_us.load(std::memory_order_relaxed);
+  if (delay_us != 0)
+  {
+    std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+  }
+
+  return static_cast<ssize_t>(syscall(SYS_pwrite64, fd, data, num_bytes, offset));
+}
+#else
+static constexpr bool kCanSlowPwrite = false;
+#endif
+
+// Bus kept in memory for the offline checks: frames written to it can be read straight back, in order, out of a
+// fixed ring.  It carries CAN FD frames too; like `GsUsbWrapper`, the classic read drops any it comes across.  Only
+// used from one thread.
+class FakeTransport : public cantaloupe::CanTransport
+{
+ public:
+  explicit FakeTransport(size_t capacity) :
+    frames_(capacity),
+    head_{0},
+    tail_{0}
+  {
+  }
+
+  bool writeCanFrame(const cantaloupe::CanFrame& frame, uint32_t timeout_ms = 0) override
+  {
+    return writeCanFdFrame(cantaloupe::toCanFdFrame(frame), timeout_ms);
+  }
+
+  bool readCanFrame(cantaloupe::CanFrame* frame, uint32_t timeout_ms = 0) override
+  {
+    cantaloupe::CanFdFrame input;
+    while (readCanFdFrame(&input, timeout_ms) == true)
+    {
+      if (cantaloupe::toCanFrame(input, frame) == true)
+      {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  size_t readCanFrames(cantaloupe::CanFrame* frames, size_t max_frames, uint32_t timeout_ms = 0) override
+  {
+    size_t num_read = 0;
+    while ((num_read < max_frames) && (readCanFrame(&frames[num_read], timeout_ms) == true))
+    {
+      num_read++;
+    }
+
+    return num_read;
+  }
+
+  bool writeCanFdFrame(const cantaloupe::CanFdFrame& frame, uint32_t /*timeout_ms*/ = 0) override
+  {
+    if ((tail_ - head_) >= frames_.size())
+    {
+      return false;
+    }
+
+    frames_[tail_++ % frames_.size()] = frame;
+    return true;
+  }
+
+  bool readCanFdFrame(cantaloupe::CanFdFrame* frame, uint32_t /*timeout_ms*/ = 0) override
+  {
+    if (head_ == tail_)
+    {
+      return false;
+    }
+
+    *frame = frames_[head_++ % frames_.size()];
+    return true;
+  }
+
+ private:
+  std::vector<cantaloupe::CanFdFrame> frames_;
+  size_t head_;
+  size_t tail_;
+};
+
+// Clock the offline checks move forward by hand.
+class FakeClock : public cantaloupe::Clock
+{
+ public:
+  uint64_t nowUs() const override { return now_us_; }
+  void advance(uint64_t num_us) { now_us_ += num_us; }
+
+ private:
+  uint64_t now_us_ = 0;
+};
+
+static constexpr size_t kAuditWarmupFrames = 10000;
+static constexpr size_t kAuditNumFrames = 1000000;
+static constexpr size_t kAuditBatchSize = 64;
+
+// Simulated time between frames, about a fully loaded 1 Mbit/s bus.
+static constexpr uint64_t kAuditFrameIntervalUs = 100;
+
+// Run frames through the receive and transmit pipelines on fake transports, and fail if anything allocates once they
+// have warmed up.
+static int auditAllocations()
+{
+  using cantaloupe::CanFrame;
+  using cantaloupe::CanGateway;
+  using cantaloupe::RoutingTable;
+  using cantaloupe::TxPriorityQueue;
+
+  FakeTransport bus_a(4 * kAuditBatchSize);
+  FakeTransport bus_b(4 * kAuditBatchSize);
+  FakeTransport tx_bus(4 * kAuditBatchSize);
+  FakeClock clock;
+
+  // Receive side: a gateway with a few rules, then the analysis stages a viewer would run.
+  CanGateway gateway(&bus_a, &bus_b);
+  gateway.routes(CanGateway::Direction::A_TO_B).addRule(RoutingTable::Rule::remap(0x100, 0x80012345));
+  gateway.routes(CanGateway::Direction::A_TO_B).addRule(RoutingTable::Rule::patch(0x200, 0xFF, 0x42));
+  gateway.routes(CanGateway::Direction::A_TO_B).addRule(RoutingTable::Rule::drop(0x7FF));
+
+  cantaloupe::PayloadChangeFilter change_filter;
+  cantaloupe::FlightRecorder recorder;
+  cantaloupe::BitActivityAnalyzer analyzer;
+  cantaloupe::CanErrorMonitor error_monitor(nullptr, cantaloupe::CanErrorMonitor::kDefaultIntervalUs, &clock);
+
+  // Transmit side: changed frames are queued for transmission with a completion callback, and a cyclic message runs
+  // alongside with a hook stamping a rolling counter.
+  TxPriorityQueue tx_queue(&tx_bus, 2 * kAuditBatchSize, &clock);
+  cantaloupe::CyclicScheduler scheduler(&tx_bus, 16, cantaloupe::CyclicScheduler::kDefaultTickUs, &clock);
+
+  uint64_t num_completions = 0;
+  CanFrame cyclic_frame;
+  cyclic_frame.id = 0x10;
+  cyclic_frame.dlc = 1;
+  scheduler.addCyclic(cyclic_frame, 1000, 0, [](CanFrame* frame, uint64_t sequence) {
+    frame->data[0] = static_cast<uint8_t>(sequence);
+  });
+
+  std::vector<CanFrame> batch(kAuditBatchSize);
+  CanFrame frame;
+  frame.dlc = 8;
+
+  uint64_t start_allocations = 0;
+  for (size_t i = 0; i < kAuditWarmupFrames + kAuditNumFrames; ++i)
+  {
+    if (i == kAuditWarmupFrames)
+    {
+      start_allocations = g_num_allocations.load();
+    }
+
+    // Every standard identifier in turn, with a payload that changes each time round.
+    const size_t round = i / (CanFrame::kIdMaskStandard + 1);
+    frame.id = static_cast<uint32_t>(i & CanFrame::kIdMaskStandard);
+    frame.data[0] = static_cast<uint8_t>(round);
+    frame.data[1] = static_cast<uint8_t>(round >> 8);
+
+    bus_a.writeCanFrame(frame);
+    if ((i % kAuditBatchSize) != (kAuditBatchSize - 1))
+    {
+      continue;
+    }
+
+    gateway.forwardBatch(CanGateway::Direction::A_TO_B, 0);
+    const size_t num_read = bus_b.readCanFrames(batch.data(), batch.size());
+    cantaloupe::Metrics::increment(cantaloupe::MetricCounter::RX_FRAMES, num_read);
+
+    for (size_t j = 0; j < num_read; ++j)
+    {
+      recorder.record(batch[j]);
+      analyzer.process(batch[j]);
+      error_monitor.processFrame(batch[j]);
+
+      if (change_filter.process(batch[j]) == true)
+      {
+        tx_queue.pushAsync(batch[j], [&num_completions](const CanFrame&, TxPriorityQueue::Result, uint64_t) {
+          num_completions++;
+        });
+      }
+    }
+
+    // Disabled log levels are checked before anything is formatted.
+    CANTALOUPE_DEBUG("Processed a batch of {} frames.", num_read);
+
+    while (tx_queue.drainOne() == true)
+    {
+    }
+
+    clock.advance(kAuditBatchSize * kAuditFrameIntervalUs);
+    scheduler.poll();
+
+    while (tx_bus.readCanFrames(batch.data(), batch.size()) > 0)
+    {
+    }
+  }
+
+  const uint64_t num_allocations = g_num_allocations.load() - start_allocations;
+  const CanGateway::Statistics gateway_statistics = gateway.getStatistics(CanGateway::Direction::A_TO_B);
+  CANTALOUPE_INFO("Ran {} frames ({} after warm-up): {} forwarded, {} queued for transmission, {} completions.",
+    kAuditWarmupFrames + kAuditNumFrames, kAuditNumFrames, gateway_statistics.frames_forwarded,
+    tx_queue.getStatistics().enqueued, num_completions);
+
+  if (num_allocations != 0)
+  {
+    CANTALOUPE_ERROR("{} allocations in the steady state.", num_allocations);
+    return -1;
+  }
+
+  CANTALOUPE_INFO("No allocations in the steady state.");
+  return 0;
+}
+
+// Simulated bus time to send one frame: an eight byte standard frame at 1 Mbit/s, with stuff bits and interframe space.
+static constexpr uint64_t kTxLatencyFrameTimeUs = 125;
+
+// High-priority frames come along at a period that does not line up with the frames on the bus.
+static constexpr uint64_t kTxLatencyHighPeriodUs = 1009;
+static constexpr uint64_t kTxLatencyDurationUs = 10 * 1000 * 1000;
+
+static constexpr uint32_t kTxLatencyBulkId = 0x7F0;
+static constexpr uint32_t kTxLatencyHighId = 0x010;
+
+// Bus for the transmit latency measurement.  Each frame written keeps it busy for `kTxLatencyFrameTimeUs` of fake
+// time, and a high-priority frame is submitted to the queue every `kTxLatencyHighPeriodUs`, wherever the bus is in
+// sending a frame.
+class SaturatedBus : public cantaloupe::CanTransport
+{
+ public:
+  SaturatedBus(FakeClock* clock, uint32_t high_id) :
+    clock_{clock},
+    queue_{nullptr},
+    high_frame_{},
+    next_high_us_{kTxLatencyHighPeriodUs},
+    delays_us_{}
+  {
+    high_frame_.id = high_id;
+    high_frame_.dlc = 8;
+    delays_us_.reserve(kTxLatencyDurationUs / kTxLatencyHighPeriodUs + 1);
+  }
+
+  void setQueue(cantaloupe::TxPriorityQueue* queue) { queue_ = queue; }
+
+  bool writeCanFrame(const cantaloupe::CanFrame& /*frame*/, uint32_t /*timeout_ms*/ = 0) override
+  {
+    const uint64_t done_us = clock_->nowUs() + kTxLatencyFrameTimeUs;
+    while (next_high_us_ < done_us)
+    {
+      clock_->advance(next_high_us_ - clock_->nowUs());
+      queue_->pushAsync(high_frame_,
+        [this](const cantaloupe::CanFrame&, cantaloupe::TxPriorityQueue::Result result, uint64_t delay_us) {
+          if (result == cantaloupe::TxPriorityQueue::Result::TRANSMITTED)
+          {
+            delays_us_.push_back(delay_us);
+          }
+        });
+      next_high_us_ += kTxLatencyHighPeriodUs;
+    }
+
+    clock_->advance(done_us - clock_->nowUs());
+    return true;
+  }
+
+  bool readCanFrame(cantaloupe::CanFrame* /*frame*/, uint32_t /*timeout_ms*/ = 0) override
+  {
+    return false;
+  }
+
+  // Queueing delay of every high-priority frame sent.
+  const std::vector<uint64_t>& delaysUs() const { return delays_us_; }
+
+ private:
+  FakeClock* clock_;
+  cantaloupe::TxPriorityQueue* queue_;
+  cantaloupe::CanFrame high_frame_;
+  uint64_t next_high_us_;
+  std::vector<uint64_t> delays_us_;
+};
+
+// Queueing delays of high-priority frames sent as `high_id` while the queue is kept full of low-priority frames,
+// sorted.
+static std::vector<uint64_t> runTxLatency(uint32_t high_id)
+{
+  using cantaloupe::TxPriorityQueue;
+
+  FakeClock clock;
+  SaturatedBus bus(&clock, high_id);
+  TxPriorityQueue queue(&bus, TxPriorityQueue::kDefaultCapacity, &clock);
+  bus.setQueue(&queue);
+
+  cantaloupe::CanFrame bulk_frame;
+  bulk_frame.id = kTxLatencyBulkId;
+  bulk_frame.dlc = 8;
+
+  while (clock.nowUs() < kTxLatencyDurationUs)
+  {
+    // Leave one slot free, so high-priority frames never have to evict anything to get in.
+    while (queue.size() < (TxPriorityQueue::kDefaultCapacity - 1))
+    {
+      queue.tryPush(bulk_frame);
+    }
+
+    queue.drainOne();
+  }
+
+  std::vector<uint64_t> delays_us = bus.delaysUs();
+  std::sort(delays_us.begin(), delays_us.end());
+  return delays_us;
+}
+
+// Measure how long high-priority frames wait in a transmit queue kept full of low-priority frames, against the same
+// frames queued in submission order (as they would be behind a FIFO).  Fails if a high-priority frame ever waits for
+// more than the frame already on the bus.
+static int measureTxLatency()
+{
+  const std::vector<uint64_t> priority_delays_us = runTxLatency(kTxLatencyHighId);
+  const std::vector<uint64_t> fifo_delays_us = runTxLatency(kTxLatencyBulkId);
+
+  if ((priority_delays_us.empty() == true) || (fifo_delays_us.empty() == true))
+  {
+    CANTALOUPE_ERROR("No high-priority frames were sent.");
+    return -1;
+  }
+
+  auto report = [](const char* name, const std::vector<uint64_t>& delays_us) {
+    CANTALOUPE_INFO("{}: {} frames, queueing delay p50 {} us, p99 {} us, max {} us.", name, delays_us.size(),
+      delays_us[delays_us.size() / 2], delays_us[delays_us.size() * 99 / 100], delays_us.back());
+  };
+
+  report("Priority order", priority_delays_us);
+  report("Submission order", fifo_delays_us);
+
+  if (priority_delays_us.back() > kTxLatencyFrameTimeUs)
+  {
+    CANTALOUPE_ERROR("High-priority frames waited behind more than the frame on the bus.");
+    return -1;
+  }
+
+  return 0;
+}
+
+static constexpr size_t kJitterNumMessages = 1000;
+static constexpr uint64_t kJitterDurationUs = 5 * 1000 * 1000;
+static constexpr uint64_t kJitterPollIntervalUs = 1000;
+static constexpr uint64_t kJitterMaxPollLatenessUs = 900;
+
+// Sink for the cyclic scheduler check: records when each frame was handed over, on the scheduler's clock.
+class RecordingSink : public cantaloupe::CanTransport
+{
+ public:
+  struct SentFrame
+  {
+    uint64_t time_us;
+    cantaloupe::CanFrame frame;
+  };
+
+  explicit RecordingSink(const FakeClock* clock) :
+    clock_{clock},
+    sent_{},
+    max_batch_{0}
+  {
+  }
+
+  bool writeCanFrame(const cantaloupe::CanFrame& frame, uint32_t /*timeout_ms*/ = 0) override
+  {
+    sent_.push_back({clock_->nowUs(), frame});
+    return true;
+  }
+
+  size_t writeCanFrames(const cantaloupe::CanFrame* frames, size_t num_frames, uint32_t timeout_ms = 0) override
+  {
+    max_batch_ = std::max(max_batch_, num_frames);
+    return CanTransport::writeCanFrames(frames, num_frames, timeout_ms);
+  }
+
+  bool readCanFrame(cantaloupe::CanFrame* /*frame*/, uint32_t /*timeout_ms*/ = 0) override
+  {
+    return false;
+  }
+
+  const std::vector<SentFrame>& sent() const { return sent_; }
+  size_t maxBatch() const { return max_batch_; }
+
+ private:
+  const FakeClock* clock_;
+  std::vector<SentFrame> sent_;
+  size_t max_batch_;
+};
+
+// Schedule `kJitterNumMessages` cyclic messages on a virtual clock, polling every `poll_interval_us` plus up to
+// `max_lateness_us` of pseudo-random delay, and check every message went out as often as its period says.  Returns the
+// worst jitter statistics over all the messages, with no transmissions at all if any message drifted.
+static cantaloupe::CyclicScheduler::JitterStatistics runCyclicJitter(uint64_t poll_interval_us,
+  uint64_t max_lateness_us, size_t* max_batch)
+{
+  using cantaloupe::CanFrame;
+  using cantaloupe::CyclicScheduler;
+
+  static const uint32_t kPeriodsUs[] = {10000, 20000, 50000, 100000, 200000, 500000, 1000000};
+
+  FakeClock clock;
+  RecordingSink sink(&clock);
+  CyclicScheduler scheduler(&sink, CyclicScheduler::kDefaultCapacity, CyclicScheduler::kDefaultTickUs, &clock);
+
+  std::vector<CyclicScheduler::Handle> handles;
+  std::vector<uint64_t> expected_transmissions;
+  for (size_t i = 0; i < kJitterNumMessages; ++i)
+  {
+    const uint32_t period_us = kPeriodsUs[i % (sizeof(kPeriodsUs) / sizeof(kPeriodsUs[0]))];
+    const uint32_t delay_us = static_cast<uint32_t>((i * 3700) % period_us) / CyclicScheduler::kDefaultTickUs *
+      CyclicScheduler::kDefaultTickUs;
+
+    CanFrame frame;
+    frame.id = static_cast<uint32_t>(0x100 + i);
+    frame.dlc = 8;
+    handles.push_back(scheduler.addCyclic(frame, period_us, delay_us));
+    expected_transmissions.push_back((kJitterDurationUs - delay_us) / period_us + 1);
+  }
+
+  // Polls land late by a repeatable pseudo-random amount, as a loaded host would manage.
+  uint32_t random = 12345;
+  uint64_t nominal_us = 0;
+  while (nominal_us <= kJitterDurationUs)
+  {
+    random = random * 1103515245 + 12345;
+    const uint64_t lateness_us = (max_lateness_us > 0) ? ((random >> 8) % (max_lateness_us + 1)) : 0;
+    clock.advance(std::min(nominal_us + lateness_us, kJitterDurationUs) - clock.nowUs());
+    scheduler.poll();
+    nominal_us += poll_interval_us;
+  }
+
+  CyclicScheduler::JitterStatistics worst;
+  worst.min_period_error_us = INT64_MAX;
+  worst.max_period_error_us = INT64_MIN;
+  for (size_t i = 0; i < kJitterNumMessages; ++i)
+  {
+    CyclicScheduler::JitterStatistics statistics;
+    scheduler.getJitterStatistics(handles[i], &statistics);
+    if (statistics.num_transmissions != expected_transmissions[i])
+    {
+      CANTALOUPE_ERROR("Message 0x{:X} was sent {} times, expected {}.", 0x100 + i, statistics.num_transmissions,
+        expected_transmissions[i]);
+      worst.num_transmissions = 0;
+      return worst;
+    }
+
+    worst.num_transmissions += statistics.num_transmissions;
+    worst.min_period_error_us = std::min(worst.min_period_error_us, statistics.min_period_error_us);
+    worst.max_period_error_us = std::max(worst.max_period_error_us, statistics.max_period_error_us);
+    worst.mean_period_error_us = std::max(worst.mean_period_error_us, std::abs(statistics.mean_period_error_us));
+    worst.stddev_period_error_us = std::max(worst.stddev_period_error_us, statistics.stddev_period_error_us);
+    worst.max_lateness_us = std::max(worst.max_lateness_us, statistics.max_lateness_us);
+  }
+
+  *max_batch = sink.maxBatch();
+  return worst;
+}
+
+// Hooks calling back into the scheduler, which they could not do while it held its lock around them.
+static bool checkCyclicHooks()
+{
+  using cantaloupe::CanFrame;
+  using cantaloupe::CyclicScheduler;
+
+  FakeClock clock;
+  RecordingSink sink(&clock);
+  CyclicScheduler scheduler(&sink, 16, CyclicScheduler::kDefaultTickUs, &clock);
+
+  CanFrame frame;
+  frame.dlc = 8;
+
+  // Stamps a counter into the outgoing copy, and the next counter into the second byte of the stored payload.
+  CyclicScheduler::Handle counter = CyclicScheduler::kInvalidHandle;
+  frame.id = 0x10;
+  counter = scheduler.addCyclic(frame, 1000, 0, [&scheduler, &counter](CanFrame* outgoing, uint64_t sequence) {
+    outgoing->data[0] = static_cast<uint8_t>(sequence);
+    const uint8_t next[2] = {0, static_cast<uint8_t>(sequence + 1)};
+    scheduler.updatePayload(counter, next, 2);
+  });
+
+  // Removes itself after five transmissions, and queues a one-shot on its first.
+  CyclicScheduler::Handle self_removing = CyclicScheduler::kInvalidHandle;
+  frame.id = 0x20;
+  self_removing = scheduler.addCyclic(frame, 1000, 0, [&scheduler, &self_removing](CanFrame*, uint64_t sequence) {
+    if (sequence == 0)
+    {
+      CanFrame one_shot;
+      one_shot.id = 0x30;
+      scheduler.addOneShot(one_shot, 500);
+    }
+    else if (sequence == 4)
+    {
+      scheduler.remove(self_removing);
+    }
+  });
+
+  for (uint64_t time_us = 0; time_us <= 20000; time_us += CyclicScheduler::kDefaultTickUs)
+  {
+    clock.advance(time_us - clock.nowUs());
+    scheduler.poll();
+  }
+
+  size_t num_counter = 0;
+  size_t num_self_removing = 0;
+  size_t num_one_shot = 0;
+  bool ok = true;
+  for (const RecordingSink::SentFrame& sent : sink.sent())
+  {
+    if (sent.frame.id == 0x10)
+    {
+      // This time's counter in the first byte, and the payload the hook stored last time round in the second.
+      ok = ok && (sent.frame.data[0] == num_counter) && (sent.frame.data[1] == num_counter) &&
+        (sent.frame.dlc == ((num_counter == 0) ? 8 : 2));
+      num_counter++;
+    }
+
+    num_self_removing += (sent.frame.id == 0x20) ? 1 : 0;
+    num_one_shot += (sent.frame.id == 0x30) ? 1 : 0;
+  }
+
+  return ok && (num_counter == 21) && (num_self_removing == 5) && (num_one_shot == 1) && (scheduler.size() == 1);
+}
+
+// Drive the cyclic scheduler on a virtual clock against a recording sink: once polling on every tick, where every
+// message must go out exactly on its period, and once polling late by up to `kJitterMaxPollLatenessUs`, where the
+// messages must still not drift.  Also checks hooks can call back into the scheduler.
+static int measureCyclicJitter()
+{
+  if (checkCyclicHooks() == false)
+  {
+    CANTALOUPE_ERROR("Cyclic scheduler hooks did not behave as expected.");
+    return -1;
+  }
+
+  size_t ideal_max_batch = 0;
+  size_t late_max_batch = 0;
+  const cantaloupe::CyclicScheduler::JitterStatistics ideal =
+    runCyclicJitter(cantaloupe::CyclicScheduler::kDefaultTickUs, 0, &ideal_max_batch);
+  const cantaloupe::CyclicScheduler::JitterStatistics late =
+    runCyclicJitter(kJitterPollIntervalUs, kJitterMaxPollLatenessUs, &late_max_batch);
+  if ((ideal.num_transmissions == 0) || (late.num_transmissions == 0))
+  {
+    return -1;
+  }
+
+  auto report = [](const char* name, const cantaloupe::CyclicScheduler::JitterStatistics& worst, size_t max_batch) {
+    CANTALOUPE_INFO("{}: {} transmissions, period error {} to {} us (worst |mean| {:.1f} us, worst stddev {:.1f} us), "
+      "max lateness {} us, largest batch {}.", name, worst.num_transmissions, worst.min_period_error_us,
+      worst.max_period_error_us, worst.mean_period_error_us, worst.stddev_period_error_us, worst.max_lateness_us,
+      max_batch);
+  };
+
+  report("Polled every tick", ideal, ideal_max_batch);
+  report("Polled late", late, late_max_batch);
+
+  // Late polls can stretch or shrink one period by as much as a poll is late, but never push a message off its grid.
+  const int64_t max_error_us = static_cast<int64_t>(kJitterPollIntervalUs + kJitterMaxPollLatenessUs);
+  if ((ideal.min_period_error_us != 0) || (ideal.max_period_error_us != 0) ||
+    (late.min_period_error_us < -max_error_us) || (late.max_period_error_us > max_error_us) ||
+    (late.max_lateness_us > static_cast<uint64_t>(max_error_us)))
+  {
+    CANTALOUPE_ERROR("Cyclic messages were sent off their period.");
+    return -1;
+  }
+
+  return 0;
+}
+
+// J1939 message seen by the transport protocol check.
+struct ReceivedJ1939Message
+{
+  cantaloupe::J1939Id id;
+  std::vector<uint8_t> data;
+};
+
+// Payload with a recognizable pattern for each transfer.
+static std::vector<uint8_t> makeJ1939Payload(size_t num_bytes, uint8_t seed)
+{
+  std::vector<uint8_t> payload(num_bytes);
+  for (size_t i = 0; i < num_bytes; ++i)
+  {
+    payload[i] = static_cast<uint8_t>(seed + i);
+  }
+
+  return payload;
+}
+
+// Single frame carrying `data` (at most eight bytes) from `source` to `destination`.
+static cantaloupe::CanFrame makeJ1939Frame(uint32_t pgn, uint8_t source, uint8_t destination,
+  const std::vector<uint8_t>& data, uint32_t timestamp_us)
+{
+  cantaloupe::J1939Id id;
+  id.priority = 7;
+  id.pgn = pgn;
+  id.source_address = source;
+  id.destination_address = destination;
+
+  cantaloupe::CanFrame frame;
+  frame.id = id.encode() | cantaloupe::CanFrame::kIdFlagEff;
+  frame.eff_frame = true;
+  frame.dlc = static_cast<uint8_t>(data.size());
+  std::copy(data.begin(), data.end(), frame.data.begin());
+  frame.timestamp_us = timestamp_us;
+  return frame;
+}
+
+// TP.CM payload: control byte, three bytes that depend on it, the byte after that, then the PGN being transferred.
+static std::vector<uint8_t> makeTpCm(uint8_t control, uint16_t total_bytes, uint8_t num_packets, uint8_t extra,
+  uint32_t pgn)
+{
+  return {control, static_cast<uint8_t>(total_bytes), static_cast<uint8_t>(total_bytes >> 8), num_packets, extra,
+    static_cast<uint8_t>(pgn), static_cast<uint8_t>(pgn >> 8), static_cast<uint8_t>(pgn >> 16)};
+}
+
+// TP.DT payload for packet `sequence` of `payload`, padded with 0xFF.
+static std::vector<uint8_t> makeTpDt(const std::vector<uint8_t>& payload, uint8_t sequence)
+{
+  using cantaloupe::J1939Receiver;
+
+  std::vector<uint8_t> packet(cantaloupe::CanFrame::kDataNumMaxBytes, 0xFF);
+  packet[0] = sequence;
+
+  const size_t offset = (sequence - 1U) * J1939Receiver::kTpBytesPerPacket;
+  for (size_t i = 0; (i < J1939Receiver::kTpBytesPerPacket) && ((offset + i) < payload.size()); ++i)
+  {
+    packet[1 + i] = payload[offset + i];
+  }
+
+  return packet;
+}
+
+// Push J1939 traffic through a fake transport into a receiver: single frames, a BAM broadcast, an RTS/CTS transfer
+// with a retransmitted packet, an aborted transfer and two that time out.  Fails if a payload comes out wrong or a
+// transfer that should not complete does.
+static int simulateJ1939()
+{
+  using cantaloupe::CanFrame;
+  using cantaloupe::J1939Id;
+  using cantaloupe::J1939Receiver;
+
+  static constexpr uint32_t kPgnDm1 = 0xFECA;
+  static constexpr uint32_t kPgnCcvs = 0xFEF1;
+  static constexpr uint32_t kPgnProprietaryA = 0xEF00;
+  static constexpr uint32_t kPacketIntervalUs = 50 * 1000;
+
+  FakeTransport bus(16);
+  J1939Receiver receiver;
+
+  std::vector<ReceivedJ1939Message> messages;
+  receiver.setDefaultHandler([&messages](const cantaloupe::J1939Message& message) {
+    messages.push_back(ReceivedJ1939Message{message.id,
+      std::vector<uint8_t>(message.data, message.data + message.length)});
+  });
+
+  uint32_t now_us = 0;
+  auto send = [&](uint32_t pgn, uint8_t source, uint8_t destination, const std::vector<uint8_t>& data) {
+    CanFrame rx_frame;
+    bus.writeCanFrame(makeJ1939Frame(pgn, source, destination, data, now_us));
+    bus.readCanFrame(&rx_frame);
+    receiver.processFrame(rx_frame);
+    now_us += kPacketIntervalUs;
+  };
+
+  bool ok = true;
+
+  // Single frames, including one claiming more than eight bytes.
+  const std::vector<uint8_t> ccvs = makeJ1939Payload(8, 0x10);
+  send(kPgnCcvs, 0x00, J1939Id::kGlobalAddress, ccvs);
+
+  CanFrame long_frame = makeJ1939Frame(kPgnCcvs, 0x00, J1939Id::kGlobalAddress, ccvs, now_us);
+  long_frame.dlc = 15;
+  bus.writeCanFrame(long_frame);
+  bus.readCanFrame(&long_frame);
+  receiver.processFrame(long_frame);
+
+  ok = ok && (messages.size() == 2) && (messages[0].data == ccvs) && (messages[1].data == ccvs) &&
+    (messages[0].id.pgn == kPgnCcvs);
+
+  // BAM broadcast of 20 bytes in three packets.
+  const std::vector<uint8_t> dm1 = makeJ1939Payload(20, 0x40);
+  send(J1939Receiver::kPgnTpConnectionManagement, 0x01, J1939Id::kGlobalAddress,
+    makeTpCm(J1939Receiver::kTpCmBroadcastAnnounce, 20, 3, 0xFF, kPgnDm1));
+  for (uint8_t sequence = 1; sequence <= 3; ++sequence)
+  {
+    send(J1939Receiver::kPgnTpDataTransfer, 0x01, J1939Id::kGlobalAddress, makeTpDt(dm1, sequence));
+  }
+
+  ok = ok && (messages.size() == 3) && (messages[2].data == dm1) && (messages[2].id.pgn == kPgnDm1) &&
+    (messages[2].id.source_address == 0x01) && (messages[2].id.destination_address == J1939Id::kGlobalAddress);
+
+  // RTS/CTS transfer of 100 bytes from 0x02 to 0x03, in two windows, with packet 5 sent twice.
+  const std::vector<uint8_t> proprietary = makeJ1939Payload(100, 0x80);
+  send(J1939Receiver::kPgnTpConnectionManagement, 0x02, 0x03,
+    makeTpCm(J1939Receiver::kTpCmRequestToSend, 100, 15, 8, kPgnProprietaryA));
+  send(J1939Receiver::kPgnTpConnectionManagement, 0x03, 0x02,
+    makeTpCm(J1939Receiver::kTpCmClearToSend, 0, 8, 1, kPgnProprietaryA));
+  for (uint8_t sequence = 1; sequence <= 8; ++sequence)
+  {
+    send(J1939Receiver::kPgnTpDataTransfer, 0x02, 0x03, makeTpDt(proprietary, sequence));
+  }
+
+  send(J1939Receiver::kPgnTpDataTransfer, 0x02, 0x03, makeTpDt(proprietary, 5));
+  send(J1939Receiver::kPgnTpConnectionManagement, 0x03, 0x02,
+    makeTpCm(J1939Receiver::kTpCmClearToSend, 0, 7, 9, kPgnProprietaryA));
+  for (uint8_t sequence = 9; sequence <= 15; ++sequence)
+  {
+    send(J1939Receiver::kPgnTpDataTransfer, 0x02, 0x03, makeTpDt(proprietary, sequence));
+  }
+
+  ok = ok && (messages.size() == 4) && (messages[3].data == proprietary) &&
+    (messages[3].id.pgn == kPgnProprietaryA) && (messages[3].id.source_address == 0x02) &&
+    (messages[3].id.destination_address == 0x03);
+
+  send(J1939Receiver::kPgnTpConnectionManagement, 0x03, 0x02,
+    makeTpCm(J1939Receiver::kTpCmEndOfMessageAck, 100, 15, 0xFF, kPgnProprietaryA));
+
+  // The receiver aborts a transfer part way through; the packets that follow belong to nothing.
+  const std::vector<uint8_t> aborted = makeJ1939Payload(14, 0xC0);
+  send(J1939Receiver::kPgnTpConnectionManagement, 0x04, 0x05,
+    makeTpCm(J1939Receiver::kTpCmRequestToSend, 14, 2, 2, kPgnProprietaryA));
+  send(J1939Receiver::kPgnTpDataTransfer, 0x04, 0x05, makeTpDt(aborted, 1));
+  send(J1939Receiver::kPgnTpConnectionManagement, 0x05, 0x04,
+    makeTpCm(J1939Receiver::kTpCmAbort, 0xFFFF, 0xFF, 0xFF, kPgnProprietaryA));
+  send(J1939Receiver::kPgnTpDataTransfer, 0x04, 0x05, makeTpDt(aborted, 2));
+
+  // A broadcast whose last packet turns up too late, and one that is simply never finished.
+  const std::vector<uint8_t> late = makeJ1939Payload(14, 0xE0);
+  send(J1939Receiver::kPgnTpConnectionManagement, 0x06, J1939Id::kGlobalAddress,
+    makeTpCm(J1939Receiver::kTpCmBroadcastAnnounce, 14, 2, 0xFF, kPgnDm1));
+  send(J1939Receiver::kPgnTpDataTransfer, 0x06, J1939Id::kGlobalAddress, makeTpDt(late, 1));
+  now_us += J1939Receiver::kDefaultSessionTimeoutUs;
+  send(J1939Receiver::kPgnTpDataTransfer, 0x06, J1939Id::kGlobalAddress, makeTpDt(late, 2));
+
+  send(J1939Receiver::kPgnTpConnectionManagement, 0x07, J1939Id::kGlobalAddress,
+    makeTpCm(J1939Receiver::kTpCmBroadcastAnnounce, 14, 2, 0xFF, kPgnDm1));
+  send(J1939Receiver::kPgnTpDataTransfer, 0x07, J1939Id::kGlobalAddress, makeTpDt(late, 1));
+  receiver.expireSessions(now_us + J1939Receiver::kDefaultSessionTimeoutUs);
+
+  const J1939Receiver::Statistics& statistics = receiver.getStatistics();
+  CANTALOUPE_INFO("{} frames, {} messages, {} transfers started, {} completed, {} aborted, {} timed out, "
+    "{} protocol errors.", statistics.frames_processed, statistics.messages_dispatched, statistics.sessions_started,
+    statistics.sessions_completed, statistics.sessions_aborted, statistics.sessions_timed_out,
+    statistics.protocol_errors);
+
+  ok = ok && (messages.size() == 4) && (statistics.sessions_started == 5) && (statistics.sessions_completed == 2) &&
+    (statistics.sessions_aborted == 1) && (statistics.sessions_timed_out == 2) &&
+    (receiver.numActiveSessions() == 0);
+
+  if (ok == false)
+  {
+    CANTALOUPE_ERROR("J1939 transfers were not reassembled as expected.");
+    return -1;
+  }
+
+  CANTALOUPE_INFO("J1939 transfers reassembled as expected.");
+  return 0;
+}
+
+static constexpr uint64_t kStormErrorIntervalUs = 200;
+static constexpr uint64_t kStormDurationUs = 2 * cantaloupe::CanErrorMonitor::kDefaultIntervalUs;
+static constexpr size_t kStormNumFrames = kStormDurationUs / kStormErrorIntervalUs;
+
+// Error frame as the firmware would send it.
+static cantaloupe::CanFrame makeErrorFrame(uint32_t classes, uint8_t controller, uint8_t protocol, uint8_t location,
+  uint8_t tx_error_count, uint8_t rx_error_count)
+{
+  cantaloupe::CanFrame frame;
+  frame.id = classes;
+  frame.dlc = 8;
+  frame.error_frame = true;
+  frame.data[1] = controller;
+  frame.data[2] = protocol;
+  frame.data[3] = location;
+  frame.data[6] = tx_error_count;
+  frame.data[7] = rx_error_count;
+  return frame;
+}
+
+// Push synthetic error traffic through a fake transport into an error monitor: an acknowledgement storm from a lone
+// node, recovery, then a burst of protocol errors ending in bus off and a restart.  Fails if the summaries or the
+// state machine come out wrong.
+static int simulateErrorStorm()
+{
+  using cantaloupe::CanBusState;
+  using cantaloupe::CanErrorFrame;
+  using cantaloupe::CanErrorKind;
+  using cantaloupe::CanErrorMonitor;
+  using cantaloupe::CanFrame;
+
+  FakeTransport bus(16);
+  FakeClock clock;
+
+  std::vector<CanErrorMonitor::Summary> summaries;
+  summaries.reserve(16);
+  CanErrorMonitor monitor([&summaries](const CanErrorMonitor::Summary& summary) {
+    summaries.push_back(summary);
+  }, CanErrorMonitor::kDefaultIntervalUs, &clock);
+
+  uint64_t num_error_frames = 0;
+  auto inject = [&](const CanFrame& frame, uint64_t interval_us) {
+    CanFrame rx_frame;
+    bus.writeCanFrame(frame);
+    bus.readCanFrame(&rx_frame);
+    num_error_frames += (monitor.processFrame(rx_frame) == true) ? 1 : 0;
+    clock.advance(interval_us);
+  };
+
+  // Healthy traffic on its own reports nothing.
+  CanFrame data_frame;
+  data_frame.id = 0x123;
+  data_frame.dlc = 8;
+  for (size_t i = 0; i < 1000; ++i)
+  {
+    inject(data_frame, 100);
+  }
+
+  // Nobody acknowledges us: the transmit error counter climbs by 8 per attempt and stops at error passive, where
+  // acknowledgement errors no longer count against it.
+  for (size_t i = 0; i < kStormNumFrames; ++i)
+  {
+    const uint8_t tx_error_count = static_cast<uint8_t>(std::min<size_t>(8 * (i + 1), 128));
+    inject(makeErrorFrame(CanErrorFrame::kClassNoAck | CanErrorFrame::kClassProtocol | CanErrorFrame::kClassCounters,
+      0, CanErrorFrame::kProtocolTx, CanErrorFrame::kLocationAckSlot, tx_error_count, 0), kStormErrorIntervalUs);
+  }
+
+  const CanBusState storm_state = monitor.getState();
+  clock.advance(CanErrorMonitor::kDefaultIntervalUs);
+  monitor.poll();
+
+  // Another node joins; the controller reports itself error active again once the counter has drained.
+  inject(makeErrorFrame(CanErrorFrame::kClassController, CanErrorFrame::kControllerActive, 0, 0, 0, 0), 100);
+  for (size_t i = 0; i < 1000; ++i)
+  {
+    inject(data_frame, 100);
+  }
+
+  clock.advance(CanErrorMonitor::kDefaultIntervalUs);
+  monitor.poll();
+
+  // A bad transceiver: one of each protocol error over and over until the controller gives up, then a restart.
+  const uint8_t protocol_errors[] = {CanErrorFrame::kProtocolBit1, CanErrorFrame::kProtocolStuff,
+    CanErrorFrame::kProtocolForm, 0};
+  for (size_t i = 0; i < 32; ++i)
+  {
+    const uint8_t tx_error_count = static_cast<uint8_t>(8 * i);
+    const uint8_t location = ((i % 4) == 3) ? CanErrorFrame::kLocationCrcSequence : 0;
+    inject(makeErrorFrame(CanErrorFrame::kClassProtocol | CanErrorFrame::kClassCounters, 0, protocol_errors[i % 4],
+      location, tx_error_count, 0), kStormErrorIntervalUs);
+  }
+
+  inject(makeErrorFrame(CanErrorFrame::kClassBusOff, 0, 0, 0, 0, 0), kStormErrorIntervalUs);
+  const CanBusState bus_off_state = monitor.getState();
+  inject(makeErrorFrame(CanErrorFrame::kClassRestarted, 0, 0, 0, 0, 0), kStormErrorIntervalUs);
+
+  clock.advance(CanErrorMonitor::kDefaultIntervalUs);
+  monitor.poll();
+
+  uint64_t summarized_error_frames = 0;
+  for (const CanErrorMonitor::Summary& summary : summaries)
+  {
+    summarized_error_frames += summary.error_frames;
+    CANTALOUPE_INFO("{} - {} us: {} error frames ({} no ack, {} bit, {} stuff, {} form, {} crc, {} bus off), "
+      "{} -> {} (worst {}, {} changes), peak TEC {} REC {}.", summary.begin_us, summary.end_us, summary.error_frames,
+      summary.count(CanErrorKind::NO_ACK), summary.count(CanErrorKind::BIT), summary.count(CanErrorKind::STUFF),
+      summary.count(CanErrorKind::FORM), summary.count(CanErrorKind::CRC), summary.count(CanErrorKind::BUS_OFF),
+      CanErrorMonitor::stateName(summary.begin_state), CanErrorMonitor::stateName(summary.end_state),
+      CanErrorMonitor::stateName(summary.worst_state), summary.state_changes, summary.peak_tx_error_count,
+      summary.peak_rx_error_count);
+  }
+
+  // The storm fills two intervals, recovery one more, and the bus off episode the last.
+  const size_t kStormSummaryFrames = CanErrorMonitor::kDefaultIntervalUs / kStormErrorIntervalUs;
+  const bool ok = (summaries.size() == 4) &&
+    (summaries[0].error_frames == kStormSummaryFrames) &&
+    (summaries[0].count(CanErrorKind::NO_ACK) == kStormSummaryFrames) &&
+    (summaries[0].worst_state == CanBusState::ERROR_PASSIVE) && (summaries[0].state_changes == 2) &&
+    (summaries[0].peak_tx_error_count == 128) &&
+    (summaries[1].error_frames == kStormNumFrames - kStormSummaryFrames) &&
+    (storm_state == CanBusState::ERROR_PASSIVE) &&
+    (summaries[2].end_state == CanBusState::ERROR_ACTIVE) && (summaries[2].error_frames == 1) &&
+    (summaries[3].count(CanErrorKind::BIT) == 8) && (summaries[3].count(CanErrorKind::STUFF) == 8) &&
+    (summaries[3].count(CanErrorKind::FORM) == 8) && (summaries[3].count(CanErrorKind::CRC) == 8) &&
+    (summaries[3].count(CanErrorKind::BUS_OFF) == 1) && (summaries[3].worst_state == CanBusState::BUS_OFF) &&
+    (bus_off_state == CanBusState::BUS_OFF) && (monitor.getState() == CanBusState::ERROR_ACTIVE) &&
+    (monitor.getStatistics().bus_off_events == 1) && (summarized_error_frames == num_error_frames) &&
+    (monitor.getStatistics().error_frames == num_error_frames);
+
+  if (ok == false)
+  {
+    CANTALOUPE_ERROR("Error storm was not summarized as expected.");
+    return -1;
+  }
+
+  CANTALOUPE_INFO("{} error frames reported as {} summaries.", num_error_frames, summaries.size());
+  return 0;
+}
+
+// Monotonic time in nanoseconds, for timing work too quick to see in microseconds.
+static uint64_t steadyNowNs()
+{
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static constexpr size_t kGatewayNumIsolatedFrames = 10000;
+static constexpr size_t kGatewayNumBatches = 20000;
+
+// Device for the gateway check: frames injected from its bus are read back in order, and every frame written to it is
+// logged and echoed back to the reader flagged `from_tx`, as a gs_usb device does once it has sent a frame.  Only used
+// from one thread.
+class SimulatedDevice : public cantaloupe::CanTransport
+{
+ public:
+  explicit SimulatedDevice(size_t capacity) :
+    rx_(capacity),
+    transmitted_(capacity)
+  {
+  }
+
+  // A frame seen on this device's bus.
+  bool inject(const cantaloupe::CanFrame& frame) { return rx_.writeCanFrame(frame); }
+
+  // The next frame this device put on its bus.
+  bool takeTransmitted(cantaloupe::CanFrame* frame) { return transmitted_.readCanFrame(frame); }
+
+  bool writeCanFrame(const cantaloupe::CanFrame& frame, uint32_t timeout_ms = 0) override
+  {
+    cantaloupe::CanFrame echo = frame;
+    echo.from_tx = true;
+    return (transmitted_.writeCanFrame(frame, timeout_ms) == true) && (rx_.writeCanFrame(echo, timeout_ms) == true);
+  }
+
+  bool readCanFrame(cantaloupe::CanFrame* frame, uint32_t timeout_ms = 0) override
+  {
+    return rx_.readCanFrame(frame, timeout_ms);
+  }
+
+  size_t readCanFrames(cantaloupe::CanFrame* frames, size_t max_frames, uint32_t timeout_ms = 0) override
+  {
+    return rx_.readCanFrames(frames, max_frames, timeout_ms);
+  }
+
+ private:
+  FakeTransport rx_;
+  FakeTransport transmitted_;
+};
+
+// Bridge two simulated devices with a gateway driven directly through `forwardBatch()`.  Checks rewriting, filtering
+// and that echoes and error frames never cross, then measures how long an isolated frame takes to get across and how
+// many frames a second each direction moves in full batches.
+static int simulateGateway()
+{
+  using cantaloupe::CanFrame;
+  using cantaloupe::CanGateway;
+  using cantaloupe::RoutingTable;
+
+  const size_t batch_size = CanGateway::kDefaultBatchSize;
+  SimulatedDevice device_a(4 * batch_size);
+  SimulatedDevice device_b(4 * batch_size);
+
+  CanGateway gateway(&device_a, &device_b);
+  gateway.routes(CanGateway::Direction::A_TO_B).addRule(RoutingTable::Rule::remap(0x100, 0x80012345));
+  gateway.routes(CanGateway::Direction::A_TO_B).addRule(RoutingTable::Rule::drop(0x7FF));
+  gateway.routes(CanGateway::Direction::B_TO_A).addRule(RoutingTable::Rule::patch(0x200, 0xFF00, 0x4200));
+
+  // One pass in each direction, so echoes of what was just forwarded are read (and dropped) straight away.
+  auto forwardBoth = [&gateway]() {
+    return gateway.forwardBatch(CanGateway::Direction::A_TO_B, 0) +
+      gateway.forwardBatch(CanGateway::Direction::B_TO_A, 0);
+  };
+
+  CanFrame frame;
+  frame.dlc = 8;
+  for (size_t i = 0; i < frame.data.size(); ++i)
+  {
+    frame.data[i] = static_cast<uint8_t>(0x10 + i);
+  }
+
+  bool ok = true;
+  CanFrame output;
+
+  // Remapped to an extended identifier on the way from A to B.
+  frame.id = 0x100;
+  device_a.inject(frame);
+  forwardBoth();
+  ok = ok && (device_b.takeTransmitted(&output) == true) && (output.id == 0x80012345) && (output.eff_frame == true) &&
+    (output.data == frame.data) && (device_a.takeTransmitted(&output) == false);
+
+  // Dropped from A to B.
+  frame.id = 0x7FF;
+  device_a.inject(frame);
+  forwardBoth();
+  ok = ok && (device_b.takeTransmitted(&output) == false);
+
+  // Second byte patched from B to A, the rest left alone.
+  frame.id = 0x200;
+  device_b.inject(frame);
+  forwardBoth();
+  ok = ok && (device_a.takeTransmitted(&output) == true) && (output.id == 0x200) && (output.data[0] == 0x10) &&
+    (output.data[1] == 0x42) && (output.data[2] == 0x12) && (device_b.takeTransmitted(&output) == false);
+
+  // Another host's transmissions echoed to us, and error frames, stay where they are.
+  frame.id = 0x300;
+  frame.from_tx = true;
+  device_a.inject(frame);
+  frame.from_tx = false;
+  frame.error_frame = true;
+  device_b.inject(frame);
+  frame.error_frame = false;
+  forwardBoth();
+  ok = ok && (device_a.takeTransmitted(&output) == false) && (device_b.takeTransmitted(&output) == false);
+
+  // Nothing keeps bouncing: once everything is through, another pass finds no work.
+  ok = ok && (forwardBoth() == 0);
+
+  const CanGateway::Statistics a_to_b = gateway.getStatistics(CanGateway::Direction::A_TO_B);
+  const CanGateway::Statistics b_to_a = gateway.getStatistics(CanGateway::Direction::B_TO_A);
+  ok = ok && (a_to_b.frames_forwarded == 1) && (a_to_b.frames_filtered == 1) && (a_to_b.echoes_dropped == 2) &&
+    (b_to_a.frames_forwarded == 1) && (b_to_a.echoes_dropped == 1) && (b_to_a.error_frames_dropped == 1);
+  if (ok == false)
+  {
+    CANTALOUPE_ERROR("Gateway did not route as expected.");
+    return -1;
+  }
+
+  // Isolated frames: each has to come out of the same pass that read it, rather than waiting for a batch to fill.
+  // Latency is from injecting the frame to finding it transmitted on the other side.
+  std::vector<uint64_t> latencies_ns[2];
+  for (size_t i = 0; i < kGatewayNumIsolatedFrames; ++i)
+  {
+    const bool from_a = (i % 2) == 0;
+    SimulatedDevice& input = from_a ? device_a : device_b;
+    SimulatedDevice& output_device = from_a ? device_b : device_a;
+
+    frame.id = static_cast<uint32_t>(0x400 + (i & 0xFF));
+    const uint64_t start_ns = steadyNowNs();
+    input.inject(frame);
+    gateway.forwardBatch(from_a ? CanGateway::Direction::A_TO_B : CanGateway::Direction::B_TO_A, 0);
+    if ((output_device.takeTransmitted(&output) == false) || (output.id != frame.id))
+    {
+      CANTALOUPE_ERROR("Isolated frame 0x{:X} was not forwarded by the pass that read it.", frame.id);
+      return -1;
+    }
+
+    latencies_ns[from_a ? 0 : 1].push_back(steadyNowNs() - start_ns);
+
+    // Read the echo back on the far side.
+    gateway.forwardBatch(from_a ? CanGateway::Direction::B_TO_A : CanGateway::Direction::A_TO_B, 0);
+  }
+
+  // Full batches: frames per second spent inside `forwardBatch()`, for each direction on its own.
+  uint64_t elapsed_ns[2] = {0, 0};
+  uint64_t num_forwarded[2] = {0, 0};
+  for (size_t i = 0; i < 2 * kGatewayNumBatches; ++i)
+  {
+    const bool from_a = (i % 2) == 0;
+    SimulatedDevice& input = from_a ? device_a : device_b;
+    SimulatedDevice& output_device = from_a ? device_b : device_a;
+    for (size_t j = 0; j < batch_size; ++j)
+    {
+      frame.id = static_cast<uint32_t>((i * batch_size + j) & CanFrame::kIdMaskStandard);
+      input.inject(frame);
+    }
+
+    const uint64_t start_ns = steadyNowNs();
+    num_forwarded[from_a ? 0 : 1] +=
+      gateway.forwardBatch(from_a ? CanGateway::Direction::A_TO_B : CanGateway::Direction::B_TO_A, 0);
+    elapsed_ns[from_a ? 0 : 1] += steadyNowNs() - start_ns;
+
+    while (output_device.takeTransmitted(&output) == true)
+    {
+    }
+
+    gateway.forwardBatch(from_a ? CanGateway::Direction::B_TO_A : CanGateway::Direction::A_TO_B, 0);
+  }
+
+  const char* names[2] = {"A to B", "B to A"};
+  for (size_t i = 0; i < 2; ++i)
+  {
+    std::vector<uint64_t>& latency_ns = latencies_ns[i];
+    std::sort(latency_ns.begin(), latency_ns.end());
+    CANTALOUPE_INFO("{}: isolated frame latency p50 {} ns, p99 {} ns, max {} ns; {} frames in batches of {} at {:.0f} "
+      "frames/s.", names[i], latency_ns[latency_ns.size() / 2], latency_ns[latency_ns.size() * 99 / 100],
+      latency_ns.back(), num_forwarded[i], batch_size,
+      1e9 * static_cast<double>(num_forwarded[i]) / static_cast<double>(std::max<uint64_t>(elapsed_ns[i], 1)));
+  }
+
+  return 0;
+}
+
+// Recorded by `--metrics` from each of its worker threads.
+static constexpr size_t kMetricsNumThreads = 4;
+static constexpr uint64_t kMetricsIncrementsPerThread = 100000;
+
+static int checkMetrics()
+{
+  using cantaloupe::HistogramSnapshot;
+  using cantaloupe::Metrics;
+  using cantaloupe::MetricCounter;
+  using cantaloupe::MetricGauge;
+  using cantaloupe::MetricHistogram;
+  using cantaloupe::MetricsSnapshot;
+
+  const MetricsSnapshot before = Metrics::snapshot();
+
+  // Shards belonging to threads that have exited still count.
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < kMetricsNumThreads; ++i)
+  {
+    threads.emplace_back([]() {
+      for (uint64_t j = 0; j < kMetricsIncrementsPerThread; ++j)
+      {
+        Metrics::increment(MetricCounter::RX_FRAMES);
+      }
+    });
+  }
+
+  for (std::thread& thread : threads)
+  {
+    thread.join();
+  }
+
+  Metrics::increment(MetricCounter::BULK_IN_BYTES, 1234);
+
+  // Every known LibUSB code lands in its own slot, -99 next to last, anything else last, successes nowhere.
+  for (int code = -1; code >= -12; --code)
+  {
+    Metrics::recordLibUsbError(code);
+  }
+
+  Metrics::recordLibUsbError(-99);
+  Metrics::recordLibUsbError(-50);
+  Metrics::recordLibUsbError(-50);
+  Metrics::recordLibUsbError(0);
+  Metrics::recordLibUsbError(7);
+
+  Metrics::updateHighWaterMark(MetricGauge::TX_QUEUE_HIGH_WATER_MARK, 5);
+  Metrics::updateHighWaterMark(MetricGauge::TX_QUEUE_HIGH_WATER_MARK, 3);
+
+  uint64_t sum = 0;
+  for (uint64_t value = 1; value <= 10000; ++value)
+  {
+    Metrics::recordLatency(MetricHistogram::BULK_OUT_LATENCY_US, value);
+    sum += value;
+  }
+
+  const MetricsSnapshot after = Metrics::snapshot();
+  const MetricsSnapshot delta = after.delta(before);
+
+  bool ok = (delta.counter(MetricCounter::RX_FRAMES) == kMetricsNumThreads * kMetricsIncrementsPerThread) &&
+    (delta.counter(MetricCounter::BULK_IN_BYTES) == 1234) && (delta.counter(MetricCounter::TX_FRAMES) == 0) &&
+    (delta.gauge(MetricGauge::TX_QUEUE_HIGH_WATER_MARK) == 5) &&
+    (delta.timestamp_us == after.timestamp_us - before.timestamp_us);
+
+  for (size_t slot = 0; slot < cantaloupe::kNumLibUsbErrorSlots; ++slot)
+  {
+    const uint64_t expected = (slot == cantaloupe::kNumLibUsbErrorSlots - 1) ? 2 : 1;
+    ok = ok && (delta.libusb_errors[slot] == expected);
+  }
+
+  ok = ok && (std::strcmp(Metrics::libUsbErrorName(0), "LIBUSB_ERROR_IO") == 0) &&
+    (std::strcmp(Metrics::libUsbErrorName(11), "LIBUSB_ERROR_NOT_SUPPORTED") == 0) &&
+    (std::strcmp(Metrics::libUsbErrorName(cantaloupe::kNumLibUsbErrorSlots - 2), "LIBUSB_ERROR_OTHER") == 0) &&
+    (std::strcmp(Metrics::libUsbErrorName(cantaloupe::kNumLibUsbErrorSlots - 1), "unknown") == 0);
+
+  // Percentiles are bucket upper edges, so they may overshoot by the bucket width (under 1/16) but never undershoot.
+  const HistogramSnapshot& histogram = delta.histogram(MetricHistogram::BULK_OUT_LATENCY_US);
+  const uint64_t p50 = histogram.percentile(0.5);
+  const uint64_t p99 = histogram.percentile(0.99);
+  const uint64_t max = histogram.percentile(1.0);
+  ok = ok && (histogram.count == 10000) && (histogram.sum == sum) &&
+    (p50 >= 5000) && (p50 <= 5000 + 5000 / 16) && (p99 >= 9900) && (p99 <= 9900 + 9900 / 16) &&
+    (max >= 10000) && (max <= 10000 + 10000 / 16) &&
+    (delta.histogram(MetricHistogram::BULK_IN_LATENCY_US).count == 0);
+
+  // Every value sits inside the bucket it is filed under, right up to the top of the range.
+  for (uint64_t value : {uint64_t{0}, uint64_t{15}, uint64_t{16}, uint64_t{17}, uint64_t{1000}, uint64_t{1} << 40,
+    ~uint64_t{0}})
+  {
+    const size_t index = HistogramSnapshot::bucketIndex(value);
+    ok = ok && (index < cantaloupe::kHistogramNumBuckets) && (HistogramSnapshot::bucketUpperBound(index) >= value) &&
+      ((index == 0) || (HistogramSnapshot::bucketUpperBound(index - 1) < value));
+  }
+
+  // The JSON names every counter and gauge, only the LibUSB codes that were seen, and each non-empty bucket.
+  const std::string json = delta.toJson();
+  const std::string text = delta.toText();
+  size_t depth = 0;
+  bool balanced = true;
+  for (char c : json)
+  {
+    if ((c == '{') || (c == '['))
+    {
+      ++depth;
+    }
+    else if ((c == '}') || (c == ']'))
+    {
+      balanced = balanced && (depth > 0);
+      depth = (depth > 0) ? depth - 1 : 0;
+    }
+  }
+
+  const std::string expected_rx = fmt::format("\"rx_frames\":{}", kMetricsNumThreads * kMetricsIncrementsPerThread);
+  ok = ok && (balanced == true) && (depth == 0) && (json.front() == '{') && (json.back() == '}') &&
+    (json.find(expected_rx) != std::string::npos) &&
+    (json.find("\"bulk_in_bytes\":1234") != std::string::npos) &&
+    (json.find("\"tx_queue_high_water_mark\":5") != std::string::npos) &&
+    (json.find("\"LIBUSB_ERROR_OTHER\":1") != std::string::npos) &&
+    (json.find("\"unknown\":2") != std::string::npos) &&
+    (json.find(fmt::format("\"bulk_out_latency_us\":{{\"count\":10000,\"sum\":{},", sum)) != std::string::npos) &&
+    (json.find("\"bulk_in_latency_us\":{\"count\":0,\"sum\":0,") != std::string::npos) &&
+    (json.find("[1,1]") != std::string::npos) &&
+    (text.find("libusb_errors{code=\"LIBUSB_ERROR_TIMEOUT\"} 1\n") != std::string::npos);
+
+  if (ok == false)
+  {
+    CANTALOUPE_ERROR("Metrics did not add up as expected:\n{}", text);
+    return -1;
+  }
+
+  CANTALOUPE_INFO("Metrics added up across {} threads:\n{}", kMetricsNumThreads, json);
+  return 0;
+}
+
+// Frames `--fd-records` times through the record buffer.
+static constexpr size_t kFdRecordsNumTimedFrames = 1000000;
+
+static bool sameFdFrame(const cantaloupe::CanFdFrame& a, const cantaloupe::CanFdFrame& b)
+{
+  return (a.id == b.id) && (a.length == b.length) && (a.error_frame == b.error_frame) &&
+    (a.rtr_frame == b.rtr_frame) && (a.eff_frame == b.eff_frame) && (a.from_tx == b.from_tx) &&
+    (a.fd_frame == b.fd_frame) && (a.bit_rate_switch == b.bit_rate_switch) &&
+    (a.error_state_indicator == b.error_state_indicator) && (a.timestamp_us == b.timestamp_us) &&
+    std::equal(a.data.begin(), a.data.begin() + a.length, b.data.begin());
+}
+
+// Count the records an iterator finds in `num_bytes` of raw records.
+static size_t countRecords(const uint8_t* records, size_t num_bytes)
+{
+  using cantaloupe::CanFrameRecordBuffer;
+
+  size_t num_records = 0;
+  const CanFrameRecordBuffer::ConstIterator end(records + num_bytes, records + num_bytes);
+  for (CanFrameRecordBuffer::ConstIterator it(records, records + num_bytes); it != end; ++it)
+  {
+    num_records++;
+  }
+
+  return num_records;
+}
+
+static int checkFdRecords()
+{
+  using cantaloupe::CanFdFrame;
+  using cantaloupe::CanFrame;
+  using cantaloupe::CanFrameRecordBuffer;
+  using cantaloupe::GsHostCanFdFrame;
+  using cantaloupe::GsHostCanFrame;
+  using cantaloupe::GsUsbWrapper;
+
+  bool ok = true;
+
+  // DLC codes: classic frames saturate at eight bytes, FD frames step up to 64, and every length maps to the
+  // smallest code that holds it.
+  const uint8_t fd_lengths[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+  for (uint8_t dlc = 0; dlc < 16; ++dlc)
+  {
+    ok = ok && (cantaloupe::canDlcToLength(dlc, true) == fd_lengths[dlc]) &&
+      (cantaloupe::canDlcToLength(dlc, false) == ((dlc < 8) ? dlc : 8)) &&
+      (cantaloupe::canLengthToDlc(fd_lengths[dlc]) == dlc);
+  }
+
+  for (size_t length = 0; length <= CanFdFrame::kDataNumMaxBytes; ++length)
+  {
+    const uint8_t dlc = cantaloupe::canLengthToDlc(length);
+    ok = ok && (fd_lengths[dlc] >= length) && ((dlc == 0) || (fd_lengths[dlc - 1] < length)) &&
+      (cantaloupe::canFdPaddedLength(length) == fd_lengths[dlc]);
+  }
+
+  ok = ok && (cantaloupe::canLengthToDlc(65) == 15) && (cantaloupe::canLengthToDlc(1000) == 15);
+
+  // Every classic and FD length, as the device would send them: through the bulk transfer layout, across the bus and
+  // into the record buffer.
+  std::vector<CanFdFrame> sent;
+  for (size_t i = 0; i <= CanFdFrame::kDataNumMaxBytes + CanFrame::kDataNumMaxBytes + 1; ++i)
+  {
+    const bool fd_frame = i <= CanFdFrame::kDataNumMaxBytes;
+    CanFdFrame frame;
+    frame.length = static_cast<uint8_t>(fd_frame ? i : (i - CanFdFrame::kDataNumMaxBytes - 1));
+    frame.eff_frame = (i % 2) == 0;
+    frame.id = frame.eff_frame ? (CanFrame::kIdFlagEff | static_cast<uint32_t>(0x1ABCDE00 + i)) :
+      static_cast<uint32_t>(0x100 + i);
+    frame.fd_frame = fd_frame;
+    frame.bit_rate_switch = fd_frame && ((i % 3) == 0);
+    frame.error_state_indicator = fd_frame && ((i % 5) == 0);
+    frame.timestamp_us = static_cast<uint32_t>(1000 * i);
+    for (size_t j = 0; j < frame.length; ++j)
+    {
+      frame.data[j] = static_cast<uint8_t>(i + 7 * j + 1);
+    }
+
+    sent.push_back(frame);
+  }
+
+  FakeTransport bus(sent.size());
+  for (const CanFdFrame& frame : sent)
+  {
+    GsHostCanFdFrame host_frame;
+    const size_t num_bytes = GsUsbWrapper::toHostCanFdFrame(frame, &host_frame);
+
+    // What the device hands back for a received frame: no echo ID, and the timestamp filled in.
+    host_frame.echo_id = GsHostCanFrame::kEchoIdNormalRxFrame;
+    if (frame.fd_frame == true)
+    {
+      host_frame.timestamp_us = frame.timestamp_us;
+    }
+    else
+    {
+      std::memcpy(&host_frame.data[CanFrame::kDataNumMaxBytes], &frame.timestamp_us, sizeof(frame.timestamp_us));
+    }
+
+    // The wrong size for the layout the flags call for is refused.
+    CanFdFrame received;
+    ok = ok && (num_bytes == (frame.fd_frame ? sizeof(GsHostCanFdFrame) : sizeof(GsHostCanFrame))) &&
+      (host_frame.can_dlc == cantaloupe::canLengthToDlc(frame.length)) &&
+      (GsUsbWrapper::fromHostCanFdFrame(host_frame, frame.fd_frame ? sizeof(GsHostCanFrame) :
+        sizeof(GsHostCanFdFrame), &received) == false) &&
+      (GsUsbWrapper::fromHostCanFdFrame(host_frame, num_bytes, &received) == true);
+
+    // FD lengths between DLC steps come back padded out with zeros.
+    CanFdFrame expected = frame;
+    expected.length = frame.fd_frame ? cantaloupe::canFdPaddedLength(frame.length) : frame.length;
+    ok = ok && sameFdFrame(received, expected) && bus.writeCanFdFrame(received);
+  }
+
+  CanFrameRecordBuffer records(64 * 1024);
+  size_t expected_bytes = 0;
+  std::vector<CanFdFrame> expected;
+  CanFdFrame received;
+  while (bus.readCanFdFrame(&received) == true)
+  {
+    // Classic frames go in through the classic overload, the way the capture path stores them.
+    CanFrame classic_frame;
+    ok = ok && ((received.fd_frame == true) ? records.append(received) :
+      ((cantaloupe::toCanFrame(received, &classic_frame) == true) && (records.append(classic_frame) == true)));
+    expected_bytes += CanFrameRecordBuffer::recordSize(received.length);
+    expected.push_back(received);
+  }
+
+  ok = ok && (records.size() == sent.size()) && (records.bytesUsed() == expected_bytes) &&
+    (CanFrameRecordBuffer::recordSize(CanFrame::kDataNumMaxBytes) == 20) &&
+    (CanFrameRecordBuffer::recordSize(CanFdFrame::kDataNumMaxBytes) == 76) &&
+    (CanFrameRecordBuffer::recordSize(9) == 24);
+
+  size_t index = 0;
+  for (const CanFrameRecordBuffer::RecordView& view : records)
+  {
+    const uint8_t* end_of_payload = view.data + view.header.length;
+    const uint8_t* end_of_record = view.data - sizeof(CanFrameRecordBuffer::RecordHeader) + view.header.record_size;
+    ok = ok && (index < expected.size()) && (view.isFd() == expected[index].fd_frame) &&
+      (view.header.record_size == CanFrameRecordBuffer::recordSize(view.header.length)) &&
+      (std::all_of(end_of_payload, end_of_record, [](uint8_t value) { return value == 0; }) == true) &&
+      sameFdFrame(view.toCanFdFrame(), expected[index]);
+    index++;
+  }
+
+  ok = ok && (index == expected.size());
+
+  // Classic reads skip FD frames rather than truncating them.
+  for (const CanFdFrame& frame : expected)
+  {
+    bus.writeCanFdFrame(frame);
+  }
+
+  CanFrame classic_frame;
+  size_t num_classic = 0;
+  while (bus.readCanFrame(&classic_frame) == true)
+  {
+    num_classic++;
+  }
+
+  ok = ok && (num_classic == CanFrame::kDataNumMaxBytes + 1);
+
+  // Appending fails cleanly once full, and encoding refuses a destination that is too small.
+  CanFrameRecordBuffer small(3 * CanFrameRecordBuffer::recordSize(CanFdFrame::kDataNumMaxBytes) - 4);
+  uint8_t scratch[CanFrameRecordBuffer::kRecordAlignment * 32];
+  ok = ok && (small.append(sent[CanFdFrame::kDataNumMaxBytes]) == true) &&
+    (small.append(sent[CanFdFrame::kDataNumMaxBytes]) == true) &&
+    (small.append(sent[CanFdFrame::kDataNumMaxBytes]) == false) && (small.size() == 2) &&
+    (CanFrameRecordBuffer::encode(sent[CanFdFrame::kDataNumMaxBytes], scratch, sizeof(scratch) - 60) == 0) &&
+    (CanFrameRecordBuffer::encode(sent[CanFdFrame::kDataNumMaxBytes], scratch, sizeof(scratch)) == 76);
+
+  // Padding between and after records is skipped, including padding too long for a single record to describe.
+  std::vector<uint8_t> padded(records.data(), records.data() + records.bytesUsed());
+  const size_t first_size = CanFrameRecordBuffer::recordSize(expected[0].length);
+  padded.insert(padded.begin() + static_cast<std::ptrdiff_t>(first_size), 256, 0);
+  CanFrameRecordBuffer::encodePadding(&padded[first_size], 256);
+  const size_t tail_bytes = 0x10000 + 3 * CanFrameRecordBuffer::kRecordAlignment;
+  padded.resize(padded.size() + tail_bytes);
+  CanFrameRecordBuffer::encodePadding(&padded[padded.size() - tail_bytes], tail_bytes);
+  ok = ok && (countRecords(padded.data(), padded.size()) == expected.size());
+
+  // Damaged input: iteration stops at the first record that cannot be right, rather than reading past it.
+  const uint8_t* raw = records.data();
+  const size_t last_size = CanFrameRecordBuffer::recordSize(expected.back().length);
+  ok = ok && (countRecords(raw, records.bytesUsed() - 1) == expected.size() - 1) &&
+    (countRecords(raw, records.bytesUsed() - last_size + 4) == expected.size() - 1) &&
+    (countRecords(raw, first_size - 1) == 0);
+
+  std::vector<uint8_t> zero_tail(raw, raw + records.bytesUsed());
+  zero_tail.resize(zero_tail.size() + 4096, 0);
+  ok = ok && (countRecords(zero_tail.data(), zero_tail.size()) == expected.size());
+
+  // Corrupt the second record's header in each way a reader has to catch.
+  const size_t second = first_size;
+  CanFrameRecordBuffer::RecordHeader header;
+  std::memcpy(&header, raw + second, sizeof(header));
+  const CanFrameRecordBuffer::RecordHeader corruptions[] = {
+    {header.id, header.timestamp_us, header.length, header.flags, 4},
+    {header.id, header.timestamp_us, header.length, header.flags, 0xFFFC},
+    {header.id, header.timestamp_us, 65, header.flags, 80},
+    {header.id, header.timestamp_us, 64, header.flags, header.record_size},
+  };
+
+  for (const CanFrameRecordBuffer::RecordHeader& corruption : corruptions)
+  {
+    std::vector<uint8_t> damaged(raw, raw + records.bytesUsed());
+    std::memcpy(&damaged[second], &corruption, sizeof(corruption));
+    ok = ok && (countRecords(damaged.data(), damaged.size()) == 1);
+  }
+
+  if (ok == false)
+  {
+    CANTALOUPE_ERROR("CAN FD frames did not round trip through the record buffer.");
+    return -1;
+  }
+
+  // Throughput for typical traffic: mostly classic 8-byte frames with an FD frame of every length mixed in.
+  CanFrameRecordBuffer timed(kFdRecordsNumTimedFrames * CanFrameRecordBuffer::recordSize(CanFdFrame::kDataNumMaxBytes));
+  const uint64_t append_start_ns = steadyNowNs();
+  for (size_t i = 0; i < kFdRecordsNumTimedFrames; ++i)
+  {
+    timed.append(sent[((i % 16) == 0) ? ((i / 16) % (CanFdFrame::kDataNumMaxBytes + 1)) : (sent.size() - 1)]);
+  }
+
+  const uint64_t iterate_start_ns = steadyNowNs();
+  uint64_t checksum = 0;
+  for (const CanFrameRecordBuffer::RecordView& view : timed)
+  {
+    checksum += view.header.length;
+  }
+
+  const uint64_t end_ns = steadyNowNs();
+  CANTALOUPE_INFO("{} classic and FD records round tripped.  {} mixed frames: {:.1f} bytes/frame (vs {} for "
+    "CanFdFrame), append {:.1f} ns/frame, iterate {:.1f} ns/frame (checksum {}).", expected.size(), timed.size(),
+    static_cast<double>(timed.bytesUsed()) / static_cast<double>(timed.size()), sizeof(CanFdFrame),
+    static_cast<double>(iterate_start_ns - append_start_ns) / static_cast<double>(kFdRecordsNumTimedFrames),
+    static_cast<double>(end_ns - iterate_start_ns) / static_cast<double>(kFdRecordsNumTimedFrames), checksum);
+  return 0;
+}
+
+// Capture window for `--flight-recorder`: frames every millisecond, ten before the trigger and five after it.
+static constexpr uint32_t kRecorderFrameIntervalUs = 1000;
+static constexpr size_t kRecorderNumPreFrames = 10;
+static constexpr size_t kRecorderNumPostFrames = 5;
+static constexpr size_t kRecorderNumTimedFrames = 4000000;
+
+static int checkFlightRecorder()
+{
+  using cantaloupe::CanFrame;
+  using cantaloupe::FlightRecorder;
+
+  char directory[] = "/tmp/cantaloupe-recorder-XXXXXX";
+  if (mkdtemp(directory) == nullptr)
+  {
+    CANTALOUPE_ERROR("Failed to create a directory for the capture: {}", std::strerror(errno));
+    return -1;
+  }
+
+  // Half an interval either side of the window edges, so no frame sits right on one.
+  FlightRecorder::Config config;
+  config.capacity_frames = 1024;
+  config.pre_trigger_us = kRecorderNumPreFrames * kRecorderFrameIntervalUs + kRecorderFrameIntervalUs / 2;
+  config.post_trigger_us = kRecorderNumPostFrames * kRecorderFrameIntervalUs + kRecorderFrameIntervalUs / 2;
+  config.output_directory = directory;
+  config.file_prefix = "check";
+
+  FlightRecorder recorder(config);
+  recorder.setTriggers({FlightRecorder::Trigger::onId(0x7E5)});
+  recorder.start();
+
+  // Plenty of traffic before the window, the trigger, and traffic running on past the end of the window.
+  FakeTransport bus(64);
+  std::vector<std::string> expected;
+  const size_t trigger_index = 200;
+  for (size_t i = 0; i < trigger_index + 50; ++i)
+  {
+    CanFrame frame;
+    frame.id = (i == trigger_index) ? 0x7E5 : static_cast<uint32_t>(0x100 + (i % 16));
+    frame.dlc = static_cast<uint8_t>(i % 9);
+    frame.data = {static_cast<uint8_t>(i), static_cast<uint8_t>(i >> 8), 0xA5, 0x5A, 1, 2, 3, 4};
+    frame.timestamp_us = static_cast<uint32_t>(123456 + i * kRecorderFrameIntervalUs);
+    bus.writeCanFrame(frame);
+
+    if ((i + kRecorderNumPreFrames >= trigger_index) && (i <= trigger_index + kRecorderNumPostFrames))
+    {
+      expected.push_back(FlightRecorder::formatCandumpLine(frame, config.interface_name));
+    }
+
+    CanFrame frames[64];
+    const size_t num_frames = bus.readCanFrames(frames, 64);
+    for (size_t j = 0; j < num_frames; ++j)
+    {
+      recorder.record(frames[j]);
+    }
+  }
+
+  // The capture thread follows the ring every few milliseconds; give it a generous while to catch up.
+  for (size_t i = 0; (i < 500) && (recorder.getStatistics().captures_written == 0); ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  recorder.stop();
+
+  std::vector<std::string> captured;
+  const std::string path = recorder.lastCapturePath();
+  std::ifstream capture(path);
+  for (std::string line; std::getline(capture, line);)
+  {
+    captured.push_back(line);
+  }
+
+  capture.close();
+  ::unlink(path.c_str());
+  ::rmdir(directory);
+
+  const FlightRecorder::Statistics statistics = recorder.getStatistics();
+  if ((captured != expected) || (statistics.captures_written != 1) || (statistics.triggers != 1) ||
+    (statistics.frames_captured != kRecorderNumPreFrames + 1 + kRecorderNumPostFrames) ||
+    (statistics.frames_lost != 0))
+  {
+    CANTALOUPE_ERROR("Capture held {} lines ({} expected: {} before the trigger, the trigger, {} after).",
+      captured.size(), expected.size(), kRecorderNumPreFrames, kRecorderNumPostFrames);
+    return -1;
+  }
+
+  // Hot path cost: nothing to check, a few triggers that never match, and the same while another thread keeps
+  // replacing them.
+  FlightRecorder timed_recorder;
+  std::vector<FlightRecorder::Trigger> triggers = {FlightRecorder::Trigger::onId(0x7FF),
+    FlightRecorder::Trigger::onPayload(0x123, {0xFF}, {0xFF}), FlightRecorder::Trigger::onErrorFrame()};
+
+  CanFrame frame;
+  frame.id = 0x100;
+  frame.dlc = 8;
+  std::atomic<bool> replacing{false};
+  std::atomic<uint64_t> num_replacements{0};
+  double ns_per_frame[3] = {0.0, 0.0, 0.0};
+  for (size_t run = 0; run < 3; ++run)
+  {
+    timed_recorder.setTriggers((run == 0) ? std::vector<FlightRecorder::Trigger>() : triggers);
+
+    replacing = run == 2;
+    std::thread replacer([&]() {
+      while (replacing == true)
+      {
+        timed_recorder.setTriggers(triggers);
+        num_replacements++;
+        std::this_thread::yield();
+      }
+    });
+
+    const uint64_t start_ns = steadyNowNs();
+    for (size_t i = 0; i < kRecorderNumTimedFrames; ++i)
+    {
+      frame.timestamp_us = static_cast<uint32_t>(i);
+      frame.data[0] = static_cast<uint8_t>(i);
+      timed_recorder.record(frame);
+    }
+
+    ns_per_frame[run] = static_cast<double>(steadyNowNs() - start_ns) / static_cast<double>(kRecorderNumTimedFrames);
+    replacing = false;
+    replacer.join();
+  }
+
+  if (timed_recorder.getStatistics().triggers != 0)
+  {
+    CANTALOUPE_ERROR("Replacing the triggers fired one.");
+    return -1;
+  }
+
+  CANTALOUPE_INFO("Capture held {} frames before the trigger, the trigger and {} after.  record() costs {:.1f} ns "
+    "per frame with no triggers, {:.1f} ns with {}, {:.1f} ns while they were replaced {} times.",
+    kRecorderNumPreFrames, kRecorderNumPostFrames, ns_per_frame[0], ns_per_frame[1], triggers.size(),
+    ns_per_frame[2], num_replacements.load());
+  return 0;
+}
+
+// Traffic timed by `--payload-filter`: a rolling counter in byte 0 on every frame and a real change now and then.
+static constexpr size_t kFilterNumIds = 1024;
+static constexpr size_t kFilterNumTimedFrames = kFilterNumIds * 1000;
+static constexpr size_t kFilterBatchSize = 64;
+static constexpr size_t kFilterChangeInterval = 10;
+
+static int checkPayloadFilter()
+{
+  using cantaloupe::CanFrame;
+  using cantaloupe::PayloadChangeFilter;
+
+  PayloadChangeFilter filter;
+  CanFrame frame;
+  frame.id = 0x100;
+  frame.dlc = 8;
+  frame.data = {1, 2, 3, 4, 5, 6, 7, 8};
+
+  // First sight, a repeat, then a change in one byte.
+  uint8_t changed[4] = {0, 0, 0, 0};
+  bool ok = (filter.process(frame, &changed[0]) == true) && (changed[0] == 0xFF) &&
+    (filter.process(frame, &changed[1]) == false) && (changed[1] == 0);
+  frame.data[3] = 0x44;
+  ok = ok && (filter.process(frame, &changed[0]) == true) && (changed[0] == 0x08);
+
+  // A masked out counter is still reported, but no longer forwards the frame.  A change of length always does.
+  ok = ok && (filter.setBitMask(0x100, ~uint64_t{0xFF}) == true);
+  frame.data[0]++;
+  ok = ok && (filter.process(frame, &changed[0]) == false) && (changed[0] == 0x01);
+  frame.dlc = 6;
+  ok = ok && (filter.process(frame, &changed[0]) == true) && (changed[0] == 0xC0);
+
+  // Extended identifiers that fit in 11 bits get their mask through the EFF flag, and keep it apart from the
+  // standard identifier with the same number.
+  CanFrame extended = frame;
+  extended.id = CanFrame::kIdFlagEff | 0x100;
+  extended.eff_frame = true;
+  CanFrame standard = frame;
+  standard.id = 0x005;
+  ok = ok && (filter.setBitMask(CanFrame::kIdFlagEff | 0x005, ~uint64_t{0xFF}) == true) &&
+    (filter.process(extended) == true) && (filter.process(standard) == true);
+  extended.id = CanFrame::kIdFlagEff | 0x005;
+  ok = ok && (filter.process(extended) == true);
+  extended.data[0]++;
+  standard.data[0]++;
+  ok = ok && (filter.process(extended) == false) && (filter.process(standard) == true);
+
+  // Error and remote frames carry nothing to compare.
+  CanFrame error_frame = frame;
+  error_frame.error_frame = true;
+  CanFrame remote_frame = frame;
+  remote_frame.rtr_frame = true;
+  ok = ok && (filter.process(error_frame) == true) && (filter.process(error_frame) == true) &&
+    (filter.process(remote_frame) == true) && (filter.getStatistics().passed_through == 3);
+
+  // Batches filter in place; after a reset every identifier is news again.
+  CanFrame batch[4] = {frame, frame, standard, standard};
+  ok = ok && (filter.filter(batch, 4, batch, changed) == 0);
+  filter.reset();
+  ok = ok && (filter.filter(batch, 4, batch, changed) == 2) && (batch[0].id == frame.id) &&
+    (batch[1].id == standard.id) && (changed[0] == 0x3F) && (changed[1] == 0x3F);
+
+  // Once the extended table is full, new extended identifiers go straight through.
+  PayloadChangeFilter small(2);
+  for (uint32_t id = 0; id < 4; ++id)
+  {
+    extended.id = CanFrame::kIdFlagEff | (0x10000 + id);
+    ok = ok && (small.process(extended) == true) && (small.process(extended) == (id >= 2));
+  }
+
+  ok = ok && (small.getStatistics().table_full == 4) && (PayloadChangeFilter::nonZeroBytes(0x00FF000000000100) == 0x42);
+  if (ok == false)
+  {
+    CANTALOUPE_ERROR("Payload change filter did not forward the expected frames.");
+    return -1;
+  }
+
+  // Throughput on sniffer-like traffic: half standard and half extended identifiers, all with a rolling counter the
+  // default mask ignores.
+  PayloadChangeFilter timed;
+  timed.setDefaultBitMask(~uint64_t{0xFF});
+  std::vector<CanFrame> traffic(kFilterNumTimedFrames);
+  for (size_t i = 0; i < kFilterNumTimedFrames; ++i)
+  {
+    CanFrame& input = traffic[i];
+    const size_t index = i % kFilterNumIds;
+    input.eff_frame = (index % 2) == 1;
+    input.id = input.eff_frame ? (CanFrame::kIdFlagEff | static_cast<uint32_t>(0x18FF0000 + index)) :
+      static_cast<uint32_t>(index);
+    input.dlc = 8;
+    input.data = {static_cast<uint8_t>(i / kFilterNumIds), 0x11, 0x22, 0x33, 0x44, 0x55, 0x66,
+      static_cast<uint8_t>(i / (kFilterNumIds * kFilterChangeInterval))};
+  }
+
+  std::vector<CanFrame> output(kFilterBatchSize);
+  size_t num_forwarded = 0;
+  const uint64_t start_ns = steadyNowNs();
+  for (size_t i = 0; i < kFilterNumTimedFrames; i += kFilterBatchSize)
+  {
+    num_forwarded += timed.filter(&traffic[i], std::min(kFilterBatchSize, kFilterNumTimedFrames - i), output.data());
+  }
+
+  const uint64_t elapsed_ns = steadyNowNs() - start_ns;
+
+  // Each identifier is forwarded when first seen and again each time the last byte moves on.
+  const size_t expected = kFilterNumIds * (1 + (kFilterNumTimedFrames / kFilterNumIds - 1) / kFilterChangeInterval);
+  if (num_forwarded != expected)
+  {
+    CANTALOUPE_ERROR("Forwarded {} of {} frames, expected {}.", num_forwarded, kFilterNumTimedFrames, expected);
+    return -1;
+  }
+
+  CANTALOUPE_INFO("Forwarded {} of {} frames across {} identifiers: {:.1f} ns/frame, {:.0f} frames/s.", num_forwarded,
+    kFilterNumTimedFrames, kFilterNumIds, static_cast<double>(elapsed_ns) / static_cast<double>(kFilterNumTimedFrames),
+    1e9 * static_cast<double>(kFilterNumTimedFrames) / static_cast<double>(std::max<uint64_t>(elapsed_ns, 1)));
+  return 0;
+}
+
+// Frames `--predicate` times the compiled expression and the hand-written lambda over.
+static constexpr size_t kPredicateNumTimedFrames = 1024;
+static constexpr size_t kPredicateNumTimedPasses = 2000;
+
+// An expression, and what it should evaluate to on the frame `--predicate` checks against.
+struct PredicateCase
+{
+  const char* expression;
+  uint64_t expected;
+};
+
+static int checkPredicates()
+{
+  using cantaloupe::CanFrame;
+  using cantaloupe::Predicate;
+
+  CanFrame frame;
+  frame.id = 0x123;
+  frame.dlc = 8;
+  frame.data = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88};
+  frame.timestamp_us = 1000000;
+
+  const PredicateCase cases[] = {
+    // Precedence and associativity follow C.
+    {"1 + 2 * 3", 7},
+    {"(1 + 2) * 3", 9},
+    {"10 - 4 - 3", 3},
+    {"100 / 10 / 5", 2},
+    {"17 % 5", 2},
+    {"1 << 4 + 1", 32},
+    {"1 | 2 ^ 3 & 6", 1},
+    {"2 < 3 == 1", 1},
+    {"1 + 2 == 3 && 4 > 5 || 6 != 7", 1},
+    {"!0 + 1", 2},
+    {"-1", ~uint64_t{0}},
+    {"- - 5", 5},
+    {"~0 >> 60", 15},
+    {"1 << 64", 0},
+
+    // Fields.
+    {"id", 0x123},
+    {"dlc", 8},
+    {"data[1]", 0x22},
+    {"data[1 + 2]", 0x44},
+    {"bits(8, 16)", 0x3322},
+    {"bits(60, 4)", 0x8},
+    {"timestamp / 1000", 1000},
+    {"eff || rtr || err || tx", 0},
+    {"id == 0x123 && (data[2] & 0x0C) == 0x00 && dlc >= 6", 1},
+
+    // Dividing by zero gives zero, whether the divisor is known up front or not.
+    {"5 / 0", 0},
+    {"5 % 0", 0},
+    {"data[0] / (data[1] - 0x22)", 0},
+    {"id % (id - 0x123) == 0", 1},
+
+    // `&&` and `||` give 0 or 1, and stop as soon as the result is known.
+    {"3 && 4", 1},
+    {"0 || 7", 1},
+    {"true && false", 0},
+    {"0 && 5 / 0", 0},
+    {"1 || 5 / 0", 1},
+    {"data[0] == 0x11 || data[1] / (id - 0x123)", 1},
+    {"data[0] == 0x10 && data[1] / (id - 0x123)", 0},
+  };
+
+  bool ok = true;
+  for (const PredicateCase& check : cases)
+  {
+    Predicate predicate;
+    std::string error;
+    if (predicate.compile(check.expression, &error) == false)
+    {
+      CANTALOUPE_ERROR("\"{}\" did not compile: {}", check.expression, error);
+      ok = false;
+    }
+    else if ((predicate.evaluate(frame) != check.expected) || (predicate.matches(frame) != (check.expected != 0)))
+    {
+      CANTALOUPE_ERROR("\"{}\" gave {}, expected {}.", check.expression, predicate.evaluate(frame), check.expected);
+      ok = false;
+    }
+  }
+
+  // Constant parts fold away completely, including a constant side of `&&` / `||` deciding the result.
+  auto compiled = [](const std::string& expression) {
+    Predicate predicate;
+    predicate.compile(expression);
+    return predicate;
+  };
+
+  auto hasOpcode = [](const Predicate& predicate, Predicate::Opcode opcode) {
+    return std::any_of(predicate.code().begin(), predicate.code().end(),
+      [opcode](const Predicate::Instruction& instruction) { return instruction.opcode == opcode; });
+  };
+
+  const Predicate folded = compiled("1 + 2 * 3 == 7 && (0x10 << 2) == 64");
+  const Predicate false_and = compiled("0 && data[0] == 1");
+  const Predicate true_or = compiled("data[0] == 1 || 1");
+  const Predicate required = compiled("id == 0x100 + 0x23 && data[0] == 0x11");
+  const Predicate short_circuit = compiled("data[0] == 0x10 && data[1] == 0x22 || dlc == 8");
+  ok = ok && (folded.code().size() == 1) && (folded.evaluate(frame) == 1) &&
+    (false_and.code().size() == 1) && (false_and.evaluate(frame) == 0) &&
+    (true_or.code().size() == 1) && (true_or.evaluate(frame) == 1) &&
+    (required.requiredId() == 0x123) && (hasOpcode(required, Predicate::Opcode::ADD) == false) &&
+    (hasOpcode(short_circuit, Predicate::Opcode::JUMP_IF_FALSE) == true) &&
+    (hasOpcode(short_circuit, Predicate::Opcode::JUMP_IF_TRUE) == true) &&
+    (short_circuit.requiredId() == Predicate::kAnyId);
+
+  // Nesting is fine up to the limit and refused past it, however it is nested.
+  const size_t limit = Predicate::kMaxNestingDepth;
+  std::string short_chain = "id";
+  for (size_t i = 0; i < limit / 2; ++i)
+  {
+    short_chain += " + id";
+  }
+
+  std::string long_chain = short_chain;
+  for (size_t i = 0; i < limit; ++i)
+  {
+    long_chain += " + id";
+  }
+
+  const std::string too_deep[] = {std::string(limit + 1, '(') + "1" + std::string(limit + 1, ')'),
+    std::string(limit + 1, '!') + "0", std::string(100000, '-') + "1", long_chain};
+  const std::string deep_enough[] = {std::string(limit / 2, '(') + "id" + std::string(limit / 2, ')'),
+    std::string(limit / 2, '!') + "0", short_chain};
+  for (const std::string& expression : too_deep)
+  {
+    std::string error;
+    ok = ok && (compiled(expression).isValid() == false) && (Predicate().compile(expression, &error) == false) &&
+      (error.find("nests more than") != std::string::npos);
+  }
+
+  for (const std::string& expression : deep_enough)
+  {
+    ok = ok && (compiled(expression).isValid() == true);
+  }
+
+  // Mistakes are reported rather than guessed at.
+  for (const char* expression : {"id ==", "data[8]", "bits(0, 65)", "frobnicate", "(id", "id == 1 1", ""})
+  {
+    std::string error;
+    ok = ok && (Predicate().compile(expression, &error) == false) && (error.empty() == false);
+  }
+
+  if (ok == false)
+  {
+    CANTALOUPE_ERROR("Predicates did not evaluate as expected.");
+    return -1;
+  }
+
+  // The filter from the class comment, compiled and as the equivalent hand-written C++.
+  const Predicate predicate = compiled("id == 0x1F0 && (data[2] & 0x0C) == 0x04 && dlc >= 6");
+  auto lambda = [](const CanFrame& input) {
+    return (input.id == 0x1F0) && ((input.data[2] & 0x0C) == 0x04) && (input.dlc >= 6);
+  };
+
+  std::vector<CanFrame> frames(kPredicateNumTimedFrames);
+  for (size_t i = 0; i < kPredicateNumTimedFrames; ++i)
+  {
+    frames[i].id = ((i % 4) == 0) ? 0x1F0 : static_cast<uint32_t>(0x100 + (i % 64));
+    frames[i].dlc = static_cast<uint8_t>(i % 9);
+    frames[i].data[2] = static_cast<uint8_t>(i * 37);
+  }
+
+  std::vector<uint8_t> results(kPredicateNumTimedFrames);
+  std::vector<uint8_t> expected(kPredicateNumTimedFrames);
+  size_t num_matches[2] = {0, 0};
+  uint64_t elapsed_ns[2] = {0, 0};
+  for (size_t pass = 0; pass < kPredicateNumTimedPasses; ++pass)
+  {
+    uint64_t start_ns = steadyNowNs();
+    num_matches[0] += predicate.evaluate(frames.data(), frames.size(), results.data());
+    elapsed_ns[0] += steadyNowNs() - start_ns;
+
+    start_ns = steadyNowNs();
+    for (size_t i = 0; i < kPredicateNumTimedFrames; ++i)
+    {
+      expected[i] = (lambda(frames[i]) == true) ? 1 : 0;
+      num_matches[1] += expected[i];
+    }
+
+    elapsed_ns[1] += steadyNowNs() - start_ns;
+  }
+
+  if ((results != expected) || (num_matches[0] != num_matches[1]) || (num_matches[0] == 0))
+  {
+    CANTALOUPE_ERROR("Compiled predicate matched {} frames, the lambda {}.", num_matches[0], num_matches[1]);
+    return -1;
+  }
+
+  const double num_evaluated = static_cast<double>(kPredicateNumTimedFrames * kPredicateNumTimedPasses);
+  CANTALOUPE_INFO("{} expressions evaluated as expected.  Compiled predicate {:.1f} ns/frame ({} instructions), "
+    "lambda {:.1f} ns/frame, over {} frames with {} matches.", sizeof(cases) / sizeof(cases[0]),
+    static_cast<double>(elapsed_ns[0]) / num_evaluated, predicate.code().size(),
+    static_cast<double>(elapsed_ns[1]) / num_evaluated, kPredicateNumTimedFrames * kPredicateNumTimedPasses,
+    num_matches[0]);
+  return 0;
+}
+
+// Frames `--capture-writer` pushes through each run, and how slow the slowed disk is.
+static constexpr size_t kCaptureNumFrames = 2000000;
+static constexpr uint32_t kCaptureSlowPwriteUs = 2000;
+
+// Frame `i` of the capture traffic: mostly classic frames, with an FD frame of every DLC length mixed in.
+static cantaloupe::CanFdFrame makeCaptureFrame(size_t i)
+{
+  cantaloupe::CanFdFrame frame;
+  frame.fd_frame = (i % 8) == 0;
+  frame.id = static_cast<uint32_t>(0x100 + (i % 0x400));
+  frame.length = frame.fd_frame ? cantaloupe::canFdPaddedLength((i / 8) % 65) : static_cast<uint8_t>(i % 9);
+  frame.bit_rate_switch = frame.fd_frame;
+  for (size_t j = 0; j < frame.length; ++j)
+  {
+    frame.data[j] = static_cast<uint8_t>(i + j);
+  }
+
+  frame.timestamp_us = static_cast<uint32_t>(i);
+  return frame;
+}
+
+// What one `--capture-writer` run saw.
+struct CaptureRun
+{
+  cantaloupe::CaptureWriter::Statistics statistics;
+  double megabytes_per_second = 0.0;
+  uint64_t max_call_ns = 0;
+  bool round_tripped = false;
+};
+
+// Write `kCaptureNumFrames` frames as fast as they come through a pwrite() backed writer, then read the file back and
+// check it holds exactly the frames `write()` accepted, in order.
+static CaptureRun runCaptureWriter(const std::string& path)
+{
+  using cantaloupe::CanFdFrame;
+  using cantaloupe::CanFrame;
+  using cantaloupe::CanFrameRecordBuffer;
+  using cantaloupe::CaptureWriter;
+
+  CaptureWriter::Config config;
+  config.buffer_size = 64 * 1024;
+  config.num_buffers = 4;
+  config.sync_interval_ms = 0;
+  config.use_io_uring = false;
+
+  CaptureRun run;
+  std::vector<uint32_t> accepted;
+  accepted.reserve(kCaptureNumFrames);
+
+  CaptureWriter writer(config);
+  if (writer.open(path) == false)
+  {
+    return run;
+  }
+
+  const uint64_t start_ns = steadyNowNs();
+  for (size_t i = 0; i < kCaptureNumFrames; ++i)
+  {
+    // Classic frames go through the classic overload, as they would coming off the bus.
+    const CanFdFrame frame = makeCaptureFrame(i);
+    CanFrame classic_frame;
+    const bool classic = cantaloupe::toCanFrame(frame, &classic_frame);
+
+    const uint64_t call_start_ns = steadyNowNs();
+    const bool written = (classic == true) ? writer.write(classic_frame) : writer.write(frame);
+    run.max_call_ns = std::max(run.max_call_ns, steadyNowNs() - call_start_ns);
+
+    if (written == true)
+    {
+      accepted.push_back(static_cast<uint32_t>(i));
+    }
+  }
+
+  writer.close();
+  const uint64_t elapsed_ns = steadyNowNs() - start_ns;
+  run.statistics = writer.getStatistics();
+  run.megabytes_per_second = 1e3 * static_cast<double>(run.statistics.bytes_written) /
+    static_cast<double>(std::max<uint64_t>(elapsed_ns, 1));
+
+  std::ifstream file(path, std::ios::binary);
+  const std::vector<uint8_t> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  ::unlink(path.c_str());
+
+  CaptureWriter::FileHeader header{};
+  if (contents.size() < sizeof(header))
+  {
+    return run;
+  }
+
+  std::memcpy(&header, contents.data(), sizeof(header));
+  bool ok = (std::memcmp(header.magic, CaptureWriter::kFileMagic, sizeof(header.magic)) == 0) &&
+    (header.version == CaptureWriter::kFileVersion) &&
+    (header.record_header_size == sizeof(CanFrameRecordBuffer::RecordHeader)) &&
+    (contents.size() == run.statistics.bytes_written) && (run.statistics.write_errors == 0) &&
+    (run.statistics.frames_written == accepted.size()) &&
+    (run.statistics.frames_written + run.statistics.frames_dropped == kCaptureNumFrames);
+
+  size_t num_records = 0;
+  const uint8_t* records = contents.data() + sizeof(header);
+  const uint8_t* end = contents.data() + contents.size();
+  const CanFrameRecordBuffer::ConstIterator records_end(end, end);
+  for (CanFrameRecordBuffer::ConstIterator it(records, end); (ok == true) && (it != records_end); ++it)
+  {
+    const CanFdFrame expected = makeCaptureFrame(accepted[num_records]);
+    const CanFdFrame frame = it->toCanFdFrame();
+    ok = (num_records < accepted.size()) && (frame.id == expected.id) && (frame.length == expected.length) &&
+      (frame.fd_frame == expected.fd_frame) && (frame.timestamp_us == expected.timestamp_us) &&
+      std::equal(frame.data.begin(), frame.data.begin() + frame.length, expected.data.begin());
+    num_records++;
+  }
+
+  run.round_tripped = ok && (num_records == accepted.size());
+  return run;
+}
+
+static int checkCaptureWriter()
+{
+  char directory[] = "/tmp/cantaloupe-capture-XXXXXX";
+  if (mkdtemp(directory) == nullptr)
+  {
+    CANTALOUPE_ERROR("Failed to create a directory for the capture: {}", std::strerror(errno));
+    return -1;
+  }
+
+  const std::string path = std::string(directory) + "/check.cap";
+  const CaptureRun fast = runCaptureWriter(path);
+
+  g_pwrite_delay_us = kCanSlowPwrite ? kCaptureSlowPwriteUs : 0;
+  const CaptureRun slow = runCaptureWriter(path);
+  g_pwrite_delay_us = 0;
+  ::rmdir(directory);
+
+  const char* names[2] = {"pwrite()", kCanSlowPwrite ? "pwrite() slowed down" : "pwrite() (cannot slow it here)"};
+  const CaptureRun* runs[2] = {&fast, &slow};
+  for (size_t i = 0; i < 2; ++i)
+  {
+    const cantaloupe::CaptureWriter::Statistics& statistics = runs[i]->statistics;
+    CANTALOUPE_INFO("{}: {} of {} frames written ({} dropped, {} bytes), {:.1f} MB/s to disk, longest write() call "
+      "{} us, longest buffer write {} us.", names[i], statistics.frames_written, kCaptureNumFrames,
+      statistics.frames_dropped, statistics.bytes_dropped, runs[i]->megabytes_per_second,
+      runs[i]->max_call_ns / 1000, statistics.max_write_latency_us);
+  }
+
+  // Whatever the disk does, what was accepted reaches it intact and in order, and the rest is counted as dropped.  A
+  // disk slowed right down must show up as drops; a writer that waited for it instead would have dropped nothing.
+  if ((fast.round_tripped == false) || (slow.round_tripped == false))
+  {
+    CANTALOUPE_ERROR("Capture file did not hold exactly the frames that were accepted.");
+    return -1;
+  }
+
+  if ((kCanSlowPwrite == true) &&
+    ((slow.statistics.frames_dropped == 0) || (slow.statistics.max_write_latency_us < kCaptureSlowPwriteUs)))
+  {
+    CANTALOUPE_ERROR("A slow disk should have dropped frames rather than hold up write().");
+    return -1;
+  }
+
+  return 0;
+}
+
+// `--thread-latency` pushes this many frames through the transmit queue per run, one every period, while the hogs keep
+// the drain thread's CPU busy.
+static constexpr size_t kThreadLatencyNumFrames = 2000;
+static constexpr uint64_t kThreadLatencyPeriodUs = 500;
+static constexpr size_t kThreadLatencyNumHogs = 2;
+static constexpr int kThreadLatencyCpu = 0;
+static constexpr int kThreadLatencyPriority = 80;
+
+// Transport for `--thread-latency`.  Every frame carries the time it was pushed in its data; the time it took the drain
+// thread to wake and hand it over goes into a histogram.  Also notes the scheduling policy the drain thread ended up
+// with, since a real-time policy it was not allowed is only logged.  Read it once the queue has stopped.
+class DeliveryTimer : public cantaloupe::CanTransport
+{
+ public:
+  DeliveryTimer() :
+    latency_us_{},
+    policy_{SCHED_OTHER}
+  {
+  }
+
+  bool writeCanFrame(const cantaloupe::CanFrame& frame, uint32_t /*timeout_ms*/ = 0) override
+  {
+    const uint64_t now_ns = steadyNowNs();
+
+    uint64_t pushed_ns = 0;
+    std::memcpy(&pushed_ns, frame.data.data(), sizeof(pushed_ns));
+    const uint64_t delay_us = (now_ns - pushed_ns) / 1000;
+
+    latency_us_.buckets[cantaloupe::HistogramSnapshot::bucketIndex(delay_us)]++;
+    latency_us_.count++;
+    latency_us_.sum += delay_us;
+
+    sched_param param{};
+    pthread_getschedparam(pthread_self(), &policy_, &param);
+    return true;
+  }
+
+  bool readCanFrame(cantaloupe::CanFrame* /*frame*/, uint32_t /*timeout_ms*/ = 0) override
+  {
+    return false;
+  }
+
+  const cantaloupe::HistogramSnapshot& latencyUs() const { return latency_us_; }
+  int policy() const { return policy_; }
+
+ private:
+  cantaloupe::HistogramSnapshot latency_us_;
+  int policy_;
+};
+
+// Push `kThreadLatencyNumFrames` frames through a transmit queue whose drain thread is set up as `thread_config`, with
+// `kThreadLatencyNumHogs` threads spinning on the same CPU.
+static void runThreadLatency(const cantaloupe::ThreadConfig& thread_config, DeliveryTimer* timer)
+{
+  std::atomic<bool> hogs_shutdown{false};
+  std::vector<std::thread> hogs;
+  for (size_t i = 0; i < kThreadLatencyNumHogs; ++i)
+  {
+    hogs.emplace_back([&hogs_shutdown]() {
+      cantaloupe::ThreadConfig hog_config;
+      hog_config.name = "hog";
+      hog_config.cpus.push_back(kThreadLatencyCpu);
+      cantaloupe::applyThreadConfig(hog_config);
+
+      while (hogs_shutdown.load(std::memory_order_relaxed) == false)
+      {
+      }
+    });
+  }
+
+  cantaloupe::TxPriorityQueue queue(timer);
+  queue.start(thread_config);
+
+  cantaloupe::CanFrame frame{};
+  frame.id = kTxLatencyHighId;
+  frame.dlc = 8;
+
+  auto next = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < kThreadLatencyNumFrames; ++i)
+  {
+    next += std::chrono::microseconds(kThreadLatencyPeriodUs);
+    std::this_thread::sleep_until(next);
+
+    const uint64_t pushed_ns = steadyNowNs();
+    std::memcpy(frame.data.data(), &pushed_ns, sizeof(pushed_ns));
+    queue.push(frame);
+  }
+
+  // Let the last frame through before stopping, as stop() aborts whatever is still queued.
+  while (queue.size() > 0)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  queue.stop();
+  hogs_shutdown = true;
+  for (std::thread& hog : hogs)
+  {
+    hog.join();
+  }
+}
+
+// Measure how long the transmit queue's drain thread takes to wake and hand a frame to the transport while other
+// threads compete for its CPU: once with the default thread config, then pinned and under SCHED_FIFO.  Without the
+// permission to use SCHED_FIFO the second run falls back to default scheduling; that is reported, not failed.
+static int measureThreadLatency()
+{
+  cantaloupe::ThreadConfig fifo_config;
+  fifo_config.cpus.push_back(kThreadLatencyCpu);
+  fifo_config.policy = cantaloupe::SchedulingPolicy::FIFO;
+  fifo_config.priority = kThreadLatencyPriority;
+
+  DeliveryTimer default_timer;
+  runThreadLatency(cantaloupe::ThreadConfig(), &default_timer);
+
+  DeliveryTimer fifo_timer;
+  runThreadLatency(fifo_config, &fifo_timer);
+
+  const char* names[2] = {"default", "SCHED_FIFO, pinned"};
+  const DeliveryTimer* timers[2] = {&default_timer, &fifo_timer};
+  for (size_t i = 0; i < 2; ++i)
+  {
+    const cantaloupe::HistogramSnapshot& latency_us = timers[i]->latencyUs();
+    if (latency_us.count != kThreadLatencyNumFrames)
+    {
+      CANTALOUPE_ERROR("{}: {} of {} frames delivered.", names[i], latency_us.count, kThreadLatencyNumFrames);
+      return -1;
+    }
+
+    CANTALOUPE_INFO("{}: wake to delivery p50 {} us, p99 {} us, p99.9 {} us, max {} us over {} frames.", names[i],
+      latency_us.percentile(0.5), latency_us.percentile(0.99), latency_us.percentile(0.999),
+      latency_us.percentile(1.0), latency_us.count);
+  }
+
+  if (fifo_timer.policy() != SCHED_FIFO)
+  {
+    CANTALOUPE_WARN("The drain thread was not allowed SCHED_FIFO (needs root or CAP_SYS_NICE), so the second run "
+      "used default scheduling.");
+  }
+
+  return 0;
+}
+
+// Identifier `--bit-activity` hides known fields in, and how many frames it sends of it.
+static constexpr uint32_t kActivityId = 0x123;
+static constexpr size_t kActivityNumFrames = 10000;
+
+// Payloads for the timed part, spread over this many identifiers.
+static constexpr size_t kActivityNumTimedIds = 2000;
+static constexpr size_t kActivityNumTimedFrames = 1 << 16;
+static constexpr size_t kActivityNumTimedPasses = 32;
+
+// Most frames a saturated 1 Mbit/s bus can carry in a second: data-less standard frames of 44 bits, no stuff bits,
+// with the 3 bit interframe space.
+static constexpr double kActivityBusFramesPerSecond = 1e6 / 47.0;
+
+static const char* fieldKindName(cantaloupe::BitActivityAnalyzer::FieldKind kind)
+{
+  switch (kind)
+  {
+    case cantaloupe::BitActivityAnalyzer::FieldKind::FLAG:
+      return "flag";
+    case cantaloupe::BitActivityAnalyzer::FieldKind::SIGNAL:
+      return "signal";
+    case cantaloupe::BitActivityAnalyzer::FieldKind::COUNTER:
+      return "counter";
+    case cantaloupe::BitActivityAnalyzer::FieldKind::CHECKSUM:
+      return "checksum";
+  }
+
+  return "unknown";
+}
+
+// CRC-8 (polynomial 0x1D, as SAE J1850) over every payload byte but the one it goes in.
+static uint8_t activityCrc(const cantaloupe::CanFrame& frame, size_t crc_byte)
+{
+  uint8_t crc = 0xFF;
+  for (size_t i = 0; i < frame.dlc; ++i)
+  {
+    if (i == crc_byte)
+    {
+      continue;
+    }
+
+    crc ^= frame.data[i];
+    for (size_t bit = 0; bit < 8; ++bit)
+    {
+      crc = static_cast<uint8_t>(((crc & 0x80) != 0) ? ((crc << 1) ^ 0x1D) : (crc << 1));
+    }
+  }
+
+  return crc;
+}
+
+// Feed the analyzer an identifier carrying a nibble counter, a CRC byte, a 12-bit signal wandering up and down and a
+// byte counter, with the rest of the payload constant, and check it finds exactly those fields and counts every bit
+// as a brute-force count does.  Then check it keeps up with a saturated 1 Mbit/s bus by a wide margin.
+static int checkBitActivity()
+{
+  using cantaloupe::BitActivityAnalyzer;
+  using cantaloupe::CanFrame;
+  using FieldKind = BitActivityAnalyzer::FieldKind;
+
+  BitActivityAnalyzer analyzer;
+
+  std::array<uint64_t, BitActivityAnalyzer::kNumBits> ones{};
+  std::array<uint64_t, BitActivityAnalyzer::kNumBits> toggles{};
+  uint64_t last_payload = 0;
+
+  // The signal sweeps its whole range up and down, holding still now and then, so every one of its bits moves.
+  uint32_t random = 12345;
+  int signal = 0;
+  int direction = 1;
+  for (size_t i = 0; i < kActivityNumFrames; ++i)
+  {
+    random = random * 1103515245 + 12345;
+    signal += direction * static_cast<int>((random >> 8) % 2);
+    if ((signal < 0) || (signal > 0xFFF))
+    {
+      direction = -direction;
+      signal = std::min(std::max(signal, 0), 0xFFF);
+    }
+
+    CanFrame frame{};
+    frame.id = kActivityId;
+    frame.dlc = 8;
+    frame.data[0] = static_cast<uint8_t>(0xA0 | (i & 0xF));
+    frame.data[2] = static_cast<uint8_t>(signal & 0xFF);
+    frame.data[3] = static_cast<uint8_t>(signal >> 8);
+    frame.data[4] = static_cast<uint8_t>(i);
+    frame.data[5] = 0x55;
+    frame.data[7] = 0x80;
+    frame.data[1] = activityCrc(frame, 1);
+    analyzer.process(frame);
+
+    uint64_t payload = 0;
+    std::memcpy(&payload, frame.data.data(), sizeof(payload));
+    for (size_t bit = 0; bit < BitActivityAnalyzer::kNumBits; ++bit)
+    {
+      ones[bit] += (payload >> bit) & 1;
+      toggles[bit] += (i > 0) ? (((payload ^ last_payload) >> bit) & 1) : 0;
+    }
+
+    last_payload = payload;
+  }
+
+  BitActivityAnalyzer::Report report;
+  if (analyzer.getReport(kActivityId, &report) == false)
+  {
+    CANTALOUPE_ERROR("No report for 0x{:03X}.", kActivityId);
+    return -1;
+  }
+
+  if ((report.frames != kActivityNumFrames) || (report.ones != ones) || (report.toggles != toggles))
+  {
+    CANTALOUPE_ERROR("Bit counts for 0x{:03X} do not match a brute-force count.", kActivityId);
+    return -1;
+  }
+
+  const std::vector<BitActivityAnalyzer::Field> expected = {
+    {0, 4, FieldKind::COUNTER}, {8, 8, FieldKind::CHECKSUM}, {16, 12, FieldKind::SIGNAL}, {32, 8, FieldKind::COUNTER}};
+
+  bool fields_match = (report.fields.size() == expected.size());
+  for (size_t i = 0; (fields_match == true) && (i < expected.size()); ++i)
+  {
+    fields_match = (report.fields[i].start_bit == expected[i].start_bit) &&
+      (report.fields[i].length == expected[i].length) && (report.fields[i].kind == expected[i].kind);
+  }
+
+  if (fields_match == false)
+  {
+    for (const BitActivityAnalyzer::Field& field : report.fields)
+    {
+      CANTALOUPE_ERROR("Inferred a {} at bit {}, {} bits long.", fieldKindName(field.kind), field.start_bit,
+        field.length);
+    }
+
+    CANTALOUPE_ERROR("Expected a nibble counter, a checksum byte, a 12-bit signal and a byte counter.");
+    return -1;
+  }
+
+  std::vector<CanFrame> traffic(kActivityNumTimedFrames);
+  for (CanFrame& frame : traffic)
+  {
+    random = random * 1103515245 + 12345;
+    frame.id = (random >> 8) % kActivityNumTimedIds;
+    frame.dlc = 8;
+    for (uint8_t& byte : frame.data)
+    {
+      random = random * 1103515245 + 12345;
+      byte = static_cast<uint8_t>(random >> 16);
+    }
+  }
+
+  BitActivityAnalyzer timed_analyzer;
+  const uint64_t start_ns = steadyNowNs();
+  for (size_t pass = 0; pass < kActivityNumTimedPasses; ++pass)
+  {
+    timed_analyzer.process(traffic.data(), traffic.size());
+  }
+
+  const uint64_t elapsed_ns = std::max<uint64_t>(steadyNowNs() - start_ns, 1);
+  const double num_timed_frames = static_cast<double>(kActivityNumTimedFrames * kActivityNumTimedPasses);
+  const double frames_per_second = 1e9 * num_timed_frames / static_cast<double>(elapsed_ns);
+
+  CANTALOUPE_INFO("Found all {} fields in 0x{:03X}.  Analyzed {:.0f} frames across {} identifiers: {:.1f} ns/frame, "
+    "{:.0f} frames/s, {:.0f}x a saturated 1 Mbit/s bus.", expected.size(), kActivityId, num_timed_frames,
+    kActivityNumTimedIds, static_cast<double>(elapsed_ns) / num_timed_frames, frames_per_second,
+    frames_per_second / kActivityBusFramesPerSecond);
+
+  if ((timed_analyzer.getStatistics().frames_in != (kActivityNumTimedFrames * kActivityNumTimedPasses)) ||
+    (frames_per_second < kActivityBusFramesPerSecond))
+  {
+    CANTALOUPE_ERROR("The analyzer cannot keep up with a saturated 1 Mbit/s bus.");
+    return -1;
+  }
+
+  return 0;
+}
+
+// `--time-series` keeps this few chunks in memory, so most of what it appends is spilled before it is queried.
+static constexpr size_t kSeriesMaxResidentChunks = 4;
+static constexpr size_t kSeriesNumSamples = 300000;
+static constexpr size_t kSeriesNumRandomQueries = 3000;
+static constexpr size_t kSeriesMaxPoints = 700;
+
+// Check `points`, the answer to a query of samples [`first`, `last`) of a series, against the samples themselves:
+// every point covers the next run of samples with their exact first and last timestamps, min, max and mean, and
+// together they cover the window.
+static bool matchesSamples(const std::vector<cantaloupe::TimeSeriesStore::Point>& points,
+  const std::vector<uint64_t>& timestamps_us, const std::vector<double>& values, size_t first, size_t last,
+  size_t max_points)
+{
+  if (points.size() > max_points)
+  {
+    return false;
+  }
+
+  size_t sample = first;
+  for (const cantaloupe::TimeSeriesStore::Point& point : points)
+  {
+    if ((point.num_samples == 0) || ((sample + point.num_samples) > last))
+    {
+      return false;
+    }
+
+    double min = values[sample];
+    double max = values[sample];
+    double sum = 0.0;
+    for (size_t i = sample; i < (sample + point.num_samples); ++i)
+    {
+      min = std::min(min, values[i]);
+      max = std::max(max, values[i]);
+      sum += values[i];
+    }
+
+    const double mean = sum / static_cast<double>(point.num_samples);
+    if ((point.begin_us != timestamps_us[sample]) || (point.end_us != timestamps_us[sample + point.num_samples - 1]) ||
+      (point.min != min) || (point.max != max) || (std::fabs(point.mean - mean) > (1e-9 * (1.0 + std::fabs(mean)))))
+    {
+      return false;
+    }
+
+    sample += point.num_samples;
+  }
+
+  return sample == last;
+}
+
+// Append two interleaved series to a store that can only keep a few chunks in memory, then check queries against a
+// brute-force min / max / mean over the same samples: the whole range, windows straddling every chunk boundary, and
+// random windows at random point counts.
+static int checkTimeSeries()
+{
+  using cantaloupe::TimeSeriesStore;
+
+  TimeSeriesStore::Config config;
+  config.max_resident_chunks = kSeriesMaxResidentChunks;
+  TimeSeriesStore store(config);
+
+  const int series[2] = {store.addSeries("speed"), store.addSeries("rpm")};
+  if ((series[0] < 0) || (series[1] < 0))
+  {
+    CANTALOUPE_ERROR("Failed to add the series.");
+    return -1;
+  }
+
+  // A third of the samples go to the second series, and timestamps repeat now and then.
+  std::vector<uint64_t> timestamps_us[2];
+  std::vector<double> values[2];
+  uint32_t random = 12345;
+  uint64_t timestamp_us = 1000;
+  for (size_t i = 0; i < kSeriesNumSamples; ++i)
+  {
+    random = random * 1103515245 + 12345;
+    const size_t which = (((random >> 8) % 3) == 0) ? 1 : 0;
+    timestamp_us += (random >> 12) % 3;
+    const double value = (100.0 * std::sin(static_cast<double>(i) * 1e-3)) + static_cast<double>((random >> 16) % 100);
+
+    if (store.append(static_cast<size_t>(series[which]), timestamp_us, value) == false)
+    {
+      CANTALOUPE_ERROR("Sample {} was dropped.", i);
+      return -1;
+    }
+
+    timestamps_us[which].push_back(timestamp_us);
+    values[which].push_back(value);
+  }
+
+  const TimeSeriesStore::Statistics statistics = store.getStatistics();
+  if ((store.append(static_cast<size_t>(series[0]), 0, 0.0) == true) || (statistics.chunks_spilled == 0))
+  {
+    CANTALOUPE_ERROR("Expected an out of order sample to be dropped, and chunks to be spilled.");
+    return -1;
+  }
+
+  // Windows as sample indices into the first series: everything, then a few around every chunk boundary.  The pool is
+  // shared with the second series, so where the spilled chunks end is not known here, but one of these straddles it.
+  const size_t num_samples = timestamps_us[0].size();
+  std::vector<std::pair<size_t, size_t>> windows = {{0, num_samples}, {1, num_samples - 1}};
+  for (size_t boundary = TimeSeriesStore::kChunkSamples; boundary < num_samples;
+    boundary += TimeSeriesStore::kChunkSamples)
+  {
+    windows.emplace_back(boundary - 1, boundary + 1);
+    windows.emplace_back(boundary - 100, std::min(boundary + 5000, num_samples));
+  }
+
+  std::vector<TimeSeriesStore::Point> points;
+  size_t num_checked = 0;
+  size_t num_points = 0;
+  for (const std::pair<size_t, size_t>& window : windows)
+  {
+    for (size_t max_points : {size_t{1}, size_t{7}, size_t{2000}, size_t{100000}})
+    {
+      const uint64_t begin_us = timestamps_us[0][window.first];
+      const uint64_t end_us = timestamps_us[0][window.second - 1] + 1;
+      const size_t first = std::lower_bound(timestamps_us[0].begin(), timestamps_us[0].end(), begin_us) -
+        timestamps_us[0].begin();
+      const size_t last = std::lower_bound(timestamps_us[0].begin(), timestamps_us[0].end(), end_us) -
+        timestamps_us[0].begin();
+
+      store.query(static_cast<size_t>(series[0]), begin_us, end_us, max_points, &points);
+      if (matchesSamples(points, timestamps_us[0], values[0], first, last, max_points) == false)
+      {
+        CANTALOUPE_ERROR("Query of samples {} to {} as {} points does not match the samples.", window.first,
+          window.second, max_points);
+        return -1;
+      }
+
+      num_checked++;
+      num_points += points.size();
+    }
+  }
+
+  for (size_t i = 0; i < kSeriesNumRandomQueries; ++i)
+  {
+    const size_t which = i % 2;
+    random = random * 1103515245 + 12345;
+    const uint64_t begin_us = 900 + (random >> 4) % (timestamp_us + 200);
+    random = random * 1103515245 + 12345;
+    const uint64_t end_us = begin_us + (random >> 4) % (((i % 3) == 0) ? 2000 : timestamp_us);
+    random = random * 1103515245 + 12345;
+    const size_t max_points = 1 + (random >> 8) % kSeriesMaxPoints;
+
+    const size_t first = std::lower_bound(timestamps_us[which].begin(), timestamps_us[which].end(), begin_us) -
+      timestamps_us[which].begin();
+    const size_t last = std::lower_bound(timestamps_us[which].begin(), timestamps_us[which].end(), end_us) -
+      timestamps_us[which].begin();
+
+    store.query(static_cast<size_t>(series[which]), begin_us, end_us, max_points, &points);
+    if (matchesSamples(points, timestamps_us[which], values[which], first, last, max_points) == false)
+    {
+      CANTALOUPE_ERROR("Query of {} to {} us in series {} as {} points does not match the samples.", begin_us, end_us,
+        which, max_points);
+      return -1;
+    }
+
+    num_checked++;
+    num_points += points.size();
+  }
+
+  const uint64_t start_ns = steadyNowNs();
+  store.query(static_cast<size_t>(series[0]), 0, timestamp_us + 1, 2000, &points);
+  const uint64_t elapsed_ns = steadyNowNs() - start_ns;
+
+  CANTALOUPE_INFO("{} queries ({} points) match the samples, with {} chunks spilled ({} bytes).  Full range query of "
+    "{} samples as {} points: {} us.", num_checked, num_points, statistics.chunks_spilled, statistics.spill_bytes,
+    num_samples, points.size(), elapsed_ns / 1000);
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  // Attach to SIGINT in order to close.
+  signal(SIGINT, sigint_handler);
+
+  // Run the allocation audit instead of talking to a device.
+  if ((argc > 1) && (std::strcmp(argv[1], "--audit-allocations") == 0))
+  {
+    return auditAllocations();
+  }
+
+  // Measure transmit queueing delay on a simulated bus instead of talking to a device.
+  if ((argc > 1) && (std::strcmp(argv[1], "--tx-latency") == 0))
+  {
+    return measureTxLatency();
+  }
+
+  // Run the cyclic scheduler on a virtual clock instead of talking to a device.
+  if ((argc > 1) && (std::strcmp(argv[1], "--cyclic-jitter") == 0))
+  {
+    return measureCyclicJitter();
+  }
+
+  // Run J1939 transport protocol traffic through the receiver instead of talking to a device.
+  if ((argc > 1) && (std::strcmp(argv[1], "--j1939") == 0))
+  {
+    return simulateJ1939();
+  }
+
+  // Run synthetic error traffic through the error monitor instead of talking to a device.
+  if ((argc > 1) && (std::strcmp(argv[1], "--error-storm") == 0))
+  {
+    return simulateErrorStorm();
+  }
+
+  // Bridge two simulated devices through the gateway instead of talking to a device.
+  if ((argc > 1) && (std::strcmp(argv[1], "--gateway") == 0))
+  {
+    return simulateGateway();
+  }
+
+  // Record known amounts into the metrics and check the snapshots instead of talking to a device.
+  if ((argc > 1) && (std::strcmp(argv[1], "--metrics") == 0))
+  {
+    return checkMetrics();
+  }
+
+  // Round trip classic and CAN FD frames through the record buffer instead of talking to a device.
+  if ((argc > 1) && (std::strcmp(argv[1], "--fd-records") == 0))
+  {
+    return checkFdRecords();
+  }
+
+  // Capture a trigger window from simulated traffic instead of talking to a device.
+  if ((argc > 1) && (std::strcmp(argv[1], "--flight-recorder") == 0))
+  {
+    return checkFlightRecorder();
+  }
+
+  // Run sniffer-style traffic through the payload change filter instead of talking to a device.
+  if ((argc > 1) && (std::strcmp(argv[1], "--payload-filter") == 0))
+  {
+    return checkPayloadFilter();
+  }
+
+  // Evaluate predicates against known answers instead of talking to a device.
+  if ((argc > 1) && (std::strcmp(argv[1], "--predicate") == 0))
+  {
+    return checkPredicates();
+  }
+
+  // Write captures through a fast and a slowed down disk instead of talking to a device.
+  if ((argc > 1) && (std::strcmp(argv[1], "--capture-writer") == 0))
+  {
+    return checkCaptureWriter();
+  }
+
+  // Time the drain thread's wake-ups under default and real-time scheduling instead of talking to a device.
+  if ((argc > 1) && (std::strcmp(argv[1], "--thread-latency") == 0))
+  {
+    return measureThreadLatency();
+  }
+
+  // Look for known fields in synthetic traffic instead of talking to a device.
+  if ((argc > 1) && (std::strcmp(argv[1], "--bit-activity") == 0))
+  {
+    return checkBitActivity();
+  }
+
+  // Query a store that has spilled most of its chunks instead of talking to a device.
+  if ((argc > 1) && (std::strcmp(argv[1], "--time-series") == 0))
+  {
+    return checkTimeSeries();
+  }
 
   // Print out the LibUSB version we linked against.
   CANTALOUPE_INFO("LibUSB version {}", cantaloupe::GsUsbWrapper::getLibUSBVersionString());
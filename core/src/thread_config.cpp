@@ -0,0 +1,223 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#include <cantaloupe/log.h>
+#include <cantaloupe/thread_config.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <alloca.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace cantaloupe
+{
+
+// Longest thread name the kernel keeps, not counting the terminator.
+static constexpr size_t kMaxThreadNameLength = 15;
+
+static size_t pageSize()
+{
+  static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return page_size;
+}
+
+static const char* policyName(SchedulingPolicy policy)
+{
+  switch (policy)
+  {
+    case SchedulingPolicy::DEFAULT:
+      return "default";
+    case SchedulingPolicy::FIFO:
+      return "SCHED_FIFO";
+    case SchedulingPolicy::ROUND_ROBIN:
+      return "SCHED_RR";
+  }
+
+  return "unknown";
+}
+
+static bool setName(const std::string& name)
+{
+  const std::string truncated = name.substr(0, kMaxThreadNameLength);
+
+#if defined(__APPLE__)
+  const int result = pthread_setname_np(truncated.c_str());
+#else
+  const int result = pthread_setname_np(pthread_self(), truncated.c_str());
+#endif
+
+  if (result != 0)
+  {
+    CANTALOUPE_WARN("Failed to name thread {}: {}", truncated, std::strerror(result));
+    return false;
+  }
+
+  return true;
+}
+
+static bool setAffinity(const std::string& name, const std::vector<int>& cpus)
+{
+#if defined(__APPLE__)
+  static_cast<void>(cpus);
+  CANTALOUPE_WARN("CPU affinity is not supported on macOS; thread {} may run on any CPU.", name);
+  return false;
+#else
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (const int cpu : cpus)
+  {
+    if ((cpu < 0) || (cpu >= CPU_SETSIZE))
+    {
+      CANTALOUPE_WARN("Ignoring invalid CPU {} for thread {}.", cpu, name);
+      continue;
+    }
+
+    CPU_SET(static_cast<size_t>(cpu), &set);
+  }
+
+  const int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (result != 0)
+  {
+    CANTALOUPE_WARN("Failed to set CPU affinity for thread {}: {}", name, std::strerror(result));
+    return false;
+  }
+
+  return true;
+#endif
+}
+
+static bool setScheduling(const std::string& name, SchedulingPolicy policy, int priority)
+{
+  int native_policy = SCHED_OTHER;
+  switch (policy)
+  {
+    case SchedulingPolicy::DEFAULT:
+      return true;
+    case SchedulingPolicy::FIFO:
+      native_policy = SCHED_FIFO;
+      break;
+    case SchedulingPolicy::ROUND_ROBIN:
+      native_policy = SCHED_RR;
+      break;
+  }
+
+  const int min_priority = sched_get_priority_min(native_policy);
+  const int max_priority = sched_get_priority_max(native_policy);
+  if ((priority < min_priority) || (priority > max_priority))
+  {
+    CANTALOUPE_WARN("Priority {} for thread {} is outside {} to {}; leaving default scheduling.", priority, name,
+      min_priority, max_priority);
+    return false;
+  }
+
+  sched_param param{};
+  param.sched_priority = priority;
+  const int result = pthread_setschedparam(pthread_self(), native_policy, &param);
+  if (result != 0)
+  {
+    CANTALOUPE_WARN("Failed to set {} priority {} for thread {}: {}{}", policyName(policy), priority, name,
+      std::strerror(result), (result == EPERM) ? " (needs root, CAP_SYS_NICE or RLIMIT_RTPRIO)" : "");
+    return false;
+  }
+
+  return true;
+}
+
+// Kept out of line, so the stack it touches is given back on return and reused by the caller.
+__attribute__((noinline)) static void prefaultStack(size_t num_bytes)
+{
+  volatile uint8_t* stack = static_cast<volatile uint8_t*>(alloca(num_bytes));
+  for (size_t i = 0; i < num_bytes; i += pageSize())
+  {
+    stack[i] = 0;
+  }
+}
+
+bool applyThreadConfig(const ThreadConfig& config, const char* default_name)
+{
+  const std::string name = (config.name.empty() == false) ? config.name :
+    ((default_name != nullptr) ? default_name : "");
+
+  bool success = true;
+  if (name.empty() == false)
+  {
+    success = setName(name) && success;
+  }
+
+  if (config.cpus.empty() == false)
+  {
+    success = setAffinity(name, config.cpus) && success;
+  }
+
+  success = setScheduling(name, config.policy, config.priority) && success;
+
+  if (config.prefault_stack_bytes > 0)
+  {
+    prefaultStack(config.prefault_stack_bytes);
+  }
+
+  return success;
+}
+
+bool lockMemory()
+{
+  // Locking future mappings under a finite limit makes later thread stacks and large allocations fail outright, so
+  // only do that when the limit cannot be hit (root bypasses it).
+  rlimit limit{};
+  const bool unlimited = (geteuid() == 0) ||
+    ((getrlimit(RLIMIT_MEMLOCK, &limit) == 0) && (limit.rlim_cur == RLIM_INFINITY));
+  const int flags = (unlimited == true) ? (MCL_CURRENT | MCL_FUTURE) : MCL_CURRENT;
+
+  if (mlockall(flags) != 0)
+  {
+    CANTALOUPE_WARN("Failed to lock memory: {}{}", std::strerror(errno),
+      ((errno == EPERM) || (errno == ENOMEM)) ? " (needs root, CAP_IPC_LOCK or a larger RLIMIT_MEMLOCK)" : "");
+    return false;
+  }
+
+  if (unlimited == false)
+  {
+    CANTALOUPE_WARN("RLIMIT_MEMLOCK is limited; only memory allocated so far is locked.");
+  }
+
+  return true;
+}
+
+void unlockMemory()
+{
+  munlockall();
+}
+
+void prefault(void* data, size_t num_bytes)
+{
+  if ((data == nullptr) || (num_bytes == 0))
+  {
+    return;
+  }
+
+  // Write each page back to itself; reading alone could leave it mapped to the shared zero page.
+  volatile uint8_t* bytes = static_cast<volatile uint8_t*>(data);
+  for (size_t i = 0; i < num_bytes; i += pageSize())
+  {
+    bytes[i] = bytes[i];
+  }
+
+  bytes[num_bytes - 1] = bytes[num_bytes - 1];
+}
+
+}  // namespace cantaloupe
@@ -0,0 +1,458 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#include <cantaloupe/log.h>
+#include <cantaloupe/time_series_store.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace cantaloupe
+{
+
+// Out-of-line definitions for constants that get bound to references (eg by std::min).
+constexpr size_t TimeSeriesStore::kChunkLevel;
+constexpr size_t TimeSeriesStore::kChunkSamples;
+constexpr size_t TimeSeriesStore::kDefaultMaxResidentChunks;
+constexpr size_t TimeSeriesStore::kMinLevel;
+constexpr size_t TimeSeriesStore::kChunkBuckets;
+constexpr uint32_t TimeSeriesStore::kNoBlock;
+
+// Samples in a chunk, as a mask over the sample index.
+static constexpr uint64_t kChunkSampleMask = TimeSeriesStore::kChunkSamples - 1;
+
+void TimeSeriesStore::Aggregate::add(const Bucket& bucket, uint64_t bucket_count)
+{
+  min = std::min(min, bucket.min);
+  max = std::max(max, bucket.max);
+  sum += bucket.sum;
+  count += bucket_count;
+}
+
+void TimeSeriesStore::Aggregate::add(double value)
+{
+  min = std::min(min, value);
+  max = std::max(max, value);
+  sum += value;
+  count++;
+}
+
+TimeSeriesStore::TimeSeriesStore(const Config& config) :
+  config_{config},
+  pool_{},
+  free_blocks_{},
+  sealed_{},
+  sealed_head_{0},
+  sealed_count_{0},
+  series_{},
+  spill_fd_{-1},
+  spill_map_{nullptr},
+  spill_capacity_{0},
+  spill_size_{0},
+  statistics_{}
+{
+  config_.max_resident_chunks = std::max<size_t>(config_.max_resident_chunks, 1);
+
+  // Value-initializing the pool also faults it in now rather than on the first appends.
+  pool_.resize(config_.max_resident_chunks);
+  sealed_.resize(config_.max_resident_chunks);
+  free_blocks_.reserve(config_.max_resident_chunks);
+  for (size_t i = config_.max_resident_chunks; i > 0; --i)
+  {
+    free_blocks_.push_back(static_cast<uint32_t>(i - 1));
+  }
+
+  std::string path = config_.spill_directory + "/cantaloupe-series-XXXXXX";
+  spill_fd_ = mkstemp(&path[0]);
+  if (spill_fd_ < 0)
+  {
+    throw std::runtime_error("Failed to create time series spill file in " + config_.spill_directory + ": " +
+      std::strerror(errno));
+  }
+
+  // Nothing else needs the name, and this way the file goes away with the descriptor.
+  unlink(path.c_str());
+}
+
+TimeSeriesStore::TimeSeriesStore() :
+  TimeSeriesStore(Config{})
+{
+}
+
+TimeSeriesStore::~TimeSeriesStore()
+{
+  if (spill_map_ != nullptr)
+  {
+    munmap(spill_map_, spill_capacity_);
+  }
+
+  if (spill_fd_ >= 0)
+  {
+    ::close(spill_fd_);
+  }
+}
+
+int TimeSeriesStore::addSeries(const std::string& name)
+{
+  // Each series holds on to one resident chunk while appending.
+  if (series_.size() >= config_.max_resident_chunks)
+  {
+    CANTALOUPE_ERROR("Cannot add time series {}: all {} resident chunks are taken.", name,
+      config_.max_resident_chunks);
+    return -1;
+  }
+
+  series_.emplace_back();
+  series_.back().name = name;
+  return static_cast<int>(series_.size() - 1);
+}
+
+bool TimeSeriesStore::append(size_t series, uint64_t timestamp_us, double value)
+{
+  if (series >= series_.size())
+  {
+    return false;
+  }
+
+  Series& target = series_[series];
+  if ((target.num_samples > 0) && (timestamp_us < target.last_us))
+  {
+    statistics_.out_of_order++;
+    return false;
+  }
+
+  const size_t offset = static_cast<size_t>(target.num_samples & kChunkSampleMask);
+  if (offset == 0)
+  {
+    uint32_t block = kNoBlock;
+    if (acquireBlock(&block) == false)
+    {
+      statistics_.dropped++;
+      return false;
+    }
+
+    target.chunks.push_back(ChunkInfo{timestamp_us, Bucket{}, block, 0});
+  }
+
+  Chunk& current = pool_[target.chunks.back().block];
+  current.timestamps_us[offset] = timestamp_us;
+  current.values[offset] = value;
+
+  target.num_samples++;
+  target.last_us = timestamp_us;
+  statistics_.samples++;
+
+  completeBuckets(&target);
+  return true;
+}
+
+bool TimeSeriesStore::query(size_t series, uint64_t begin_us, uint64_t end_us, size_t max_points,
+  std::vector<Point>* points) const
+{
+  if (series >= series_.size())
+  {
+    return false;
+  }
+
+  points->clear();
+  const Series& source = series_[series];
+  if ((max_points == 0) || (begin_us >= end_us))
+  {
+    return true;
+  }
+
+  const uint64_t first = lowerBound(source, begin_us);
+  const uint64_t last = lowerBound(source, end_us);
+  if (first >= last)
+  {
+    return true;
+  }
+
+  // Finest level whose aligned runs cut the window into at most `max_points` pieces.
+  size_t level = 0;
+  while ((((last - 1) >> level) - (first >> level) + 1) > max_points)
+  {
+    level++;
+  }
+
+  // Inner runs are a single stored summary (or a few samples below `kMinLevel`); only the two runs cut by the window
+  // edges need more than one step.
+  for (uint64_t run = first >> level; run <= ((last - 1) >> level); ++run)
+  {
+    const uint64_t run_begin = std::max(first, run << level);
+    const uint64_t run_end = std::min(last, (run + 1) << level);
+    const Aggregate summary = aggregate(source, run_begin, run_end);
+
+    Point point;
+    point.begin_us = timestamp(source, run_begin);
+    point.end_us = timestamp(source, run_end - 1);
+    point.min = summary.min;
+    point.max = summary.max;
+    point.mean = summary.sum / static_cast<double>(summary.count);
+    point.num_samples = summary.count;
+    points->push_back(point);
+  }
+
+  return true;
+}
+
+size_t TimeSeriesStore::bucketOffset(size_t level)
+{
+  // Level `l` holds `2^(kChunkLevel - l)` buckets, stored finest level first.
+  return (size_t{2} << (kChunkLevel - kMinLevel)) - (size_t{2} << (kChunkLevel - level));
+}
+
+TimeSeriesStore::Bucket TimeSeriesStore::merge(const Bucket& a, const Bucket& b)
+{
+  return Bucket{std::min(a.min, b.min), std::max(a.max, b.max), a.sum + b.sum};
+}
+
+const TimeSeriesStore::Chunk& TimeSeriesStore::chunk(const Series& series, size_t index) const
+{
+  const ChunkInfo& info = series.chunks[index];
+  if (info.block != kNoBlock)
+  {
+    return pool_[info.block];
+  }
+
+  return *reinterpret_cast<const Chunk*>(spill_map_ + info.spill_offset);
+}
+
+const TimeSeriesStore::Bucket& TimeSeriesStore::bucket(const Series& series, size_t level, uint64_t index) const
+{
+  if (level < kChunkLevel)
+  {
+    const size_t shift = kChunkLevel - level;
+    const Chunk& source = chunk(series, static_cast<size_t>(index >> shift));
+    return source.buckets[bucketOffset(level) + static_cast<size_t>(index & ((uint64_t{1} << shift) - 1))];
+  }
+
+  if (level == kChunkLevel)
+  {
+    return series.chunks[static_cast<size_t>(index)].summary;
+  }
+
+  return series.upper_levels[level - kChunkLevel - 1][static_cast<size_t>(index)];
+}
+
+uint64_t TimeSeriesStore::timestamp(const Series& series, uint64_t sample) const
+{
+  return chunk(series, static_cast<size_t>(sample >> kChunkLevel)).timestamps_us[sample & kChunkSampleMask];
+}
+
+uint64_t TimeSeriesStore::lowerBound(const Series& series, uint64_t timestamp_us) const
+{
+  // The first chunk starting at or after `timestamp_us`.  The sample wanted is either in the chunk before it or is its
+  // first sample.
+  const auto next = std::lower_bound(series.chunks.begin(), series.chunks.end(), timestamp_us,
+    [](const ChunkInfo& info, uint64_t value) { return info.first_us < value; });
+  if (next == series.chunks.begin())
+  {
+    return 0;
+  }
+
+  const size_t index = static_cast<size_t>(next - series.chunks.begin()) - 1;
+  const uint64_t chunk_begin = uint64_t{index} << kChunkLevel;
+  const size_t num_samples = static_cast<size_t>(std::min<uint64_t>(series.num_samples - chunk_begin, kChunkSamples));
+
+  const uint64_t* timestamps = chunk(series, index).timestamps_us;
+  return chunk_begin + static_cast<uint64_t>(std::lower_bound(timestamps, timestamps + num_samples, timestamp_us) -
+    timestamps);
+}
+
+TimeSeriesStore::Aggregate TimeSeriesStore::aggregate(const Series& series, uint64_t begin, uint64_t end) const
+{
+  Aggregate result{std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), 0.0, 0};
+  const size_t top_level = topLevel(series);
+
+  // Take the largest stored run that starts at `begin` and fits, as in a segment tree.
+  while (begin < end)
+  {
+    const size_t alignment = (begin == 0) ? top_level : static_cast<size_t>(__builtin_ctzll(begin));
+    const size_t fit = static_cast<size_t>(63 - __builtin_clzll(end - begin));
+    const size_t level = std::min(std::min(alignment, fit), top_level);
+
+    if (level < kMinLevel)
+    {
+      const Chunk& source = chunk(series, static_cast<size_t>(begin >> kChunkLevel));
+      result.add(source.values[begin & kChunkSampleMask]);
+      begin++;
+    }
+    else
+    {
+      result.add(bucket(series, level, begin >> level), uint64_t{1} << level);
+      begin += uint64_t{1} << level;
+    }
+  }
+
+  return result;
+}
+
+void TimeSeriesStore::completeBuckets(Series* series)
+{
+  const uint64_t num_samples = series->num_samples;
+  ChunkInfo& info = series->chunks.back();
+  Chunk& current = pool_[info.block];
+
+  // The sample just appended completes the runs at every level it is the last sample of.
+  for (size_t level = kMinLevel; (num_samples & ((uint64_t{1} << level) - 1)) == 0; ++level)
+  {
+    const uint64_t index = (num_samples >> level) - 1;
+
+    if (level == kMinLevel)
+    {
+      const size_t first = static_cast<size_t>((index << level) & kChunkSampleMask);
+      Bucket result{current.values[first], current.values[first], 0.0};
+      for (size_t i = first; i < first + (size_t{1} << level); ++i)
+      {
+        result.min = std::min(result.min, current.values[i]);
+        result.max = std::max(result.max, current.values[i]);
+        result.sum += current.values[i];
+      }
+
+      current.buckets[bucketOffset(level) + static_cast<size_t>(index & ((uint64_t{1} << (kChunkLevel - level)) - 1))] =
+        result;
+    }
+    else if (level < kChunkLevel)
+    {
+      const size_t local = static_cast<size_t>(index & ((uint64_t{1} << (kChunkLevel - level)) - 1));
+      const size_t children = bucketOffset(level - 1) + (2 * local);
+      current.buckets[bucketOffset(level) + local] = merge(current.buckets[children], current.buckets[children + 1]);
+    }
+    else if (level == kChunkLevel)
+    {
+      const size_t children = bucketOffset(level - 1);
+      info.summary = merge(current.buckets[children], current.buckets[children + 1]);
+
+      // The chunk is full and may be spilled from now on.
+      const size_t tail = (sealed_head_ + sealed_count_) % sealed_.size();
+      sealed_[tail] = ChunkRef{static_cast<uint32_t>(series - series_.data()),
+        static_cast<uint32_t>(series->chunks.size() - 1)};
+      sealed_count_++;
+    }
+    else
+    {
+      const Bucket result = merge(bucket(*series, level - 1, 2 * index), bucket(*series, level - 1, (2 * index) + 1));
+      if (series->upper_levels.size() < (level - kChunkLevel))
+      {
+        series->upper_levels.emplace_back();
+      }
+
+      series->upper_levels[level - kChunkLevel - 1].push_back(result);
+    }
+  }
+}
+
+bool TimeSeriesStore::acquireBlock(uint32_t* block)
+{
+  if ((free_blocks_.empty() == true) && (spillOldest() == false))
+  {
+    return false;
+  }
+
+  *block = free_blocks_.back();
+  free_blocks_.pop_back();
+  return true;
+}
+
+bool TimeSeriesStore::spillOldest()
+{
+  if (sealed_count_ == 0)
+  {
+    return false;
+  }
+
+  const ChunkRef oldest = sealed_[sealed_head_];
+  ChunkInfo& info = series_[oldest.series].chunks[oldest.chunk];
+  if (growSpillFile(spill_size_ + sizeof(Chunk)) == false)
+  {
+    return false;
+  }
+
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(&pool_[info.block]);
+  size_t written = 0;
+  while (written < sizeof(Chunk))
+  {
+    const ssize_t result = pwrite(spill_fd_, data + written, sizeof(Chunk) - written,
+      static_cast<off_t>(spill_size_ + written));
+    if ((result < 0) && (errno == EINTR))
+    {
+      continue;
+    }
+
+    if (result <= 0)
+    {
+      CANTALOUPE_ERROR("Failed to spill time series chunk: {}", (result < 0) ? std::strerror(errno) : "no progress");
+      return false;
+    }
+
+    written += static_cast<size_t>(result);
+  }
+
+  free_blocks_.push_back(info.block);
+  info.block = kNoBlock;
+  info.spill_offset = spill_size_;
+  spill_size_ += sizeof(Chunk);
+
+  sealed_head_ = (sealed_head_ + 1) % sealed_.size();
+  sealed_count_--;
+
+  statistics_.chunks_spilled++;
+  statistics_.spill_bytes += sizeof(Chunk);
+  return true;
+}
+
+bool TimeSeriesStore::growSpillFile(uint64_t min_size)
+{
+  if (min_size <= spill_capacity_)
+  {
+    return true;
+  }
+
+  // Grow by doubling, so the mapping is only replaced a logarithmic number of times.
+  uint64_t capacity = std::max<uint64_t>(2 * spill_capacity_, sizeof(Chunk) * config_.max_resident_chunks);
+  while (capacity < min_size)
+  {
+    capacity *= 2;
+  }
+
+  if (ftruncate(spill_fd_, static_cast<off_t>(capacity)) != 0)
+  {
+    CANTALOUPE_ERROR("Failed to grow time series spill file: {}", std::strerror(errno));
+    return false;
+  }
+
+  void* map = mmap(nullptr, static_cast<size_t>(capacity), PROT_READ, MAP_SHARED, spill_fd_, 0);
+  if (map == MAP_FAILED)
+  {
+    CANTALOUPE_ERROR("Failed to map time series spill file: {}", std::strerror(errno));
+    return false;
+  }
+
+  if (spill_map_ != nullptr)
+  {
+    munmap(spill_map_, static_cast<size_t>(spill_capacity_));
+  }
+
+  spill_map_ = static_cast<uint8_t*>(map);
+  spill_capacity_ = capacity;
+  return true;
+}
+
+}  // namespace cantaloupe
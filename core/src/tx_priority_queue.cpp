@@ -0,0 +1,423 @@
+// cantaloupe, CAN bus viewer for MacOS.
+//
+// cantaloupe is free software: you can redistribute it and/or modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// cantaloupe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along with cantaloupe.  If not, see
+// <https://www.gnu.org/licenses/>.
+#include <cantaloupe/gs_usb_commands.h>
+#include <cantaloupe/metrics.h>
+#include <cantaloupe/tx_priority_queue.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+namespace cantaloupe
+{
+
+// How often the drain thread checks for shutdown while the queue is empty.
+static constexpr uint32_t kDrainIdleWaitMs = 100;
+
+TxPriorityQueue::TxPriorityQueue(CanTransport* transport, size_t capacity, const Clock* clock) :
+  transport_{transport},
+  clock_{(clock != nullptr) ? clock : &SteadyClock::instance()},
+  capacity_{std::max<size_t>(capacity, 1)},
+  mutex_{},
+  not_empty_{},
+  not_full_{},
+  nodes_(capacity_),
+  heap_{},
+  next_sequence_{0},
+  statistics_{},
+  thread_config_{},
+  thread_shutdown_{false},
+  drain_thread_{}
+{
+  heap_.reserve(capacity_);
+}
+
+TxPriorityQueue::~TxPriorityQueue()
+{
+  stop();
+  clear();
+}
+
+uint32_t TxPriorityQueue::arbitrationKey(const CanFrame& frame)
+{
+  const bool extended = (frame.eff_frame == true) || ((frame.id & GsHostCanFrame::kCanIdEffFlag) != 0);
+  const bool remote = (frame.rtr_frame == true) || ((frame.id & GsHostCanFrame::kCanIdRtrFlag) != 0);
+
+  // Lay the bits out in the order they go on the wire.  Standard: 11-bit id, RTR, IDE(0).  Extended: 11-bit base id,
+  // SRR(1), IDE(1), 18-bit id extension, RTR.  Dominant (0) bits win, so the numerically smaller key wins.
+  if (extended == false)
+  {
+    const uint32_t base_id = frame.id & CanFrame::kIdMaskStandard;
+    return (base_id << 21) | (static_cast<uint32_t>(remote) << 20);
+  }
+
+  const uint32_t raw_id = frame.id & CanFrame::kIdMaskExtended;
+  const uint32_t base_id = raw_id >> 18;
+  const uint32_t id_extension = raw_id & 0x3FFFF;
+  return (base_id << 21) | (1U << 20) | (1U << 19) | (id_extension << 1) | static_cast<uint32_t>(remote);
+}
+
+bool TxPriorityQueue::push(const CanFrame& frame, uint64_t deadline_us, uint32_t timeout_ms)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  auto has_room = [this]() { return (heap_.size() < capacity_) || (thread_shutdown_ == true); };
+  if (timeout_ms == 0)
+  {
+    not_full_.wait(lock, has_room);
+  }
+  else if (not_full_.wait_for(lock, std::chrono::milliseconds(timeout_ms), has_room) == false)
+  {
+    statistics_.rejected++;
+    return false;
+  }
+
+  const uint64_t now_us = clock_->nowUs();
+  if ((heap_.size() >= capacity_) || ((deadline_us != 0) && (deadline_us <= now_us)))
+  {
+    statistics_.rejected++;
+    return false;
+  }
+
+  insertLocked(frame, deadline_us, now_us, nullptr);
+  lock.unlock();
+
+  not_empty_.notify_one();
+  return true;
+}
+
+bool TxPriorityQueue::tryPush(const CanFrame& frame, uint64_t deadline_us)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  const uint64_t now_us = clock_->nowUs();
+  if ((heap_.size() >= capacity_) || ((deadline_us != 0) && (deadline_us <= now_us)))
+  {
+    statistics_.rejected++;
+    return false;
+  }
+
+  insertLocked(frame, deadline_us, now_us, nullptr);
+  lock.unlock();
+
+  not_empty_.notify_one();
+  return true;
+}
+
+bool TxPriorityQueue::pushAsync(const CanFrame& frame, CompletionCallback callback, uint64_t deadline_us)
+{
+  Node evicted;
+  bool have_evicted = false;
+  uint64_t evicted_delay_us = 0;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const uint64_t now_us = clock_->nowUs();
+    if ((deadline_us != 0) && (deadline_us <= now_us))
+    {
+      statistics_.rejected++;
+      return false;
+    }
+
+    if (heap_.size() >= capacity_)
+    {
+      // The lowest-priority item is one of the leaves.  Among equal keys the newest one goes first.
+      size_t victim = heap_.size() / 2;
+      for (size_t i = victim + 1; i < heap_.size(); ++i)
+      {
+        if (before(heap_[victim], heap_[i]) == true)
+        {
+          victim = i;
+        }
+      }
+
+      if (arbitrationKey(frame) >= heap_[victim].key)
+      {
+        statistics_.rejected++;
+        return false;
+      }
+
+      const uint32_t node = removeAt(victim);
+      evicted = std::move(nodes_[node]);
+      nodes_[node].callback = nullptr;
+      nodes_.release(node);
+      statistics_.evicted++;
+      have_evicted = true;
+      evicted_delay_us = now_us - evicted.enqueue_us;
+    }
+
+    insertLocked(frame, deadline_us, now_us, std::move(callback));
+  }
+
+  not_empty_.notify_one();
+
+  if ((have_evicted == true) && evicted.callback)
+  {
+    evicted.callback(evicted.frame, Result::EVICTED, evicted_delay_us);
+  }
+
+  return true;
+}
+
+void TxPriorityQueue::insertLocked(const CanFrame& frame, uint64_t deadline_us, uint64_t now_us,
+  CompletionCallback callback)
+{
+  const uint32_t node = nodes_.acquire();
+
+  nodes_[node].frame = frame;
+  nodes_[node].deadline_us = deadline_us;
+  nodes_[node].enqueue_us = now_us;
+  nodes_[node].callback = std::move(callback);
+
+  heap_.push_back(HeapItem{arbitrationKey(frame), next_sequence_++, node});
+  siftUp(heap_.size() - 1);
+
+  statistics_.enqueued++;
+  if (heap_.size() > statistics_.high_water_mark)
+  {
+    statistics_.high_water_mark = heap_.size();
+    Metrics::updateHighWaterMark(MetricGauge::TX_QUEUE_HIGH_WATER_MARK, heap_.size());
+  }
+}
+
+uint32_t TxPriorityQueue::removeAt(size_t position)
+{
+  const uint32_t node = heap_[position].node;
+
+  heap_[position] = heap_.back();
+  heap_.pop_back();
+
+  if (position < heap_.size())
+  {
+    siftDown(position);
+    siftUp(position);
+  }
+
+  return node;
+}
+
+void TxPriorityQueue::siftUp(size_t position)
+{
+  const HeapItem item = heap_[position];
+
+  while (position > 0)
+  {
+    const size_t parent = (position - 1) / 2;
+    if (before(item, heap_[parent]) == false)
+    {
+      break;
+    }
+
+    heap_[position] = heap_[parent];
+    position = parent;
+  }
+
+  heap_[position] = item;
+}
+
+void TxPriorityQueue::siftDown(size_t position)
+{
+  const HeapItem item = heap_[position];
+  const size_t size = heap_.size();
+
+  while (true)
+  {
+    size_t child = 2 * position + 1;
+    if (child >= size)
+    {
+      break;
+    }
+
+    if ((child + 1 < size) && (before(heap_[child + 1], heap_[child]) == true))
+    {
+      child++;
+    }
+
+    if (before(heap_[child], item) == false)
+    {
+      break;
+    }
+
+    heap_[position] = heap_[child];
+    position = child;
+  }
+
+  heap_[position] = item;
+}
+
+bool TxPriorityQueue::drainOne(uint32_t timeout_ms)
+{
+  Node node;
+  uint64_t now_us = 0;
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true)
+    {
+      if ((heap_.empty() == true) && (timeout_ms > 0))
+      {
+        not_empty_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+          [this]() { return (heap_.empty() == false) || (thread_shutdown_ == true); });
+      }
+
+      if (heap_.empty() == true)
+      {
+        return false;
+      }
+
+      const uint32_t index = removeAt(0);
+      node = std::move(nodes_[index]);
+      nodes_[index].callback = nullptr;
+      nodes_.release(index);
+
+      now_us = clock_->nowUs();
+      if ((node.deadline_us == 0) || (now_us < node.deadline_us))
+      {
+        break;
+      }
+
+      // Too late to be useful; report it and look at the next one.
+      statistics_.expired++;
+      lock.unlock();
+      not_full_.notify_one();
+
+      if (node.callback)
+      {
+        node.callback(node.frame, Result::EXPIRED, now_us - node.enqueue_us);
+      }
+
+      lock.lock();
+    }
+
+    const uint64_t delay_us = now_us - node.enqueue_us;
+    statistics_.max_queueing_delay_us = std::max(statistics_.max_queueing_delay_us, delay_us);
+    statistics_.total_queueing_delay_us += delay_us;
+  }
+
+  not_full_.notify_one();
+
+  const bool transmitted = transport_->writeCanFrame(node.frame, kTransmitTimeoutMs);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (transmitted == true)
+    {
+      statistics_.transmitted++;
+    }
+    else
+    {
+      statistics_.failed++;
+    }
+  }
+
+  if (node.callback)
+  {
+    node.callback(node.frame, (transmitted == true) ? Result::TRANSMITTED : Result::FAILED, now_us - node.enqueue_us);
+  }
+
+  return transmitted;
+}
+
+void TxPriorityQueue::clear()
+{
+  std::vector<Node> aborted;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    aborted.reserve(heap_.size());
+
+    for (const HeapItem& item : heap_)
+    {
+      aborted.push_back(std::move(nodes_[item.node]));
+      nodes_[item.node].callback = nullptr;
+      nodes_.release(item.node);
+    }
+
+    statistics_.aborted += heap_.size();
+    heap_.clear();
+  }
+
+  not_full_.notify_all();
+
+  const uint64_t now_us = clock_->nowUs();
+  for (const Node& node : aborted)
+  {
+    if (node.callback)
+    {
+      node.callback(node.frame, Result::ABORTED, now_us - node.enqueue_us);
+    }
+  }
+}
+
+bool TxPriorityQueue::start(const ThreadConfig& thread_config)
+{
+  if (drain_thread_.joinable() == true)
+  {
+    return false;
+  }
+
+  thread_config_ = thread_config;
+  thread_shutdown_ = false;
+  drain_thread_ = std::thread(std::bind(&TxPriorityQueue::drainThread, this));
+  return true;
+}
+
+void TxPriorityQueue::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    thread_shutdown_ = true;
+  }
+
+  not_empty_.notify_all();
+  not_full_.notify_all();
+
+  if (drain_thread_.joinable() == true)
+  {
+    drain_thread_.join();
+  }
+}
+
+void TxPriorityQueue::drainThread()
+{
+  applyThreadConfig(thread_config_, "cantaloupe-txq");
+
+  while (true)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (thread_shutdown_ == true)
+      {
+        break;
+      }
+    }
+
+    drainOne(kDrainIdleWaitMs);
+  }
+}
+
+size_t TxPriorityQueue::size() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return heap_.size();
+}
+
+TxPriorityQueue::Statistics TxPriorityQueue::getStatistics() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return statistics_;
+}
+
+}  // namespace cantaloupe